@@ -0,0 +1,484 @@
+/*  RetroArch - A frontend for libretro.
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Persistent cache of extracted archive members.
+ *
+ * Extracted members live as plain files in the cache directory,
+ * named after a hash of "archive#member" followed by the member's
+ * own name so the extension is kept. The index file lists one entry
+ * per line, most recently used first:
+ *
+ *    <member crc32> <member size> <archive mtime> <archive size> <path>
+ *
+ * It is read once and checked against the cached files, so a lookup
+ * after that only has to stat the archive. When the cache grows past
+ * archive_cache_size, entries are evicted from the end of the list.
+ *
+ * Keys without a '#' name data by its own checksums instead, such as
+ * soft-patched content. Those have no archive and are stored with an
+ * mtime and archive size of 0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <file/file_path.h>
+#include <compat/strl.h>
+#include <retro_miscellaneous.h>
+#include <rhash.h>
+
+#include "archive_cache.h"
+#include "file_ops.h"
+#include "general.h"
+
+#define ARCHIVE_CACHE_INDEX "archive_cache.txt"
+#define ARCHIVE_CACHE_CRC_CHUNK (256 * 1024)
+
+struct archive_cache_entry
+{
+   char *path;             /* archive#member */
+   uint32_t crc;           /* of the member */
+   uint64_t size;          /* of the member */
+   int64_t mtime;          /* of the archive */
+   uint64_t archive_size;
+};
+
+static struct
+{
+   /* Directory the index was read from. */
+   char dir[PATH_MAX_LENGTH];
+   struct archive_cache_entry *entries;
+   size_t count;
+   size_t capacity;
+   uint64_t total;
+   bool loaded;
+} archive_cache;
+
+static bool archive_cache_get_dir(char *dir, size_t size)
+{
+   settings_t *settings = config_get_ptr();
+
+   if (!settings->archive_cache_size)
+      return false;
+
+   if (*settings->archive_cache_directory)
+   {
+      strlcpy(dir, settings->archive_cache_directory, size);
+      if (!path_is_directory(dir) && !path_mkdir(dir))
+         return false;
+      return true;
+   }
+
+   strlcpy(dir, settings->extraction_directory, size);
+   return *dir && path_is_directory(dir);
+}
+
+static uint64_t archive_cache_limit(void)
+{
+   settings_t *settings = config_get_ptr();
+   return (uint64_t)settings->archive_cache_size << 20;
+}
+
+static void archive_cache_file_path(const char *dir, const char *path,
+      char *s, size_t len)
+{
+   char name[PATH_MAX_LENGTH];
+
+   snprintf(name, sizeof(name), "%08x%08x-%s",
+         (unsigned)djb2_calculate(path),
+         (unsigned)crc32_update(0, path, strlen(path)),
+         path_basename(path));
+   fill_pathname_join(s, dir, name, len);
+}
+
+static bool archive_cache_stat(const char *path, int64_t *mtime,
+      uint64_t *size)
+{
+   struct stat st;
+   char archive[PATH_MAX_LENGTH];
+   char *hash;
+
+   strlcpy(archive, path, sizeof(archive));
+   if (!(hash = strchr(archive, '#')))
+   {
+      /* Content-addressed, there is no archive to go stale. */
+      *mtime = 0;
+      *size  = 0;
+      return true;
+   }
+   *hash = '\0';
+
+   if (stat(archive, &st) != 0)
+      return false;
+
+   *mtime = st.st_mtime;
+   *size  = st.st_size;
+   return true;
+}
+
+static void archive_cache_free_entries(void)
+{
+   size_t i;
+
+   for (i = 0; i < archive_cache.count; i++)
+      free(archive_cache.entries[i].path);
+   free(archive_cache.entries);
+
+   archive_cache.entries  = NULL;
+   archive_cache.count    = 0;
+   archive_cache.capacity = 0;
+   archive_cache.total    = 0;
+}
+
+static bool archive_cache_append(const struct archive_cache_entry *entry)
+{
+   if (archive_cache.count == archive_cache.capacity)
+   {
+      size_t capacity = archive_cache.capacity ?
+         archive_cache.capacity * 2 : 32;
+      struct archive_cache_entry *entries = (struct archive_cache_entry*)
+         realloc(archive_cache.entries, capacity * sizeof(*entries));
+
+      if (!entries)
+         return false;
+
+      archive_cache.entries  = entries;
+      archive_cache.capacity = capacity;
+   }
+
+   archive_cache.entries[archive_cache.count++] = *entry;
+   archive_cache.total += entry->size;
+   return true;
+}
+
+static void archive_cache_remove(size_t i, bool delete_file)
+{
+   struct archive_cache_entry *entry = &archive_cache.entries[i];
+
+   if (delete_file)
+   {
+      char file[PATH_MAX_LENGTH];
+      archive_cache_file_path(archive_cache.dir, entry->path,
+            file, sizeof(file));
+      remove(file);
+   }
+
+   archive_cache.total -= entry->size;
+   free(entry->path);
+   memmove(entry, entry + 1,
+         (archive_cache.count - i - 1) * sizeof(*entry));
+   archive_cache.count--;
+}
+
+/* Moves an entry to the front, as the most recently used. */
+static void archive_cache_touch(size_t i)
+{
+   struct archive_cache_entry entry = archive_cache.entries[i];
+
+   memmove(archive_cache.entries + 1, archive_cache.entries,
+         i * sizeof(entry));
+   archive_cache.entries[0] = entry;
+}
+
+static void archive_cache_save(void)
+{
+   size_t i;
+   char index[PATH_MAX_LENGTH];
+   size_t len  = 0;
+   size_t size = 1;
+   char *buf   = NULL;
+
+   for (i = 0; i < archive_cache.count; i++)
+      size += strlen(archive_cache.entries[i].path) + 80;
+
+   if (!(buf = (char*)malloc(size)))
+      return;
+
+   *buf = '\0';
+   for (i = 0; i < archive_cache.count; i++)
+   {
+      const struct archive_cache_entry *entry = &archive_cache.entries[i];
+      len += snprintf(buf + len, size - len, "%08x %llu %lld %llu %s\n",
+            (unsigned)entry->crc, (unsigned long long)entry->size,
+            (long long)entry->mtime,
+            (unsigned long long)entry->archive_size, entry->path);
+   }
+
+   fill_pathname_join(index, archive_cache.dir, ARCHIVE_CACHE_INDEX,
+         sizeof(index));
+   if (!write_file_atomic(index, buf, len))
+      RARCH_WARN("Failed to write archive cache index \"%s\".\n", index);
+
+   free(buf);
+}
+
+/* Reads the index, dropping entries whose file has gone. */
+static void archive_cache_load(const char *dir)
+{
+   char index[PATH_MAX_LENGTH];
+   char *line  = NULL;
+   FILE *file  = NULL;
+   bool dirty  = false;
+
+   if (archive_cache.loaded && !strcmp(archive_cache.dir, dir))
+      return;
+
+   archive_cache_free_entries();
+   strlcpy(archive_cache.dir, dir, sizeof(archive_cache.dir));
+   archive_cache.loaded = true;
+
+   fill_pathname_join(index, dir, ARCHIVE_CACHE_INDEX, sizeof(index));
+   if (!(file = fopen(index, "r")))
+      return;
+
+   line = (char*)malloc(PATH_MAX_LENGTH + 80);
+
+   while (line && fgets(line, PATH_MAX_LENGTH + 80, file))
+   {
+      struct archive_cache_entry entry;
+      char cached[PATH_MAX_LENGTH];
+      struct stat st;
+      char *p   = line;
+      size_t len = strlen(line);
+
+      while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+         line[--len] = '\0';
+
+      entry.crc          = strtoul(p, &p, 16);
+      entry.size         = strtoull(p, &p, 10);
+      entry.mtime        = strtoll(p, &p, 10);
+      entry.archive_size = strtoull(p, &p, 10);
+
+      if (*p++ != ' ' || !*p)
+      {
+         dirty = true;
+         continue;
+      }
+
+      archive_cache_file_path(dir, p, cached, sizeof(cached));
+      if (stat(cached, &st) != 0 || (uint64_t)st.st_size != entry.size)
+      {
+         remove(cached);
+         dirty = true;
+         continue;
+      }
+
+      entry.path = strdup(p);
+      if (!entry.path || !archive_cache_append(&entry))
+      {
+         free(entry.path);
+         break;
+      }
+   }
+
+   free(line);
+   fclose(file);
+
+   if (dirty)
+      archive_cache_save();
+}
+
+static ssize_t archive_cache_find(const char *path)
+{
+   size_t i;
+
+   for (i = 0; i < archive_cache.count; i++)
+   {
+      if (!strcmp(archive_cache.entries[i].path, path))
+         return i;
+   }
+
+   return -1;
+}
+
+/* Adds an entry in front, then evicts from the back until the cache
+ * fits. The new entry itself is never evicted. */
+static bool archive_cache_insert(const char *path, uint64_t size,
+      uint32_t crc)
+{
+   struct archive_cache_entry entry;
+   ssize_t i = archive_cache_find(path);
+
+   /* Same file name, so the old copy was already replaced. */
+   if (i >= 0)
+      archive_cache_remove(i, false);
+
+   if (!archive_cache_stat(path, &entry.mtime, &entry.archive_size))
+      return false;
+
+   entry.path = strdup(path);
+   entry.crc  = crc;
+   entry.size = size;
+
+   if (!entry.path || !archive_cache_append(&entry))
+   {
+      free(entry.path);
+      return false;
+   }
+
+   archive_cache_touch(archive_cache.count - 1);
+
+   while (archive_cache.count > 1
+         && archive_cache.total > archive_cache_limit())
+   {
+      RARCH_LOG("Evicting \"%s\" from the archive cache.\n",
+            archive_cache.entries[archive_cache.count - 1].path);
+      archive_cache_remove(archive_cache.count - 1, true);
+   }
+
+   archive_cache_save();
+   return true;
+}
+
+bool archive_cache_enabled(void)
+{
+   char dir[PATH_MAX_LENGTH];
+   return archive_cache_get_dir(dir, sizeof(dir));
+}
+
+bool archive_cache_lookup(const char *path, char *cached, size_t size,
+      uint32_t *crc)
+{
+   char dir[PATH_MAX_LENGTH];
+   struct archive_cache_entry *entry;
+   uint64_t archive_size;
+   int64_t mtime;
+   ssize_t i;
+
+   if (!archive_cache_get_dir(dir, sizeof(dir)))
+      return false;
+
+   archive_cache_load(dir);
+
+   if ((i = archive_cache_find(path)) < 0)
+      return false;
+
+   entry = &archive_cache.entries[i];
+
+   if (!archive_cache_stat(path, &mtime, &archive_size)
+         || mtime != entry->mtime || archive_size != entry->archive_size)
+   {
+      RARCH_LOG("Archive changed, dropping \"%s\" from the archive cache.\n",
+            path);
+      archive_cache_remove(i, true);
+      archive_cache_save();
+      return false;
+   }
+
+   archive_cache_file_path(dir, path, cached, size);
+   if (crc)
+      *crc = entry->crc;
+
+   if (i > 0)
+   {
+      archive_cache_touch(i);
+      archive_cache_save();
+   }
+
+   RARCH_LOG("Using \"%s\" from the archive cache.\n", cached);
+   return true;
+}
+
+static bool archive_cache_path(const char *path, char *cached, size_t size)
+{
+   char dir[PATH_MAX_LENGTH];
+
+   if (!archive_cache_get_dir(dir, sizeof(dir)))
+      return false;
+
+   archive_cache_load(dir);
+   archive_cache_file_path(dir, path, cached, size);
+   return true;
+}
+
+bool archive_cache_entry_path(const char *path, char *cached, size_t size)
+{
+   if (!archive_cache_path(path, cached, size))
+      return false;
+
+   /* A copy the index doesn't know about can't be trusted. */
+   if (archive_cache_find(path) < 0)
+      remove(cached);
+
+   return true;
+}
+
+bool archive_cache_add_file(const char *path)
+{
+   char cached[PATH_MAX_LENGTH];
+   uint64_t size = 0;
+   uint32_t crc  = 0;
+   uint8_t *buf  = NULL;
+   FILE *file    = NULL;
+   size_t numread;
+
+   if (!archive_cache_path(path, cached, sizeof(cached)))
+      return false;
+
+   if (!(file = fopen(cached, "rb")))
+      return false;
+
+   /* The file was just written, so this reads from the page cache. */
+   if ((buf = (uint8_t*)malloc(ARCHIVE_CACHE_CRC_CHUNK)))
+   {
+      while ((numread = fread(buf, 1, ARCHIVE_CACHE_CRC_CHUNK, file)) > 0)
+      {
+         crc   = crc32_update(crc, buf, numread);
+         size += numread;
+      }
+   }
+
+   fclose(file);
+
+   if (!buf || size > archive_cache_limit())
+   {
+      free(buf);
+      return false;
+   }
+
+   free(buf);
+   return archive_cache_insert(path, size, crc);
+}
+
+bool archive_cache_store(const char *path, const void *data, size_t size,
+      uint32_t crc)
+{
+   char cached[PATH_MAX_LENGTH];
+
+   if (!archive_cache_entry_path(path, cached, sizeof(cached)))
+      return false;
+
+   if (size > archive_cache_limit())
+      return false;
+
+   if (!write_file_atomic(cached, data, size))
+      return false;
+
+   if (!archive_cache_insert(path, size, crc))
+   {
+      remove(cached);
+      return false;
+   }
+
+   return true;
+}
+
+void archive_cache_deinit(void)
+{
+   archive_cache_free_entries();
+   archive_cache.loaded = false;
+}
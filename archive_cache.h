@@ -0,0 +1,101 @@
+/*  RetroArch - A frontend for libretro.
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARCHIVE_CACHE_H
+#define ARCHIVE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <boolean.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * archive_cache_enabled:
+ *
+ * Returns: true if archive_cache_size is not 0 and there is a
+ * directory to keep the cache in.
+ **/
+bool archive_cache_enabled(void);
+
+/**
+ * archive_cache_lookup:
+ * @path         : path of an archive member, "archive#member".
+ * @cached       : receives the path of the extracted copy.
+ * @size         : size of @cached.
+ * @crc          : if not NULL, receives the CRC32 of the member.
+ *
+ * Looks for an extracted copy of an archive member. Entries are
+ * keyed by the archive's path and modification time, so a lookup
+ * costs one stat of the archive. A @path without '#' is a key for
+ * content-addressed data instead, which is never stale.
+ *
+ * Returns: true if there is a copy that is still current.
+ **/
+bool archive_cache_lookup(const char *path, char *cached, size_t size,
+      uint32_t *crc);
+
+/**
+ * archive_cache_entry_path:
+ * @path         : path of an archive member, "archive#member".
+ * @cached       : receives where to extract it to.
+ * @size         : size of @cached.
+ *
+ * Gives the path to extract a member to before adding it with
+ * archive_cache_add_file. Removes anything left over there.
+ *
+ * Returns: false if the cache is disabled.
+ **/
+bool archive_cache_entry_path(const char *path, char *cached, size_t size);
+
+/**
+ * archive_cache_add_file:
+ * @path         : path of an archive member, "archive#member".
+ *
+ * Adds a member extracted to its archive_cache_entry_path, evicting
+ * the least recently used entries to stay within the size limit.
+ *
+ * Returns: false if the member was not added, in which case the
+ * extracted file is left for the caller to clean up.
+ **/
+bool archive_cache_add_file(const char *path);
+
+/**
+ * archive_cache_store:
+ * @path         : path of an archive member, "archive#member".
+ * @data         : contents of the member.
+ * @size         : size of @data.
+ * @crc          : CRC32 of @data.
+ *
+ * Writes a member extracted to memory to the cache and adds it.
+ *
+ * Returns: true if the member was added.
+ **/
+bool archive_cache_store(const char *path, const void *data, size_t size,
+      uint32_t crc);
+
+/**
+ * archive_cache_deinit:
+ *
+ * Frees the in-memory copy of the index.
+ **/
+void archive_cache_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ARCHIVE_CACHE_H */
@@ -20,8 +20,14 @@
 #include <boolean.h>
 #include <string.h>
 #include <stdio.h>
+#include <retro_miscellaneous.h>
+#include "file_ops.h"
 #include "general.h"
 
+/* SRAM is compared and copied in blocks of this size, so only the
+ * blocks the core wrote to since the last check are touched. */
+#define AUTOSAVE_BLOCK_SIZE 4096
+
 struct autosave
 {
    volatile bool quit;
@@ -36,6 +42,13 @@ struct autosave
    const char *path;
    size_t bufsize;
    unsigned interval;
+   /* The last write failed, retry even if nothing changed since. */
+   bool pending;
+
+   /* Frames run under the lock, and how many of them the last
+    * check covered. */
+   unsigned frames;
+   unsigned checked_frames;
 };
 
 /**
@@ -60,6 +73,49 @@ static void autosave_unlock(autosave_t *handle)
    slock_unlock(handle->lock);
 }
 
+/**
+ * autosave_update:
+ * @handle          : pointer to autosave object
+ *
+ * Copies the blocks of SRAM that changed since the last call
+ * into the autosave buffer. SRAM only changes while the core runs,
+ * between lock_autosave and unlock_autosave, so nothing is compared
+ * when no frame ran since.
+ *
+ * Returns: number of bytes that changed.
+ **/
+static size_t autosave_update(autosave_t *handle)
+{
+   size_t offset;
+   size_t dirty       = 0;
+   uint8_t *buffer    = (uint8_t*)handle->buffer;
+   const uint8_t *src = (const uint8_t*)handle->retro_buffer;
+
+   autosave_lock(handle);
+
+   if (handle->frames == handle->checked_frames)
+   {
+      autosave_unlock(handle);
+      return 0;
+   }
+   handle->checked_frames = handle->frames;
+
+   for (offset = 0; offset < handle->bufsize; offset += AUTOSAVE_BLOCK_SIZE)
+   {
+      size_t len = min(handle->bufsize - offset, (size_t)AUTOSAVE_BLOCK_SIZE);
+
+      if (memcmp(buffer + offset, src + offset, len) == 0)
+         continue;
+
+      memcpy(buffer + offset, src + offset, len);
+      dirty += len;
+   }
+
+   autosave_unlock(handle);
+
+   return dirty;
+}
+
 /**
  * autosave_thread:
  * @data            : pointer to autosave object
@@ -73,41 +129,27 @@ static void autosave_thread(void *data)
 
    while (!save->quit)
    {
-      bool differ = false;
-
-      autosave_lock(save);
-      differ = memcmp(save->buffer, save->retro_buffer,
-            save->bufsize) != 0;
-      if (differ)
-         memcpy(save->buffer, save->retro_buffer, save->bufsize);
-      autosave_unlock(save);
+      size_t dirty = autosave_update(save);
 
-      if (differ)
+      if (dirty || save->pending)
       {
-         /* Should probably deal with this more elegantly. */
-         FILE *file = fopen(save->path, "wb");
-
-         if (file)
+         /* Avoid spamming down stderr ... */
+         if (first_log)
          {
-            bool failed = false;
-
-            /* Avoid spamming down stderr ... */
-            if (first_log)
-            {
-               RARCH_LOG("Autosaving SRAM to \"%s\", will continue to check every %u seconds ...\n",
-                     save->path, save->interval);
-               first_log = false;
-            }
-            else
-               RARCH_LOG("SRAM changed ... autosaving ...\n");
-
-            failed |= fwrite(save->buffer, 1, save->bufsize, file)
-               != save->bufsize;
-            failed |= fflush(file) != 0;
-            failed |= fclose(file) != 0;
-            if (failed)
-               RARCH_WARN("Failed to autosave SRAM. Disk might be full.\n");
+            RARCH_LOG("Autosaving SRAM to \"%s\", will continue to check every %u seconds ...\n",
+                  save->path, save->interval);
+            first_log = false;
          }
+         else
+            RARCH_LOG("SRAM changed (%u of %u bytes) ... autosaving ...\n",
+                  (unsigned)dirty, (unsigned)save->bufsize);
+
+         /* The buffer is only written by this thread,
+          * so it can be saved without holding the lock. */
+         save->pending = !write_file_atomic(save->path,
+               save->buffer, save->bufsize);
+         if (save->pending)
+            RARCH_WARN("Failed to autosave SRAM. Disk might be full.\n");
       }
 
       slock_lock(save->cond_lock);
@@ -216,7 +258,10 @@ void unlock_autosave(void)
    for (i = 0; i < global->num_autosave; i++)
    {
       if (global->autosave[i])
+      {
+         global->autosave[i]->frames++;
          autosave_unlock(global->autosave[i]);
+      }
    }
 }
 
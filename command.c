@@ -191,6 +191,7 @@ static const struct cmd_map map[] = {
    { "STATE_SLOT_MINUS",       RARCH_STATE_SLOT_MINUS },
    { "FPS_TOGGLE",             RARCH_SHOW_FPS_TOGGLE },
    { "REWIND",                 RARCH_REWIND },
+   { "REWIND_SEEK",            RARCH_REWIND_SEEK },
    { "PAUSE_TOGGLE",           RARCH_PAUSE_TOGGLE },
    { "FRAMEADVANCE",           RARCH_FRAMEADVANCE },
    { "RESET",                  RARCH_RESET },
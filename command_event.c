@@ -28,6 +28,7 @@
 #include "retroarch.h"
 #include "dir_list_special.h"
 #include "preempt.h"
+#include "runahead.h"
 #include "core_history.h"
 
 #include "configuration.h"
@@ -647,6 +648,7 @@ static void event_save_state(const char *path,
       char *s, size_t len)
 {
    settings_t *settings = config_get_ptr();
+   unsigned pending;
 
    if (!save_state(path))
    {
@@ -654,7 +656,12 @@ static void event_save_state(const char *path,
       return;
    }
 
-   if (settings->state_slot < 0)
+   /* The writer reports when the state is on disk. */
+   pending = save_state_pending();
+   if (pending)
+      snprintf(s, len, "Saving state to slot #%d (%u pending) ...",
+            settings->state_slot, pending);
+   else if (settings->state_slot < 0)
       snprintf(s, len, "Saved state to slot #-1 (auto).");
    else
       snprintf(s, len, "Saved state to slot #%d.", settings->state_slot);
@@ -823,7 +830,7 @@ bool event_command(enum event_command cmd)
             netplay_disconnect();
          else
 #endif
-         preempt_reset_buffer(driver->preempt_data);
+         event_command(EVENT_CMD_PREEMPT_RESET_BUFFER);
          break;
       case EVENT_CMD_RESIZE_WINDOWED_SCALE:
          if (global->pending.windowed_scale == 0)
@@ -864,7 +871,7 @@ bool event_command(enum event_command cmd)
             netplay_disconnect();
          else
 #endif
-         preempt_reset_buffer(driver->preempt_data);
+         event_command(EVENT_CMD_PREEMPT_RESET_BUFFER);
          break;
       case EVENT_CMD_SAVE_STATE:
          if (settings->savestate_auto_index)
@@ -948,8 +955,20 @@ bool event_command(enum event_command cmd)
             return false;
 #endif
          if (global->rewind.state)
+         {
+            unsigned entries;
+            float ratio;
+
+            state_manager_capacity(global->rewind.state,
+                  &entries, NULL, NULL, &ratio);
+            RARCH_LOG("Rewind buffer held %u states, %.2fx compressed.\n",
+                  entries, ratio);
             state_manager_free(global->rewind.state);
+         }
          global->rewind.state = NULL;
+         if (global->rewind.dump)
+            fclose(global->rewind.dump);
+         global->rewind.dump = NULL;
          break;
       case EVENT_CMD_REWIND_INIT:
          if (*settings->libretro)
@@ -1162,6 +1181,10 @@ bool event_command(enum event_command cmd)
 #endif
          break;
       case EVENT_CMD_CORE_DEINIT:
+         save_state_wait();
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+         runahead_deinit();
+#endif
          video_driver_free_hw_context();
 
          pretro_unload_game();
@@ -1402,11 +1425,20 @@ bool event_command(enum event_command cmd)
          break;
       case EVENT_CMD_PREEMPT_UPDATE:
          preempt_deinit();
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+         runahead_deinit();
+         if (!preempt_init() && !runahead_init())
+            return false;
+#else
          if (!preempt_init())
             return false;
+#endif
          break;
       case EVENT_CMD_PREEMPT_RESET_BUFFER:
          preempt_reset_buffer(driver->preempt_data);
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+         runahead_reset_buffer(driver->runahead_data);
+#endif
          break;
       case EVENT_CMD_FULLSCREEN_TOGGLE:
          if (!video_driver_has_windowed())
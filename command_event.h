@@ -229,6 +229,7 @@ typedef struct event_cmd_state
    bool pause_pressed;
    bool frameadvance_pressed;
    bool rewind_pressed;
+   bool rewind_seek_pressed;
    bool netplay_flip_pressed;
    bool cheat_index_plus_pressed;
    bool cheat_index_minus_pressed;
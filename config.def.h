@@ -423,6 +423,19 @@ static const unsigned aspect_ratio_idx = ASPECT_RATIO_CORE;
  * instead of same-instance savesates */
 static const bool preempt_fast_savestates = true;
 
+/* Keep preemptive frames as one full savestate plus deltas,
+ * instead of one full savestate per frame. */
+static const bool preempt_delta_states = false;
+
+/* With preempt_frames set to auto, the share of each frame 
+ * (in percent) that replaying may take. */
+static const unsigned preempt_auto_budget = 50;
+
+/* Number of input changes to precompute for preemptive frames, each 
+ * on its own secondary core instance. A correct guess turns the 
+ * replay into a state swap. Implies same-binary savestates. */
+static const unsigned preempt_speculate = 0;
+
 /* Save configuration file on exit. */
 static const bool config_save_on_exit = true;
 
@@ -607,6 +620,24 @@ static const unsigned rewind_buffer_size = 20; /* 20MiB */
 /* How many frames to rewind at a time. */
 static const unsigned rewind_granularity = 1;
 
+/* Compresses rewind states on a separate thread, so the main thread
+ * only pays for serializing. */
+static const bool rewind_threaded = false;
+
+/* Runs rewind states through zlib as well, trading some CPU time 
+ * for a longer rewind history in the same buffer. */
+static const bool rewind_deflate = false;
+
+/* Stores every Nth rewind state in full. 0 stores only differences. */
+static const unsigned rewind_keyframe_interval = 0;
+
+/* Moves rewind states that no longer fit in the rewind buffer 
+ * to a file next to the savestates, up to this many MB. 0 disables. */
+static const unsigned rewind_disk_size = 0;
+
+/* How far back the rewind seek hotkey jumps, in seconds. */
+static const unsigned rewind_seek_seconds = 10;
+
 /* Pause gameplay when gameplay loses focus. */
 static const bool pause_nonactive = false;
 
@@ -618,6 +649,25 @@ static const unsigned autosave_interval = 0;
  * user 1 rather than user 2. */
 static const bool netplay_client_swap_input = true;
 
+/* Largest input delay netplay may pick, in frames. Netplay delays 
+ * local input just enough to keep rollback replays within 
+ * netplay_replay_budget. 0 disables input delay. */
+static const unsigned netplay_max_input_delay = 4;
+
+/* Time rollback replays may take, in percent of a frame. */
+static const unsigned netplay_replay_budget = 25;
+
+/* Netplay compares a hash of the game state with the peer's 
+ * every netplay_check_frames frames. With netplay_check_sample 
+ * above 1, only one in that many blocks of the state is hashed 
+ * per check, a different one each time. */
+static const unsigned netplay_check_frames = 60;
+static const unsigned netplay_check_sample = 1;
+
+/* How many spectators a netplay host lets watch, on the netplay 
+ * port plus one. 0 disables spectating. */
+static const unsigned netplay_max_spectators = 0;
+
 /* On save state load, block SRAM from being overwritten.
  * This could potentially lead to buggy games. */
 static const bool block_sram_overwrite = false;
@@ -783,6 +833,7 @@ static const struct retro_keybind retro_keybinds_1[] = {
    { true, RARCH_FAST_FORWARD_HOLD_KEY,   RETRO_LBL_FAST_FORWARD_HOLD_KEY, RETROK_SPACE,   NO_BTN, 0, AXIS_NONE },
    { true, RARCH_SLOWMOTION,              RETRO_LBL_SLOWMOTION,            RETROK_UNKNOWN, NO_BTN, 0, AXIS_NONE },
    { true, RARCH_REWIND,                  RETRO_LBL_REWIND,                RETROK_UNKNOWN, NO_BTN, 0, AXIS_NONE },
+   { true, RARCH_REWIND_SEEK,             RETRO_LBL_REWIND_SEEK,           RETROK_UNKNOWN, NO_BTN, 0, AXIS_NONE },
    { true, RARCH_PAUSE_TOGGLE,            RETRO_LBL_PAUSE_TOGGLE,          RETROK_p,       NO_BTN, 0, AXIS_NONE },
    { true, RARCH_FRAMEADVANCE,            RETRO_LBL_FRAMEADVANCE,          RETROK_k,       NO_BTN, 0, AXIS_NONE },
    { true, RARCH_SHOW_FPS_TOGGLE,         RETRO_LBL_SHOW_FPS,              RETROK_F3,      NO_BTN, 0, AXIS_NONE },
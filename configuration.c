@@ -128,6 +128,14 @@ static void config_populate_scoped_setting_list(void)
       settings->preempt_frames, settings->preempt_frames_scope);
    SCOPED_LIST_ADD_BOOL("preempt_fast_savestates",
       settings->preempt_fast_savestates, settings->preempt_frames_scope);
+   SCOPED_LIST_ADD_BOOL("preempt_delta_states",
+      settings->preempt_delta_states, settings->preempt_frames_scope);
+   SCOPED_LIST_ADD_UINT("preempt_auto_budget",
+      settings->preempt_auto_budget, settings->preempt_frames_scope);
+   SCOPED_LIST_ADD_UINT("preempt_speculate",
+      settings->preempt_speculate, settings->preempt_frames_scope);
+   SCOPED_LIST_ADD_UINT("runahead_frames",
+      settings->runahead_frames, settings->preempt_frames_scope);
    SCOPED_LIST_ADD_UINT("aspect_ratio_index",
       settings->video.aspect_ratio_idx, settings->video.aspect_ratio_idx_scope);
    SCOPED_LIST_ADD_UINT("custom_viewport_width",
@@ -626,6 +634,9 @@ static void config_set_defaults(void)
    settings->video.rotation                    = ORIENTATION_NORMAL;
 
    settings->preempt_fast_savestates           = preempt_fast_savestates;
+   settings->preempt_delta_states              = preempt_delta_states;
+   settings->preempt_auto_budget               = preempt_auto_budget;
+   settings->preempt_speculate                 = preempt_speculate;
 
    settings->audio.enable                      = audio_enable;
    settings->audio.mute_enable                 = false;
@@ -647,6 +658,11 @@ static void config_set_defaults(void)
    settings->rewind_enable                     = rewind_enable;
    settings->rewind_buffer_size                = rewind_buffer_size;
    settings->rewind_granularity                = rewind_granularity;
+   settings->rewind_threaded                   = rewind_threaded;
+   settings->rewind_deflate                    = rewind_deflate;
+   settings->rewind_keyframe_interval          = rewind_keyframe_interval;
+   settings->rewind_disk_size                  = rewind_disk_size;
+   settings->rewind_seek_seconds               = rewind_seek_seconds;
    settings->slowmotion_ratio                  = slowmotion_ratio;
    settings->fastforward_ratio                 = fastforward_ratio;
    settings->throttle_using_core_fps           = throttle_using_core_fps;
@@ -839,9 +855,11 @@ static void config_set_defaults(void)
 
    *settings->cheat_database = '\0';
    *settings->cheat_settings_path = '\0';
+   *settings->rewind_dump_path = '\0';
    *settings->screenshot_directory = '\0';
    *settings->system_directory = '\0';
    *settings->extraction_directory = '\0';
+   *settings->archive_cache_directory = '\0';
    *settings->input_remapping_directory = '\0';
    *settings->input.autoconfig_dir = '\0';
    *settings->input.overlay = '\0';
@@ -863,7 +881,10 @@ static void config_set_defaults(void)
    settings->sort_savestates_enable = default_sort_savestates_enable;
 
    settings->savestate_file_compression = true;
+   settings->savestate_file_compression_fast = false;
    settings->sram_file_compression = false;
+   settings->archive_cache_size = 0;
+   settings->archive_7z_cache_size = 64;
 
    settings->menu_ok_btn          = default_menu_btn_ok;
    settings->menu_cancel_btn      = default_menu_btn_cancel;
@@ -965,6 +986,11 @@ static void config_set_defaults(void)
    if (!global->has_set_netplay_ip_port)
       global->netplay_port = RARCH_DEFAULT_PORT;
    settings->netplay_periodic_resync = true;
+   settings->netplay_max_input_delay = netplay_max_input_delay;
+   settings->netplay_replay_budget   = netplay_replay_budget;
+   settings->netplay_check_frames    = netplay_check_frames;
+   settings->netplay_check_sample    = netplay_check_sample;
+   settings->netplay_max_spectators  = netplay_max_spectators;
 #endif
 
    if (*g_defaults.config_path)
@@ -1672,6 +1698,20 @@ static bool config_load_file(const char *path, bool set_defaults)
          &settings->netplay_show_crc_checks);
    config_get_bool(conf, "netplay_show_rollback",
          &settings->netplay_show_rollback);
+   config_get_bool(conf, "netplay_show_stats",
+         &settings->netplay_show_stats);
+   config_get_uint(conf, "netplay_max_input_delay",
+         &settings->netplay_max_input_delay);
+   config_get_uint(conf, "netplay_replay_budget",
+         &settings->netplay_replay_budget);
+   config_get_uint(conf, "netplay_check_frames",
+         &settings->netplay_check_frames);
+   config_get_uint(conf, "netplay_check_sample",
+         &settings->netplay_check_sample);
+   config_get_bool(conf, "netplay_check_bisect",
+         &settings->netplay_check_bisect);
+   config_get_uint(conf, "netplay_max_spectators",
+         &settings->netplay_max_spectators);
 
    for (i = 0; i < settings->input.max_users; i++)
    {
@@ -1750,6 +1790,14 @@ static bool config_load_file(const char *path, bool set_defaults)
          &settings->preempt_frames);
    config_get_bool(conf, "preempt_fast_savestates",
          &settings->preempt_fast_savestates);
+   config_get_bool(conf, "preempt_delta_states",
+         &settings->preempt_delta_states);
+   config_get_uint(conf, "preempt_auto_budget",
+         &settings->preempt_auto_budget);
+   config_get_uint(conf, "preempt_speculate",
+         &settings->preempt_speculate);
+   config_get_uint(conf, "runahead_frames",
+         &settings->runahead_frames);
    
    config_get_path(conf, "audio_dsp_plugin",
          settings->audio.dsp_plugin, PATH_MAX_LENGTH);
@@ -1823,6 +1871,12 @@ static bool config_load_file(const char *path, bool set_defaults)
    
    config_get_path(conf, "extraction_directory",
          settings->extraction_directory, PATH_MAX_LENGTH);
+   config_get_path(conf, "archive_cache_directory",
+         settings->archive_cache_directory, PATH_MAX_LENGTH);
+   config_get_uint(conf, "archive_cache_size",
+         &settings->archive_cache_size);
+   config_get_uint(conf, "archive_7z_cache_size",
+         &settings->archive_7z_cache_size);
    config_get_path(conf, "input_remapping_directory",
          settings->input_remapping_directory, PATH_MAX_LENGTH);
    config_get_path(conf, "core_assets_directory",
@@ -1973,6 +2027,18 @@ static bool config_load_file(const char *path, bool set_defaults)
          &settings->rewind_buffer_size);
    config_get_uint(conf, "rewind_granularity",
          &settings->rewind_granularity);
+   config_get_bool(conf, "rewind_threaded",
+         &settings->rewind_threaded);
+   config_get_bool(conf, "rewind_deflate",
+         &settings->rewind_deflate);
+   config_get_uint(conf, "rewind_keyframe_interval",
+         &settings->rewind_keyframe_interval);
+   config_get_uint(conf, "rewind_disk_size",
+         &settings->rewind_disk_size);
+   config_get_uint(conf, "rewind_seek_seconds",
+         &settings->rewind_seek_seconds);
+   config_get_path(conf, "rewind_dump_path",
+         settings->rewind_dump_path, PATH_MAX_LENGTH);
 
    config_get_float(conf, "slowmotion_ratio",
          &settings->slowmotion_ratio);
@@ -2099,6 +2165,8 @@ static bool config_load_file(const char *path, bool set_defaults)
 
    config_get_bool(conf, "savestate_file_compression",
          &settings->savestate_file_compression);
+   config_get_bool(conf, "savestate_file_compression_fast",
+         &settings->savestate_file_compression_fast);
    config_get_bool(conf, "sram_file_compression",
          &settings->sram_file_compression);
 
@@ -2364,6 +2432,8 @@ bool main_config_file_save(const char *path)
          settings->sort_savestates_enable);
    config_set_bool(conf, "savestate_file_compression",
          settings->savestate_file_compression);
+   config_set_bool(conf, "savestate_file_compression_fast",
+         settings->savestate_file_compression_fast);
    config_set_bool(conf, "savestate_auto_index",
          settings->savestate_auto_index);
    config_set_bool(conf, "savestate_auto_save",
@@ -2395,6 +2465,18 @@ bool main_config_file_save(const char *path)
    }
    config_set_int(conf, "rewind_granularity",
          settings->rewind_granularity);
+   config_set_bool(conf, "rewind_threaded",
+         settings->rewind_threaded);
+   config_set_bool(conf, "rewind_deflate",
+         settings->rewind_deflate);
+   config_set_int(conf, "rewind_keyframe_interval",
+         settings->rewind_keyframe_interval);
+   config_set_int(conf, "rewind_disk_size",
+         settings->rewind_disk_size);
+   config_set_int(conf, "rewind_seek_seconds",
+         settings->rewind_seek_seconds);
+   config_set_path(conf, "rewind_dump_path",
+         settings->rewind_dump_path);
 
    config_set_string(conf, "video_driver",
          settings->video.driver);
@@ -2464,6 +2546,14 @@ bool main_config_file_save(const char *path)
             settings->preempt_frames);
       config_set_bool(conf, "preempt_fast_savestates",
             settings->preempt_fast_savestates);
+      config_set_bool(conf, "preempt_delta_states",
+            settings->preempt_delta_states);
+      config_set_int(conf, "preempt_auto_budget",
+            settings->preempt_auto_budget);
+      config_set_int(conf, "preempt_speculate",
+            settings->preempt_speculate);
+      config_set_int(conf, "runahead_frames",
+            settings->runahead_frames);
    }
    if (settings->video.frame_delay_scope == GLOBAL)
       config_set_int(conf, "video_frame_delay",
@@ -2623,6 +2713,20 @@ bool main_config_file_save(const char *path)
          settings->netplay_show_crc_checks);
    config_set_bool(conf, "netplay_show_rollback",
          settings->netplay_show_rollback);
+   config_set_bool(conf, "netplay_show_stats",
+         settings->netplay_show_stats);
+   config_set_int(conf, "netplay_max_input_delay",
+         settings->netplay_max_input_delay);
+   config_set_int(conf, "netplay_replay_budget",
+         settings->netplay_replay_budget);
+   config_set_int(conf, "netplay_check_frames",
+         settings->netplay_check_frames);
+   config_set_int(conf, "netplay_check_sample",
+         settings->netplay_check_sample);
+   config_set_bool(conf, "netplay_check_bisect",
+         settings->netplay_check_bisect);
+   config_set_int(conf, "netplay_max_spectators",
+         settings->netplay_max_spectators);
 
    config_set_string(conf, "audio_driver", settings->audio.driver);
    config_set_bool(conf,   "audio_enable", settings->audio.enable);
@@ -2655,6 +2759,12 @@ bool main_config_file_save(const char *path)
 
    config_set_path(conf, "extraction_directory",
          settings->extraction_directory);
+   config_set_path(conf, "archive_cache_directory",
+         settings->archive_cache_directory);
+   config_set_int(conf, "archive_cache_size",
+         settings->archive_cache_size);
+   config_set_int(conf, "archive_7z_cache_size",
+         settings->archive_7z_cache_size);
    config_set_path(conf, "core_assets_directory",
          *settings->core_assets_directory ?
          settings->core_assets_directory : "default");
@@ -374,14 +374,27 @@ typedef struct settings
    char system_directory[PATH_MAX_LENGTH];
 
    char extraction_directory[PATH_MAX_LENGTH];
+   char archive_cache_directory[PATH_MAX_LENGTH];
+   unsigned archive_cache_size; /* MB */
+   unsigned archive_7z_cache_size; /* MB */
 
    bool rewind_enable;
    unsigned rewind_buffer_size; /* MB */
    unsigned rewind_granularity;
+   bool rewind_threaded;
+   bool rewind_deflate;
+   unsigned rewind_keyframe_interval;
+   unsigned rewind_disk_size; /* MB */
+   unsigned rewind_seek_seconds;
+   char rewind_dump_path[PATH_MAX_LENGTH];
 
    unsigned preempt_frames;
    unsigned preempt_frames_scope;
    bool preempt_fast_savestates;
+   bool preempt_delta_states;
+   unsigned preempt_auto_budget;
+   unsigned preempt_speculate;
+   unsigned runahead_frames;
 
    float slowmotion_ratio;
    float fastforward_ratio;
@@ -403,6 +416,13 @@ typedef struct settings
    bool netplay_periodic_resync;
    bool netplay_show_crc_checks;
    bool netplay_show_rollback;
+   bool netplay_show_stats;
+   unsigned netplay_max_input_delay;
+   unsigned netplay_replay_budget;
+   unsigned netplay_check_frames;
+   unsigned netplay_check_sample;
+   bool netplay_check_bisect;
+   unsigned netplay_max_spectators;
 
    char core_assets_directory[PATH_MAX_LENGTH];
    char assets_directory[PATH_MAX_LENGTH];
@@ -419,6 +439,7 @@ typedef struct settings
    bool sort_savestates_enable;
 
    bool savestate_file_compression;
+   bool savestate_file_compression_fast;
    bool sram_file_compression;
 
    unsigned menu_ok_btn;
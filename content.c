@@ -16,6 +16,10 @@
 
 #include "content.h"
 #include "file_ops.h"
+#include "archive_cache.h"
+#ifdef HAVE_7ZIP
+#include "decompress/7zip_support.h"
+#endif
 #include <file/file_path.h>
 #include "general.h"
 #include <stdlib.h>
@@ -29,6 +33,11 @@
 #include <file/file_extract.h>
 #include <string/stdstring.h>
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#include "runloop.h"
+#endif
+
 #ifdef _WIN32
 #ifdef _XBOX
 #include <xtl.h>
@@ -41,11 +50,161 @@
 #endif
 #endif
 
+#ifdef HAVE_COMPRESSION
+/**
+ * read_archive_content:
+ * @path         : path of the archive member, "archive#member".
+ * @buf          : receives the contents of the member.
+ * @length       : receives the size of @buf.
+ * @mapped       : receives whether @buf is a mapping from map_file.
+ * @crc          : if not NULL, receives the CRC32 of @buf.
+ *
+ * Reads an archive member from the archive cache if it has a copy.
+ * Otherwise extracts it and adds it to the cache for next time.
+ *
+ * Returns: true if successful, false on error.
+ **/
+static bool read_archive_content(const char *path, uint8_t **buf,
+      ssize_t *length, bool *mapped, uint32_t *crc)
+{
+   char cached[PATH_MAX_LENGTH];
+   uint32_t member_crc = 0;
+
+   if (archive_cache_lookup(path, cached, sizeof(cached), &member_crc))
+   {
+#ifdef HAVE_MMAP
+      *buf    = (uint8_t*)map_file(cached, length);
+      *mapped = *buf != NULL;
+#endif
+      if (*buf || read_file(cached, (void**)buf, length))
+      {
+         if (crc)
+            *crc = member_crc;
+         return true;
+      }
+   }
+
+   if (!read_file_crc32(path, (void**)buf, length, &member_crc))
+      return false;
+
+   if (*length >= 0)
+      archive_cache_store(path, *buf, *length, member_crc);
+
+   if (crc)
+      *crc = member_crc;
+   return true;
+}
+#endif
+
+/**
+ * read_content_data:
+ * @path         : path of the content file.
+ * @buf          : receives the contents of the content file.
+ * @length       : receives the size of @buf.
+ * @patch        : apply a soft patch, if there is one.
+ * @mapped       : receives whether @buf is a mapping from map_file.
+ * @crc          : if not NULL, receives the CRC32 of @buf.
+ *
+ * Reads a content file for a core that does not need its path.
+ * Plain files are mapped when possible, and only copied when a
+ * soft patch changes them. Free @buf with free_content_data.
+ * The CRC32 is taken while the file is read, not in a second pass.
+ * Soft-patched content comes from the archive cache when it was
+ * patched before.
+ *
+ * Returns: true if successful, false on error.
+ **/
+bool read_content_data(const char *path, void **buf, ssize_t *length,
+      bool patch, bool *mapped, uint32_t *crc)
+{
+   uint8_t *ret_buf = NULL;
+   uint8_t *source  = NULL;
+   ssize_t len      = 0;
+   ssize_t source_len;
+   bool source_mapped;
+
+   *mapped = false;
+
+#ifdef HAVE_COMPRESSION
+   if (path_contains_compressed_file(path))
+   {
+      if (!read_archive_content(path, &ret_buf, &len, mapped, crc))
+         return false;
+   }
+   else
+#endif
+   {
+#ifdef HAVE_MMAP
+      ret_buf = (uint8_t*)map_file(path, &len);
+      *mapped = ret_buf != NULL;
+
+      /* Checksumming the mapping is what reads it in. */
+      if (ret_buf && crc)
+         *crc = crc32_update(0, ret_buf, len);
+#endif
+
+      if (!ret_buf)
+      {
+         if (crc)
+         {
+            if (!read_file_crc32(path, (void**)&ret_buf, &len, crc))
+               return false;
+         }
+         else if (!read_file(path, (void**)&ret_buf, &len))
+            return false;
+      }
+   }
+
+   if (len < 0)
+   {
+      free(ret_buf);
+      return false;
+   }
+
+   source        = ret_buf;
+   source_len    = len;
+   source_mapped = *mapped;
+
+   /* Also gives the CRC32 of the patched content. */
+   if (patch)
+      patch_content(&ret_buf, &len, mapped, crc);
+
+   /* Patching made a copy; the original is no longer needed. */
+   if (ret_buf != source)
+      free_content_data(source, source_len, source_mapped);
+
+   *buf    = ret_buf;
+   *length = len;
+
+   return true;
+}
+
+/**
+ * free_content_data:
+ * @buf          : contents returned by read_content_data.
+ * @length       : size of @buf.
+ * @mapped       : whether @buf is a mapping from map_file.
+ *
+ * Frees or unmaps content read by read_content_data.
+ **/
+void free_content_data(void *buf, ssize_t length, bool mapped)
+{
+#ifdef HAVE_MMAP
+   if (mapped)
+   {
+      unmap_file(buf, length);
+      return;
+   }
+#endif
+   free(buf);
+}
+
 /**
  * read_content_file:
  * @path         : buffer of the content file.
  * @buf          : size   of the content file.
  * @length       : size of the content file that has been read from.
+ * @mapped       : receives whether @buf is a mapping from map_file.
  *
  * Read the content file. If read into memory, also performs soft patching
  * (see patch_content function) in case soft patching has not been
@@ -53,32 +212,17 @@
  *
  * Returns: true if successful, false on error.
  **/
-static bool read_content_file(unsigned i, const char *path, void **buf,
-      ssize_t *length)
+static bool read_content_file(const char *path, void **buf,
+      ssize_t *length, bool *mapped)
 {
-   uint8_t *ret_buf = NULL;
    global_t *global = global_get_ptr();
 
    RARCH_LOG("Loading content file: %s.\n", path);
-   if (!read_file(path, (void**) &ret_buf, length))
+   if (!read_content_data(path, buf, length, !global->block_patch, mapped,
+            &global->content_crc))
       return false;
 
-   if (*length < 0)
-      return false;
-
-   if (i != 0)
-      return true;
-
-   /* Attempt to apply a patch. */
-   if (!global->block_patch)
-      patch_content(&ret_buf, length);
-   
-#ifdef HAVE_ZLIB
-   global->content_crc = zlib_crc32_calculate(ret_buf, *length);
-
    RARCH_LOG("CRC32: 0x%x .\n", (unsigned)global->content_crc);
-#endif
-   *buf = ret_buf;
 
    return true;
 }
@@ -133,11 +277,276 @@ struct sram_block
    size_t size;
 };
 
+/**
+ * write_state_file:
+ * @path      : path of saved state that shall be written to.
+ * @data      : serialized state.
+ * @size      : size of @data.
+ * @compress  : write in RZIP format.
+ * @fast      : compress for speed rather than size.
+ * @progress  : show progress while compressing.
+ *
+ * Writes a serialized state to disk.
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+static bool write_state_file(const char *path, const void *data,
+      size_t size, bool compress, bool fast, bool progress)
+{
+   bool ret;
+
+   if (compress)
+      ret = write_rzip_file(path, data, size, fast, progress);
+   else
+      ret = write_file(path, data, size);
+
+   if (!ret)
+      RARCH_ERR("Failed to save state to \"%s\".\n", path);
+
+   return ret;
+}
+
+#ifdef HAVE_THREADS
+/* States written at once before save_state waits for the writer. */
+#define STATE_WRITER_MAX_PENDING 4
+
+struct state_write
+{
+   char path[PATH_MAX_LENGTH];
+   void *data;
+   size_t size;
+   bool compress;
+   bool fast;
+   struct state_write *next;
+};
+
+/* Serialized states are compressed and written on this thread,
+ * oldest first. A state stays queued until it is on disk, so
+ * loading it in the meantime is served from memory. */
+static struct
+{
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   struct state_write *head;
+   struct state_write *tail;
+   unsigned pending;
+   bool quit;
+} state_writer;
+
+static void state_writer_thread(void *data)
+{
+   char msg[PATH_MAX_LENGTH];
+   struct state_write *job;
+
+   (void)data;
+
+   slock_lock(state_writer.lock);
+
+   for (;;)
+   {
+      while (!state_writer.head && !state_writer.quit)
+         scond_wait(state_writer.cond, state_writer.lock);
+
+      if (!state_writer.head)
+         break;
+
+      job = state_writer.head;
+      slock_unlock(state_writer.lock);
+
+      /* Readers only copy the data, so it is safe
+       * to write it out without holding the lock. */
+      if (write_state_file(job->path, job->data, job->size,
+               job->compress, job->fast, false))
+         snprintf(msg, sizeof(msg), "Saved state to \"%s\".",
+               path_basename(job->path));
+      else
+         snprintf(msg, sizeof(msg), "Failed to save state to \"%s\".",
+               path_basename(job->path));
+      rarch_main_msg_queue_push(msg, 2, 180, true);
+
+      slock_lock(state_writer.lock);
+      state_writer.head = job->next;
+      if (!state_writer.head)
+         state_writer.tail = NULL;
+      state_writer.pending--;
+      scond_broadcast(state_writer.cond);
+
+      free(job->data);
+      free(job);
+   }
+
+   slock_unlock(state_writer.lock);
+}
+
+static bool state_writer_init(void)
+{
+   if (state_writer.thread)
+      return true;
+
+   state_writer.lock = slock_new();
+   state_writer.cond = scond_new();
+
+   if (state_writer.lock && state_writer.cond)
+   {
+      state_writer.quit   = false;
+      state_writer.thread = sthread_create(state_writer_thread, NULL);
+   }
+
+   if (state_writer.thread)
+      return true;
+
+   if (state_writer.lock)
+      slock_free(state_writer.lock);
+   if (state_writer.cond)
+      scond_free(state_writer.cond);
+   state_writer.lock = NULL;
+   state_writer.cond = NULL;
+   return false;
+}
+
+/**
+ * state_writer_push:
+ * @path      : path of saved state that shall be written to.
+ * @data      : serialized state, owned by the writer on success.
+ * @size      : size of @data.
+ *
+ * Queues a serialized state for writing.
+ *
+ * Returns: true if queued, false if the writer could not be started.
+ **/
+static bool state_writer_push(const char *path, void *data, size_t size)
+{
+   settings_t *settings = config_get_ptr();
+   struct state_write *job;
+
+   if (!state_writer_init())
+      return false;
+
+   job = (struct state_write*)calloc(1, sizeof(*job));
+   if (!job)
+      return false;
+
+   strlcpy(job->path, path, sizeof(job->path));
+   job->data     = data;
+   job->size     = size;
+   job->compress = settings->savestate_file_compression;
+   job->fast     = settings->savestate_file_compression_fast;
+
+   slock_lock(state_writer.lock);
+
+   /* Don't keep an unbounded number of states in memory
+    * when saving faster than the disk can keep up. */
+   while (state_writer.pending >= STATE_WRITER_MAX_PENDING)
+      scond_wait(state_writer.cond, state_writer.lock);
+
+   if (state_writer.tail)
+      state_writer.tail->next = job;
+   else
+      state_writer.head = job;
+   state_writer.tail = job;
+   state_writer.pending++;
+
+   scond_broadcast(state_writer.cond);
+   slock_unlock(state_writer.lock);
+
+   return true;
+}
+
+/**
+ * state_writer_read:
+ * @path      : path of saved state.
+ * @buf       : receives a copy of the state. Needs to be freed manually.
+ * @size      : receives the size of @buf.
+ *
+ * Looks for the most recent state queued for @path.
+ *
+ * Returns: true if @path has a state waiting to be written.
+ **/
+static bool state_writer_read(const char *path, void **buf, ssize_t *size)
+{
+   struct state_write *job;
+   struct state_write *found = NULL;
+
+   if (!state_writer.thread)
+      return false;
+
+   slock_lock(state_writer.lock);
+
+   for (job = state_writer.head; job; job = job->next)
+      if (!strcmp(job->path, path))
+         found = job;
+
+   if (found && (*buf = malloc(found->size)))
+   {
+      memcpy(*buf, found->data, found->size);
+      *size = found->size;
+   }
+   else
+      found = NULL;
+
+   slock_unlock(state_writer.lock);
+
+   return found != NULL;
+}
+#endif
+
+/**
+ * save_state_pending:
+ *
+ * Returns: number of states that are still being written.
+ **/
+unsigned save_state_pending(void)
+{
+#ifdef HAVE_THREADS
+   unsigned pending;
+
+   if (!state_writer.thread)
+      return 0;
+
+   slock_lock(state_writer.lock);
+   pending = state_writer.pending;
+   slock_unlock(state_writer.lock);
+
+   return pending;
+#else
+   return 0;
+#endif
+}
+
+/**
+ * save_state_wait:
+ *
+ * Waits until every state queued by save_state is on disk,
+ * and stops the writer.
+ **/
+void save_state_wait(void)
+{
+#ifdef HAVE_THREADS
+   if (!state_writer.thread)
+      return;
+
+   slock_lock(state_writer.lock);
+   state_writer.quit = true;
+   scond_broadcast(state_writer.cond);
+   slock_unlock(state_writer.lock);
+
+   sthread_join(state_writer.thread);
+   slock_free(state_writer.lock);
+   scond_free(state_writer.cond);
+
+   state_writer.thread = NULL;
+   state_writer.lock   = NULL;
+   state_writer.cond   = NULL;
+#endif
+}
+
 /**
  * save_state:
  * @path      : path of saved state that shall be written to.
  *
- * Save a state from memory to disk.
+ * Save a state from memory to disk. The state is serialized right
+ * away, and, with threads, written to disk in the background.
  *
  * Returns: true if successful, false otherwise.
  **/
@@ -164,16 +573,16 @@ bool save_state(const char *path)
    RARCH_LOG("State size: %d bytes.\n", (int)size);
    ret = pretro_serialize(data, size);
 
-   if (ret)
-   {
-      if (settings->savestate_file_compression)
-         ret = write_rzip_file(path, data, size);
-      else
-         ret = write_file(path, data, size);
-   }
-
    if (!ret)
       RARCH_ERR("Failed to save state to \"%s\".\n", path);
+#ifdef HAVE_THREADS
+   else if (state_writer_push(path, data, size))
+      return true;
+#endif
+   else
+      ret = write_state_file(path, data, size,
+            settings->savestate_file_compression,
+            settings->savestate_file_compression_fast, true);
 
    free(data);
 
@@ -197,9 +606,14 @@ bool load_state(const char *path)
    struct sram_block *blocks = NULL;
    settings_t *settings      = config_get_ptr();
    global_t *global          = global_get_ptr();
-   bool ret;
+   bool ret                  = false;
 
-   ret = read_rzip_file(path, &buf, &size);
+#ifdef HAVE_THREADS
+   /* A state that is still being written is loaded from memory. */
+   ret = state_writer_read(path, &buf, &size);
+#endif
+   if (!ret)
+      ret = read_rzip_file(path, &buf, &size);
    if (!ret)
       ret = read_file(path, &buf, &size);
 
@@ -329,9 +743,9 @@ void save_ram_file(const char *path, int type)
       return;
 
    if (settings->sram_file_compression)
-      ret = write_rzip_file(path, data, size);
+      ret = write_rzip_file(path, data, size, false, true);
    else
-      ret = write_file(path, data, size);
+      ret = write_file_atomic(path, data, size);
 
    if (ret == false)
    {
@@ -345,7 +759,8 @@ void save_ram_file(const char *path, int type)
 }
 
 static bool load_content_dont_need_fullpath(
-      struct retro_game_info *info, unsigned i, const char *path)
+      struct retro_game_info *info, unsigned i, const char *path,
+      bool *mapped)
 {
    ssize_t len;
    /* Load the content into memory. */
@@ -355,9 +770,10 @@ static bool load_content_dont_need_fullpath(
    bool ret = false;
 
    if (i == 0)
-      ret = read_content_file(i, path, (void**)&info->data, &len);
+      ret = read_content_file(path, (void**)&info->data, &len, mapped);
    else
-      ret = read_file(path, (void**)&info->data, &len);
+      ret = read_content_data(path, (void**)&info->data, &len,
+            false, mapped, NULL);
 
    if (!ret || len < 0)
    {
@@ -381,6 +797,7 @@ static bool load_content_need_fullpath(
    char new_path[PATH_MAX_LENGTH];
    char *new_basedir    = NULL;
    bool ret             = false;
+   bool cached          = false;
    settings_t *settings = config_get_ptr();
    global_t   *global   = global_get_ptr();
 
@@ -393,40 +810,66 @@ static bool load_content_need_fullpath(
    if (!path_contains_compressed_file(path))
       return true;
 
-   RARCH_LOG("Compressed file in case of need_fullpath."
-         "Now extracting to temporary directory.\n");
+   if (archive_cache_lookup(path, new_path, sizeof(new_path), NULL))
+      cached = true;
+   else if (archive_cache_entry_path(path, new_path, sizeof(new_path)))
+   {
+      RARCH_LOG("Compressed file in case of need_fullpath."
+            "Now extracting to archive cache.\n");
 
-   new_basedir = string_alloc(PATH_MAX_LENGTH);
-   strlcpy(new_basedir, settings->extraction_directory, PATH_MAX_LENGTH);
+      ret = read_compressed_file(path, NULL, new_path, &len);
 
-   if ((!strcmp(new_basedir, "")) ||
-         !path_is_directory(new_basedir))
-   {
-      RARCH_WARN("Tried extracting to extraction directory, but "
-            "extraction directory was not set or found. "
-            "Setting extraction directory to directory "
-            "derived by basename...\n");
-      fill_pathname_basedir(new_basedir, path, PATH_MAX_LENGTH);
+      if (!ret || len < 0)
+      {
+         RARCH_ERR("Could not read content file \"%s\".\n", path);
+         remove(new_path);
+         return false;
+      }
+
+      /* If it is too big for the cache, it is temporary after all. */
+      cached = archive_cache_add_file(path);
    }
+   else
+   {
+      RARCH_LOG("Compressed file in case of need_fullpath."
+            "Now extracting to temporary directory.\n");
 
-   attributes.i = 0;
-   fill_pathname_join(new_path, new_basedir,
-         path_basename(path), sizeof(new_path));
-   free(new_basedir);
+      new_basedir = string_alloc(PATH_MAX_LENGTH);
+      strlcpy(new_basedir, settings->extraction_directory, PATH_MAX_LENGTH);
 
-   ret = read_compressed_file(path, NULL, new_path, &len);
+      if ((!strcmp(new_basedir, "")) ||
+            !path_is_directory(new_basedir))
+      {
+         RARCH_WARN("Tried extracting to extraction directory, but "
+               "extraction directory was not set or found. "
+               "Setting extraction directory to directory "
+               "derived by basename...\n");
+         fill_pathname_basedir(new_basedir, path, PATH_MAX_LENGTH);
+      }
 
-   if (!ret || len < 0)
-   {
-      RARCH_ERR("Could not read content file \"%s\".\n", path);
-      return false;
+      fill_pathname_join(new_path, new_basedir,
+            path_basename(path), sizeof(new_path));
+      free(new_basedir);
+
+      ret = read_compressed_file(path, NULL, new_path, &len);
+
+      if (!ret || len < 0)
+      {
+         RARCH_ERR("Could not read content file \"%s\".\n", path);
+         return false;
+      }
    }
 
+   attributes.i = 0;
    string_list_append(additional_path_allocs, new_path, attributes);
    info[i].path =
       additional_path_allocs->elems
       [additional_path_allocs->size -1 ].data;
 
+   /* The archive cache keeps its copies. */
+   if (cached)
+      return true;
+
    /* global->temporary_content is initialized in init_content_file
     * The following part takes care of cleanup of the unzipped files
     * after exit.
@@ -456,10 +899,13 @@ static bool load_content(const struct retro_subsystem_info *special,
    struct string_list* additional_path_allocs = string_list_new();
    struct retro_game_info *info = (struct retro_game_info*)
       calloc(content->size, sizeof(*info));
+   bool *mapped = (bool*)calloc(content->size, sizeof(*mapped));
 
-   if (!info)
+   if (!info || !mapped)
    {
       string_list_free(additional_path_allocs);
+      free(info);
+      free(mapped);
       return false;
    }
 
@@ -484,7 +930,8 @@ static bool load_content(const struct retro_subsystem_info *special,
 
       if (!need_fullpath && *path)
       {
-         if (!load_content_dont_need_fullpath(&info[i], i, path))
+         if (!load_content_dont_need_fullpath(&info[i], i, path,
+                  &mapped[i]))
             goto end;
       }
       else
@@ -508,11 +955,20 @@ static bool load_content(const struct retro_subsystem_info *special,
 
 end:
    for (i = 0; i < content->size; i++)
-      free((void*)info[i].data);
+   {
+      if (info[i].data)
+         free_content_data((void*)info[i].data, info[i].size, mapped[i]);
+   }
+
+#ifdef HAVE_7ZIP
+   /* The content is loaded, so blocks decoded while
+    * browsing the archive are of no further use. */
+   compressed_7zip_cache_free();
+#endif
 
    string_list_free(additional_path_allocs);
-   if (info)
-      free(info);
+   free(mapped);
+   free(info);
    return ret;
 }
 
@@ -43,12 +43,28 @@ bool load_state(const char *path);
  * save_state:
  * @path      : path of saved state that shall be written to.
  *
- * Save a state from memory to disk.
+ * Save a state from memory to disk. The state is serialized right
+ * away, and, with threads, written to disk in the background.
  *
  * Returns: true if successful, false otherwise.
  **/
 bool save_state(const char *path);
 
+/**
+ * save_state_pending:
+ *
+ * Returns: number of states that are still being written.
+ **/
+unsigned save_state_pending(void);
+
+/**
+ * save_state_wait:
+ *
+ * Waits until every state queued by save_state is on disk,
+ * and stops the writer.
+ **/
+void save_state_wait(void);
+
 /**
  * load_ram_file:
  * @path             : path of RAM state that will be loaded from.
@@ -70,6 +86,36 @@ void load_ram_file(const char *path, int type);
  */
 void save_ram_file(const char *path, int type);
 
+/**
+ * read_content_data:
+ * @path         : path of the content file.
+ * @buf          : receives the contents of the content file.
+ * @length       : receives the size of @buf.
+ * @patch        : apply a soft patch, if there is one.
+ * @mapped       : receives whether @buf is a mapping from map_file.
+ * @crc          : if not NULL, receives the CRC32 of @buf.
+ *
+ * Reads a content file for a core that does not need its path.
+ * Plain files are mapped when possible, and only copied when a
+ * soft patch changes them. Free @buf with free_content_data.
+ * The CRC32 is taken while the file is read, not in a second pass,
+ * unless a soft patch changed the contents.
+ *
+ * Returns: true if successful, false on error.
+ **/
+bool read_content_data(const char *path, void **buf, ssize_t *length,
+      bool patch, bool *mapped, uint32_t *crc);
+
+/**
+ * free_content_data:
+ * @buf          : contents returned by read_content_data.
+ * @length       : size of @buf.
+ * @mapped       : whether @buf is a mapping from map_file.
+ *
+ * Frees or unmaps content read by read_content_data.
+ **/
+void free_content_data(void *buf, ssize_t length, bool mapped);
+
 /**
  * init_content_file:
  *
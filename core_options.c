@@ -57,6 +57,8 @@ struct core_option_manager
    const char *category_desc;
 
    bool updated;
+   /* Counts value changes, for readers other than the core */
+   unsigned generation;
 };
 
 static retro_core_options_update_display_callback_t core_option_update_display_cb;
@@ -654,6 +656,22 @@ bool core_option_updated(core_option_manager_t *opt_mgr)
    return opt_mgr->updated;
 }
 
+/**
+ * core_option_generation:
+ * @opt_mgr           : options manager handle
+ *
+ * Unlike core_option_updated, this isn't reset by
+ * RETRO_ENVIRONMENT_GET_VARIABLE.
+ *
+ * Returns: a count that goes up whenever an option value changes.
+ **/
+unsigned core_option_generation(core_option_manager_t *opt_mgr)
+{
+   if (!opt_mgr)
+      return 0;
+   return opt_mgr->generation;
+}
+
 static void core_options_delete_unscoped(void)
 {
    char path[PATH_MAX_LENGTH];
@@ -934,6 +952,7 @@ void core_option_set_val(core_option_manager_t *opt_mgr,
       core_option_update_display_cb();
 
    opt_mgr->updated         = true;  /* need sync with core */
+   opt_mgr->generation++;
    core_options_touched     = true;  /* need flush to disk */
 }
 
@@ -995,6 +1014,7 @@ void core_option_update_vals_from_file(core_option_manager_t *opt_mgr,
       core_option_update_display_cb();
 
    opt_mgr->updated     = true;  /* need sync with core */
+   opt_mgr->generation++;
    core_options_touched = true;  /* need flush to disk */
    config_file_free(conf);
 }
@@ -1022,6 +1042,7 @@ void core_option_next(core_option_manager_t *opt_mgr, size_t idx)
       core_option_update_display_cb();
 
    opt_mgr->updated     = true;  /* need sync with core */
+   opt_mgr->generation++;
    core_options_touched = true;  /* need flush to disk */
 }
 
@@ -1050,6 +1071,7 @@ void core_option_prev(core_option_manager_t *opt_mgr, size_t idx)
       core_option_update_display_cb();
 
    opt_mgr->updated     = true;  /* need sync with core */
+   opt_mgr->generation++;
    core_options_touched = true;  /* need flush to disk */
 }
 
@@ -1075,6 +1097,7 @@ void core_option_first(core_option_manager_t *opt_mgr, size_t idx)
       core_option_update_display_cb();
 
    opt_mgr->updated     = true;  /* need sync with core */
+   opt_mgr->generation++;
    core_options_touched = true;  /* need flush to disk */
 }
 
@@ -1100,6 +1123,7 @@ void core_option_last(core_option_manager_t *opt_mgr, size_t idx)
       core_option_update_display_cb();
 
    opt_mgr->updated     = true;  /* need sync with core */
+   opt_mgr->generation++;
    core_options_touched = true;  /* need flush to disk */
 }
 
@@ -1122,6 +1146,7 @@ void core_option_set_default(core_option_manager_t *opt_mgr, size_t idx)
       core_option_update_display_cb();
 
    opt_mgr->updated         = true;  /* need sync with core */
+   opt_mgr->generation++;
    core_options_touched     = true;  /* need flush to disk */
 }
 
@@ -1145,6 +1170,7 @@ void core_options_set_defaults(core_option_manager_t *opt_mgr)
       core_option_update_display_cb();
 
    opt_mgr->updated     = true;  /* need sync with core */
+   opt_mgr->generation++;
    core_options_touched = true;  /* need flush to disk */
 }
 
@@ -71,6 +71,17 @@ void core_option_update_category_visibilities(core_option_manager_t *opt_mgr);
  **/
 bool core_option_updated(core_option_manager_t *opt_mgr);
 
+/**
+ * core_option_generation:
+ * @opt_mgr           : options manager handle
+ *
+ * Unlike core_option_updated, this isn't reset by
+ * RETRO_ENVIRONMENT_GET_VARIABLE.
+ *
+ * Returns: a count that goes up whenever an option value changes.
+ **/
+unsigned core_option_generation(core_option_manager_t *opt_mgr);
+
 /**
  * core_option_flush:
  * @opt_mgr         : options manager handle
@@ -19,12 +19,19 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <string.h>
 #include <retro_miscellaneous.h>
+#include <compat/strl.h>
 #include <file/file_path.h>
 #include <string/string_list.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 #include "7zip_support.h"
+#include "../performance.h"
+#include "../general.h"
 
 #include "../deps/7zip/7z.h"
 #include "../deps/7zip/7zAlloc.h"
@@ -37,7 +44,14 @@
  */
 #define RARCH_ZIP_SUPPORT_BUFFER_SIZE_MAX 16384
 
+/* Most folders kept decoded between calls. The most data
+ * is archive_7z_cache_size. */
+#define SEVENZIP_CACHE_BLOCKS 32
+/* Most threads decoding folders in the background. */
+#define SEVENZIP_MAX_THREADS  4
+
 static ISzAlloc g_Alloc = { SzAlloc, SzFree };
+static ISzAlloc g_AllocTemp = { SzAllocTemp, SzFreeTemp };
 
 static int Buf_EnsureSize(CBuf *dest, size_t size)
 {
@@ -177,6 +191,437 @@ static SRes ConvertUtf16toCharString(const uint16_t *s, char *outstring)
    return res;
 }
 
+/* Decoded folders ("solid blocks") of the most recently used archive
+ * are kept in memory, so that listing an archive and then loading a
+ * member of it, or loading several members of one block, only decodes
+ * each block once. Listing an archive also starts decoding the blocks
+ * holding its members in the background. */
+struct sevenzip_archive
+{
+   char path[PATH_MAX_LENGTH];
+   int64_t mtime;
+   uint64_t size;
+   CSzArEx db;
+   unsigned refs;
+};
+
+struct sevenzip_block
+{
+   uint8_t *data;
+   size_t size;
+   uint32_t folder;
+   uint64_t last_used;
+   /* False while a thread is still decoding it. */
+   bool ready;
+};
+
+static struct
+{
+   struct sevenzip_archive *archive;
+   struct sevenzip_block blocks[SEVENZIP_CACHE_BLOCKS];
+   unsigned num_blocks;
+   size_t size;
+   /* Taken from the settings whenever an archive is opened,
+    * so that threads never read them. */
+   uint64_t limit;
+   uint64_t clock;
+#ifdef HAVE_THREADS
+   slock_t *lock;
+   scond_t *cond;
+#endif
+} sevenzip_cache;
+
+static void sevenzip_cache_lock(void)
+{
+#ifdef HAVE_THREADS
+   /* Created on first use, which is always on the main thread. */
+   if (!sevenzip_cache.lock)
+   {
+      sevenzip_cache.lock = slock_new();
+      sevenzip_cache.cond = scond_new();
+   }
+   slock_lock(sevenzip_cache.lock);
+#endif
+}
+
+static void sevenzip_cache_unlock(void)
+{
+#ifdef HAVE_THREADS
+   slock_unlock(sevenzip_cache.lock);
+#endif
+}
+
+static void sevenzip_cache_wait(void)
+{
+#ifdef HAVE_THREADS
+   scond_wait(sevenzip_cache.cond, sevenzip_cache.lock);
+#endif
+}
+
+static void sevenzip_cache_signal(void)
+{
+#ifdef HAVE_THREADS
+   scond_broadcast(sevenzip_cache.cond);
+#endif
+}
+
+static void sevenzip_cache_remove(unsigned i)
+{
+   struct sevenzip_block *block = &sevenzip_cache.blocks[i];
+
+   IAlloc_Free(&g_Alloc, block->data);
+   sevenzip_cache.size -= block->size;
+   *block = sevenzip_cache.blocks[--sevenzip_cache.num_blocks];
+}
+
+/* Drops every block. Threads still decoding one throw their result
+ * away when they are done. Called with the lock held. */
+static void sevenzip_cache_clear(void)
+{
+   while (sevenzip_cache.num_blocks)
+      sevenzip_cache_remove(sevenzip_cache.num_blocks - 1);
+   sevenzip_cache_signal();
+}
+
+static struct sevenzip_block *sevenzip_cache_find(
+      const struct sevenzip_archive *archive, uint32_t folder)
+{
+   unsigned i;
+
+   if (archive != sevenzip_cache.archive)
+      return NULL;
+
+   for (i = 0; i < sevenzip_cache.num_blocks; i++)
+      if (sevenzip_cache.blocks[i].folder == folder)
+         return &sevenzip_cache.blocks[i];
+   return NULL;
+}
+
+/* Reserves room for a folder that is about to be decoded, evicting
+ * the least recently used blocks. Returns false if it cannot fit. */
+static bool sevenzip_cache_add(struct sevenzip_archive *archive,
+      uint32_t folder)
+{
+   struct sevenzip_block *block = NULL;
+   size_t size = (size_t)SzFolder_GetUnpackSize(
+         archive->db.db.Folders + folder);
+
+   if (archive != sevenzip_cache.archive || size > sevenzip_cache.limit)
+      return false;
+
+   while (sevenzip_cache.num_blocks == SEVENZIP_CACHE_BLOCKS
+         || sevenzip_cache.size + size > sevenzip_cache.limit)
+   {
+      unsigned i;
+      int lru = -1;
+
+      for (i = 0; i < sevenzip_cache.num_blocks; i++)
+      {
+         if (!sevenzip_cache.blocks[i].ready)
+            continue;
+         if (lru < 0 || sevenzip_cache.blocks[i].last_used
+               < sevenzip_cache.blocks[lru].last_used)
+            lru = i;
+      }
+
+      /* Everything left is still being decoded. */
+      if (lru < 0)
+         return false;
+
+      sevenzip_cache_remove(lru);
+   }
+
+   block            = &sevenzip_cache.blocks[sevenzip_cache.num_blocks++];
+   block->data      = NULL;
+   block->size      = size;
+   block->folder    = folder;
+   block->last_used = ++sevenzip_cache.clock;
+   block->ready     = false;
+   sevenzip_cache.size += size;
+   return true;
+}
+
+/* Fills in a block reserved with sevenzip_cache_add, or drops the
+ * reservation if data is NULL. Returns false if the block was evicted
+ * in the meantime, in which case the caller still owns data. */
+static bool sevenzip_cache_publish(struct sevenzip_archive *archive,
+      uint32_t folder, uint8_t *data)
+{
+   bool ret                     = false;
+   struct sevenzip_block *block = sevenzip_cache_find(archive, folder);
+
+   if (block && !block->ready)
+   {
+      if (data)
+      {
+         block->data  = data;
+         block->ready = true;
+         ret          = true;
+      }
+      else
+         sevenzip_cache_remove(block - sevenzip_cache.blocks);
+   }
+
+   sevenzip_cache_signal();
+   return ret;
+}
+
+/* Called with the lock held. */
+static void sevenzip_archive_release(struct sevenzip_archive *archive)
+{
+   if (!archive || --archive->refs)
+      return;
+
+   SzArEx_Free(&archive->db, &g_Alloc);
+   free(archive);
+}
+
+static bool sevenzip_stat(const char *path, int64_t *mtime, uint64_t *size)
+{
+   struct stat st;
+
+   if (stat(path, &st) != 0)
+      return false;
+
+   *mtime = (int64_t)st.st_mtime;
+   *size  = (uint64_t)st.st_size;
+   return true;
+}
+
+static SRes sevenzip_open(const char *path, CFileInStream *archive_stream,
+      CLookToRead *look_stream)
+{
+   if (InFile_Open(&archive_stream->file, path))
+      return SZ_ERROR_READ;
+
+   FileInStream_CreateVTable(archive_stream);
+   LookToRead_CreateVTable(look_stream, False);
+   look_stream->realStream = &archive_stream->s;
+   LookToRead_Init(look_stream);
+   return SZ_OK;
+}
+
+/* Returns a reference to the parsed headers of an archive, reusing
+ * those of the last archive if it has not changed on disk. */
+static struct sevenzip_archive *sevenzip_archive_get(const char *path,
+      SRes *res)
+{
+   CFileInStream archive_stream;
+   CLookToRead look_stream;
+   int64_t mtime                    = 0;
+   uint64_t size                    = 0;
+   struct sevenzip_archive *archive = NULL;
+   settings_t *settings             = config_get_ptr();
+
+   *res = SZ_ERROR_READ;
+   if (!sevenzip_stat(path, &mtime, &size))
+      return NULL;
+
+   sevenzip_cache_lock();
+   sevenzip_cache.limit = (uint64_t)settings->archive_7z_cache_size << 20;
+   archive = sevenzip_cache.archive;
+   if (archive && !strcmp(archive->path, path)
+         && archive->mtime == mtime && archive->size == size)
+   {
+      archive->refs++;
+      sevenzip_cache_unlock();
+      *res = SZ_OK;
+      return archive;
+   }
+   sevenzip_cache_unlock();
+
+   if (sevenzip_open(path, &archive_stream, &look_stream) != SZ_OK)
+      return NULL;
+
+   archive = (struct sevenzip_archive*)calloc(1, sizeof(*archive));
+   if (!archive)
+   {
+      File_Close(&archive_stream.file);
+      *res = SZ_ERROR_MEM;
+      return NULL;
+   }
+
+   strlcpy(archive->path, path, sizeof(archive->path));
+   archive->mtime = mtime;
+   archive->size  = size;
+
+   CrcGenerateTable();
+   SzArEx_Init(&archive->db);
+   *res = SzArEx_Open(&archive->db, &look_stream.s, &g_Alloc, &g_AllocTemp);
+   File_Close(&archive_stream.file);
+
+   if (*res != SZ_OK)
+   {
+      SzArEx_Free(&archive->db, &g_Alloc);
+      free(archive);
+      return NULL;
+   }
+
+   /* One reference for the cache, one for the caller. */
+   archive->refs = 2;
+
+   sevenzip_cache_lock();
+   sevenzip_cache_clear();
+   sevenzip_archive_release(sevenzip_cache.archive);
+   sevenzip_cache.archive = archive;
+   sevenzip_cache_unlock();
+
+   return archive;
+}
+
+/* Decodes a whole folder with a stream of its own, so that several
+ * folders of one archive can be decoded at the same time. */
+static SRes sevenzip_decode_folder(struct sevenzip_archive *archive,
+      uint32_t folder, uint8_t **data, size_t *size)
+{
+   CFileInStream archive_stream;
+   CLookToRead look_stream;
+   uint32_t block_index = 0xFFFFFFFF;
+   size_t offset        = 0;
+   size_t processed     = 0;
+   SRes res             = sevenzip_open(archive->path,
+         &archive_stream, &look_stream);
+
+   *data = NULL;
+   *size = 0;
+
+   if (res != SZ_OK)
+      return res;
+
+   res = SzArEx_Extract(&archive->db, &look_stream.s,
+         archive->db.FolderStartFileIndex[folder], &block_index,
+         data, size, &offset, &processed, &g_Alloc, &g_AllocTemp);
+   File_Close(&archive_stream.file);
+
+   /* An empty folder would be decoded again on every extraction. */
+   if (res == SZ_OK && !*data)
+      res = SZ_ERROR_DATA;
+
+   if (res != SZ_OK)
+   {
+      IAlloc_Free(&g_Alloc, *data);
+      *data = NULL;
+   }
+
+   return res;
+}
+
+#ifdef HAVE_THREADS
+struct sevenzip_prefetch
+{
+   struct sevenzip_archive *archive;
+   uint32_t folders[SEVENZIP_CACHE_BLOCKS];
+   unsigned num_folders;
+   unsigned next;
+   unsigned threads;
+};
+
+static void sevenzip_prefetch_thread(void *userdata)
+{
+   struct sevenzip_prefetch *prefetch = (struct sevenzip_prefetch*)userdata;
+
+   sevenzip_cache_lock();
+
+   while (prefetch->next < prefetch->num_folders)
+   {
+      uint8_t *data  = NULL;
+      size_t size    = 0;
+      uint32_t folder = prefetch->folders[prefetch->next++];
+
+      /* Skip folders that are cached, being decoded by someone else
+       * or no longer wanted since another archive was opened. */
+      if (sevenzip_cache_find(prefetch->archive, folder)
+            || !sevenzip_cache_add(prefetch->archive, folder))
+         continue;
+
+      sevenzip_cache_unlock();
+      sevenzip_decode_folder(prefetch->archive, folder, &data, &size);
+      sevenzip_cache_lock();
+
+      if (!sevenzip_cache_publish(prefetch->archive, folder, data))
+         IAlloc_Free(&g_Alloc, data);
+   }
+
+   if (!--prefetch->threads)
+   {
+      sevenzip_archive_release(prefetch->archive);
+      free(prefetch);
+   }
+
+   sevenzip_cache_unlock();
+}
+
+/* Decodes the given folders in the background, on as many threads as
+ * there are cores, up to SEVENZIP_MAX_THREADS. */
+static void sevenzip_prefetch(struct sevenzip_archive *archive,
+      const uint32_t *folders, unsigned num_folders)
+{
+   unsigned i;
+   unsigned threads                   = min(rarch_get_cpu_cores(),
+         SEVENZIP_MAX_THREADS);
+   struct sevenzip_prefetch *prefetch = NULL;
+
+   if (!num_folders)
+      return;
+
+   prefetch = (struct sevenzip_prefetch*)calloc(1, sizeof(*prefetch));
+   if (!prefetch)
+      return;
+
+   threads               = min(max(threads, 1), num_folders);
+   prefetch->archive     = archive;
+   prefetch->num_folders = num_folders;
+   memcpy(prefetch->folders, folders, num_folders * sizeof(*folders));
+
+   sevenzip_cache_lock();
+   archive->refs++;
+
+   for (i = 0; i < threads; i++)
+   {
+      sthread_t *thread = NULL;
+
+      prefetch->threads++;
+      thread = sthread_create(sevenzip_prefetch_thread, prefetch);
+      if (!thread)
+      {
+         prefetch->threads--;
+         break;
+      }
+      sthread_detach(thread);
+   }
+
+   if (!prefetch->threads)
+   {
+      sevenzip_archive_release(archive);
+      free(prefetch);
+   }
+   sevenzip_cache_unlock();
+}
+#endif
+
+static SRes sevenzip_file_name(const CSzArEx *db, uint32_t i,
+      uint16_t **temp, size_t *temp_size, char *infile)
+{
+   size_t len = SzArEx_GetFileNameUtf16(db, i, NULL);
+
+   infile[0] = '\0';
+
+   if (len > *temp_size)
+   {
+      free(*temp);
+      *temp_size = len;
+      *temp      = (uint16_t *)malloc(len * sizeof(**temp));
+      if (!*temp)
+      {
+         *temp_size = 0;
+         return SZ_ERROR_MEM;
+      }
+   }
+
+   SzArEx_GetFileNameUtf16(db, i, *temp);
+   return ConvertUtf16toCharString(*temp, infile);
+}
+
 /* Extract the relative path relative_path from a 7z archive 
  * archive_path and allocate a buf for it to write it in.
  * If optional_outfile is set, extract to that instead and don't alloc buffer.
@@ -186,25 +631,16 @@ int read_7zip_file(
       const char *relative_path, void **buf,
       const char *optional_outfile)
 {
-   CFileInStream archiveStream;
-   CLookToRead lookStream;
-   CSzArEx db;
+   struct sevenzip_archive *archive = NULL;
    SRes res;
-   ISzAlloc allocImp;
-   ISzAlloc allocTempImp;
+   uint32_t i;
    uint16_t *temp  = NULL;
    size_t tempSize = 0;
    long outsize    = -1;
    bool file_found = false;
 
-   /*These are the allocation routines.
-    * Currently using the non-standard 7zip choices. */
-   allocImp.Alloc     = SzAlloc;
-   allocImp.Free      = SzFree;
-   allocTempImp.Alloc = SzAllocTemp;
-   allocTempImp.Free  = SzFreeTemp;
-
-   if (InFile_Open(&archiveStream.file, archive_path))
+   archive = sevenzip_archive_get(archive_path, &res);
+   if (!archive)
    {
       RARCH_ERR("Could not open %s as 7z archive\n.",archive_path);
       return -1;
@@ -215,103 +651,126 @@ int read_7zip_file(
             archive_path,relative_path);
    }
 
-   FileInStream_CreateVTable(&archiveStream);
-   LookToRead_CreateVTable(&lookStream, False);
-   lookStream.realStream = &archiveStream.s;
-   LookToRead_Init(&lookStream);
-   CrcGenerateTable();
-   SzArEx_Init(&db);
-   res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
-
-   if (res == SZ_OK)
+   for (i = 0; i < archive->db.db.NumFiles; i++)
    {
-      uint32_t i;
-      uint32_t blockIndex  = 0xFFFFFFFF;
-      uint8_t *outBuffer   = 0;
-      size_t outBufferSize = 0;
+      char infile[PATH_MAX_LENGTH];
+
+      if (archive->db.db.Files[i].IsDir)
+         continue;
 
-      for (i = 0; i < db.db.NumFiles; i++)
+      res = sevenzip_file_name(&archive->db, i, &temp, &tempSize, infile);
+      if (res == SZ_ERROR_MEM)
+         break;
+
+      if (!strcmp(infile, relative_path))
       {
-         size_t len;
-         char infile[PATH_MAX_LENGTH];
-         size_t offset           = 0;
-         size_t outSizeProcessed = 0;
-         const CSzFileItem    *f = db.db.Files + i;
+         file_found = true;
+         break;
+      }
+   }
+   free(temp);
 
-         infile[0] = '\0';
+   if (file_found && res == SZ_OK)
+   {
+      /* C LZMA SDK does not support chunked extraction - see here:
+       * sourceforge.net/p/sevenzip/discussion/45798/thread/6fb59aaf/
+       * so the whole folder holding the file is decoded, or taken
+       * from the cache. */
+      struct sevenzip_block *block = NULL;
+      uint32_t folder          = archive->db.FileIndexToFolderIndexMap[i];
+      uint32_t blockIndex      = folder;
+      uint8_t *outBuffer       = NULL;
+      size_t outBufferSize     = 0;
+      size_t offset            = 0;
+      size_t outSizeProcessed  = 0;
+      bool reserved            = false;
+
+      sevenzip_cache_lock();
+
+      /* Wait for a thread that is already decoding this folder. */
+      while ((block = sevenzip_cache_find(archive, folder)) && !block->ready)
+         sevenzip_cache_wait();
+
+      if (block)
+      {
+         /* The lock is held until the data has been copied out,
+          * so the block cannot be evicted under us. */
+         block->last_used = ++sevenzip_cache.clock;
+         outBuffer        = block->data;
+         outBufferSize    = block->size;
+      }
+      else
+      {
+         if (folder != (uint32_t)-1)
+            reserved = sevenzip_cache_add(archive, folder);
+         sevenzip_cache_unlock();
 
-         if (f->IsDir)
-         {
-            /* We skip over everything which is not a directory. 
-             * FIXME: Why continue then if f->IsDir is true?*/
-            continue;
-         }
+         if (folder != (uint32_t)-1)
+            res = sevenzip_decode_folder(archive, folder,
+                  &outBuffer, &outBufferSize);
+      }
 
-         len = SzArEx_GetFileNameUtf16(&db, i, NULL);
-         if (len > tempSize)
-         {
-            free(temp);
-            tempSize = len;
-            temp = (uint16_t *)malloc(tempSize * sizeof(temp[0]));
-            if (temp == 0)
-            {
-               res = SZ_ERROR_MEM;
-               break;
-            }
-         }
-         SzArEx_GetFileNameUtf16(&db, i, temp);
-         res = ConvertUtf16toCharString(temp,infile);
+      /* With the folder in outBuffer this only finds the file
+       * in it and checks its CRC. */
+      if (res == SZ_OK)
+         res = SzArEx_Extract(&archive->db, NULL, i, &blockIndex,
+               &outBuffer, &outBufferSize, &offset, &outSizeProcessed,
+               &g_Alloc, &g_AllocTemp);
 
-         if (!strcmp(infile, relative_path))
+      if (res == SZ_OK)
+      {
+         outsize = outSizeProcessed;
+         if (optional_outfile != NULL)
          {
-            /* C LZMA SDK does not support chunked extraction - see here:
-             * sourceforge.net/p/sevenzip/discussion/45798/thread/6fb59aaf/
-             * */
-            file_found = true;
-            res = SzArEx_Extract(&db, &lookStream.s, i,&blockIndex,
-                  &outBuffer, &outBufferSize,&offset, &outSizeProcessed,
-                  &allocImp, &allocTempImp);
-            if (res != SZ_OK)
+            FILE* outsink = fopen(optional_outfile,"wb");
+            if (outsink == NULL)
             {
-               break; /* This goes to the error section. */
+               RARCH_ERR("Could not open outfilepath %s.\n",
+                     optional_outfile);
+               outsize = -1;
             }
-            outsize = outSizeProcessed;
-            if (optional_outfile != NULL)
+            else
             {
-               FILE* outsink = fopen(optional_outfile,"wb");
-               if (outsink == NULL)
-               {
-                  RARCH_ERR("Could not open outfilepath %s.\n",
-                        optional_outfile);
-                  IAlloc_Free(&allocImp, outBuffer);
-                  SzArEx_Free(&db, &allocImp);
-                  free(temp);
-                  File_Close(&archiveStream.file);
-                  return -1;
-               }
                fwrite(outBuffer+offset,1,outsize,outsink);
                fclose(outsink);
             }
-            else
-            {
-               /*We could either use the 7Zip allocated buffer,
-                * or create our own and use it.
-                * We would however need to realloc anyways, because RetroArch
-                * expects a \0 at the end, therefore we allocate new,
-                * copy and free the old one. */
-               *buf = malloc(outsize + 1);
-               ((char*)(*buf))[outsize] = '\0';
-               memcpy(*buf,outBuffer+offset,outsize);
-            }
-            IAlloc_Free(&allocImp, outBuffer);
-            break;
          }
+         else
+         {
+            /*We could either use the 7Zip allocated buffer,
+             * or create our own and use it.
+             * We would however need to realloc anyways, because RetroArch
+             * expects a \0 at the end, therefore we allocate new,
+             * copy and free the old one. */
+            *buf = malloc(outsize + 1);
+            ((char*)(*buf))[outsize] = '\0';
+            memcpy(*buf,outBuffer+offset,outsize);
+         }
+      }
+
+      if (block)
+         sevenzip_cache_unlock();
+      else
+      {
+         sevenzip_cache_lock();
+         if (!reserved || !sevenzip_cache_publish(archive, folder,
+                  res == SZ_OK ? outBuffer : NULL))
+            IAlloc_Free(&g_Alloc, outBuffer);
+         sevenzip_cache_unlock();
+      }
+
+      if (res == SZ_OK && outsize < 0)
+      {
+         sevenzip_cache_lock();
+         sevenzip_archive_release(archive);
+         sevenzip_cache_unlock();
+         return -1;
       }
    }
-   SzArEx_Free(&db, &allocImp);
-   free(temp);
 
-   File_Close(&archiveStream.file);
+   sevenzip_cache_lock();
+   sevenzip_archive_release(archive);
+   sevenzip_cache_unlock();
 
    if (res == SZ_OK && file_found == true)
       return outsize;
@@ -333,15 +792,16 @@ int read_7zip_file(
 struct string_list *compressed_7zip_file_list_new(const char *path,
       const char* ext)
 {
-   CFileInStream archiveStream;
-   CLookToRead lookStream;
-   CSzArEx db;
+   struct sevenzip_archive *archive = NULL;
    SRes res;
-   ISzAlloc allocImp;
-   ISzAlloc allocTempImp;
+   uint32_t i;
    uint16_t *temp               = NULL;
    size_t tempSize              = 0;
-   long outsize                 = -1;
+#ifdef HAVE_THREADS
+   uint32_t folders[SEVENZIP_CACHE_BLOCKS];
+   unsigned num_folders         = 0;
+   uint64_t folders_size        = 0;
+#endif
 
    struct string_list *ext_list = NULL;
    struct string_list     *list = string_list_new();
@@ -352,100 +812,75 @@ struct string_list *compressed_7zip_file_list_new(const char *path,
    if (ext)
       ext_list = string_split(ext, "|");
 
-   (void)outsize;
-
-   /* These are the allocation routines - currently using 
-    * the non-standard 7zip choices. */
-   allocImp.Alloc     = SzAlloc;
-   allocImp.Free      = SzFree;
-   allocTempImp.Alloc = SzAllocTemp;
-   allocTempImp.Free  = SzFreeTemp;
-
-   if (InFile_Open(&archiveStream.file, path))
+   archive = sevenzip_archive_get(path, &res);
+   if (!archive)
    {
-      RARCH_ERR("Could not open %s as 7z archive.\n",path);
+      if (res == SZ_ERROR_READ)
+         RARCH_ERR("Could not open %s as 7z archive.\n",path);
       goto error;
    }
 
-   FileInStream_CreateVTable(&archiveStream);
-   LookToRead_CreateVTable(&lookStream, False);
-   lookStream.realStream = &archiveStream.s;
-   LookToRead_Init(&lookStream);
-   CrcGenerateTable();
-   SzArEx_Init(&db);
-   res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
-
-   if (res == SZ_OK)
+   for (i = 0; i < archive->db.db.NumFiles; i++)
    {
-      uint32_t i;
-      uint32_t blockIndex  = 0xFFFFFFFF;
-      uint8_t *outBuffer   = 0;
-      size_t outBufferSize = 0;
+      union string_list_elem_attr attr;
+      const char *file_ext         = NULL;
+      char infile[PATH_MAX_LENGTH];
+      bool supported_by_core       = false;
 
-      (void)blockIndex;
-      (void)outBufferSize;
-      (void)outBuffer;
-
-      for (i = 0; i < db.db.NumFiles; i++)
+      if (archive->db.db.Files[i].IsDir)
       {
-         union string_list_elem_attr attr;
-         const char *file_ext         = NULL;
-         char infile[PATH_MAX_LENGTH];
-         size_t offset                = 0;
-         size_t outSizeProcessed      = 0;
-         size_t                   len = 0;
-         bool supported_by_core       = false;
-         const CSzFileItem         *f = db.db.Files + i;
+         /* we skip over everything, which is a directory. */
+         continue;
+      }
 
-         (void)offset;
-         (void)outSizeProcessed;
+      res = sevenzip_file_name(&archive->db, i, &temp, &tempSize, infile);
+      if (res == SZ_ERROR_MEM)
+         break;
+      file_ext = path_get_extension(infile);
 
-         infile[0] = '\0';
+      if (string_list_find_elem_prefix(ext_list, ".", file_ext))
+         supported_by_core = true;
 
-         if (f->IsDir)
-         {
-            /* we skip over everything, which is a directory. */
-            continue;
-         }
-         len = SzArEx_GetFileNameUtf16(&db, i, NULL);
-         if (len > tempSize)
-         {
-            free(temp);
-            tempSize = len;
-            temp     = (uint16_t *)malloc(tempSize * sizeof(temp[0]));
+      /*
+       * Currently we only support files without subdirs in the archives.
+       * Folders are not supported (differences between win and lin.
+       * Archives within archives should imho never be supported.
+       */
 
-            if (temp == 0)
-            {
-               res = SZ_ERROR_MEM;
-               break;
-            }
-         }
-         SzArEx_GetFileNameUtf16(&db, i, temp);
-         res      = ConvertUtf16toCharString(temp, infile);
-         file_ext = path_get_extension(infile);
+      if (!supported_by_core)
+         continue;
 
-         if (string_list_find_elem_prefix(ext_list, ".", file_ext))
-            supported_by_core = true;
+      attr.i = RARCH_COMPRESSED_FILE_IN_ARCHIVE;
 
-         /*
-          * Currently we only support files without subdirs in the archives.
-          * Folders are not supported (differences between win and lin.
-          * Archives within archives should imho never be supported.
-          */
+      if (!string_list_append(list, infile, attr))
+         goto error;
 
-         if (!supported_by_core)
-            continue;
+#ifdef HAVE_THREADS
+      {
+         /* Queue the folder of each listed file for decoding, as long
+          * as they all fit in the cache together. */
+         unsigned j;
+         uint32_t folder = archive->db.FileIndexToFolderIndexMap[i];
 
-         attr.i = RARCH_COMPRESSED_FILE_IN_ARCHIVE;
+         if (folder == (uint32_t)-1 || num_folders == SEVENZIP_CACHE_BLOCKS)
+            continue;
 
-         if (!string_list_append(list, infile, attr))
-            goto error;
+         for (j = 0; j < num_folders; j++)
+            if (folders[j] == folder)
+               break;
 
+         if (j == num_folders && folders_size + SzFolder_GetUnpackSize(
+                  archive->db.db.Folders + folder) <= sevenzip_cache.limit)
+         {
+            folders_size += SzFolder_GetUnpackSize(
+                  archive->db.db.Folders + folder);
+            folders[num_folders++] = folder;
+         }
       }
+#endif
    }
-   SzArEx_Free(&db, &allocImp);
    free(temp);
-   File_Close(&archiveStream.file);
+   temp = NULL;
 
    if (res != SZ_OK)
    {
@@ -463,17 +898,38 @@ struct string_list *compressed_7zip_file_list_new(const char *path,
       goto error;
    }
 
+#ifdef HAVE_THREADS
+   sevenzip_prefetch(archive, folders, num_folders);
+#endif
+
+   sevenzip_cache_lock();
+   sevenzip_archive_release(archive);
+   sevenzip_cache_unlock();
+
    string_list_free(ext_list);
    return list;
 
 error:
    RARCH_ERR("Failed to open compressed_file: \"%s\"\n", path);
-   SzArEx_Free(&db, &allocImp);
+   if (archive)
+   {
+      sevenzip_cache_lock();
+      sevenzip_archive_release(archive);
+      sevenzip_cache_unlock();
+   }
    free(temp);
-   File_Close(&archiveStream.file);
    string_list_free(list);
    string_list_free(ext_list);
    return NULL;
 }
 
+void compressed_7zip_cache_free(void)
+{
+   sevenzip_cache_lock();
+   sevenzip_cache_clear();
+   sevenzip_archive_release(sevenzip_cache.archive);
+   sevenzip_cache.archive = NULL;
+   sevenzip_cache_unlock();
+}
+
 #undef RARCH_ZIP_SUPPORT_BUFFER_SIZE_MAX
@@ -27,6 +27,9 @@ int read_7zip_file(const char * archive_path,
 struct string_list *compressed_7zip_file_list_new(const char *path,
       const char* ext);
 
+/* Frees the folders kept decoded in memory between calls. */
+void compressed_7zip_cache_free(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -112,6 +112,7 @@ enum
    RARCH_FAST_FORWARD_HOLD_KEY,
    RARCH_SLOWMOTION,
    RARCH_REWIND,
+   RARCH_REWIND_SEEK,
    RARCH_PAUSE_TOGGLE,
    RARCH_FRAMEADVANCE,
    RARCH_SHOW_FPS_TOGGLE,
@@ -156,6 +157,7 @@ enum
    | UINT64_C(1) << RARCH_STATE_SLOT_MINUS \
    | UINT64_C(1) << RARCH_SHOW_FPS_TOGGLE \
    | UINT64_C(1) << RARCH_REWIND \
+   | UINT64_C(1) << RARCH_REWIND_SEEK \
    | UINT64_C(1) << RARCH_PAUSE_TOGGLE \
    | UINT64_C(1) << RARCH_FRAMEADVANCE \
    | UINT64_C(1) << RARCH_RESET \
@@ -272,6 +274,7 @@ typedef struct driver
    void *recording_data;
    void *netplay_data;
    void *preempt_data;
+   void *runahead_data;
    void *ui_companion_data;
 
    bool audio_active;
@@ -20,6 +20,7 @@
 #include "retroarch_logger.h"
 #include "performance.h"
 #include "preempt.h"
+#include "runahead.h"
 #include <file/file_path.h>
 #include <string.h>
 #include <ctype.h>
@@ -297,6 +298,13 @@ void core_set_controller_port_device(unsigned port, unsigned device)
    pretro_set_controller_port_device(port,
          device == RETRO_DEVICE_KEYBOARD_DEFAULT
          ? RETRO_DEVICE_NONE : device);
+
+   preempt_set_controller_port_device(
+         (preempt_t*)driver_get_ptr()->preempt_data, port, device);
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+   runahead_set_controller_port_device(
+         (runahead_t*)driver_get_ptr()->runahead_data, port, device);
+#endif
 }
 
 /**
@@ -1201,10 +1209,17 @@ bool rarch_environment_cb(unsigned cmd, void *data)
 
          if (preempt_in_preframe(driver->preempt_data))
          {
+            /* Speculative branches hand states between instances. */
             global->savestate_context = settings->preempt_fast_savestates
+                  && !settings->preempt_speculate
                   ? RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE
                   : RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_BINARY;
          }
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+         else if (runahead_in_serialize(driver->runahead_data))
+            global->savestate_context =
+                  RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_BINARY;
+#endif
 #ifdef HAVE_NETPLAY
          else if (netplay_use_rollback_states(driver->netplay_data))
             global->savestate_context = RETRO_SAVESTATE_CONTEXT_ROLLBACK_NETPLAY;
@@ -24,6 +24,11 @@
 #include <compat/strl.h>
 #include <compat/posix_string.h>
 #include <retro_miscellaneous.h>
+#include <rhash.h>
+
+/* Read size when checksumming a file while it's read, small
+ * enough that each chunk is still in the cache for the CRC. */
+#define READ_CRC32_CHUNK_SIZE (256 * 1024)
 
 #ifdef HAVE_COMPRESSION
 #include <file/file_extract.h>
@@ -32,9 +37,18 @@
 
 #define RZIP_VERSION 1
 #define RZIP_COMPRESSION_LEVEL 6
+#define RZIP_FAST_COMPRESSION_LEVEL 1
 #define RZIP_DEFAULT_CHUNK_SIZE 131072
 #define RZIP_HEADER_SIZE 20
 #define RZIP_CHUNK_HEADER_SIZE 4
+/* Chunks are (de)compressed on up to this many threads. */
+#define RZIP_MAX_THREADS 8
+/* Compressed chunks held back for the writer, per thread. */
+#define RZIP_CHUNKS_PER_THREAD 2
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
 #endif
 
 #ifdef HAVE_7ZIP
@@ -69,6 +83,13 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 /**
  * write_file:
  * @path             : path to file.
@@ -91,17 +112,72 @@ bool write_file(const char *path, const void *data, ssize_t size)
    return ret;
 }
 
+/**
+ * write_file_atomic:
+ * @path             : path to file.
+ * @data             : contents to write to the file.
+ * @size             : size of the contents.
+ *
+ * Writes data to a temporary file next to @path, flushes it to disk
+ * and then renames it over @path, so that a crash or power loss
+ * leaves either the old or the new contents behind.
+ *
+ * Returns: true (1) on success, false (0) otherwise.
+ */
+bool write_file_atomic(const char *path, const void *data, ssize_t size)
+{
+   char tmp_path[PATH_MAX_LENGTH];
+   bool ret   = false;
+   FILE *file = NULL;
+
+   snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+   file = fopen(tmp_path, "wb");
+   if (!file)
+      return false;
+
+   ret  = fwrite(data, 1, size, file) == size;
+   ret &= fflush(file) == 0;
+#if defined(_WIN32) && !defined(_XBOX)
+   ret &= _commit(_fileno(file)) == 0;
+#elif !defined(_WIN32) && !defined(__CELLOS_LV2__) && !defined(GEKKO) && !defined(PSP) && !defined(_3DS)
+   ret &= fsync(fileno(file)) == 0;
+#endif
+   ret &= fclose(file) == 0;
+
+   if (ret)
+   {
+#if defined(_WIN32) && !defined(_XBOX)
+      ret = MoveFileExA(tmp_path, path,
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+      /* rename() only replaces an existing file on POSIX. */
+#if defined(_XBOX) || defined(__CELLOS_LV2__) || defined(GEKKO) || defined(PSP) || defined(_3DS)
+      remove(path);
+#endif
+      ret = rename(tmp_path, path) == 0;
+#endif
+   }
+
+   if (!ret)
+      remove(tmp_path);
+
+   return ret;
+}
+
 /**
  * read_generic_file:
  * @path             : path to file.
  * @buf              : buffer to allocate and read the contents of the
  *                     file into. Needs to be freed manually.
+ * @crc              : if not NULL, receives the CRC32 of what was read.
  *
  * Read the contents of a file into @buf.
  *
  * Returns: number of items read, -1 on error.
  */
-static int read_generic_file(const char *path, void **buf, ssize_t *len)
+static int read_generic_file(const char *path, void **buf, ssize_t *len,
+      uint32_t *crc)
 {
    long ret                 = 0;
    ssize_t content_buf_size = 0;
@@ -125,7 +201,25 @@ static int read_generic_file(const char *path, void **buf, ssize_t *len)
    if (!content_buf)
       goto error;
 
-   if ((ret = fread(content_buf, 1, content_buf_size, file)) < content_buf_size)
+   if (crc)
+   {
+      /* Checksum each chunk right after reading it
+       * rather than going over the whole file again. */
+      size_t chunk;
+
+      *crc = 0;
+      while (ret < content_buf_size && (chunk = fread(
+                  (uint8_t*)content_buf + ret, 1, min(READ_CRC32_CHUNK_SIZE,
+                     content_buf_size - ret), file)) > 0)
+      {
+         *crc = crc32_update(*crc, (uint8_t*)content_buf + ret, chunk);
+         ret += chunk;
+      }
+   }
+   else
+      ret = fread(content_buf, 1, content_buf_size, file);
+
+   if (ret < content_buf_size)
       RARCH_WARN("Didn't read whole file.\n");
 
    *buf    = content_buf;
@@ -157,9 +251,10 @@ error:
 /* Generic compressed file loader.
  * Extracts to buf, unless optional_filename != 0
  * Then extracts to optional_filename and leaves buf alone.
+ * If crc is not NULL, it receives the CRC32 of buf.
  */
-int read_compressed_file(const char * path, void **buf,
-      const char* optional_filename, ssize_t *length)
+static int read_compressed_file_crc32(const char * path, void **buf,
+      const char* optional_filename, ssize_t *length, uint32_t *crc)
 {
    const char* file_ext               = NULL;
    char *archive_found                = NULL;
@@ -210,19 +305,46 @@ int read_compressed_file(const char * path, void **buf,
    {
       *length = read_7zip_file(archive_path,archive_found,buf,optional_filename);
       if (*length != -1)
+      {
+         if (crc && !optional_filename)
+            *crc = crc32_update(0, *buf, *length);
          return 1;
+      }
    }
 #endif
 #ifdef HAVE_ZLIB
    if (strcasecmp(file_ext,"zip") == 0)
    {
+      size_t size = 0;
+
+      /* Inflate straight into memory, checksumming as it goes.
+       * Archives the simple parser can't handle, or won't read
+       * whole, go through minizip. */
+      if (!optional_filename && zlib_extract_content_to_memory(
+               archive_path, archive_found, NULL, buf, &size, crc))
+      {
+         *length = size;
+         return 1;
+      }
+
       *length = read_zip_file(archive_path,archive_found,buf,optional_filename);
       if (*length != -1)
+      {
+         if (crc && !optional_filename)
+            *crc = crc32_update(0, *buf, *length);
          return 1;
+      }
    }
 #endif
    return 0;
 }
+
+int read_compressed_file(const char * path, void **buf,
+      const char* optional_filename, ssize_t *length)
+{
+   return read_compressed_file_crc32(path, buf, optional_filename,
+         length, NULL);
+}
 #endif
 
 /**
@@ -246,9 +368,101 @@ int read_file(const char *path, void **buf, ssize_t *length)
          return 1;
    }
 #endif
-   return read_generic_file(path, buf, length);
+   return read_generic_file(path, buf, length, NULL);
 }
 
+/**
+ * read_file_crc32:
+ * @path             : path to file.
+ * @buf              : buffer to allocate and read the contents of the
+ *                     file into. Needs to be freed manually.
+ * @length           : Number of items read, -1 on error.
+ * @crc              : receives the CRC32 of the contents.
+ *
+ * Same as read_file, but also checksums the contents. Plain files
+ * are checksummed chunk by chunk as they are read, and ZIP members
+ * as they are inflated.
+ *
+ * Returns: 1 if file read, 0 on error.
+ */
+int read_file_crc32(const char *path, void **buf, ssize_t *length,
+      uint32_t *crc)
+{
+#ifdef HAVE_COMPRESSION
+   if (path_contains_compressed_file(path))
+   {
+      if (read_compressed_file_crc32(path, buf, NULL, length, crc))
+         return 1;
+   }
+#endif
+   return read_generic_file(path, buf, length, crc);
+}
+
+#ifdef HAVE_MMAP
+/**
+ * map_file:
+ * @path             : path to file.
+ * @length           : receives the size of the file.
+ *
+ * Maps a file copy-on-write. Pages are only read in as they are
+ * touched, and are shared with the page cache until written to.
+ * Like a buffer from read_file, the mapping is followed by a '\0',
+ * so files that end on a page boundary are not mapped.
+ *
+ * Returns: the mapping, or NULL if the file could not be mapped.
+ */
+void *map_file(const char *path, ssize_t *length)
+{
+   struct stat st;
+   void *data = NULL;
+   int fd     = open(path, O_RDONLY);
+
+   if (fd < 0)
+      return NULL;
+
+   /* The rest of the last page reads as zeroes, which is the
+    * terminator. A file that fills it has no room for one. */
+   if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+         && st.st_size % sysconf(_SC_PAGESIZE))
+   {
+      data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED)
+         data = NULL;
+      else
+         *length = st.st_size;
+   }
+
+   close(fd);
+   return data;
+}
+
+/**
+ * unmap_file:
+ * @data             : mapping returned by map_file.
+ * @length           : size of the mapping.
+ *
+ * Unmaps a file mapped with map_file.
+ */
+void unmap_file(void *data, ssize_t length)
+{
+   munmap(data, length);
+}
+#else
+void *map_file(const char *path, ssize_t *length)
+{
+   (void)path;
+   (void)length;
+   return NULL;
+}
+
+void unmap_file(void *data, ssize_t length)
+{
+   (void)data;
+   (void)length;
+}
+#endif
+
 struct string_list *compressed_file_list_new(const char *path,
       const char* ext)
 {
@@ -379,34 +593,266 @@ static bool read_rzip_file_header(FILE *file,
 }
 #endif /* HAVE_COMPRESSION */
 
+#ifdef HAVE_COMPRESSION
+struct rzip_chunk
+{
+   const uint8_t *in;
+   uint8_t *out;
+   uint32_t in_size;
+   /* Room in out, then how much of it was filled. */
+   uint32_t out_size;
+   bool done;
+};
+
+/* Chunks are independent zlib streams, so they are handed out in
+ * order to a few threads, and the calling thread picks up chunks
+ * as well while it waits for the next one it needs. */
+struct rzip_pool
+{
+#ifdef HAVE_THREADS
+   slock_t *lock;
+   scond_t *cond;
+   sthread_t *threads[RZIP_MAX_THREADS - 1];
+#endif
+   unsigned num_threads;
+   struct rzip_chunk *chunks;
+   size_t num_chunks;
+   /* Next chunk to hand out. */
+   size_t next;
+   /* Chunks from here on wait until earlier ones are written. */
+   size_t limit;
+   /* Deflate level, or -1 to inflate. */
+   int level;
+   bool failed;
+};
+
+static void rzip_pool_lock(struct rzip_pool *pool)
+{
+#ifdef HAVE_THREADS
+   if (pool->lock)
+      slock_lock(pool->lock);
+#endif
+}
+
+static void rzip_pool_unlock(struct rzip_pool *pool)
+{
+#ifdef HAVE_THREADS
+   if (pool->lock)
+      slock_unlock(pool->lock);
+#endif
+}
+
+static void rzip_pool_signal(struct rzip_pool *pool)
+{
+#ifdef HAVE_THREADS
+   if (pool->cond)
+      scond_broadcast(pool->cond);
+#endif
+}
+
+static void *rzip_stream_new(int level)
+{
+   void *stream = zlib_stream_new();
+
+   if (!stream)
+      return NULL;
+
+   if (level >= 0)
+      zlib_deflate_init(stream, level);
+   else if (!zlib_inflate_init(stream))
+   {
+      free(stream);
+      return NULL;
+   }
+
+   return stream;
+}
+
+static void rzip_stream_free(void *stream, int level)
+{
+   if (!stream)
+      return;
+
+   if (level >= 0)
+      zlib_stream_deflate_free(stream);
+   else
+      zlib_stream_inflate_free(stream);
+   free(stream);
+}
+
+static bool rzip_chunk_process(void *stream, int level,
+      struct rzip_chunk *chunk)
+{
+   zlib_set_stream(stream, chunk->in_size, chunk->out_size,
+         chunk->in, chunk->out);
+
+   if (level >= 0)
+   {
+      if (zlib_deflate(stream) != 1)
+         return false;
+      chunk->out_size = zlib_stream_get_total_out(stream);
+      zlib_stream_deflate_reset(stream);
+   }
+   else
+   {
+      if (zlib_inflate(stream) != 1)
+         return false;
+      chunk->out_size = zlib_stream_get_total_out(stream);
+      zlib_stream_inflate_reset(stream);
+   }
+
+   return true;
+}
+
+/**
+ * rzip_pool_work:
+ * @pool             : chunks to process.
+ * @stream           : zlib stream of the calling thread.
+ * @wait_for         : chunk to return after, or NULL to work
+ *                     until every chunk is handed out.
+ *
+ * Returns: false if a chunk failed to (de)compress.
+ */
+static bool rzip_pool_work(struct rzip_pool *pool, void *stream,
+      const struct rzip_chunk *wait_for)
+{
+   bool ret;
+
+   rzip_pool_lock(pool);
+
+   while (!pool->failed && !(wait_for && wait_for->done))
+   {
+      if (pool->next < pool->limit)
+      {
+         bool ok;
+         struct rzip_chunk *chunk = &pool->chunks[pool->next++];
+
+         rzip_pool_unlock(pool);
+         ok = stream && rzip_chunk_process(stream, pool->level, chunk);
+         rzip_pool_lock(pool);
+
+         chunk->done   = true;
+         pool->failed |= !ok;
+         rzip_pool_signal(pool);
+         continue;
+      }
+
+      if (!wait_for && pool->next >= pool->num_chunks)
+         break;
+
+#ifdef HAVE_THREADS
+      /* Only reached with threads: otherwise the chunk waited
+       * for is always the next one to be handed out. */
+      scond_wait(pool->cond, pool->lock);
+#endif
+   }
+
+   ret = !pool->failed;
+   rzip_pool_unlock(pool);
+
+   return ret;
+}
+
+#ifdef HAVE_THREADS
+static void rzip_pool_thread(void *data)
+{
+   struct rzip_pool *pool = (struct rzip_pool*)data;
+   void *stream           = rzip_stream_new(pool->level);
+
+   if (stream)
+      rzip_pool_work(pool, stream, NULL);
+   rzip_stream_free(stream, pool->level);
+}
+#endif
+
+static void rzip_pool_start(struct rzip_pool *pool)
+{
+#ifdef HAVE_THREADS
+   unsigned i;
+   unsigned threads = rarch_get_cpu_cores();
+
+   if (threads > RZIP_MAX_THREADS)
+      threads = RZIP_MAX_THREADS;
+   if (threads > pool->num_chunks)
+      threads = pool->num_chunks;
+   if (threads < 2)
+      return;
+
+   pool->lock = slock_new();
+   pool->cond = scond_new();
+   if (!pool->lock || !pool->cond)
+      return;
+
+   /* The calling thread is one of them. */
+   for (i = 0; i < threads - 1; i++)
+   {
+      pool->threads[i] = sthread_create(rzip_pool_thread, pool);
+      if (!pool->threads[i])
+         break;
+      pool->num_threads++;
+   }
+#endif
+}
+
+static void rzip_pool_stop(struct rzip_pool *pool)
+{
+#ifdef HAVE_THREADS
+   unsigned i;
+
+   /* Threads still waiting for work give up. */
+   rzip_pool_lock(pool);
+   pool->failed = true;
+   rzip_pool_signal(pool);
+   rzip_pool_unlock(pool);
+
+   for (i = 0; i < pool->num_threads; i++)
+      sthread_join(pool->threads[i]);
+
+   if (pool->lock)
+      slock_free(pool->lock);
+   if (pool->cond)
+      scond_free(pool->cond);
+#endif
+   free(pool->chunks);
+}
+#endif
+
 /**
  * write_rzip_file:
  * @path             : path to file.
  * @data             : contents to compress and write to file.
  * @size             : size of the uncompressed contents.
+ * @fast             : favour speed over size.
+ * @progress         : show progress in the message queue. Only
+ *                     allowed on the main thread.
  *
- * Writes @data to @path in RZIP format.
+ * Writes @data to @path in RZIP format. Chunks are compressed
+ * on several threads when available.
  *
  * Returns: true on success, false otherwise.
  */
-bool write_rzip_file(const char *path, const void *data, uint64_t size)
+bool write_rzip_file(const char *path, const void *data, uint64_t size,
+      bool fast, bool progress)
 {
 #ifdef HAVE_COMPRESSION
+   size_t i;
+   size_t window;
    bool     ret     = false;
    void*    stream  = NULL;
    uint8_t* next_in = (uint8_t*)data;
    uint8_t* buf     = NULL;
    uint8_t  chunk_header[RZIP_CHUNK_HEADER_SIZE];
-   uint32_t chunk_infl_size;
-   uint64_t total_read = 0;
-   uint32_t zlib_defl_size;
+   struct rzip_pool pool;
 
    const uint32_t buf_size = RZIP_DEFAULT_CHUNK_SIZE * 2;
 
    FILE *file = fopen(path, "wb");
 
+   memset(&pool, 0, sizeof(pool));
+
    /* Run .2s before showing progress */
-   print_rzip_progress(0, 0, 150000, NULL);
+   if (progress)
+      print_rzip_progress(0, 0, 150000, NULL);
 
    if (!file)
       return false;
@@ -414,30 +860,62 @@ bool write_rzip_file(const char *path, const void *data, uint64_t size)
    if (!write_rzip_file_header(file, size))
       goto end;
 
-   /* Init zlib stream */
-   stream = zlib_stream_new();
-   buf = malloc(buf_size);
-   if (!buf || !stream)
+   pool.level      = fast ? RZIP_FAST_COMPRESSION_LEVEL
+      : RZIP_COMPRESSION_LEVEL;
+   pool.num_chunks = (size + RZIP_DEFAULT_CHUNK_SIZE - 1)
+      / RZIP_DEFAULT_CHUNK_SIZE;
+   if (pool.num_chunks == 0)
+   {
+      ret = true;
+      goto end;
+   }
+
+   pool.chunks = (struct rzip_chunk*)
+      calloc(pool.num_chunks, sizeof(*pool.chunks));
+   stream      = rzip_stream_new(pool.level);
+   if (!pool.chunks || !stream)
       goto end;
-   zlib_deflate_init(stream, RZIP_COMPRESSION_LEVEL);
 
-   while (total_read < size)
+   rzip_pool_start(&pool);
+
+   /* Compressed chunks wait in a ring of buffers until written. */
+   window = (pool.num_threads + 1) * RZIP_CHUNKS_PER_THREAD;
+   if (window > pool.num_chunks)
+      window = pool.num_chunks;
+
+   buf = (uint8_t*)malloc(window * buf_size);
+   if (!buf)
+      goto end;
+
+   for (i = 0; i < pool.num_chunks; i++)
    {
-      /* Deflate chunk */
-      chunk_infl_size = min(RZIP_DEFAULT_CHUNK_SIZE, size - total_read);
-      zlib_set_stream(stream, chunk_infl_size, buf_size, next_in, buf);
-      if (zlib_deflate(stream) != 1)
+      pool.chunks[i].in       = next_in + i * RZIP_DEFAULT_CHUNK_SIZE;
+      pool.chunks[i].in_size  = min(RZIP_DEFAULT_CHUNK_SIZE,
+            size - i * RZIP_DEFAULT_CHUNK_SIZE);
+      pool.chunks[i].out      = buf + (i % window) * buf_size;
+      pool.chunks[i].out_size = buf_size;
+   }
+
+   rzip_pool_lock(&pool);
+   pool.limit = window;
+   rzip_pool_signal(&pool);
+   rzip_pool_unlock(&pool);
+
+   for (i = 0; i < pool.num_chunks; i++)
+   {
+      struct rzip_chunk *chunk = &pool.chunks[i];
+
+      if (!rzip_pool_work(&pool, stream, chunk))
          goto end;
 
-      zlib_defl_size = zlib_stream_get_total_out(stream);
-      if (zlib_defl_size == 0 || zlib_defl_size > buf_size)
+      if (chunk->out_size == 0 || chunk->out_size > buf_size)
          goto end;
 
       /* Create header */
-      chunk_header[3] = (zlib_defl_size >> 24) & 0xFF;
-      chunk_header[2] = (zlib_defl_size >> 16) & 0xFF;
-      chunk_header[1] = (zlib_defl_size >>  8) & 0xFF;
-      chunk_header[0] =  zlib_defl_size        & 0xFF;
+      chunk_header[3] = (chunk->out_size >> 24) & 0xFF;
+      chunk_header[2] = (chunk->out_size >> 16) & 0xFF;
+      chunk_header[1] = (chunk->out_size >>  8) & 0xFF;
+      chunk_header[0] =  chunk->out_size        & 0xFF;
 
       /* Write header */
       if (fwrite(&chunk_header, 1, RZIP_CHUNK_HEADER_SIZE, file)
@@ -445,24 +923,27 @@ bool write_rzip_file(const char *path, const void *data, uint64_t size)
          goto end;
 
       /* Write chunk */
-      if (fwrite(buf, 1, zlib_defl_size, file) != zlib_defl_size)
+      if (fwrite(chunk->out, 1, chunk->out_size, file) != chunk->out_size)
          goto end;
 
-      /* Setup next */
-      total_read += chunk_infl_size;
-      next_in    += chunk_infl_size;
-      zlib_stream_deflate_reset(stream);
+      /* Its buffer is free for the chunk one window further. */
+      rzip_pool_lock(&pool);
+      pool.limit = min(i + 1 + window, pool.num_chunks);
+      rzip_pool_signal(&pool);
+      rzip_pool_unlock(&pool);
 
       /* Show progress at ~20fps */
-      print_rzip_progress(total_read, size, 50000, "Compressing");
+      if (progress)
+         print_rzip_progress(min((uint64_t)(i + 1) * RZIP_DEFAULT_CHUNK_SIZE,
+               size), size, 50000, "Compressing");
    }
 
    ret = true;
 end:
-   if (stream)
-      zlib_stream_deflate_free(stream);
-   if (file)
-      fclose(file);
+   rzip_pool_stop(&pool);
+   rzip_stream_free(stream, pool.level);
+   if (file && fclose(file) != 0)
+      ret = false;
    if (buf)
       free(buf);
    if (!ret)
@@ -480,28 +961,31 @@ end:
  *                     file into. Needs to be freed manually.
  * @len              : Number of items read. Not updated on failure
  *
- * Decompresses contents from an RZIP file to @buf.
+ * Decompresses contents from an RZIP file to @buf. Chunks are
+ * decompressed on several threads when available.
  *
  * Returns: true if file read, false on error.
  */
 bool read_rzip_file(const char *path, void **buf, ssize_t *len)
 {
 #ifdef HAVE_COMPRESSION
+   size_t i;
    bool     ret       = false;
    void*    stream    = NULL;
-   uint32_t file_size = 0;
+   long     file_size = 0;
+   size_t   defl_size = 0;
+   size_t   pos       = 0;
    uint64_t data_size = 0;
-   uint64_t total_out = 0;
    void*    out_buf   = NULL;
-   uint8_t* next_out;
-   uint8_t* chunk_buf = NULL;
-   uint32_t chunk_defl_size;
+   uint8_t* defl_buf  = NULL;
    uint32_t chunk_infl_size;
-   uint32_t zlib_infl_size;
-   uint8_t  chunk_header[RZIP_CHUNK_HEADER_SIZE];
+   struct rzip_pool pool;
 
    FILE *file = fopen(path, "rb");
 
+   memset(&pool, 0, sizeof(pool));
+   pool.level = -1;
+
    /* Run .2s before showing progress */
    print_rzip_progress(0, 0, 150000, NULL);
 
@@ -512,7 +996,7 @@ bool read_rzip_file(const char *path, void **buf, ssize_t *len)
       goto end;
 
    file_size = ftell(file);
-   if (file_size < 0)
+   if (file_size < RZIP_HEADER_SIZE)
       goto end;
 
    rewind(file);
@@ -520,70 +1004,88 @@ bool read_rzip_file(const char *path, void **buf, ssize_t *len)
    if (!read_rzip_file_header(file, &data_size, &chunk_infl_size))
       goto end;
 
+   if (data_size >= (size_t)-1)
+      goto end;
+
+   /* Read all chunks at once, then inflate them side by side. */
+   defl_size = file_size - RZIP_HEADER_SIZE;
+   defl_buf  = (uint8_t*)malloc(defl_size);
    out_buf   = malloc(data_size + 1);
-   next_out  = out_buf;
-   chunk_buf = malloc(chunk_infl_size * 2);
-   if (!out_buf || !chunk_buf)
+   if (!out_buf || !defl_buf)
       goto end;
 
-   /* Init zlib stream */
-   stream = zlib_stream_new();
-   if (!stream)
+   if (fread(defl_buf, 1, defl_size, file) < defl_size)
       goto end;
-   zlib_inflate_init(stream);
 
-   while (total_out < data_size)
+   pool.num_chunks = (data_size + chunk_infl_size - 1) / chunk_infl_size;
+   pool.chunks     = (struct rzip_chunk*)
+      calloc(pool.num_chunks, sizeof(*pool.chunks));
+   if (!pool.chunks)
+      goto end;
+
+   for (i = 0; i < pool.num_chunks; i++)
    {
-      /* Read header */
-      if (fread(chunk_header, 1, RZIP_CHUNK_HEADER_SIZE, file)
-               < RZIP_CHUNK_HEADER_SIZE)
+      struct rzip_chunk *chunk = &pool.chunks[i];
+      uint32_t chunk_defl_size;
+
+      if (defl_size - pos < RZIP_CHUNK_HEADER_SIZE)
          goto end;
 
       /* Get size of next chunk */
-      chunk_defl_size = ((uint32_t)chunk_header[3] << 24) |
-                        ((uint32_t)chunk_header[2] << 16) |
-                        ((uint32_t)chunk_header[1] <<  8) |
-                         (uint32_t)chunk_header[0];
-      if (chunk_defl_size == 0)
-         goto end;
+      chunk_defl_size = ((uint32_t)defl_buf[pos + 3] << 24) |
+                        ((uint32_t)defl_buf[pos + 2] << 16) |
+                        ((uint32_t)defl_buf[pos + 1] <<  8) |
+                         (uint32_t)defl_buf[pos];
+      pos += RZIP_CHUNK_HEADER_SIZE;
 
-      /* Read chunk */
-      if (fread(chunk_buf, 1, chunk_defl_size, file) < chunk_defl_size)
+      if (chunk_defl_size == 0 || chunk_defl_size > defl_size - pos)
          goto end;
 
-      /* Inflate chunk to out_buf */
-      zlib_set_stream(stream, chunk_defl_size, chunk_infl_size,
-                      chunk_buf, next_out);
-      if (zlib_inflate(stream) != 1)
-         goto end;
+      chunk->in       = defl_buf + pos;
+      chunk->in_size  = chunk_defl_size;
+      chunk->out      = (uint8_t*)out_buf + i * chunk_infl_size;
+      chunk->out_size = min(chunk_infl_size, data_size - i * chunk_infl_size);
+      pos            += chunk_defl_size;
+   }
+
+   stream     = rzip_stream_new(pool.level);
+   pool.limit = pool.num_chunks;
+   if (!stream)
+      goto end;
 
-      zlib_infl_size = zlib_stream_get_total_out(stream);
-      if (zlib_infl_size == 0 || zlib_infl_size > chunk_infl_size)
+   rzip_pool_start(&pool);
+
+   for (i = 0; i < pool.num_chunks; i++)
+   {
+      struct rzip_chunk *chunk = &pool.chunks[i];
+      uint32_t expected = min(chunk_infl_size, data_size - i * chunk_infl_size);
+
+      if (!rzip_pool_work(&pool, stream, chunk))
          goto end;
 
-      /* Setup next */
-      next_out  += zlib_infl_size;
-      total_out += zlib_infl_size;
-      zlib_stream_inflate_reset(stream);
+      /* Every chunk but the last one is full. */
+      if (chunk->out_size != expected)
+         goto end;
 
       /* Show progress at ~20fps */
-      print_rzip_progress(total_out, data_size, 50000, "Decompressing");
+      print_rzip_progress((uint64_t)i * chunk_infl_size + expected,
+            data_size, 50000, "Decompressing");
    }
 
    /* Allow for easy reading of strings to be safe.
     * Will only work with sane character formatting (Unix). */
-   ((char*)out_buf)[total_out] = '\0';
+   ((char*)out_buf)[data_size] = '\0';
 
    if (len)
-      *len = (ssize_t)total_out;
+      *len = (ssize_t)data_size;
    ret = true;
 end:
+   rzip_pool_stop(&pool);
+   rzip_stream_free(stream, pool.level);
    if (file)
       fclose(file);
-   if (stream)
-      zlib_stream_inflate_free(stream);
-   if (chunk_buf)
-      free(chunk_buf);
+   if (defl_buf)
+      free(defl_buf);
    if (!ret && out_buf)
       free(out_buf);
    else
@@ -51,6 +51,46 @@ int read_compressed_file(const char * path, void **buf,
  */
 int read_file(const char *path, void **buf, ssize_t *length);
 
+/**
+ * read_file_crc32:
+ * @path             : path to file.
+ * @buf              : buffer to allocate and read the contents of the
+ *                     file into. Needs to be freed manually.
+ * @length           : Number of items read, -1 on error.
+ * @crc              : receives the CRC32 of the contents.
+ *
+ * Same as read_file, but also checksums the contents while
+ * reading them.
+ *
+ * Returns: true if file read, false on error.
+ */
+int read_file_crc32(const char *path, void **buf, ssize_t *length,
+      uint32_t *crc);
+
+/**
+ * map_file:
+ * @path             : path to file.
+ * @length           : receives the size of the file.
+ *
+ * Maps a file copy-on-write. Pages are only read in as they are
+ * touched, and are shared with the page cache until written to.
+ * Like a buffer from read_file, the mapping is followed by a '\0',
+ * so files that end on a page boundary are not mapped.
+ *
+ * Returns: the mapping, or NULL if the file could not be mapped
+ * or the platform has no mmap.
+ */
+void *map_file(const char *path, ssize_t *length);
+
+/**
+ * unmap_file:
+ * @data             : mapping returned by map_file.
+ * @length           : size of the mapping.
+ *
+ * Unmaps a file mapped with map_file.
+ */
+void unmap_file(void *data, ssize_t length);
+
 /**
  * write_file:
  * @path             : path to file.
@@ -63,17 +103,35 @@ int read_file(const char *path, void **buf, ssize_t *length);
  */
 bool write_file(const char *path, const void *buf, ssize_t size);
 
+/**
+ * write_file_atomic:
+ * @path             : path to file.
+ * @data             : contents to write to the file.
+ * @size             : size of the contents.
+ *
+ * Writes data to a file through a flushed temporary file, so that
+ * @path never holds partially written contents.
+ *
+ * Returns: true (1) on success, false (0) otherwise.
+ */
+bool write_file_atomic(const char *path, const void *buf, ssize_t size);
+
 /**
  * write_rzip_file:
  * @path             : path to file.
  * @data             : contents to compress and write to file.
  * @size             : size of the uncompressed contents.
+ * @fast             : favour speed over size.
+ * @progress         : show progress in the message queue. Only
+ *                     allowed on the main thread.
  *
- * Writes @data to @path in RZIP format.
+ * Writes @data to @path in RZIP format. Chunks are compressed
+ * on several threads when available.
  *
  * Returns: true on success, false otherwise.
  */
-bool write_rzip_file(const char *path, const void *data, uint64_t size);
+bool write_rzip_file(const char *path, const void *data, uint64_t size,
+      bool fast, bool progress);
 
 /**
  * read_rzip_file:
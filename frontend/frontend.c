@@ -23,6 +23,7 @@
 #include "../runloop_data.h"
 #include "../input/input_remapping.h"
 #include "../core_history.h"
+#include "../archive_cache.h"
 #ifdef HAVE_NETPLAY
 #include "../netplay.h"
 #endif
@@ -75,6 +76,8 @@ void main_exit(void *args)
       rarch_main_deinit();
    }
 
+   archive_cache_deinit();
+
    event_command(EVENT_CMD_PERFCNT_REPORT_FRONTEND_LOG);
 
 #if defined(HAVE_LOGGER) && !defined(ANDROID)
@@ -541,6 +541,7 @@ FILE
 #include "../libretro-common/string/string_list.c"
 #include "../libretro-common/string/stdstring.c"
 #include "../file_ops.c"
+#include "../archive_cache.c"
 #include "../libretro-common/file/nbio/nbio_stdio.c"
 #include "../libretro-common/file/file_list.c"
 #include "../libretro-common/file/vfs_implementation.c"
@@ -671,6 +672,14 @@ PREEMPTIVE FRAMES
 ============================================================ */
 #include "../preempt.c"
 
+/*============================================================
+RUN-AHEAD
+============================================================ */
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+#include "../secondary_core.c"
+#include "../runahead.c"
+#endif
+
 /*============================================================
 DATA RUNLOOP
 ============================================================ */
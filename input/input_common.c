@@ -87,6 +87,7 @@ const struct input_bind_map input_config_bind_map[RARCH_BIND_LIST_END_NULL] = {
       DECLARE_META_BIND(2, hold_fast_forward,     RARCH_FAST_FORWARD_HOLD_KEY, "Fast forward hold"),
       DECLARE_META_BIND(2, slowmotion,            RARCH_SLOWMOTION, "Slow motion"),
       DECLARE_META_BIND(1, rewind,                RARCH_REWIND, "Rewind"),
+      DECLARE_META_BIND(2, rewind_seek,           RARCH_REWIND_SEEK, "Rewind seek"),
       DECLARE_META_BIND(2, pause_toggle,          RARCH_PAUSE_TOGGLE, "Pause toggle"),
       DECLARE_META_BIND(2, frame_advance,         RARCH_FRAMEADVANCE, "Frame advance"),
       DECLARE_META_BIND(2, fps_toggle,            RARCH_SHOW_FPS_TOGGLE, "FPS toggle"),
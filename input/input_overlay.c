@@ -397,6 +397,19 @@ void input_overlay_update_eightway_diag_sens(void)
                                   &overlay_eightway_abxy_slope_low);
 }
 
+/**
+ * input_overlay_bind_mask:
+ * @str                : Bind name.
+ *
+ * Returns: bit of the bind named @str, or 0 if there is none.
+ **/
+static uint64_t input_overlay_bind_mask(const char *str)
+{
+   unsigned id = input_translate_str_to_bind_id(str);
+
+   return id < RARCH_BIND_LIST_END ? UINT64_C(1) << id : 0;
+}
+
 static void input_overlay_desc_populate_eightway(config_file_t *ol_conf,
       struct overlay_desc *desc, unsigned ol_idx, unsigned desc_idx)
 {
@@ -445,7 +458,7 @@ static void input_overlay_desc_populate_eightway(config_file_t *ol_conf,
    {
       eightway->up = 0;
       for (tok = strtok_r(str, "|", &save); tok; tok = strtok_r(NULL, "|", &save))
-         eightway->up |= UINT64_C(1) << input_translate_str_to_bind_id(tok);
+         eightway->up |= input_overlay_bind_mask(tok);
       free(str);
    }
    
@@ -454,7 +467,7 @@ static void input_overlay_desc_populate_eightway(config_file_t *ol_conf,
    {
       eightway->down = 0;
       for (tok = strtok_r(str, "|", &save); tok; tok = strtok_r(NULL, "|", &save))
-         eightway->down |= UINT64_C(1) << input_translate_str_to_bind_id(tok);
+         eightway->down |= input_overlay_bind_mask(tok);
       free(str);
    }
 
@@ -463,7 +476,7 @@ static void input_overlay_desc_populate_eightway(config_file_t *ol_conf,
    {
       eightway->right = 0;
       for (tok = strtok_r(str, "|", &save); tok; tok = strtok_r(NULL, "|", &save))
-         eightway->right |= UINT64_C(1) << input_translate_str_to_bind_id(tok);
+         eightway->right |= input_overlay_bind_mask(tok);
       free(str);
    }
    
@@ -472,7 +485,7 @@ static void input_overlay_desc_populate_eightway(config_file_t *ol_conf,
    {
       eightway->left = 0;
       for (tok = strtok_r(str, "|", &save); tok; tok = strtok_r(NULL, "|", &save))
-         eightway->left |= UINT64_C(1) << input_translate_str_to_bind_id(tok);
+         eightway->left |= input_overlay_bind_mask(tok);
       free(str);
    }
 
@@ -766,7 +779,7 @@ static bool input_overlay_load_desc(input_overlay_t *ol,
             for (tmp = strtok_r(key, "|", &save); tmp; tmp = strtok_r(NULL, "|", &save))
             {
                if (strcmp(tmp, "nul") != 0)
-                  desc->key_mask |= UINT64_C(1) << input_translate_str_to_bind_id(tmp);
+                  desc->key_mask |= input_overlay_bind_mask(tmp);
             }
 
             if (desc->key_mask & (UINT64_C(1) << RARCH_OVERLAY_NEXT))
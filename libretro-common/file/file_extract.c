@@ -25,6 +25,7 @@
 #include <compat/strl.h>
 #include <retro_miscellaneous.h>
 #include <string/string_list.h>
+#include <rhash.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -51,6 +52,12 @@ struct zlib_file_backend
 #define END_OF_CENTRAL_DIR_SIGNATURE 0x06054b50
 #endif
 
+#define ZLIB_CRC32_FILE_CHUNK (64 * 1024)
+
+/* Inflate size when extracting to memory, small enough that
+ * each piece is still in the cache for the CRC. */
+#define ZIP_EXTRACT_CHUNK_SIZE (256 * 1024)
+
 static bool zlib_write_file(const char *path, const void *data, ssize_t size)
 {
    bool ret   = false;
@@ -147,12 +154,32 @@ error:
    return NULL;
 }
 #else
+/* Without mmap() the whole archive is read into memory first, which
+ * only pays off when the content is most of it. Larger archives are
+ * not extracted to memory, see zlib_extract_content_to_memory. */
+#define ZIP_EXTRACT_READ_MAX (32 * 1024 * 1024)
+
 typedef struct
 {
    void *data;
    size_t size;
 } zlib_file_data_t;
 
+static long zlib_file_length(const char *path)
+{
+   long len   = -1;
+   FILE *file = fopen(path, "rb");
+
+   if (!file)
+      return -1;
+
+   if (fseek(file, 0, SEEK_END) == 0)
+      len = ftell(file);
+
+   fclose(file);
+   return len;
+}
+
 static int zlib_read_file(const char *path, void **buf, ssize_t *len)
 {
    long ret                 = 0;
@@ -433,7 +460,7 @@ int zlib_inflate(void *data)
 
 uint32_t zlib_crc32_calculate(const uint8_t *data, size_t length)
 {
-   return crc32(0, data, length);
+   return crc32_update(0, data, length);
 }
 
 uint32_t zlib_crc32_adjust(uint32_t crc, uint8_t data)
@@ -445,31 +472,27 @@ uint32_t zlib_crc32_adjust(uint32_t crc, uint8_t data)
 
 uint32_t zlib_crc32_file(const char *path)
 {
-   FILE *file = fopen(path, "rb");
-   Bytef *buf = malloc(16384 * sizeof(Bytef));
-
-   if (file)
-   {
-      uLong crc = crc32(0L, Z_NULL, 0 );
+   uint32_t crc = 0;
+   FILE *file   = fopen(path, "rb");
+   uint8_t *buf = NULL;
 
-      for (;;)
-      {
-         int numread = fread((void*)buf, 1, sizeof(buf), file);
+   if (!file)
+      return 0;
 
-         if (numread > 0)
-            crc = crc32(crc, buf, numread);
-         else
-            break;
-      }
+   buf = (uint8_t*)malloc(ZLIB_CRC32_FILE_CHUNK);
 
-      fclose(file);
-      free(buf);
+   if (buf)
+   {
+      size_t numread;
 
-      return crc;
+      while ((numread = fread(buf, 1, ZLIB_CRC32_FILE_CHUNK, file)) > 0)
+         crc = crc32_update(crc, buf, numread);
    }
 
+   fclose(file);
    free(buf);
-   return 0;
+
+   return crc;
 }
 
 /**
@@ -713,6 +736,12 @@ struct zip_extract_userdata
    const char *extraction_directory;
    size_t zip_path_size;
    struct string_list *ext;
+   /* Extract this member rather than the first with one of ext. */
+   const char *member;
+   /* If not NULL, extract into a buffer instead of a file. */
+   void **buf;
+   size_t *size;
+   uint32_t *crc;
    bool found_content;
 };
 
@@ -722,6 +751,90 @@ enum
    ZLIB_MODE_DEFLATE      = 8,
 } zlib_compression_mode;
 
+/**
+ * zip_extract_to_memory:
+ * @data                        : extraction userdata, with a buffer set.
+ * @cdata                       : compressed member data.
+ * @cmode                       : compression mode of the member.
+ * @csize                       : compressed size of the member.
+ * @size                        : uncompressed size of the member.
+ * @checksum                    : CRC32 of the member from the archive.
+ *
+ * Inflates a member straight into a buffer, checksumming each piece
+ * as it comes out, so nothing goes through a temporary file.
+ *
+ * Returns: true (1) on success, otherwise false (0).
+ **/
+static bool zip_extract_to_memory(struct zip_extract_userdata *data,
+      const uint8_t *cdata, unsigned cmode, uint32_t csize,
+      uint32_t size, uint32_t checksum)
+{
+   uint32_t crc = 0;
+   uint8_t *buf = (uint8_t*)malloc(size + 1);
+
+   if (!buf)
+      return false;
+
+   switch (cmode)
+   {
+      case ZLIB_MODE_UNCOMPRESSED:
+         if (csize != size)
+            goto error;
+         memcpy(buf, cdata, size);
+         crc = crc32_update(0, buf, size);
+         break;
+      case ZLIB_MODE_DEFLATE:
+         {
+            z_stream stream;
+            int zstatus = Z_OK;
+
+            memset(&stream, 0, sizeof(stream));
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+               goto error;
+
+            stream.next_in  = (Bytef*)cdata;
+            stream.avail_in = csize;
+            stream.next_out = buf;
+
+            while (zstatus == Z_OK && stream.total_out < size)
+            {
+               uint8_t *out     = stream.next_out;
+               stream.avail_out = min(ZIP_EXTRACT_CHUNK_SIZE,
+                     size - stream.total_out);
+
+               zstatus = inflate(&stream, Z_NO_FLUSH);
+               crc     = crc32_update(crc, out, stream.next_out - out);
+            }
+
+            inflateEnd(&stream);
+
+            if (stream.total_out != size
+                  || (zstatus != Z_OK && zstatus != Z_STREAM_END))
+               goto error;
+         }
+         break;
+      default:
+         goto error;
+   }
+
+   if (crc != checksum)
+      goto error;
+
+   /* Allow for easy reading of strings, as read_file does. */
+   buf[size] = '\0';
+
+   *data->buf  = buf;
+   *data->size = size;
+   if (data->crc)
+      *data->crc = crc;
+
+   return true;
+
+error:
+   free(buf);
+   return false;
+}
+
 static int zip_extract_cb(const char *name, const char *valid_exts,
       const uint8_t *cdata,
       unsigned cmode, uint32_t csize, uint32_t size,
@@ -732,11 +845,19 @@ static int zip_extract_cb(const char *name, const char *valid_exts,
    /* Extract first content that matches our list. */
    const char *ext = path_get_extension(name);
 
-   if (ext && string_list_find_elem(data->ext, ext))
+   if (data->member ? !strcmp(name, data->member)
+         : (ext && string_list_find_elem(data->ext, ext)))
    {
       char new_path[PATH_MAX_LENGTH];
       new_path[0] = '\0';
 
+      if (data->buf)
+      {
+         data->found_content = zip_extract_to_memory(data, cdata,
+               cmode, csize, size, checksum);
+         return 0;
+      }
+
       if (data->extraction_directory)
          fill_pathname_join(new_path, data->extraction_directory,
                path_basename(name), sizeof(new_path));
@@ -832,6 +953,66 @@ end:
    return ret;
 }
 
+/**
+ * zlib_extract_content_to_memory:
+ * @zip_path                    : filename path to ZIP archive.
+ * @member                      : member to extract, or NULL for the
+ *                                first one with one of @valid_exts.
+ * @valid_exts                  : valid extensions for a content file.
+ * @buf                         : receives the contents, followed by a
+ *                                '\0'. Needs to be freed manually.
+ * @size                        : receives the size of @buf.
+ * @crc                         : if not NULL, receives the CRC32 of @buf.
+ *
+ * Extract a content file from archive into memory, for cores that
+ * do not need a full path. The contents are checked against the CRC32
+ * stored in the archive. Without mmap(), archives larger than
+ * ZIP_EXTRACT_READ_MAX are refused rather than read whole, so the
+ * caller can fall back to reading just the member.
+ *
+ * Returns : true (1) on success, otherwise false (0).
+ **/
+bool zlib_extract_content_to_memory(const char *zip_path,
+      const char *member, const char *valid_exts,
+      void **buf, size_t *size, uint32_t *crc)
+{
+   struct string_list *list = NULL;
+   bool ret = true;
+   struct zip_extract_userdata userdata = {0};
+
+#ifndef HAVE_MMAP
+   if (zlib_file_length(zip_path) > ZIP_EXTRACT_READ_MAX)
+      return false;
+#endif
+
+   if (!member)
+   {
+      if (!valid_exts)
+         return false;
+
+      list = string_split(valid_exts, "|");
+      if (!list)
+         GOTO_END_ERROR();
+   }
+
+   userdata.ext    = list;
+   userdata.member = member;
+   userdata.buf    = buf;
+   userdata.size   = size;
+   userdata.crc    = crc;
+
+   if (!zlib_parse_file(zip_path, valid_exts, zip_extract_cb, &userdata))
+      GOTO_END_ERROR();
+
+   if (!userdata.found_content)
+      GOTO_END_ERROR();
+
+end:
+   if (list)
+      string_list_free(list);
+   return ret;
+}
+
 static int zlib_get_file_list_cb(const char *path, const char *valid_exts,
       const uint8_t *cdata,
       unsigned cmode, uint32_t csize, uint32_t size, uint32_t checksum,
@@ -100,6 +100,26 @@ int zlib_parse_file_iterate(void *data, bool *returnerr,
 bool zlib_extract_first_content_file(char *zip_path, size_t zip_path_size, 
       const char *valid_exts, const char *extraction_dir);
 
+/**
+ * zlib_extract_content_to_memory:
+ * @zip_path                    : filename path to ZIP archive.
+ * @member                      : member to extract, or NULL for the
+ *                                first one with one of @valid_exts.
+ * @valid_exts                  : valid extensions for a content file.
+ * @buf                         : receives the contents, followed by a
+ *                                '\0'. Needs to be freed manually.
+ * @size                        : receives the size of @buf.
+ * @crc                         : if not NULL, receives the CRC32 of @buf.
+ *
+ * Extract a content file from archive straight into memory, without
+ * a temporary file, for cores that do not need a full path.
+ *
+ * Returns : true (1) on success, otherwise false (0).
+ **/
+bool zlib_extract_content_to_memory(const char *zip_path,
+      const char *member, const char *valid_exts,
+      void **buf, size_t *size, uint32_t *crc);
+
 /**
  * zlib_get_file_list:
  * @path                        : filename path of archive
@@ -84,5 +84,36 @@ int sha1_calculate(const char *path, char *result);
 
 uint32_t djb2_calculate(const char *str);
 
+/**
+ * crc32_update:
+ * @crc           : CRC32 of the data before @data, 0 to start a new one
+ * @data          : data to checksum
+ * @size          : size of @data in bytes
+ *
+ * Zlib compatible CRC32, using the CPU's CRC or carry-less
+ * multiply instructions where there are any.
+ *
+ * Returns: CRC32 of everything so far.
+ **/
+uint32_t crc32_update(uint32_t crc, const void *data, size_t size);
+
+/**
+ * hash64_calculate:
+ * @data          : data to hash
+ * @size          : size of @data in bytes
+ * @offset        : start of the first block to hash
+ * @block         : bytes to hash out of every @stride, a multiple of 32
+ * @stride        : distance between the starts of two blocks
+ *
+ * Fast, non-cryptographic 64-bit hash in the style of xxHash64.
+ * Passing @block == @stride == @size with @offset 0 hashes all of
+ * @data, smaller blocks only sample it. The result does not depend
+ * on the host's endianness.
+ *
+ * Returns: hash of the sampled blocks.
+ **/
+uint64_t hash64_calculate(const void *data, size_t size,
+      size_t offset, size_t block, size_t stride);
+
 #endif
 
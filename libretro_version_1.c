@@ -40,6 +40,7 @@
 #include "intl/intl.h"
 #include "input/input_common.h"
 #include "preempt.h"
+#include "runahead.h"
 #include "gfx/video_monitor.h"
 
 #ifdef HAVE_NETPLAY
@@ -350,6 +351,10 @@ void retro_init_libretro_cbs(void *data)
       pretro_set_input_poll(input_poll_preempt);
       pretro_set_input_state(input_state_preempt);
    }
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+   else if (driver->runahead_data)
+      pretro_set_input_poll(input_poll_runahead);
+#endif
 }
 
 /**
@@ -40,6 +40,10 @@
 #include "../input/input_joypad_to_keyboard.h"
 #include "../core_history.h"
 
+#ifdef HAVE_7ZIP
+#include "../decompress/7zip_support.h"
+#endif
+
 #ifdef HAVE_NETWORKING
 extern char *core_buf;
 extern size_t core_len;
@@ -1129,6 +1133,15 @@ static int menu_displaylist_parse_generic(menu_displaylist_info_t *info,
 
    (void)device;
 
+   path_is_compressed = path_is_compressed_file(info->path);
+
+#ifdef HAVE_7ZIP
+   /* Folders decoded ahead while an archive was listed are
+    * of no use once the menu has left it. */
+   if (!path_is_compressed)
+      compressed_7zip_cache_free();
+#endif
+
    if (!*info->path)
    {
       if (frontend_driver_parse_drive_list(info->list) != 0)
@@ -1148,7 +1161,6 @@ static int menu_displaylist_parse_generic(menu_displaylist_info_t *info,
    slock_unlock(gx_device_mutex);
 #endif
 
-   path_is_compressed = path_is_compressed_file(info->path);
    push_dir           = (info->setting
          && info->setting->browser_selection_type == ST_DIR);
 
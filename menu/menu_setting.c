@@ -1918,13 +1918,40 @@ static void setting_get_string_representation_preemptive_frames(void *data,
    rarch_setting_t *setting = (rarch_setting_t*)data;
    if (setting)
    {
-      if (*setting->value.unsigned_integer > 0)
+      driver_t *driver = driver_get_ptr();
+      unsigned frames;
+      float run, serialize, unserialize;
+
+      if (*setting->value.unsigned_integer == PREEMPT_FRAMES_AUTO)
+      {
+         if (preempt_get_timings((preempt_t*)driver->preempt_data,
+                  &frames, &run, &serialize, &unserialize))
+            snprintf(s, len, "Auto (%u)", frames);
+         else
+            strlcpy(s, "Auto", len);
+      }
+      else if (*setting->value.unsigned_integer > 0)
          sprintf(s, "%u", *setting->value.unsigned_integer);
       else
          strcpy(s, "OFF");
    }
 }
 
+static void setting_get_string_representation_preemptive_timings(void *data,
+      char *s, size_t len)
+{
+   driver_t *driver = driver_get_ptr();
+   unsigned frames;
+   float run, serialize, unserialize;
+
+   if (preempt_get_timings((preempt_t*)driver->preempt_data,
+            &frames, &run, &serialize, &unserialize) && run > 0.0f)
+      snprintf(s, len, "Run %.2f, Save %.2f, Load %.2f ms",
+            run, serialize, unserialize);
+   else
+      strlcpy(s, "N/A", len);
+}
+
 static void setting_get_string_representation_touch_method(void *data,
       char *s, size_t len)
 {
@@ -5082,6 +5109,74 @@ static bool setting_append_list_rewind_options(
          general_read_handler);
    menu_settings_list_current_add_range(list, list_info, 1, 32768, 1, true, false);
 
+#ifdef HAVE_THREADS
+   CONFIG_BOOL(
+         settings->rewind_threaded,
+         "rewind_threaded",
+         "Threaded Rewind",
+         rewind_threaded,
+         menu_hash_to_str(MENU_VALUE_OFF),
+         menu_hash_to_str(MENU_VALUE_ON),
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+#endif
+
+#ifdef HAVE_ZLIB
+   CONFIG_BOOL(
+         settings->rewind_deflate,
+         "rewind_deflate",
+         "Compress Rewind Buffer",
+         rewind_deflate,
+         menu_hash_to_str(MENU_VALUE_OFF),
+         menu_hash_to_str(MENU_VALUE_ON),
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+#endif
+
+   CONFIG_UINT(
+         settings->rewind_keyframe_interval,
+         "rewind_keyframe_interval",
+         "Rewind Keyframe Interval",
+         rewind_keyframe_interval,
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+   menu_settings_list_current_add_range(list, list_info, 0, 3600, 1, true, true);
+
+#ifdef HAVE_MMAP
+   CONFIG_UINT(
+         settings->rewind_disk_size,
+         "rewind_disk_size",
+         "Rewind History on Disk (MB)",
+         rewind_disk_size,
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+   menu_settings_list_current_add_range(list, list_info, 0, 4096, 64, true, true);
+#endif
+
+   CONFIG_UINT(
+         settings->rewind_seek_seconds,
+         "rewind_seek_seconds",
+         "Rewind Seek Distance (seconds)",
+         rewind_seek_seconds,
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+   menu_settings_list_current_add_range(list, list_info, 1, 600, 1, true, true);
+
    END_SUB_GROUP(list, list_info, parent_group);
    END_GROUP(list, list_info, parent_group);
 
@@ -6174,7 +6269,7 @@ static bool setting_append_list_latency_options(
             parent_group,
             general_write_handler,
             general_read_handler);
-      menu_settings_list_current_add_range(list, list_info, 0, MAX_PREEMPT_FRAMES, 1, true, true);
+      menu_settings_list_current_add_range(list, list_info, 0, PREEMPT_FRAMES_AUTO, 1, true, true);
       (*list)[list_info->index - 1].get_string_representation = 
          &setting_get_string_representation_preemptive_frames;
       menu_settings_list_current_add_cmd(list, list_info, EVENT_CMD_PREEMPT_UPDATE);
@@ -6197,6 +6292,81 @@ static bool setting_append_list_latency_options(
             general_read_handler);
       }
 
+      CONFIG_BOOL(
+            settings->preempt_delta_states,
+            "preempt_delta_states",
+            "  State Buffer",
+            preempt_delta_states,
+            "Full",
+            "Delta",
+            group_info.name,
+            subgroup_info.name,
+            parent_group,
+            general_write_handler,
+            general_read_handler);
+      menu_settings_list_current_add_cmd(list, list_info, EVENT_CMD_PREEMPT_UPDATE);
+
+      if (settings->preempt_frames == PREEMPT_FRAMES_AUTO)
+      {
+         CONFIG_UINT(
+               settings->preempt_auto_budget,
+               "preempt_auto_budget",
+               "  Auto Frame Budget (%)",
+               preempt_auto_budget,
+               group_info.name,
+               subgroup_info.name,
+               parent_group,
+               general_write_handler,
+               general_read_handler);
+         menu_settings_list_current_add_range(list, list_info, 10, 90, 5, true, true);
+      }
+
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+      CONFIG_UINT(
+            settings->preempt_speculate,
+            "preempt_speculate",
+            "  Speculative Branches",
+            preempt_speculate,
+            group_info.name,
+            subgroup_info.name,
+            parent_group,
+            general_write_handler,
+            general_read_handler);
+      menu_settings_list_current_add_range(list, list_info, 0, MAX_PREEMPT_BRANCHES, 1, true, true);
+      menu_settings_list_current_add_cmd(list, list_info, EVENT_CMD_PREEMPT_UPDATE);
+#endif
+
+      if (driver->preempt_data)
+      {
+         CONFIG_ACTION(
+               "preempt_timings",
+               "  Measured Cost",
+               group_info.name,
+               subgroup_info.name,
+               parent_group);
+         (*list)[list_info->index - 1].get_string_representation = 
+               &setting_get_string_representation_preemptive_timings;
+      }
+
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+      if (settings->preempt_frames == 0)
+      {
+         CONFIG_UINT(
+               settings->runahead_frames,
+               "runahead_frames",
+               "Run-Ahead Frames (Second Instance)",
+               0,
+               group_info.name,
+               subgroup_info.name,
+               parent_group,
+               general_write_handler,
+               general_read_handler);
+         menu_settings_list_current_add_range(list, list_info, 0, MAX_PREEMPT_FRAMES, 1, true, true);
+         menu_settings_list_current_add_cmd(list, list_info, EVENT_CMD_PREEMPT_UPDATE);
+         settings_data_list_current_add_flags(list, list_info, SD_FLAG_IS_DEFERRED);
+      }
+#endif
+
       CONFIG_UINT(
             settings->preempt_frames_scope,
             "preempt_frames_scope",
@@ -8541,6 +8711,19 @@ static bool setting_append_list_netplay_options(
             general_write_handler,
             general_read_handler);
       settings_data_list_current_add_flags(list, list_info, SD_FLAG_ALLOW_INPUT);
+
+      CONFIG_BOOL(
+            global->netplay_is_spectate,
+            "netplay_spectate",
+            "Spectate",
+            false,
+            menu_hash_to_str(MENU_VALUE_OFF),
+            menu_hash_to_str(MENU_VALUE_ON),
+            group_info.name,
+            subgroup_info.name,
+            parent_group,
+            general_write_handler,
+            general_read_handler);
    }
 
    if (!global->netplay_is_client || settings->menu.show_advanced_settings)
@@ -8557,6 +8740,18 @@ static bool setting_append_list_netplay_options(
             parent_group,
             general_write_handler,
             general_read_handler);
+
+      CONFIG_UINT(
+            settings->netplay_max_spectators,
+            "netplay_max_spectators",
+            "Max Spectators",
+            netplay_max_spectators,
+            group_info.name,
+            subgroup_info.name,
+            parent_group,
+            general_write_handler,
+            general_read_handler);
+      menu_settings_list_current_add_range(list, list_info, 0, 16, 1, true, true);
    }
 
    CONFIG_UINT(
@@ -8624,6 +8819,84 @@ static bool setting_append_list_netplay_options(
          general_write_handler,
          general_read_handler);
 
+   CONFIG_BOOL(
+         settings->netplay_show_stats,
+         "netplay_show_stats",
+         "Show connection stats",
+         false,
+         menu_hash_to_str(MENU_VALUE_OFF),
+         menu_hash_to_str(MENU_VALUE_ON),
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+
+   CONFIG_UINT(
+         settings->netplay_max_input_delay,
+         "netplay_max_input_delay",
+         "Max Input Delay Frames",
+         netplay_max_input_delay,
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+   menu_settings_list_current_add_range(list, list_info, 0, 8, 1, true, true);
+
+   CONFIG_UINT(
+         settings->netplay_replay_budget,
+         "netplay_replay_budget",
+         "Rollback Budget (% of frame)",
+         netplay_replay_budget,
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+   menu_settings_list_current_add_range(list, list_info, 5, 100, 5, true, true);
+   settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
+
+   CONFIG_UINT(
+         settings->netplay_check_frames,
+         "netplay_check_frames",
+         "State Check Interval (frames)",
+         netplay_check_frames,
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+   menu_settings_list_current_add_range(list, list_info, 1, 600, 1, true, true);
+   settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
+
+   CONFIG_UINT(
+         settings->netplay_check_sample,
+         "netplay_check_sample",
+         "State Check Sampling (1 in N)",
+         netplay_check_sample,
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+   menu_settings_list_current_add_range(list, list_info, 1, 64, 1, true, true);
+   settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
+
+   CONFIG_BOOL(
+         settings->netplay_check_bisect,
+         "netplay_check_bisect",
+         "Locate state mismatches",
+         false,
+         menu_hash_to_str(MENU_VALUE_OFF),
+         menu_hash_to_str(MENU_VALUE_ON),
+         group_info.name,
+         subgroup_info.name,
+         parent_group,
+         general_write_handler,
+         general_read_handler);
+   settings_data_list_current_add_flags(list, list_info, SD_FLAG_ADVANCED);
+
    END_SUB_GROUP(list, list_info, parent_group);
 
    START_SUB_GROUP(
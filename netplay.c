@@ -20,8 +20,10 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <zlib.h>
 #include <net/net_compat.h>
+#include <rhash.h>
 #include "netplay.h"
 #include "general.h"
 #include "autosave.h"
@@ -29,11 +31,22 @@
 #include "intl/intl.h"
 #include "tasks/tasks.h"
 #include "preempt.h"
+#include "runahead.h"
+#include "rewind.h"
+#include "performance.h"
 
 struct delta_frame
 {
-   void *state;
-
+   /* Savestate at frame start, as a delta against keyframe 'key'.
+    * Keyframes are kept whole, outside of the ring. */
+   void *patch;
+   size_t patch_capacity;
+   uint32_t key;
+   bool is_key;
+   /* The delta couldn't be stored, so the state is gone */
+   bool is_lost;
+
+   /* Hash of the state, on check frames only */
    uint32_t self_crc;
    uint32_t peer_crc;
 
@@ -47,21 +60,85 @@ struct delta_frame
 };
 
 #define RARCH_DEFAULT_PORT 55435
-#define UDP_FRAME_PACKETS 20
-#define NETPLAY_BUF_SIZE 10
-#define SYNC_PERIOD 300
+/* Part of the handshake magic, so that peers speaking different 
+ * formats refuse to connect. Bump it whenever a message changes. */
+#define NETPLAY_PROTOCOL_VERSION 1
+/* Three seconds of rollback at 60 fps. */
+#define NETPLAY_BUF_SIZE 180
+/* The peer can still be missing up to two buffers' worth of our 
+ * input, so that much is kept to be sent again. */
+#define NETPLAY_INPUT_HISTORY (NETPLAY_BUF_SIZE * 2)
+/* Frames per packet, few enough for one unfragmented datagram. 
+ * They are the newest ones, or if the peer is further behind, 
+ * those from the first frame it still lacks. */
+#define UDP_FRAME_PACKETS 119
+/* Sequence number, send time, echoed peer send time and the next 
+ * frame wanted from the peer, ahead of the frames */
+#define UDP_HEADER_WORDS 4
+#define UDP_PACKET_WORDS (UDP_HEADER_WORDS + UDP_FRAME_PACKETS * 3)
+
+/* A sampled state check hashes one block out of every check_sample. 
+ * To locate a mismatch, the state is split into at most 
+ * NETPLAY_HASH_REGIONS regions, hashed separately. */
+#define NETPLAY_HASH_BLOCK 64
+#define NETPLAY_HASH_REGIONS 1024
+#define NETPLAY_HASH_MSG_WORDS (3 + NETPLAY_HASH_REGIONS * 2)
+
+#define NETPLAY_MAX_DELAY 8
+#define NETPLAY_INPUT_QUEUE 16
+/* Connection stats are gathered over this many frames, 
+ * and logged every NETPLAY_STATS_LOG_PERIOD of those. */
+#define NETPLAY_STATS_WINDOW 60
+#define NETPLAY_STATS_LOG_PERIOD 10
+
+/* Every Nth frame of the rollback buffer is kept whole,
+ * the ones in between as a delta against it. */
+#define NETPLAY_KEY_INTERVAL 15
+#define NETPLAY_KEYFRAMES (NETPLAY_BUF_SIZE / NETPLAY_KEY_INTERVAL + 2)
 
 #define NETPLAY_CMD_ACK 0
 #define NETPLAY_CMD_NAK 1
 #define NETPLAY_CMD_FLIP_PLAYERS 2
 #define NETPLAY_CMD_LOAD_SAVESTATE 3
 #define NETPLAY_CMD_RESYNC 4
+#define NETPLAY_CMD_STATE_HASHES 5
+/* Spectator stream, host to spectator only, never answered */
+#define NETPLAY_CMD_SPECTATE_STATE 6
+#define NETPLAY_CMD_SPECTATE_INPUT 7
+
+#define NETPLAY_MAX_SPECTATORS 16
+/* Spectators that have this much more than a state queued up 
+ * can't keep up, and are dropped. */
+#define NETPLAY_SPECTATE_BACKLOG (64 * 1024)
+
+/* Savestate payload flags */
+#define NETPLAY_STATE_DELTA (1 << 0)
 
 #define NETPLAY_PREV_PTR(x) ((x) == 0 ? NETPLAY_BUF_SIZE - 1 : (x) - 1)
 #define NETPLAY_NEXT_PTR(x) ((x + 1) % NETPLAY_BUF_SIZE)
 
 #define RETRY_MS 500
 
+struct netplay_keyframe
+{
+   void *state;
+   uint32_t key;
+   bool valid;
+};
+
+/* Outgoing stream to a spectator. Sockets are non-blocking, 
+ * and whatever they don't take yet waits in buf. */
+struct netplay_spectator
+{
+   int fd;
+   uint8_t *buf;
+   size_t head;
+   size_t size;
+   size_t capacity;
+   /* Needs a state before any more input */
+   bool need_state;
+};
+
 struct netplay
 {
    char nick[32];
@@ -82,6 +159,11 @@ struct netplay
     * Each savestate represents the frame start.
     * Each input state is applied to that frame. */
    struct delta_frame *buffer;
+   struct netplay_keyframe keyframes[NETPLAY_KEYFRAMES];
+   /* Scratch space to serialize into and rebuild states in,
+    * padded for state_delta_encode */
+   void *state;
+   void *patch;
 
    /* Pointer where we are now. */
    size_t self_ptr; 
@@ -103,7 +185,11 @@ struct netplay
 
    /* To combat UDP packet loss we also send 
     * old data along with the packets. */
-   uint32_t packet_buffer[UDP_FRAME_PACKETS * 3];
+   uint32_t packet_buffer[UDP_PACKET_WORDS];
+   /* Our input as sent, three words per frame, by frame number */
+   uint32_t input_history[NETPLAY_INPUT_HISTORY * 3];
+   /* First frame the peer said it still lacked */
+   uint32_t peer_ack;
    uint32_t frame_count;
    uint32_t read_frame_count;
    uint32_t other_frame_count;
@@ -115,6 +201,8 @@ struct netplay
    unsigned timeout_cnt;
    /* Set after sending or receiving a savestate */
    bool need_resync;
+   /* A rollback state is gone, resync from the current one */
+   bool state_lost;
 
    /* User flipping
     * Flipping state. If ptr >= flip_frame, we apply the flip.
@@ -123,8 +211,80 @@ struct netplay
     * well after flip_frame before allowing another flip. */
    bool flip;
    uint32_t flip_frame;
+
+   /* Savestate transfer.
+    * Both peers keep the last state that was sent and acknowledged,
+    * so the next one can go out as a delta against it. */
+   void *xfer_base;
+   uint32_t xfer_base_crc;
+   bool has_xfer_base;
+   /* Scratch space, padded for state_delta_encode */
+   void *xfer_state;
+   void *xfer_patch;
+   void *xfer_zbuf;
+   size_t xfer_zbuf_size;
+
+   /* Local input is used input_delay frames after it was read. 
+    * input_frame_count is the first frame without input yet. */
+   unsigned input_delay;
+   uint32_t input_frame_count;
+   uint16_t self_inputs[NETPLAY_INPUT_QUEUE];
+   /* Last frame whose CRC was sent */
+   uint32_t crc_frame;
+
+   /* State checks. The client uses the host's settings. */
+   unsigned check_frames;
+   unsigned check_sample;
+   /* Region hashes of the state of region_frame, kept by the client 
+    * until the host's arrive to locate a mismatch */
+   uint64_t *region_hashes;
+   uint32_t *region_msg;
+   size_t region_size;
+   uint32_t region_frame;
+   bool has_region_hashes;
+
+   /* Spectators. The host streams confirmed input to them, 
+    * and they play it back without sending anything. */
+   bool is_spectator;
+   int spectate_fd;
+   unsigned max_spectators;
+   struct netplay_spectator spectators[NETPLAY_MAX_SPECTATORS];
+   /* Next frame whose input goes out to spectators */
+   uint32_t spectate_frame;
+   /* Spectator: input of the current frame for both users */
+   uint16_t spectate_input[2];
+
+   /* Connection stats. Times are in ms, except for replays. */
+   uint32_t send_seq;
+   uint32_t peer_seq;
+   uint32_t peer_send_time;
+   uint32_t peer_recv_time;
+   int32_t peer_transit;
+   bool has_peer_seq;
+   float rtt;
+   float jitter;
+   float loss;
+   /* Per-frame replay cost in usec */
+   float replay_frame_time;
+
+   /* Current stats window */
+   unsigned stats_frames;
+   unsigned stats_windows;
+   unsigned packets_received;
+   unsigned packets_expected;
+   unsigned rollbacks;
+   unsigned rollback_frames;
+   unsigned max_rollback;
+   retro_time_t replay_time;
+
+   struct netplay_stats totals;
 };
 
+static uint32_t netplay_time_ms(void)
+{
+   return (uint32_t)(rarch_get_time_usec() / 1000);
+}
+
 /**
  * warn_hangup:
  *
@@ -151,6 +311,38 @@ static bool netplay_should_skip(netplay_t *netplay)
    return netplay->in_replay && netplay->has_connection;
 }
 
+/**
+ * netplay_pack_frames:
+ * @netplay              : pointer to netplay object
+ *
+ * Fills the frames of the next packet from the input history. 
+ * Slots past the newest frame are zeroed, which reads as frame 0.
+ **/
+static void netplay_pack_frames(netplay_t *netplay)
+{
+   unsigned i;
+   uint32_t *frames = netplay->packet_buffer + UDP_HEADER_WORDS;
+   uint32_t end     = netplay->input_frame_count;
+   uint32_t first   = end > UDP_FRAME_PACKETS ? end - UDP_FRAME_PACKETS : 0;
+
+   /* An ack from before a resync can be past anything we sent. */
+   if (netplay->peer_ack < first
+         && end - netplay->peer_ack <= NETPLAY_INPUT_HISTORY)
+      first = netplay->peer_ack;
+
+   for (i = 0; i < UDP_FRAME_PACKETS; i++)
+   {
+      uint32_t frame = first + i;
+
+      if (frame < end)
+         memcpy(frames + i * 3, netplay->input_history
+               + (frame % NETPLAY_INPUT_HISTORY) * 3,
+               3 * sizeof(uint32_t));
+      else
+         memset(frames + i * 3, 0, 3 * sizeof(uint32_t));
+   }
+}
+
 static bool send_chunk(netplay_t *netplay)
 {
    const struct sockaddr *addr = NULL;
@@ -162,6 +354,17 @@ static bool send_chunk(netplay_t *netplay)
 
    if (addr)
    {
+      uint32_t now = netplay_time_ms();
+
+      /* Hand back the peer's send time, moved forward by how long 
+       * we've held on to it, so the peer gets the RTT. */
+      netplay->packet_buffer[1] = htonl(now);
+      netplay->packet_buffer[2] = htonl(netplay->has_peer_seq
+            ? netplay->peer_send_time + (now - netplay->peer_recv_time)
+            : 0);
+      netplay->packet_buffer[3] = htonl(netplay->read_frame_count);
+      netplay_pack_frames(netplay);
+
       if (sendto(netplay->udp_fd, (const char*)netplay->packet_buffer,
                sizeof(netplay->packet_buffer), 0, addr,
                sizeof(struct sockaddr_in6)) != sizeof(netplay->packet_buffer))
@@ -173,6 +376,153 @@ static bool send_chunk(netplay_t *netplay)
    return true;
 }
 
+/**
+ * netplay_hash_state:
+ * @netplay              : pointer to netplay object
+ * @frame                : frame of the state in netplay->state
+ *
+ * Hashes the state for a state check. When sampling, each check 
+ * covers the next of the check_sample interleaved sets of blocks.
+ *
+ * Returns: non-zero hash, folded to the 32 bits the packets carry.
+ **/
+static uint32_t netplay_hash_state(netplay_t *netplay, uint32_t frame)
+{
+   unsigned phase = (frame / netplay->check_frames) % netplay->check_sample;
+   uint64_t hash  = hash64_calculate(netplay->state, netplay->state_size,
+         phase * NETPLAY_HASH_BLOCK, NETPLAY_HASH_BLOCK,
+         netplay->check_sample * NETPLAY_HASH_BLOCK);
+   uint32_t ret   = (uint32_t)(hash ^ (hash >> 32));
+
+   return ret ? ret : 1;
+}
+
+/**
+ * netplay_hash_regions:
+ * @netplay              : pointer to netplay object
+ * @region_size          : receives the size of each region
+ *
+ * Hashes the state in netplay->state region by region into 
+ * netplay->region_hashes.
+ *
+ * Returns: number of regions.
+ **/
+static unsigned netplay_hash_regions(netplay_t *netplay, size_t *region_size)
+{
+   const uint8_t *state = (const uint8_t*)netplay->state;
+   size_t size          = (netplay->state_size + NETPLAY_HASH_REGIONS - 1)
+      / NETPLAY_HASH_REGIONS;
+   unsigned count, i;
+
+   size  = (size + NETPLAY_HASH_BLOCK - 1) & ~(size_t)(NETPLAY_HASH_BLOCK - 1);
+   if (!size)
+      size = NETPLAY_HASH_BLOCK;
+   count = (netplay->state_size + size - 1) / size;
+
+   for (i = 0; i < count; i++)
+   {
+      size_t len = min(size, netplay->state_size - i * size);
+      netplay->region_hashes[i] = hash64_calculate(state + i * size,
+            len, 0, len, len);
+   }
+
+   *region_size = size;
+   return count;
+}
+
+/**
+ * netplay_store_state:
+ * @netplay              : pointer to netplay object
+ * @buf_idx              : rollback buffer entry
+ * @frame                : frame the entry is for
+ *
+ * Stores the state in netplay->state into the rollback buffer, 
+ * as a keyframe or as a delta against the current keyframe, 
+ * and hashes it on check frames.
+ **/
+static void netplay_store_state(netplay_t *netplay,
+      size_t buf_idx, uint32_t frame)
+{
+   struct delta_frame *ptr           = &netplay->buffer[buf_idx];
+   uint32_t key                      = frame / NETPLAY_KEY_INTERVAL;
+   struct netplay_keyframe *keyframe =
+         &netplay->keyframes[key % NETPLAY_KEYFRAMES];
+   size_t patch_size;
+
+   if (frame % netplay->check_frames == netplay->check_frames - 1)
+      ptr->self_crc = netplay_hash_state(netplay, frame);
+   else
+      ptr->self_crc = 0;
+
+   ptr->key = key;
+
+   /* Entries depending on an old keyframe are always rewritten after it,
+    * so it can be replaced. Right after a resync there is no keyframe 
+    * yet, and the first state becomes one. */
+   if (frame % NETPLAY_KEY_INTERVAL == 0
+         || !keyframe->valid || keyframe->key != key)
+   {
+      memcpy(keyframe->state, netplay->state, netplay->state_size);
+      keyframe->key   = key;
+      keyframe->valid = true;
+      ptr->is_key     = true;
+      ptr->is_lost    = false;
+      return;
+   }
+
+   patch_size = state_delta_encode(keyframe->state, netplay->state,
+         netplay->state_size, netplay->patch);
+
+   /* Only grow, or shrink when it's way too large. */
+   if (patch_size > ptr->patch_capacity
+         || patch_size < ptr->patch_capacity / 4)
+   {
+      void *patch = realloc(ptr->patch, patch_size);
+
+      if (patch)
+      {
+         ptr->patch          = patch;
+         ptr->patch_capacity = patch_size;
+      }
+      else if (patch_size > ptr->patch_capacity)
+      {
+         RARCH_ERR("Failed to allocate netplay rollback state.\n");
+         ptr->is_lost        = true;
+         netplay->state_lost = true;
+         return;
+      }
+   }
+
+   memcpy(ptr->patch, netplay->patch, patch_size);
+   ptr->is_key  = false;
+   ptr->is_lost = false;
+}
+
+/**
+ * netplay_load_state:
+ * @netplay              : pointer to netplay object
+ * @buf_idx              : rollback buffer entry
+ *
+ * Rebuilds the state of a rollback buffer entry in netplay->state.
+ *
+ * Returns: false if the state of the entry is gone.
+ **/
+static bool netplay_load_state(netplay_t *netplay, size_t buf_idx)
+{
+   struct delta_frame *ptr = &netplay->buffer[buf_idx];
+
+   if (ptr->is_lost)
+      return false;
+
+   memcpy(netplay->state,
+         netplay->keyframes[ptr->key % NETPLAY_KEYFRAMES].state,
+         netplay->state_size);
+
+   if (!ptr->is_key)
+      state_delta_apply(ptr->patch, netplay->state);
+   return true;
+}
+
 /* Needed after sending/receiving a savestate */
 static void netplay_resync(netplay_t *netplay)
 {
@@ -180,25 +530,42 @@ static void netplay_resync(netplay_t *netplay)
          netplay->buffer[NETPLAY_PREV_PTR(netplay->read_ptr)].peer_input_state;
    int16_t i;
 
-   /* Load state if we're the recipient */
+   /* Both sides now have the transferred state. 
+    * Load it if we're the recipient. */
+   memcpy(netplay->state, netplay->xfer_base, netplay->state_size);
    if (netplay->buffer[netplay->other_ptr].self_crc == 0xFEED)
-      pretro_unserialize(netplay->buffer[netplay->other_ptr].state,
-            netplay->state_size);
+      pretro_unserialize(netplay->state, netplay->state_size);
 
    netplay->self_ptr = netplay->other_ptr;
    netplay->read_ptr = netplay->other_ptr;
 
    for (i = 0; i < NETPLAY_BUF_SIZE; i++)
       netplay->buffer[i].self_crc = 0;
+   for (i = 0; i < NETPLAY_KEYFRAMES; i++)
+      netplay->keyframes[i].valid = false;
    netplay->buffer[NETPLAY_PREV_PTR(netplay->read_ptr)].peer_input_state
          = last_peer_input;
 
    netplay->other_frame_count = 1;
    netplay->frame_count = 1;
    netplay->read_frame_count = 1;
+   netplay->input_frame_count = 1;
+   netplay->crc_frame = 0;
+   /* Nothing sent before the resync is valid now. */
+   memset(netplay->input_history, 0, sizeof(netplay->input_history));
+   netplay->peer_ack = 1;
+   netplay->has_region_hashes = false;
+
+   /* Spectators start over from the new state. */
+   for (i = 0; i < NETPLAY_MAX_SPECTATORS; i++)
+      netplay->spectators[i].need_state = true;
+   netplay->spectate_frame = netplay->other_frame_count;
 
    netplay->flip_frame = netplay->flip ? 1 : 0;
 
+   netplay->state_lost = false;
+   netplay_store_state(netplay, netplay->other_ptr, netplay->frame_count);
+
    netplay->need_resync = false;
 }
 
@@ -215,11 +582,17 @@ static bool get_self_input_state(netplay_t *netplay)
    driver_t *driver        = driver_get_ptr();
    settings_t *settings    = config_get_ptr();
    uint16_t state          = 0;
-   uint16_t lag            = netplay->frame_count > netplay->read_frame_count
+   uint32_t crc            = 0;
+   uint32_t crc_frame      = 0;
+   uint32_t last_frame     = netplay->frame_count + netplay->input_delay;
+   uint32_t lag            = netplay->frame_count > netplay->read_frame_count
          ? netplay->frame_count - netplay->read_frame_count
          : 0;
    int i;
 
+   if (lag > 0xFF)
+      lag = 0xFF;
+
    if (!driver->block_libretro_input && netplay->frame_count > 0)
    {
       retro_input_state_t cb = netplay->cbs.state_cb;
@@ -234,14 +607,43 @@ static bool get_self_input_state(netplay_t *netplay)
    else if (netplay->frame_count == 0 && !netplay_connect(netplay))
       return false;
 
-   memmove(netplay->packet_buffer, netplay->packet_buffer + 3,
-         sizeof(netplay->packet_buffer) - 3 * sizeof(uint32_t));
-   netplay->packet_buffer[(UDP_FRAME_PACKETS - 1) * 3]
-         = htonl(netplay->frame_count);
-   netplay->packet_buffer[(UDP_FRAME_PACKETS - 1) * 3 + 1]
-         = htonl(state | (lag << 16));
-   netplay->packet_buffer[(UDP_FRAME_PACKETS - 1) * 3 + 2]
-         = htonl(netplay->buffer[netplay->self_ptr].self_crc);
+   /* Only send the CRC of a state once no more rollbacks can change 
+    * it, or the peer might compare against a mispredicted one. */
+   if (netplay->other_frame_count >= netplay->check_frames - 1)
+   {
+      crc_frame = netplay->other_frame_count
+         - (netplay->other_frame_count + 1) % netplay->check_frames;
+
+      if (crc_frame > netplay->crc_frame
+            && last_frame - crc_frame < NETPLAY_BUF_SIZE)
+         crc = netplay->buffer[(netplay->self_ptr + NETPLAY_BUF_SIZE
+               - (netplay->frame_count - crc_frame)) % NETPLAY_BUF_SIZE]
+            .self_crc;
+   }
+
+   /* Frames skipped over by a growing delay get the same input. 
+    * When it shrinks, nothing new goes out until it caught up. 
+    * A CRC goes along with the newest frame, along with how 
+    * far back it belongs. */
+   while (netplay->input_frame_count <= last_frame)
+   {
+      uint32_t frame   = netplay->input_frame_count++;
+      bool send_crc    = crc && frame == last_frame;
+      uint32_t offset  = send_crc ? frame - crc_frame : 0;
+      uint32_t *record = netplay->input_history
+         + (frame % NETPLAY_INPUT_HISTORY) * 3;
+
+      record[0] = htonl(frame);
+      record[1] = htonl(state | (lag << 16) | (offset << 24));
+      record[2] = htonl(send_crc ? crc : 0);
+
+      netplay->self_inputs[frame % NETPLAY_INPUT_QUEUE] = state;
+
+      if (send_crc)
+         netplay->crc_frame = crc_frame;
+   }
+
+   netplay->packet_buffer[0] = htonl(++netplay->send_seq);
 
    if (!send_chunk(netplay))
    {
@@ -249,7 +651,8 @@ static bool get_self_input_state(netplay_t *netplay)
       return false;
    }
 
-   netplay->buffer[netplay->self_ptr].self_input_state = state;
+   netplay->buffer[netplay->self_ptr].self_input_state =
+         netplay->self_inputs[netplay->frame_count % NETPLAY_INPUT_QUEUE];
    return true;
 }
 
@@ -275,6 +678,252 @@ static bool netplay_get_response(netplay_t *netplay)
    return ntohl(response) == NETPLAY_CMD_ACK;
 }
 
+static void netplay_set_xfer_base(netplay_t *netplay)
+{
+   memcpy(netplay->xfer_base, netplay->xfer_state, netplay->state_size);
+   netplay->xfer_base_crc = crc32(0, (const Bytef*)netplay->xfer_base,
+         netplay->state_size);
+   netplay->has_xfer_base = true;
+}
+
+/**
+ * netplay_pack_state:
+ * @netplay              : pointer to netplay object
+ * @state                : savestate to send
+ * @header               : payload header, in network byte order
+ *
+ * Deflates @state into netplay->xfer_zbuf, as a delta against the
+ * last acknowledged state if there is one and that comes out smaller.
+ *
+ * Returns: size of the deflated payload, or 0 on failure.
+ **/
+static size_t netplay_pack_state(netplay_t *netplay, const void *state,
+      uint32_t *header)
+{
+   uint32_t flags      = 0;
+   const void *src     = netplay->xfer_state;
+   size_t src_size     = netplay->state_size;
+   uLongf payload_size = netplay->xfer_zbuf_size;
+
+   memcpy(netplay->xfer_state, state, netplay->state_size);
+
+   if (netplay->has_xfer_base)
+   {
+      size_t patch_size = state_delta_encode(netplay->xfer_base,
+            netplay->xfer_state, netplay->state_size, netplay->xfer_patch);
+
+      if (patch_size < netplay->state_size)
+      {
+         src      = netplay->xfer_patch;
+         src_size = patch_size;
+         flags   |= NETPLAY_STATE_DELTA;
+      }
+   }
+
+   if (compress2((Bytef*)netplay->xfer_zbuf, &payload_size,
+            (const Bytef*)src, src_size, Z_BEST_SPEED) != Z_OK)
+      return 0;
+
+   header[0] = htonl(flags);
+   header[1] = htonl(netplay->xfer_base_crc);
+   header[2] = htonl(src_size);
+   header[3] = htonl(payload_size);
+
+   return payload_size;
+}
+
+/**
+ * netplay_skip_payload:
+ * @netplay              : pointer to netplay object
+ * @size                 : bytes to skip
+ *
+ * Reads and drops the payload of a rejected message, so the 
+ * stream stays in step with the peer.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool netplay_skip_payload(netplay_t *netplay, size_t size)
+{
+   while (size)
+   {
+      size_t chunk = min(size, netplay->xfer_zbuf_size);
+
+      if (!chunk || !socket_receive_all_blocking(netplay->tcp_fd,
+               netplay->xfer_zbuf, chunk))
+         return false;
+      size -= chunk;
+   }
+
+   return true;
+}
+
+/**
+ * netplay_receive_state:
+ * @netplay              : pointer to netplay object
+ *
+ * Receives and inflates a savestate sent by netplay_send_savestate.
+ * On success, it is left in netplay->xfer_base, as the base for the 
+ * next delta.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool netplay_receive_state(netplay_t *netplay)
+{
+   uint32_t header[4];
+   uint32_t flags, base_crc;
+   uLongf size, payload_size;
+   bool is_delta;
+   void *dst;
+   retro_time_t start = rarch_get_time_usec();
+
+   if (!socket_receive_all_blocking(netplay->tcp_fd, header, sizeof(header)))
+      return false;
+
+   flags        = ntohl(header[0]);
+   base_crc     = ntohl(header[1]);
+   size         = ntohl(header[2]);
+   payload_size = ntohl(header[3]);
+   is_delta     = flags & NETPLAY_STATE_DELTA;
+
+   if (payload_size > netplay->xfer_zbuf_size
+         || (is_delta && size > state_delta_max_size(netplay->state_size))
+         || (!is_delta && size != netplay->state_size))
+   {
+      RARCH_ERR("Netplay state from peer has unexpected size.\n");
+      netplay_skip_payload(netplay, payload_size);
+      return false;
+   }
+
+   /* Always drain the payload, so the stream stays in step. */
+   if (!socket_receive_all_blocking(netplay->tcp_fd,
+            netplay->xfer_zbuf, payload_size))
+      return false;
+
+   if (is_delta && (!netplay->has_xfer_base
+            || base_crc != netplay->xfer_base_crc))
+   {
+      RARCH_ERR("Netplay state delta does not match our base state.\n");
+      netplay->has_xfer_base = false;
+      return false;
+   }
+
+   dst = is_delta ? netplay->xfer_patch : netplay->xfer_state;
+   if (uncompress((Bytef*)dst, &size, (const Bytef*)netplay->xfer_zbuf,
+            payload_size) != Z_OK || size != ntohl(header[2]))
+   {
+      RARCH_ERR("Failed to inflate netplay state from peer.\n");
+      return false;
+   }
+
+   if (is_delta)
+   {
+      memcpy(netplay->xfer_state, netplay->xfer_base, netplay->state_size);
+      state_delta_apply(netplay->xfer_patch, netplay->xfer_state);
+   }
+
+   netplay_set_xfer_base(netplay);
+
+   RARCH_LOG("Netplay state received: %lu bytes%s for %u, in %.1f ms.\n",
+         (unsigned long)payload_size, is_delta ? " (delta)" : "",
+         (unsigned)netplay->state_size,
+         (rarch_get_time_usec() - start) / 1000.0);
+
+   return true;
+}
+
+static uint64_t netplay_region_hash(const uint32_t *msg, unsigned i)
+{
+   return (uint64_t)ntohl(msg[3 + i * 2]) << 32 | ntohl(msg[4 + i * 2]);
+}
+
+/**
+ * netplay_locate_mismatch:
+ * @netplay              : pointer to netplay object
+ * @words                : size of netplay->region_msg in words
+ *
+ * Compares the host's region hashes in netplay->region_msg against 
+ * ours for the same frame, and logs which parts of the state differ.
+ *
+ * Returns: false if the message is malformed.
+ **/
+static bool netplay_locate_mismatch(netplay_t *netplay, size_t words)
+{
+   const uint32_t *msg = netplay->region_msg;
+   uint32_t frame      = ntohl(msg[0]);
+   size_t peer_size    = ntohl(msg[1]);
+   unsigned count      = ntohl(msg[2]);
+   unsigned differ     = 0;
+   unsigned runs       = 0;
+   size_t region_size  = 0;
+   unsigned i;
+
+   if (count > NETPLAY_HASH_REGIONS || words != 3 + count * 2)
+      return false;
+
+   if (netplay->has_region_hashes && netplay->region_frame == frame)
+      region_size = netplay->region_size;
+   else
+   {
+      uint32_t age = netplay->frame_count - frame;
+
+      if (frame > netplay->frame_count || age >= NETPLAY_BUF_SIZE)
+      {
+         RARCH_WARN("Netplay state of frame %u is gone, "
+               "cannot locate the mismatch.\n", frame);
+         return true;
+      }
+
+      if (!netplay_load_state(netplay,
+            (netplay->self_ptr + NETPLAY_BUF_SIZE - age) % NETPLAY_BUF_SIZE)
+            || netplay_hash_regions(netplay, &region_size) != count)
+         region_size = 0;
+   }
+
+   netplay->has_region_hashes = false;
+   netplay->region_frame      = frame;
+
+   if (region_size != peer_size)
+   {
+      RARCH_WARN("Netplay state sizes differ, "
+            "cannot locate the mismatch.\n");
+      return true;
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      unsigned start = i;
+
+      if (netplay_region_hash(msg, i) == netplay->region_hashes[i])
+         continue;
+
+      while (i + 1 < count && netplay_region_hash(msg, i + 1)
+            != netplay->region_hashes[i + 1])
+         i++;
+
+      differ += i - start + 1;
+      if (runs++ < 8)
+         RARCH_LOG("Netplay state differs at 0x%08x-0x%08x.\n",
+               (unsigned)(start * region_size),
+               (unsigned)(min((i + 1) * region_size,
+                     netplay->state_size) - 1));
+   }
+
+   RARCH_WARN("Netplay state mismatch at frame %u: %u of %u regions "
+         "of %u bytes differ, in %u run(s).\n",
+         frame, differ, count, (unsigned)region_size, runs);
+
+   if (config_get_ptr()->netplay_show_crc_checks)
+   {
+      char msg_str[64];
+      snprintf(msg_str, sizeof(msg_str),
+            "State mismatch\n%u region(s) of %u bytes",
+            differ, (unsigned)region_size);
+      rarch_main_msg_queue_push(msg_str, 1, 180, true);
+   }
+
+   return true;
+}
+
 static bool netplay_get_cmd(netplay_t *netplay)
 {
    uint32_t cmd, flip_frame;
@@ -331,9 +980,8 @@ static bool netplay_get_cmd(netplay_t *netplay)
             video_driver_cached_frame();
          }
 
-         if (!socket_receive_all_blocking(netplay->tcp_fd,
-               netplay->buffer[netplay->other_ptr].state,
-               netplay->state_size))
+         if (cmd_size != 4 * sizeof(uint32_t)
+               || !netplay_receive_state(netplay))
          {
             RARCH_ERR("Failed to receive netplay state from peer.\n");
             rarch_main_msg_queue_push("Failed to receive netplay state "
@@ -348,6 +996,20 @@ static bool netplay_get_cmd(netplay_t *netplay)
             rarch_main_msg_queue_push("Netplay state received.", 1, 180, true);
          return netplay_cmd_ack(netplay);
 
+      case NETPLAY_CMD_STATE_HASHES:
+         if (cmd_size % sizeof(uint32_t) != 0
+               || cmd_size > NETPLAY_HASH_MSG_WORDS * sizeof(uint32_t)
+               || !socket_receive_all_blocking(netplay->tcp_fd,
+                  netplay->region_msg, cmd_size)
+               || !netplay_locate_mismatch(netplay,
+                  cmd_size / sizeof(uint32_t)))
+         {
+            RARCH_ERR("Failed to receive state hashes from host.\n");
+            return netplay_cmd_nak(netplay);
+         }
+
+         return netplay_cmd_ack(netplay);
+
       default:
          break;
    }
@@ -459,32 +1121,84 @@ static bool receive_data(netplay_t *netplay, uint32_t *buffer, size_t size)
    return true;
 }
 
+/**
+ * netplay_measure_packet:
+ * @netplay              : pointer to netplay object
+ * @header               : header of a packet from the peer
+ *
+ * Updates RTT, jitter and packet loss. Resent and reordered 
+ * packets only count towards the RTT.
+ **/
+static void netplay_measure_packet(netplay_t *netplay, const uint32_t *header)
+{
+   uint32_t now       = netplay_time_ms();
+   uint32_t seq       = header[0];
+   uint32_t send_time = header[1];
+   uint32_t echo      = header[2];
+   int32_t transit    = (int32_t)(now - send_time);
+
+   if (echo && (int32_t)(now - echo) >= 0)
+   {
+      float rtt = (float)(int32_t)(now - echo);
+      netplay->rtt = netplay->rtt ? netplay->rtt + (rtt - netplay->rtt) / 8 : rtt;
+   }
+
+   if (netplay->has_peer_seq)
+   {
+      if ((int32_t)(seq - netplay->peer_seq) <= 0)
+         return;
+
+      /* Clocks differ, but only the change in transit time counts. */
+      netplay->packets_expected += seq - netplay->peer_seq;
+      netplay->jitter += (fabsf((float)(transit - netplay->peer_transit))
+            - netplay->jitter) / 16;
+   }
+   else
+      netplay->packets_expected++;
+
+   netplay->packets_received++;
+   netplay->peer_seq       = seq;
+   netplay->peer_send_time = send_time;
+   netplay->peer_recv_time = now;
+   netplay->peer_transit   = transit;
+   netplay->has_peer_seq   = true;
+}
+
 static void netplay_parse_packet(netplay_t *netplay, uint32_t *buffer)
 {
    int i;
 
-   for (i = 0; i < UDP_FRAME_PACKETS * 3; i++)
+   for (i = 0; i < UDP_PACKET_WORDS; i++)
       buffer[i] = ntohl(buffer[i]);
 
+   netplay_measure_packet(netplay, buffer);
+   netplay->peer_ack = buffer[3];
+   buffer += UDP_HEADER_WORDS;
+
    for (i = 0; i < UDP_FRAME_PACKETS
          && netplay->read_frame_count <= netplay->frame_count;
          i++)
    {
-      uint32_t frame, crc;
+      uint32_t frame, crc, offset;
       uint16_t state, lag;
 
       frame = buffer[3 * i];
       if (frame != netplay->read_frame_count)
          continue;
 
-      state = buffer[3 * i + 1] & 0xFFFF;
-      lag   = buffer[3 * i + 1] >> 16;
-      crc   = buffer[3 * i + 2];
+      state  = buffer[3 * i + 1] & 0xFFFF;
+      lag    = (buffer[3 * i + 1] >> 16) & 0xFF;
+      offset = buffer[3 * i + 1] >> 24;
+      crc    = buffer[3 * i + 2];
 
       netplay->buffer[netplay->read_ptr].is_simulated = false;
       netplay->buffer[netplay->read_ptr].peer_input_state = state;
-      netplay->buffer[netplay->read_ptr].peer_crc = crc;
       netplay->buffer[netplay->read_ptr].peer_lag = lag;
+
+      /* The CRC is for an older frame, if we still have it. */
+      if (crc && frame - offset + NETPLAY_BUF_SIZE > netplay->frame_count)
+         netplay->buffer[(netplay->read_ptr + NETPLAY_BUF_SIZE - offset)
+            % NETPLAY_BUF_SIZE].peer_crc = crc;
       netplay->read_ptr = NETPLAY_NEXT_PTR(netplay->read_ptr);
       netplay->read_frame_count++;
       netplay->timeout_cnt = 0;
@@ -571,7 +1285,7 @@ static void netplay_poll(netplay_t *netplay)
       uint32_t first_read = netplay->read_frame_count;
       do 
       {
-         uint32_t buffer[UDP_FRAME_PACKETS * 3];
+         uint32_t buffer[UDP_PACKET_WORDS];
          if (!receive_data(netplay, buffer, sizeof(buffer)))
          {
             netplay_disconnect();
@@ -643,16 +1357,11 @@ static bool netplay_is_alive(netplay_t *netplay)
    return netplay->has_connection;
 }
 
-static bool netplay_flip_port(netplay_t *netplay, bool port)
+static bool netplay_flip_port(netplay_t *netplay, bool port, uint32_t frame)
 {
-   size_t frame;
-
    if (netplay->flip_frame == 0)
       return port;
 
-   frame = netplay->in_replay ?
-      netplay->tmp_frame_count : netplay->frame_count;
-
    return port ^ netplay->flip ^ (frame < netplay->flip_frame);
 }
 
@@ -662,7 +1371,9 @@ static int16_t netplay_input_state(netplay_t *netplay, bool port,
    size_t ptr = netplay->in_replay ? netplay->tmp_ptr : netplay->self_ptr;
    uint16_t input_state;
 
-   if (netplay->port == (netplay_flip_port(netplay, port) ? 1 : 0))
+   if (netplay->port == (netplay_flip_port(netplay, port,
+               netplay->in_replay ?
+               netplay->tmp_frame_count : netplay->frame_count) ? 1 : 0))
    {
       if (netplay->buffer[ptr].is_simulated)
          input_state = netplay->buffer[ptr].sim_peer_input_state;
@@ -683,6 +1394,13 @@ int16_t input_state_net(unsigned port, unsigned device,
 {
    driver_t *driver = driver_get_ptr();
    netplay_t *netplay = (netplay_t*)driver->netplay_data;
+   if (netplay_is_alive(netplay) && netplay->is_spectator)
+   {
+      uint16_t input_state = netplay->spectate_input[port ? 1 : 0];
+      if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
+         return input_state;
+      return ((1 << id) & input_state) ? 1 : 0;
+   }
    if (netplay_is_alive(netplay))
       return netplay_input_state(netplay, port, device, idx, id);
    return netplay->cbs.state_cb(port, device, idx, id);
@@ -1023,6 +1741,8 @@ static uint32_t implementation_magic_value(void)
    for (i = 0; i < len; i++)
       res ^= ver[i] << ((i & 0xf) + 16);
 
+   res ^= (uint32_t)NETPLAY_PROTOCOL_VERSION << 24;
+
    return res;
 }
 
@@ -1075,6 +1795,7 @@ static bool send_info(netplay_t *netplay)
    char msg[512]      = {0};
    void *sram         = NULL;
    uint32_t header[3] = {0};
+   uint32_t check[2];
    global_t *global   = global_get_ptr();
    
    header[0] = htonl(global->content_crc);
@@ -1111,6 +1832,16 @@ static bool send_info(netplay_t *netplay)
       return false;
    }
 
+   /* State checks have to line up, so use the host's settings. */
+   if (!socket_receive_all_blocking(netplay->tcp_fd, check, sizeof(check)))
+   {
+      RARCH_ERR("Failed to receive state check settings from host.\n");
+      return false;
+   }
+
+   netplay->check_frames = max(ntohl(check[0]), 1);
+   netplay->check_sample = max(ntohl(check[1]), 1);
+
    snprintf(msg, sizeof(msg), "Connected to: \"%s (%s)\"",
             netplay->other_nick, global->netplay_server);
    RARCH_LOG("%s\n", msg);
@@ -1122,6 +1853,7 @@ static bool send_info(netplay_t *netplay)
 static bool get_info(netplay_t *netplay)
 {
    uint32_t header[3];
+   uint32_t check[2];
    const void *sram = NULL;
    global_t *global = global_get_ptr();
 
@@ -1186,11 +1918,20 @@ static bool get_info(netplay_t *netplay)
       return false;
    }
 
-#ifndef HAVE_SOCKET_LEGACY
-   log_connection(&netplay->other_addr, 0, netplay->other_nick);
-#endif
+   check[0] = htonl(netplay->check_frames);
+   check[1] = htonl(netplay->check_sample);
 
-   return true;
+   if (!socket_send_all_blocking(netplay->tcp_fd, check, sizeof(check)))
+   {
+      RARCH_ERR("Failed to send state check settings to client.\n");
+      return false;
+   }
+
+#ifndef HAVE_SOCKET_LEGACY
+   log_connection(&netplay->other_addr, 0, netplay->other_nick);
+#endif
+
+   return true;
 }
 
 static bool netplay_init_buffers(netplay_t *netplay)
@@ -1210,15 +1951,44 @@ static bool netplay_init_buffers(netplay_t *netplay)
    netplay->state_size = pretro_serialize_size();
 
    for (i = 0; i < NETPLAY_BUF_SIZE; i++)
+      netplay->buffer[i].is_simulated = true;
+
+   for (i = 0; i < NETPLAY_KEYFRAMES; i++)
    {
-      netplay->buffer[i].state = calloc(netplay->state_size, 1);
+      netplay->keyframes[i].state = calloc(
+            state_delta_buffer_size(netplay->state_size), 1);
 
-      if (!netplay->buffer[i].state)
+      if (!netplay->keyframes[i].state)
          return false;
-
-      netplay->buffer[i].is_simulated = true;
    }
 
+   netplay->state = calloc(state_delta_buffer_size(netplay->state_size), 1);
+   netplay->patch = malloc(state_delta_max_size(netplay->state_size));
+
+   if (!netplay->state || !netplay->patch)
+      return false;
+
+   netplay->xfer_zbuf_size = compressBound(
+         state_delta_max_size(netplay->state_size));
+   netplay->xfer_base  = calloc(
+         state_delta_buffer_size(netplay->state_size), 1);
+   netplay->xfer_state = calloc(
+         state_delta_buffer_size(netplay->state_size), 1);
+   netplay->xfer_patch = malloc(state_delta_max_size(netplay->state_size));
+   netplay->xfer_zbuf  = malloc(netplay->xfer_zbuf_size);
+
+   if (!netplay->xfer_base || !netplay->xfer_state
+         || !netplay->xfer_patch || !netplay->xfer_zbuf)
+      return false;
+
+   netplay->region_hashes = (uint64_t*)malloc(
+         NETPLAY_HASH_REGIONS * sizeof(uint64_t));
+   netplay->region_msg    = (uint32_t*)malloc(
+         NETPLAY_HASH_MSG_WORDS * sizeof(uint32_t));
+
+   if (!netplay->region_hashes || !netplay->region_msg)
+      return false;
+
    return true;
 }
 
@@ -1238,6 +2008,7 @@ netplay_t *netplay_new(const char *server, const char *nick,
                        const struct retro_callbacks *cb)
 {
    netplay_t *netplay = NULL;
+   unsigned i;
 
    netplay = (netplay_t*)calloc(1, sizeof(*netplay));
    if (!netplay)
@@ -1248,12 +2019,20 @@ netplay_t *netplay_new(const char *server, const char *nick,
    netplay->cbs     = *cb;
    netplay->is_host = server ? false : true;
    netplay->port    = server ? 0 : 1;
+   netplay->check_frames = max(config_get_ptr()->netplay_check_frames, 1);
+   netplay->check_sample = max(config_get_ptr()->netplay_check_sample, 1);
+   netplay->is_spectator = server && global_get_ptr()->netplay_is_spectate;
+   netplay->spectate_fd  = -1;
+   netplay->max_spectators = min(config_get_ptr()->netplay_max_spectators,
+         NETPLAY_MAX_SPECTATORS);
+   for (i = 0; i < NETPLAY_MAX_SPECTATORS; i++)
+      netplay->spectators[i].fd = -1;
    strlcpy(netplay->nick, nick, sizeof(netplay->nick));
 
    if (!netplay_init_buffers(netplay))
    {
       netplay_free(netplay);
-      netplay = NULL;
+      return NULL;
    }
 
    /* Get SRAM size at frame 0 for consistency (hopefully) */
@@ -1261,6 +2040,157 @@ netplay_t *netplay_new(const char *server, const char *nick,
    return netplay;
 }
 
+/**
+ * netplay_spectate_wait:
+ * @netplay              : pointer to netplay object
+ *
+ * Waits for the host's stream, letting the user give up.
+ *
+ * Returns: false if the connection failed or the user gave up.
+ **/
+static bool netplay_spectate_wait(netplay_t *netplay)
+{
+   for (;;)
+   {
+      fd_set fds;
+      struct timeval tv = {0};
+      int ret;
+
+      tv.tv_usec = RETRY_MS * 1000;
+
+      FD_ZERO(&fds);
+      FD_SET(netplay->tcp_fd, &fds);
+
+      ret = socket_select(netplay->tcp_fd + 1, &fds, NULL, NULL, &tv);
+      if (ret < 0)
+         return false;
+      if (ret > 0)
+         return true;
+
+      if (hold_back_to_cancel_iterate(6))
+         return false;
+   }
+}
+
+/**
+ * netplay_spectate_listen:
+ * @netplay              : pointer to netplay object
+ * @port                 : port to listen on
+ *
+ * Opens the socket spectators connect to.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool netplay_spectate_listen(netplay_t *netplay, uint16_t port)
+{
+   char port_buf[16]               = {0};
+   const struct addrinfo *tmp_info = NULL;
+   struct addrinfo hints, *res     = NULL;
+
+   memset(&hints, 0, sizeof(hints));
+
+#if defined(_WIN32) || defined(HAVE_SOCKET_LEGACY)
+   hints.ai_family   = AF_INET;
+#else
+   hints.ai_family   = AF_UNSPEC;
+#endif
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags    = AI_PASSIVE;
+
+   snprintf(port_buf, sizeof(port_buf), "%hu", (unsigned short)port);
+   if (getaddrinfo_rarch(NULL, port_buf, &hints, &res) < 0 || !res)
+      return false;
+
+   for (tmp_info = res; tmp_info; tmp_info = tmp_info->ai_next)
+   {
+      int yes = 1;
+      int fd  = socket(tmp_info->ai_family,
+            tmp_info->ai_socktype, tmp_info->ai_protocol);
+
+      if (fd < 0)
+         continue;
+
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
+            (const char*)&yes, sizeof(int));
+
+      if (bind(fd, tmp_info->ai_addr, tmp_info->ai_addrlen) < 0
+            || listen(fd, NETPLAY_MAX_SPECTATORS) < 0)
+      {
+         socket_close(fd);
+         continue;
+      }
+
+      netplay->spectate_fd = fd;
+      break;
+   }
+
+   freeaddrinfo_rarch(res);
+
+   if (netplay->spectate_fd < 0)
+      return false;
+
+   RARCH_LOG("Netplay spectators can join on port %hu.\n",
+         (unsigned short)port);
+   return true;
+}
+
+/**
+ * netplay_spectate_connect:
+ * @netplay              : pointer to netplay object
+ * @server               : host to watch
+ * @port                 : the host's spectator port
+ *
+ * Connects to a host as a spectator and checks that both run 
+ * the same content, core and state size.
+ *
+ * Returns: true (1) if successful, otherwise false (0).
+ **/
+static bool netplay_spectate_connect(netplay_t *netplay,
+      const char *server, uint16_t port)
+{
+   global_t *global = global_get_ptr();
+   uint32_t header[5];
+
+   if (!network_init() || init_tcp_socket(netplay, server, port) != 1)
+      goto error;
+
+   /* The host might still be waiting for its client. */
+   if (!netplay_spectate_wait(netplay)
+         || !socket_receive_all_blocking(netplay->tcp_fd,
+            header, sizeof(header)))
+   {
+      RARCH_ERR("Failed to receive header from host.\n");
+      goto error;
+   }
+
+   if (global->content_crc != ntohl(header[0])
+         || implementation_magic_value() != ntohl(header[1])
+         || netplay->state_size != ntohl(header[2]))
+   {
+      RARCH_ERR("Cannot spectate, the host runs different content "
+            "or a different core.\n");
+      rarch_main_msg_queue_push("Cannot spectate, the host runs "
+            "different content or a different core.", 1, 240, true);
+      goto error;
+   }
+
+   netplay->check_frames = max(ntohl(header[3]), 1);
+   netplay->check_sample = max(ntohl(header[4]), 1);
+
+   RARCH_LOG("Spectating \"%s\".\n", server);
+   rarch_main_msg_queue_push("Spectating netplay.", 1, 180, true);
+
+   netplay->has_connection = true;
+   return true;
+
+error:
+   deinit_netplay();
+   RARCH_WARN(RETRO_LOG_INIT_NETPLAY_FAILED);
+   rarch_main_msg_queue_push(RETRO_MSG_INIT_NETPLAY_FAILED, 2, 180, false);
+
+   return false;
+}
+
 bool netplay_connect(netplay_t *netplay)
 {
    global_t *global = global_get_ptr();
@@ -1268,6 +2198,18 @@ bool netplay_connect(netplay_t *netplay)
    uint16_t port = global->netplay_port ? global->netplay_port : RARCH_DEFAULT_PORT;
    int ret = 0;
 
+   if (netplay->is_spectator)
+      return netplay_spectate_connect(netplay, server, port + 1);
+
+   /* Spectators may line up while we wait for the client. */
+   if (netplay->is_host && netplay->max_spectators
+         && netplay->spectate_fd < 0
+         && !netplay_spectate_listen(netplay, port + 1))
+   {
+      RARCH_WARN("Failed to open netplay port for spectators.\n");
+      netplay->max_spectators = 0;
+   }
+
    ret = init_socket(netplay, server, port);
 
    if (ret == -1)
@@ -1369,7 +2311,13 @@ bool netplay_send_savestate(bool silent)
 {
    driver_t *driver   = driver_get_ptr();
    netplay_t *netplay = (netplay_t*)driver->netplay_data;
-   void *savestate    = netplay->buffer[netplay->other_ptr].state;
+   void *savestate    = netplay->state;
+
+   if (netplay->is_spectator)
+   {
+      RARCH_WARN("Loading a state leaves the spectated game.\n");
+      return false;
+   }
 
    netplay->use_rollback_states = true;
    pretro_serialize(savestate, netplay->state_size);
@@ -1380,11 +2328,36 @@ bool netplay_send_savestate(bool silent)
       video_driver_cached_frame();
    }
 
-   if (!netplay_send_cmd(netplay, silent ?
-         NETPLAY_CMD_RESYNC : NETPLAY_CMD_LOAD_SAVESTATE,
-         savestate, netplay->state_size)
-         || !netplay_get_response(netplay))
+   for (;;)
    {
+      uint32_t header[4];
+      retro_time_t start  = rarch_get_time_usec();
+      size_t payload_size = netplay_pack_state(netplay, savestate, header);
+
+      if (payload_size
+            && netplay_send_cmd(netplay, silent ?
+               NETPLAY_CMD_RESYNC : NETPLAY_CMD_LOAD_SAVESTATE,
+               header, sizeof(header))
+            && socket_send_all_blocking(netplay->tcp_fd,
+               netplay->xfer_zbuf, payload_size)
+            && netplay_get_response(netplay))
+      {
+         netplay_set_xfer_base(netplay);
+         RARCH_LOG("Netplay state sent: %u bytes%s for %u, in %.1f ms.\n",
+               (unsigned)payload_size,
+               ntohl(header[0]) & NETPLAY_STATE_DELTA ? " (delta)" : "",
+               (unsigned)netplay->state_size,
+               (rarch_get_time_usec() - start) / 1000.0);
+         break;
+      }
+
+      /* Peer may have lost our base state, try once more in full. */
+      if (netplay->has_xfer_base)
+      {
+         netplay->has_xfer_base = false;
+         continue;
+      }
+
       RARCH_LOG("Failed to send netplay state.\n");
       rarch_main_msg_queue_push("Failed to send netplay state.", 2, 180, true);
       return false;
@@ -1408,30 +2381,46 @@ void netplay_free(netplay_t *netplay)
 {
    unsigned i;
 
-   for (i = 0; i < NETPLAY_BUF_SIZE; i++)
-      free(netplay->buffer[i].state);
+   if (netplay->buffer)
+      for (i = 0; i < NETPLAY_BUF_SIZE; i++)
+         free(netplay->buffer[i].patch);
    free(netplay->buffer);
 
+   for (i = 0; i < NETPLAY_KEYFRAMES; i++)
+      free(netplay->keyframes[i].state);
+   free(netplay->state);
+   free(netplay->patch);
+
+   free(netplay->xfer_base);
+   free(netplay->xfer_state);
+   free(netplay->xfer_patch);
+   free(netplay->xfer_zbuf);
+
+   free(netplay->region_hashes);
+   free(netplay->region_msg);
+
+   for (i = 0; i < NETPLAY_MAX_SPECTATORS; i++)
+      free(netplay->spectators[i].buf);
+
    if (netplay->addr)
       freeaddrinfo_rarch(netplay->addr);
 
    free(netplay);
 }
 
-static void netplay_update_state_crc(netplay_t *netplay,
-      size_t buf_idx, size_t frame)
-{
-   struct delta_frame *ptr = &netplay->buffer[buf_idx];
-
-   if (frame % SYNC_PERIOD == SYNC_PERIOD - 1)
-      ptr->self_crc = crc32(0, ptr->state, netplay->state_size);
-   else
-      ptr->self_crc = 0;
-}
-
 static void netplay_replay_frames(netplay_t *netplay)
 {
-   driver_t *driver = driver_get_ptr();
+   driver_t *driver   = driver_get_ptr();
+   retro_time_t start = rarch_get_time_usec();
+   unsigned depth     = netplay->frame_count - netplay->other_frame_count;
+   float frame_time;
+
+   /* Nothing to replay from. The resync under way replaces it. */
+   if (!netplay_load_state(netplay, netplay->other_ptr))
+   {
+      netplay->in_replay = false;
+      return;
+   }
 
    driver->audio_suspended  = true;
    driver->video_active     = false;
@@ -1447,8 +2436,7 @@ static void netplay_replay_frames(netplay_t *netplay)
       rarch_main_msg_queue_push(msg, 0, 60, true);
    }
 
-   pretro_unserialize(netplay->buffer[netplay->other_ptr].state,
-         netplay->state_size);
+   pretro_unserialize(netplay->state, netplay->state_size);
 
    do {
 #if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
@@ -1466,20 +2454,110 @@ static void netplay_replay_frames(netplay_t *netplay)
       netplay->tmp_ptr = NETPLAY_NEXT_PTR(netplay->tmp_ptr);
       netplay->tmp_frame_count++;
 
-      pretro_serialize(netplay->buffer[netplay->tmp_ptr].state,
-            netplay->state_size);
-
-      /* Recompute CRC */
-      netplay_update_state_crc(netplay,
+      pretro_serialize(netplay->state, netplay->state_size);
+      netplay_store_state(netplay,
             netplay->tmp_ptr, netplay->tmp_frame_count);
 
    } while (netplay->tmp_frame_count < netplay->frame_count);
 
+   if (depth)
+   {
+      retro_time_t elapsed = rarch_get_time_usec() - start;
+
+      frame_time = (float)elapsed / depth;
+      netplay->replay_frame_time = netplay->replay_frame_time
+         ? netplay->replay_frame_time
+         + (frame_time - netplay->replay_frame_time) / 8
+         : frame_time;
+
+      netplay->totals.rollbacks++;
+      netplay->totals.replayed_frames += depth;
+      if (depth > netplay->totals.max_rollback)
+         netplay->totals.max_rollback = depth;
+
+      netplay->rollbacks++;
+      netplay->rollback_frames += depth;
+      netplay->replay_time     += elapsed;
+      if (depth > netplay->max_rollback)
+         netplay->max_rollback = depth;
+   }
+
    netplay->in_replay         = false;
    driver->audio_suspended    = false;
    driver->video_active       = true;
 }
 
+/**
+ * netplay_pre_frame_spectate:
+ * @netplay : pointer to netplay object
+ *
+ * Reads the host's stream up to the input for this frame, 
+ * loading any state that comes along first.
+ **/
+static void netplay_pre_frame_spectate(netplay_t *netplay)
+{
+   if (!netplay->has_connection && !netplay_connect(netplay))
+      return;
+
+   for (;;)
+   {
+      uint32_t cmd, cmd_size, msg[3], frame, crc;
+
+      if (!netplay_spectate_wait(netplay)
+            || !socket_receive_all_blocking(netplay->tcp_fd,
+               &cmd, sizeof(cmd)))
+         goto error;
+
+      cmd      = ntohl(cmd);
+      cmd_size = cmd & 0xffff;
+      cmd      = cmd >> 16;
+
+      if (cmd == NETPLAY_CMD_SPECTATE_STATE
+            && cmd_size == 5 * sizeof(uint32_t))
+      {
+         if (!socket_receive_all_blocking(netplay->tcp_fd,
+                  msg, sizeof(uint32_t))
+               || !netplay_receive_state(netplay))
+            goto error;
+
+         pretro_unserialize(netplay->xfer_base, netplay->state_size);
+         netplay->frame_count = ntohl(msg[0]);
+         continue;
+      }
+
+      if (cmd != NETPLAY_CMD_SPECTATE_INPUT
+            || cmd_size != sizeof(msg)
+            || !socket_receive_all_blocking(netplay->tcp_fd,
+               msg, sizeof(msg))
+            || ntohl(msg[0]) != netplay->frame_count)
+      {
+         RARCH_ERR("Netplay spectator stream is out of step.\n");
+         goto error;
+      }
+
+      frame = ntohl(msg[0]);
+      crc   = ntohl(msg[2]);
+      netplay->spectate_input[0] = ntohl(msg[1]) & 0xFFFF;
+      netplay->spectate_input[1] = ntohl(msg[1]) >> 16;
+
+      if (crc && frame % netplay->check_frames == netplay->check_frames - 1)
+      {
+         pretro_serialize(netplay->state, netplay->state_size);
+
+         netplay->totals.crc_checks++;
+         if (netplay_hash_state(netplay, frame) != crc)
+         {
+            netplay->totals.crc_mismatches++;
+            RARCH_WARN("Spectated game drifted at frame %u.\n", frame);
+         }
+      }
+      return;
+   }
+
+error:
+   netplay_disconnect();
+}
+
 /**
  * netplay_pre_frame:   
  * @netplay : pointer to netplay object
@@ -1490,16 +2568,19 @@ static void netplay_replay_frames(netplay_t *netplay)
 void netplay_pre_frame(netplay_t *netplay)
 {
    struct delta_frame *ptr;
+
+   if (netplay->is_spectator)
+   {
+      netplay_pre_frame_spectate(netplay);
+      return;
+   }
+
    netplay->use_rollback_states = true;
 
    if (!netplay->need_resync)
    {
-      ptr = &netplay->buffer[netplay->self_ptr];
-      pretro_serialize(ptr->state, netplay->state_size);
-
-      /* Periodically compute savestate CRC */
-      netplay_update_state_crc(netplay,
-            netplay->self_ptr, netplay->frame_count);
+      pretro_serialize(netplay->state, netplay->state_size);
+      netplay_store_state(netplay, netplay->self_ptr, netplay->frame_count);
    }
 
    /* Update input buffer and simulate missing input */
@@ -1529,6 +2610,391 @@ void netplay_pre_frame(netplay_t *netplay)
       netplay_replay_frames(netplay);
 }
 
+/**
+ * netplay_update_input_delay:
+ * @netplay : pointer to netplay object
+ *
+ * Moves the input delay one frame towards the smallest one which keeps 
+ * rollback replays within netplay_replay_budget.
+ **/
+static void netplay_update_input_delay(netplay_t *netplay)
+{
+   settings_t *settings = config_get_ptr();
+   double fps           = video_viewport_get_system_av_info()->timing.fps;
+   float frame_time     = 1000000.0f / (fps > 0.0 ? fps : 60.0);
+   float budget         = frame_time * settings->netplay_replay_budget / 100;
+   float replay_cost    = (float)netplay->replay_time / netplay->stats_frames;
+   unsigned max_delay   = settings->netplay_max_input_delay;
+   unsigned late, allowed, target;
+
+   if (max_delay > NETPLAY_MAX_DELAY)
+      max_delay = NETPLAY_MAX_DELAY;
+
+   /* How many frames late peer input would be without any delay */
+   late = (unsigned)ceil((netplay->rtt / 2 + netplay->jitter * 2)
+         * 1000 / frame_time);
+
+   /* How deep rollbacks may be to stay within budget */
+   allowed = late;
+   if (netplay->replay_frame_time > 0)
+      allowed = (unsigned)(budget / netplay->replay_frame_time);
+
+   target = late > allowed ? late - allowed : 0;
+
+   /* Whatever the cause, such as packet loss, replays cost too much. 
+    * And don't give back delay while they're anywhere near. */
+   if (replay_cost > budget && target <= netplay->input_delay)
+      target = netplay->input_delay + 1;
+   else if (replay_cost > budget / 2 && target < netplay->input_delay)
+      target = netplay->input_delay;
+
+   if (target > max_delay)
+      target = max_delay;
+
+   if (target == netplay->input_delay)
+      return;
+
+   netplay->input_delay += target > netplay->input_delay ? 1 : -1;
+   RARCH_LOG("Netplay input delay: %u frame(s).\n", netplay->input_delay);
+}
+
+/**
+ * netplay_update_stats:
+ * @netplay : pointer to netplay object
+ *
+ * Closes a stats window every NETPLAY_STATS_WINDOW frames, adapts 
+ * the input delay to it, and shows and logs the stats.
+ **/
+static void netplay_update_stats(netplay_t *netplay)
+{
+   settings_t *settings = config_get_ptr();
+   char msg[256];
+
+   if (++netplay->stats_frames < NETPLAY_STATS_WINDOW)
+      return;
+
+   if (netplay->packets_expected)
+      netplay->loss = 1.0f - (float)netplay->packets_received
+         / netplay->packets_expected;
+
+   netplay_update_input_delay(netplay);
+
+   snprintf(msg, sizeof(msg),
+         "RTT: %.0f ms, jitter: %.1f ms, loss: %.1f%%\n"
+         "Rollback: %.1f frames avg, %u max, %.2f ms/frame\n"
+         "Input delay: %u",
+         netplay->rtt, netplay->jitter, netplay->loss * 100,
+         netplay->rollbacks
+         ? (float)netplay->rollback_frames / netplay->rollbacks : 0.0f,
+         netplay->max_rollback, netplay->replay_frame_time / 1000,
+         netplay->input_delay);
+
+   if (settings->netplay_show_stats)
+      rarch_main_msg_queue_push(msg, 1, NETPLAY_STATS_WINDOW, true);
+
+   if (++netplay->stats_windows % NETPLAY_STATS_LOG_PERIOD == 0)
+   {
+      char *nl;
+      while ((nl = strchr(msg, '\n')))
+         *nl = ' ';
+      RARCH_LOG("Netplay: %s, %u rollback(s) in %u frames.\n",
+            msg, netplay->rollbacks, netplay->stats_frames);
+   }
+
+   netplay->stats_frames     = 0;
+   netplay->packets_received = 0;
+   netplay->packets_expected = 0;
+   netplay->rollbacks        = 0;
+   netplay->rollback_frames  = 0;
+   netplay->max_rollback     = 0;
+   netplay->replay_time      = 0;
+}
+
+/**
+ * netplay_spectator_drop:
+ * @spectator            : spectator to drop
+ * @reason               : why, for the log
+ *
+ * Closes a spectator's connection and frees its slot.
+ **/
+static void netplay_spectator_drop(struct netplay_spectator *spectator,
+      const char *reason)
+{
+   RARCH_WARN("Netplay spectator dropped, %s.\n", reason);
+
+   socket_close(spectator->fd);
+   free(spectator->buf);
+   memset(spectator, 0, sizeof(*spectator));
+   spectator->fd = -1;
+}
+
+/**
+ * netplay_spectator_queue:
+ * @spectator            : spectator to send to
+ * @data                 : data to send
+ * @size                 : size of @data
+ *
+ * Appends data to the spectator's stream. Drops the spectator 
+ * if it can't be buffered.
+ **/
+static void netplay_spectator_queue(struct netplay_spectator *spectator,
+      const void *data, size_t size)
+{
+   if (spectator->fd < 0)
+      return;
+
+   if (spectator->head && spectator->size + size > spectator->capacity)
+   {
+      memmove(spectator->buf, spectator->buf + spectator->head,
+            spectator->size - spectator->head);
+      spectator->size -= spectator->head;
+      spectator->head  = 0;
+   }
+
+   if (spectator->size + size > spectator->capacity)
+   {
+      size_t capacity = max(max(spectator->capacity * 2,
+               spectator->size + size), 4096);
+      uint8_t *buf    = (uint8_t*)realloc(spectator->buf, capacity);
+
+      if (!buf)
+      {
+         netplay_spectator_drop(spectator, "out of memory");
+         return;
+      }
+
+      spectator->buf      = buf;
+      spectator->capacity = capacity;
+   }
+
+   memcpy(spectator->buf + spectator->size, data, size);
+   spectator->size += size;
+}
+
+/**
+ * netplay_spectator_flush:
+ * @netplay              : pointer to netplay object
+ * @spectator            : spectator to send to
+ *
+ * Sends as much of the spectator's stream as the socket takes 
+ * without blocking.
+ **/
+static void netplay_spectator_flush(netplay_t *netplay,
+      struct netplay_spectator *spectator)
+{
+   while (spectator->head < spectator->size)
+   {
+      ssize_t ret = send(spectator->fd,
+            (const char*)spectator->buf + spectator->head,
+            spectator->size - spectator->head, MSG_NOSIGNAL);
+
+      if (ret <= 0)
+      {
+         if (isagain((int)ret))
+            break;
+         netplay_spectator_drop(spectator, "connection lost");
+         return;
+      }
+
+      spectator->head += ret;
+   }
+
+   if (spectator->head == spectator->size)
+      spectator->head = spectator->size = 0;
+   else if (spectator->size - spectator->head
+         > netplay->xfer_zbuf_size + NETPLAY_SPECTATE_BACKLOG)
+      netplay_spectator_drop(spectator, "it could not keep up");
+}
+
+static void netplay_spectate_accept(netplay_t *netplay)
+{
+   while (check_for_client(&netplay->spectate_fd))
+   {
+      struct netplay_spectator *spectator = NULL;
+      struct sockaddr_storage addr;
+      socklen_t addr_size = sizeof(addr);
+      uint32_t header[5];
+      unsigned i, watching = 1;
+      char msg[64];
+      int fd = accept(netplay->spectate_fd,
+            (struct sockaddr*)&addr, &addr_size);
+
+      if (fd < 0)
+         return;
+
+      for (i = 0; i < netplay->max_spectators; i++)
+      {
+         if (netplay->spectators[i].fd >= 0)
+            watching++;
+         else if (!spectator)
+            spectator = &netplay->spectators[i];
+      }
+
+      if (!spectator)
+      {
+         RARCH_WARN("Netplay spectator turned away, "
+               "%u are watching already.\n", netplay->max_spectators);
+         socket_close(fd);
+         continue;
+      }
+
+      socket_set_block(fd, false);
+      set_tcp_nodelay(fd);
+
+      spectator->fd         = fd;
+      spectator->need_state = true;
+
+      header[0] = htonl(global_get_ptr()->content_crc);
+      header[1] = htonl(implementation_magic_value());
+      header[2] = htonl(netplay->state_size);
+      header[3] = htonl(netplay->check_frames);
+      header[4] = htonl(netplay->check_sample);
+      netplay_spectator_queue(spectator, header, sizeof(header));
+
+      snprintf(msg, sizeof(msg), "Netplay spectator joined, %u watching.",
+            watching);
+      RARCH_LOG("%s\n", msg);
+      rarch_main_msg_queue_push(msg, 1, 180, false);
+   }
+}
+
+static uint16_t netplay_spectate_port_input(netplay_t *netplay,
+      size_t buf_idx, uint32_t frame, bool port)
+{
+   if (netplay->port == (netplay_flip_port(netplay, port, frame) ? 1 : 0))
+      return netplay->buffer[buf_idx].peer_input_state;
+   return netplay->buffer[buf_idx].self_input_state;
+}
+
+/**
+ * netplay_spectate_update:
+ * @netplay              : pointer to netplay object
+ *
+ * Lets new spectators in, and streams the input and state check 
+ * hashes of frames that became confirmed since the last call. 
+ * New spectators first get the state of the oldest unconfirmed 
+ * frame, compressed once for all of them. Never waits on a spectator.
+ **/
+static void netplay_spectate_update(netplay_t *netplay)
+{
+   uint32_t end    = netplay->other_frame_count;
+   bool need_state = false;
+   uint32_t frame;
+   unsigned i;
+
+   netplay_spectate_accept(netplay);
+
+   if (!netplay->has_connection)
+      end = netplay->spectate_frame;
+   else if (netplay->spectate_frame > end
+         || end - netplay->spectate_frame >= NETPLAY_BUF_SIZE)
+   {
+      for (i = 0; i < NETPLAY_MAX_SPECTATORS; i++)
+         netplay->spectators[i].need_state = true;
+      netplay->spectate_frame = end;
+   }
+
+   for (frame = netplay->spectate_frame; frame < end; frame++)
+   {
+      size_t buf_idx = (netplay->other_ptr + NETPLAY_BUF_SIZE
+            - (end - frame)) % NETPLAY_BUF_SIZE;
+      uint32_t msg[4];
+
+      msg[0] = htonl(NETPLAY_CMD_SPECTATE_INPUT << 16 | 3 * sizeof(uint32_t));
+      msg[1] = htonl(frame);
+      msg[2] = htonl(netplay_spectate_port_input(netplay, buf_idx, frame, 0)
+            | netplay_spectate_port_input(netplay, buf_idx, frame, 1) << 16);
+      /* Hash of the confirmed state at the start of the frame, 
+       * on check frames, so spectators can tell if they drifted */
+      msg[3] = htonl(netplay->buffer[buf_idx].self_crc);
+
+      for (i = 0; i < NETPLAY_MAX_SPECTATORS; i++)
+         if (!netplay->spectators[i].need_state)
+            netplay_spectator_queue(&netplay->spectators[i], msg, sizeof(msg));
+   }
+   netplay->spectate_frame = end;
+
+   for (i = 0; i < NETPLAY_MAX_SPECTATORS; i++)
+      if (netplay->spectators[i].fd >= 0 && netplay->spectators[i].need_state
+            && netplay->has_connection)
+         need_state = true;
+
+   if (need_state && netplay_load_state(netplay, netplay->other_ptr))
+   {
+      uLongf payload_size = netplay->xfer_zbuf_size;
+      uint32_t msg[6];
+
+      if (compress2((Bytef*)netplay->xfer_zbuf, &payload_size,
+               (const Bytef*)netplay->state, netplay->state_size,
+               Z_BEST_SPEED) != Z_OK)
+         payload_size = 0;
+
+      msg[0] = htonl(NETPLAY_CMD_SPECTATE_STATE << 16 | 5 * sizeof(uint32_t));
+      msg[1] = htonl(end);
+      msg[2] = htonl(0);
+      msg[3] = htonl(0);
+      msg[4] = htonl(netplay->state_size);
+      msg[5] = htonl(payload_size);
+
+      for (i = 0; i < NETPLAY_MAX_SPECTATORS; i++)
+      {
+         struct netplay_spectator *spectator = &netplay->spectators[i];
+
+         if (spectator->fd < 0 || !spectator->need_state)
+            continue;
+
+         if (!payload_size)
+         {
+            netplay_spectator_drop(spectator, "state did not compress");
+            continue;
+         }
+
+         netplay_spectator_queue(spectator, msg, sizeof(msg));
+         netplay_spectator_queue(spectator, netplay->xfer_zbuf, payload_size);
+         spectator->need_state = false;
+      }
+   }
+
+   for (i = 0; i < NETPLAY_MAX_SPECTATORS; i++)
+      if (netplay->spectators[i].fd >= 0)
+         netplay_spectator_flush(netplay, &netplay->spectators[i]);
+}
+
+/**
+ * netplay_send_region_hashes:
+ * @netplay              : pointer to netplay object
+ * @buf_idx              : rollback buffer entry
+ * @frame                : frame of the entry
+ *
+ * Sends the region hashes of a mismatched state to the client.
+ **/
+static void netplay_send_region_hashes(netplay_t *netplay,
+      size_t buf_idx, uint32_t frame)
+{
+   uint32_t *msg      = netplay->region_msg;
+   size_t region_size = 0;
+   unsigned count, i;
+
+   if (!netplay_load_state(netplay, buf_idx))
+      return;
+   count = netplay_hash_regions(netplay, &region_size);
+
+   msg[0] = htonl(frame);
+   msg[1] = htonl(region_size);
+   msg[2] = htonl(count);
+
+   for (i = 0; i < count; i++)
+   {
+      msg[3 + i * 2] = htonl((uint32_t)(netplay->region_hashes[i] >> 32));
+      msg[4 + i * 2] = htonl((uint32_t)netplay->region_hashes[i]);
+   }
+
+   if (!netplay_send_cmd(netplay, NETPLAY_CMD_STATE_HASHES,
+            msg, (3 + count * 2) * sizeof(uint32_t))
+         || !netplay_get_response(netplay))
+      RARCH_WARN("Failed to send state hashes to client.\n");
+}
+
 /**
  * netplay_post_frame:
  * @netplay : pointer to netplay object
@@ -1543,6 +3009,16 @@ void netplay_post_frame(netplay_t *netplay)
    size_t end_ptr          = NETPLAY_NEXT_PTR(netplay->self_ptr);
    struct delta_frame *ptr = &netplay->buffer[end_ptr];
 
+   if (netplay->is_spectator)
+   {
+      if (netplay->has_connection)
+      {
+         netplay->frame_count++;
+         netplay->totals.frames++;
+      }
+      return;
+   }
+
    if (netplay->has_connection)
    {
       netplay->frame_count++;
@@ -1556,6 +3032,10 @@ void netplay_post_frame(netplay_t *netplay)
    {
       bool mismatch = (ptr->self_crc != ptr->peer_crc);
 
+      netplay->totals.crc_checks++;
+      if (mismatch)
+         netplay->totals.crc_mismatches++;
+
       if (settings->netplay_show_crc_checks)
       {
          char msg[32];
@@ -1565,11 +3045,46 @@ void netplay_post_frame(netplay_t *netplay)
          rarch_main_msg_queue_push(msg, 1, 120, true);
       }
 
+      /* The host hands its region hashes to the client, which has 
+       * both and logs where the states differ. That has to happen 
+       * before a resync replaces the client's state. */
+      if (mismatch && settings->netplay_check_bisect)
+      {
+         uint32_t frame = netplay->frame_count - NETPLAY_BUF_SIZE;
+
+         if (netplay->is_host)
+            netplay_send_region_hashes(netplay, end_ptr, frame);
+         else if (netplay->region_frame != frame
+               && netplay_load_state(netplay, end_ptr))
+         {
+            netplay_hash_regions(netplay, &netplay->region_size);
+            netplay->region_frame      = frame;
+            netplay->has_region_hashes = true;
+         }
+      }
+
       if (mismatch && netplay->is_host
             && settings->netplay_periodic_resync)
          netplay_send_savestate(true);
    }
 
+   /* The slot now holds a new frame, whose CRC may come in early. */
+   ptr->peer_crc = 0;
+
+   /* Rollbacks can't go past a lost state, so both sides start over 
+    * from ours. Tried again next frame if it can't be sent. */
+   if (netplay->state_lost && netplay->has_connection)
+      netplay_send_savestate(true);
+
+   if (netplay->spectate_fd >= 0)
+      netplay_spectate_update(netplay);
+
+   if (netplay->has_connection)
+   {
+      netplay->totals.frames++;
+      netplay_update_stats(netplay);
+   }
+
    netplay->use_rollback_states = false;
 }
 
@@ -1598,6 +3113,9 @@ static void netplay_mask_unmask_config(bool starting)
       settings->slowmotion_ratio = 1.033333;  /* shave 2fps for peer catch-up */
       
       preempt_deinit(); /* Netplay overrides the same libretro calls */
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+      runahead_deinit();
+#endif
       
       has_started = true;
    }
@@ -1608,7 +3126,12 @@ static void netplay_mask_unmask_config(bool starting)
       settings->pause_nonactive = pause_nonactive;
       settings->slowmotion_ratio = slowmotion_ratio;
       
-      preempt_init(); /* skips if preempt_frames == 0 */
+      if (!preempt_init()) /* skips if preempt_frames == 0 */
+      {
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+         runahead_init();
+#endif
+      }
       
       has_started = false;
    }
@@ -1634,12 +3157,18 @@ void deinit_netplay(void)
 {
    driver_t *driver = driver_get_ptr();
    netplay_t *netplay = (netplay_t*)driver->netplay_data;
+   unsigned i;
    if (netplay)
    {
       if (netplay->tcp_fd >= 0)
          socket_close(netplay->tcp_fd);
       if (netplay->udp_fd >= 0)
          socket_close(netplay->udp_fd);
+      if (netplay->spectate_fd >= 0)
+         socket_close(netplay->spectate_fd);
+      for (i = 0; i < NETPLAY_MAX_SPECTATORS; i++)
+         if (netplay->spectators[i].fd >= 0)
+            socket_close(netplay->spectators[i].fd);
 
       retro_init_libretro_cbs(&driver->retro_ctx);
       netplay_free(netplay);
@@ -1699,6 +3228,15 @@ bool netplay_use_rollback_states(netplay_t *netplay)
    return netplay->use_rollback_states;
 }
 
+void netplay_get_stats(netplay_t *netplay, struct netplay_stats *stats)
+{
+   *stats             = netplay->totals;
+   stats->rtt         = netplay->rtt;
+   stats->jitter      = netplay->jitter;
+   stats->loss        = netplay->loss;
+   stats->input_delay = netplay->input_delay;
+}
+
 #ifdef HAVE_SOCKET_LEGACY
 
 #undef sockaddr_storage
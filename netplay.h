@@ -26,6 +26,23 @@
 
 typedef struct netplay netplay_t;
 
+struct netplay_stats
+{
+   /* Totals since the connection was made */
+   unsigned frames;
+   unsigned rollbacks;
+   unsigned replayed_frames;
+   unsigned max_rollback;
+   unsigned crc_checks;
+   unsigned crc_mismatches;
+
+   /* Current values */
+   float rtt;     /* ms */
+   float jitter;  /* ms */
+   float loss;    /* 0 to 1, over the last second */
+   unsigned input_delay;
+};
+
 void input_poll_net(void);
 
 int16_t input_state_net(unsigned port, unsigned device,
@@ -123,5 +140,12 @@ bool netplay_send_savestate(bool silent);
 
 bool netplay_use_rollback_states(netplay_t *netplay);
 
+/**
+ * netplay_get_stats:
+ * @netplay              : pointer to netplay object
+ * @stats                : filled in with the connection stats
+ **/
+void netplay_get_stats(netplay_t *netplay, struct netplay_stats *stats);
+
 #endif
 
@@ -21,10 +21,13 @@
 #include <boolean.h>
 #include <compat/msvc.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#include <retro_miscellaneous.h>
+#include <rhash.h>
 #include "patch.h"
 #include "file_ops.h"
-#include <file/file_extract.h>
+#include "archive_cache.h"
 #include "general.h"
 #include "retroarch_logger.h"
 
@@ -42,25 +45,22 @@ struct bps_data
    uint8_t *target_data;
    size_t modify_length, source_length, target_length;
    size_t modify_offset, source_offset, target_offset;
-   uint32_t modify_checksum, source_checksum, target_checksum;
 
-   size_t source_relative_offset, target_relative_offset, output_offset;
+   size_t output_offset;
 };
 
 static uint8_t bps_read(struct bps_data *bps)
 {
-   uint8_t data = bps->modify_data[bps->modify_offset++];
-#ifdef HAVE_ZLIB
-   bps->modify_checksum = zlib_crc32_adjust(bps->modify_checksum, data);
-#endif
-   return data;
+   if (bps->modify_offset >= bps->modify_length)
+      return 0;
+   return bps->modify_data[bps->modify_offset++];
 }
 
 static uint64_t bps_decode(struct bps_data *bps)
 {
    uint64_t data = 0, shift = 1;
 
-   for (;;)
+   while (bps->modify_offset < bps->modify_length)
    {
       uint8_t x = bps_read(bps);
       data += (x & 0x7f) * shift;
@@ -73,17 +73,8 @@ static uint64_t bps_decode(struct bps_data *bps)
    return data;
 }
 
-static void bps_write(struct bps_data *bps, uint8_t data)
-{
-   if (!bps)
-      return;
-
-   bps->target_data[bps->output_offset++] = data;
-#ifdef HAVE_ZLIB
-   bps->target_checksum = zlib_crc32_adjust(bps->target_checksum, data);
-#endif
-}
-
+/* Checksums are taken over whole buffers once patching is done,
+ * rather than a byte at a time as the data is read and written. */
 patch_error_t bps_apply_patch(
       const uint8_t *modify_data, size_t modify_length,
       const uint8_t *source_data, size_t source_length,
@@ -94,7 +85,8 @@ patch_error_t bps_apply_patch(
           modify_markup_size;
    struct bps_data bps = {0};
    uint32_t modify_source_checksum = 0, modify_target_checksum = 0,
-            modify_modify_checksum = 0, checksum;
+            modify_modify_checksum = 0, checksum,
+            source_checksum, target_checksum;
 
    if (modify_length < 19)
       return PATCH_PATCH_TOO_SMALL;
@@ -105,8 +97,6 @@ patch_error_t bps_apply_patch(
    bps.target_length = *target_length;
    bps.source_data = source_data;
    bps.source_length = source_length;
-   bps.modify_checksum = ~0;
-   bps.target_checksum = ~0;
 
    if ((bps_read(&bps) != 'B') || (bps_read(&bps) != 'P') ||
          (bps_read(&bps) != 'S') || (bps_read(&bps) != '1'))
@@ -115,8 +105,9 @@ patch_error_t bps_apply_patch(
    modify_source_size = bps_decode(&bps);
    modify_target_size = bps_decode(&bps);
    modify_markup_size = bps_decode(&bps);
-   for (i = 0; i < modify_markup_size; i++)
-      bps_read(&bps);
+   if (modify_markup_size > bps.modify_length - bps.modify_offset)
+      return PATCH_PATCH_INVALID;
+   bps.modify_offset += modify_markup_size;
 
    if (modify_source_size > bps.source_length)
       return PATCH_SOURCE_TOO_SMALL;
@@ -130,16 +121,24 @@ patch_error_t bps_apply_patch(
 
       length = (length >> 2) + 1;
 
+      if (length > bps.target_length - bps.output_offset)
+         return PATCH_TARGET_TOO_SMALL;
+
       switch (mode)
       {
          case SOURCE_READ:
-            while (length--)
-               bps_write(&bps, bps.source_data[bps.output_offset]);
+            if (bps.output_offset + length > bps.source_length)
+               return PATCH_SOURCE_TOO_SMALL;
+            memcpy(bps.target_data + bps.output_offset,
+                  bps.source_data + bps.output_offset, length);
             break;
 
          case TARGET_READ:
-            while (length--)
-               bps_write(&bps, bps_read(&bps));
+            if (length > bps.modify_length - bps.modify_offset)
+               return PATCH_PATCH_INVALID;
+            memcpy(bps.target_data + bps.output_offset,
+                  bps.modify_data + bps.modify_offset, length);
+            bps.modify_offset += length;
             break;
 
          case SOURCE_COPY:
@@ -154,42 +153,48 @@ patch_error_t bps_apply_patch(
             if (mode == SOURCE_COPY)
             {
                bps.source_offset += offset;
-               while (length--)
-                  bps_write(&bps, bps.source_data[bps.source_offset++]);
+               if (bps.source_offset > bps.source_length
+                     || length > bps.source_length - bps.source_offset)
+                  return PATCH_SOURCE_TOO_SMALL;
+               memcpy(bps.target_data + bps.output_offset,
+                     bps.source_data + bps.source_offset, length);
+               bps.source_offset += length;
             }
             else
             {
                bps.target_offset += offset;
-               while (length--)
-                  bps_write(&bps, bps.target_data[bps.target_offset++]);
-               break;
+               if (bps.target_offset >= bps.output_offset)
+                  return PATCH_PATCH_INVALID;
+               /* Byte by byte, as the copy may overlap what it
+                * writes to repeat a pattern. */
+               for (i = 0; i < length; i++)
+                  bps.target_data[bps.output_offset + i] =
+                     bps.target_data[bps.target_offset + i];
+               bps.target_offset += length;
             }
             break;
          }
       }
+
+      bps.output_offset += length;
    }
 
 
    for (i = 0; i < 32; i += 8)
-      modify_source_checksum |= bps_read(&bps) << i;
+      modify_source_checksum |= (uint32_t)bps_read(&bps) << i;
    for (i = 0; i < 32; i += 8)
-      modify_target_checksum |= bps_read(&bps) << i;
+      modify_target_checksum |= (uint32_t)bps_read(&bps) << i;
 
-   checksum = ~bps.modify_checksum;
+   checksum = crc32_update(0, bps.modify_data, bps.modify_offset);
    for (i = 0; i < 32; i += 8)
-      modify_modify_checksum |= bps_read(&bps) << i;
-
-#ifdef HAVE_ZLIB
-   bps.source_checksum = zlib_crc32_calculate(bps.source_data, bps.source_length);
-#else
-   return PATCH_PATCH_CHECKSUM_INVALID;
-#endif
+      modify_modify_checksum |= (uint32_t)bps_read(&bps) << i;
 
-   bps.target_checksum = ~bps.target_checksum;
+   source_checksum = crc32_update(0, bps.source_data, bps.source_length);
+   target_checksum = crc32_update(0, bps.target_data, bps.output_offset);
 
-   if (bps.source_checksum != modify_source_checksum)
+   if (source_checksum != modify_source_checksum)
       return PATCH_SOURCE_CHECKSUM_INVALID;
-   if (bps.target_checksum != modify_target_checksum)
+   if (target_checksum != modify_target_checksum)
       return PATCH_TARGET_CHECKSUM_INVALID;
    if (checksum != modify_modify_checksum)
       return PATCH_PATCH_CHECKSUM_INVALID;
@@ -211,43 +216,46 @@ struct ups_data
 static uint8_t ups_patch_read(struct ups_data *data) 
 {
    if (data && data->patch_offset < data->patch_length) 
-   {
-      uint8_t n = data->patch_data[data->patch_offset++];
-#ifdef HAVE_ZLIB
-      data->patch_checksum = zlib_crc32_adjust(data->patch_checksum, n);
-#endif
-      return n;
-   }
+      return data->patch_data[data->patch_offset++];
    return 0x00;
 }
 
 static uint8_t ups_source_read(struct ups_data *data) 
 {
    if (data && data->source_offset < data->source_length) 
-   {
-      uint8_t n = data->source_data[data->source_offset++];
-#ifdef HAVE_ZLIB
-      data->source_checksum = zlib_crc32_adjust(data->source_checksum, n);
-#endif
-      return n;
-   }
+      return data->source_data[data->source_offset++];
    return 0x00;
 }
 
 static void ups_target_write(struct ups_data *data, uint8_t n) 
 {
    if (data && data->target_offset < data->target_length) 
-   {
       data->target_data[data->target_offset] = n;
-#ifdef HAVE_ZLIB
-      data->target_checksum = zlib_crc32_adjust(data->target_checksum, n);
-#endif
-   }
 
    if (data)
       data->target_offset++;
 }
 
+/* Same as length calls to ups_target_write(ups_source_read()),
+ * copying whatever is in range of both buffers in one go. */
+static void ups_copy(struct ups_data *data, unsigned length)
+{
+   if (data->target_offset < data->target_length)
+   {
+      unsigned n = min(length, data->source_length - data->source_offset);
+      n = min(n, data->target_length - data->target_offset);
+
+      memcpy(data->target_data + data->target_offset,
+            data->source_data + data->source_offset, n);
+      data->source_offset += n;
+      data->target_offset += n;
+      length              -= n;
+   }
+
+   while (length--) 
+      ups_target_write(data, ups_source_read(data));
+}
+
 static uint64_t ups_decode(struct ups_data *data) 
 {
    uint64_t offset = 0, shift = 1;
@@ -280,9 +288,6 @@ patch_error_t ups_apply_patch(
    data.patch_length    = patchlength;
    data.source_length   = sourcelength;
    data.target_length   = *targetlength;
-   data.patch_checksum  = ~0;
-   data.source_checksum = ~0;
-   data.target_checksum = ~0;
 
    if (data.patch_length < 18) 
       return PATCH_PATCH_INVALID;
@@ -310,8 +315,7 @@ patch_error_t ups_apply_patch(
    while (data.patch_offset < data.patch_length - 12) 
    {
       unsigned length = ups_decode(&data);
-      while (length--) 
-         ups_target_write(&data, ups_source_read(&data));
+      ups_copy(&data, length);
       while (true) 
       {
          uint8_t patch_xor = ups_patch_read(&data);
@@ -321,23 +325,25 @@ patch_error_t ups_apply_patch(
       }
    }
 
-   while (data.source_offset < data.source_length) 
-      ups_target_write(&data, ups_source_read(&data));
+   ups_copy(&data, data.source_length - data.source_offset);
    while (data.target_offset < data.target_length) 
       ups_target_write(&data, ups_source_read(&data));
 
 
    for (i = 0; i < 4; i++) 
-      source_read_checksum |= ups_patch_read(&data) << (i * 8);
+      source_read_checksum |= (uint32_t)ups_patch_read(&data) << (i * 8);
    for (i = 0; i < 4; i++) 
-      target_read_checksum |= ups_patch_read(&data) << (i * 8);
+      target_read_checksum |= (uint32_t)ups_patch_read(&data) << (i * 8);
 
-   patch_result_checksum = ~data.patch_checksum;
-   data.source_checksum  = ~data.source_checksum;
-   data.target_checksum  = ~data.target_checksum;
+   patch_result_checksum = crc32_update(0, data.patch_data,
+         data.patch_offset);
+   data.source_checksum  = crc32_update(0, data.source_data,
+         data.source_offset);
+   data.target_checksum  = crc32_update(0, data.target_data,
+         min(data.target_offset, data.target_length));
 
    for (i = 0; i < 4; i++) 
-      patch_read_checksum |= ups_patch_read(&data) << (i * 8);
+      patch_read_checksum |= (uint32_t)ups_patch_read(&data) << (i * 8);
 
    if (patch_result_checksum != patch_read_checksum) 
       return PATCH_PATCH_INVALID;
@@ -368,6 +374,7 @@ patch_error_t ips_apply_patch(
       uint8_t *targetdata, size_t *targetlength)
 {
    uint32_t offset = 5;
+   size_t capacity = *targetlength;
 
    if (patchlen < 8 ||
          patchdata[0] != 'P' ||
@@ -377,6 +384,9 @@ patch_error_t ips_apply_patch(
          patchdata[4] != 'H')
       return PATCH_PATCH_INVALID;
 
+   if (sourcelength > capacity)
+      return PATCH_TARGET_TOO_SMALL;
+
    memcpy(targetdata, sourcedata, sourcelength);
 
    *targetlength = sourcelength;
@@ -402,6 +412,11 @@ patch_error_t ips_apply_patch(
             uint32_t size = patchdata[offset++] << 16;
             size |= patchdata[offset++] << 8;
             size |= patchdata[offset++] << 0;
+            if (size > capacity)
+               return PATCH_TARGET_TOO_SMALL;
+            /* Truncation can also extend the target, with zeroes. */
+            if (size > *targetlength)
+               memset(targetdata + *targetlength, 0, size - *targetlength);
             *targetlength = size;
             return PATCH_SUCCESS;
          }
@@ -415,11 +430,18 @@ patch_error_t ips_apply_patch(
 
       if (length) /* Copy */
       {
-         if (offset > patchlen - length)
+         if (length > patchlen - offset)
             break;
+         if (address + length > capacity)
+            return PATCH_TARGET_TOO_SMALL;
+
+         /* Anything between the old end and the record is zero. */
+         if (address > *targetlength)
+            memset(targetdata + *targetlength, 0, address - *targetlength);
 
-         while (length--)
-            targetdata[address++] = patchdata[offset++];
+         memcpy(targetdata + address, patchdata + offset, length);
+         address += length;
+         offset  += length;
       }
       else /* RLE */
       {
@@ -431,10 +453,14 @@ patch_error_t ips_apply_patch(
 
          if (length == 0) /* Illegal */
             break;
+         if (address + length > capacity)
+            return PATCH_TARGET_TOO_SMALL;
 
-         while (length--)
-            targetdata[address++] = patchdata[offset];
+         if (address > *targetlength)
+            memset(targetdata + *targetlength, 0, address - *targetlength);
 
+         memset(targetdata + address, patchdata[offset], length);
+         address += length;
          offset++;
       }
 
@@ -445,33 +471,132 @@ patch_error_t ips_apply_patch(
    return PATCH_PATCH_INVALID;
 }
 
+static void free_patch_data(void *data, ssize_t size, bool mapped)
+{
+#ifdef HAVE_MMAP
+   if (mapped)
+   {
+      unmap_file(data, size);
+      return;
+   }
+#endif
+   free(data);
+}
+
+/* Patched content is kept in the archive cache under a key made of
+ * the CRC32 of the content and of the patch, so the same patch on
+ * the same content is only ever applied once.
+ * BPS and UPS patches end in the CRC32 of the rest of the patch,
+ * which makes the CRC32 of the whole file the same for all of them.
+ * The key holds the CRC32 of all but the last four bytes and those
+ * four bytes themselves instead. */
+static void patch_cache_key(char *key, size_t size, uint32_t source_crc,
+      const uint8_t *patch_data, size_t patch_size)
+{
+   global_t *global = global_get_ptr();
+   const char *ext  = path_get_extension(global->fullpath);
+   size_t body_size = patch_size >= 4 ? patch_size - 4 : 0;
+   uint32_t tail    = 0;
+   size_t i;
+
+   for (i = body_size; i < patch_size; i++)
+      tail = (tail << 8) | patch_data[i];
+
+   snprintf(key, size, "patched-%08x-%08x%08x%s%s",
+         (unsigned)source_crc,
+         (unsigned)crc32_update(0, patch_data, body_size),
+         (unsigned)tail, *ext ? "." : "", ext);
+}
+
+static bool patch_cache_load(const char *key, uint8_t **buf,
+      ssize_t *size, bool *mapped, uint32_t *crc)
+{
+   char cached[PATH_MAX_LENGTH];
+   uint32_t cached_crc = 0;
+   void *data          = NULL;
+   ssize_t len         = 0;
+   bool data_mapped    = false;
+
+   if (!archive_cache_lookup(key, cached, sizeof(cached), &cached_crc))
+      return false;
+
+#ifdef HAVE_MMAP
+   data        = map_file(cached, &len);
+   data_mapped = data != NULL;
+#endif
+
+   if (!data && !read_file(cached, &data, &len))
+      return false;
+
+   if (len < 0)
+   {
+      free(data);
+      return false;
+   }
+
+   *buf    = (uint8_t*)data;
+   *size   = len;
+   *mapped = data_mapped;
+   if (crc)
+      *crc = cached_crc;
+   return true;
+}
+
 static bool apply_patch_content(uint8_t **buf,
-      ssize_t *size, const char *patch_desc, const char *patch_path,
+      ssize_t *size, bool *mapped, uint32_t *crc,
+      const char *patch_desc, const char *patch_path,
       patch_func_t func)
 {
    size_t target_size;
-   ssize_t patch_size;
+   char key[PATH_MAX_LENGTH];
+   uint32_t source_crc;
+   bool cache               = archive_cache_enabled();
+   ssize_t patch_size       = 0;
    void *patch_data         = NULL;
+   bool patch_mapped        = false;
    patch_error_t err        = PATCH_UNKNOWN;
-   bool success             = false;
    uint8_t *patched_content = NULL;
    ssize_t ret_size         = *size;
    uint8_t *ret_buf         = *buf;
-   
-   if (!read_file(patch_path, &patch_data, &patch_size))
-      return false;
-   if (patch_size < 0)
-      return false;
 
    if (!path_file_exists(patch_path))
       return false;
 
+#ifdef HAVE_MMAP
+   patch_data   = map_file(patch_path, &patch_size);
+   patch_mapped = patch_data != NULL;
+#endif
+
+   if (!patch_data && !read_file(patch_path, &patch_data, &patch_size))
+      return false;
+   if (patch_size < 0)
+   {
+      free(patch_data);
+      return false;
+   }
+
    RARCH_LOG("Found %s file in \"%s\", attempting to patch ...\n",
          patch_desc, patch_path);
 
+   /* Without the cache, don't checksum anything for its key. */
+   if (cache)
+   {
+      source_crc = crc ? *crc : crc32_update(0, ret_buf, ret_size);
+      patch_cache_key(key, sizeof(key), source_crc,
+            (const uint8_t*)patch_data, patch_size);
+
+      if (patch_cache_load(key, buf, size, mapped, crc))
+      {
+         RARCH_LOG("Content patched from cache (%s).\n", patch_desc);
+         free_patch_data(patch_data, patch_size, patch_mapped);
+         return true;
+      }
+   }
+
    target_size = ret_size * 4; /* Just to be sure. */
 
-   patched_content = (uint8_t*)malloc(target_size);
+   /* One more byte for the '\0' that read_file would add. */
+   patched_content = (uint8_t*)malloc(target_size + 1);
 
    if (!patched_content)
    {
@@ -482,34 +607,47 @@ static bool apply_patch_content(uint8_t **buf,
    err = func((const uint8_t*)patch_data, patch_size, ret_buf,
          ret_size, patched_content, &target_size);
 
+   /* The source buffer belongs to the caller, it may be
+    * a mapping of the content file. */
    if (err == PATCH_SUCCESS)
    {
+      uint32_t target_crc = 0;
+
+      if (crc || cache)
+         target_crc = crc32_update(0, patched_content, target_size);
+
+      patched_content[target_size] = '\0';
+
       RARCH_LOG("Content patched successfully (%s).\n", patch_desc);
-      success = true;
+      if (cache)
+         archive_cache_store(key, patched_content, target_size, target_crc);
+
+      *buf    = patched_content;
+      *size   = target_size;
+      *mapped = false;
+      if (crc)
+         *crc = target_crc;
    }
    else
+   {
       RARCH_ERR("Failed to patch %s: Error #%u\n", patch_desc,
             (unsigned)err);
-
-   if (success)
-   {
-      free(ret_buf);
-      *buf = patched_content;
-      *size = target_size;
+      free(patched_content);
    }
 
-   free(patch_data);
+   free_patch_data(patch_data, patch_size, patch_mapped);
    return true;
 
 error:
    *buf = ret_buf;
    *size = ret_size;
-   free(patch_data);
+   free_patch_data(patch_data, patch_size, patch_mapped);
 
    return false;
 }
 
-static bool try_bps_patch(uint8_t **buf, ssize_t *size)
+static bool try_bps_patch(uint8_t **buf, ssize_t *size,
+      bool *mapped, uint32_t *crc)
 {
    global_t *global = global_get_ptr();
    bool allow_bps   = !global->ups_pref && !global->ips_pref;
@@ -519,11 +657,12 @@ static bool try_bps_patch(uint8_t **buf, ssize_t *size)
    if (global->bps_name[0] == '\0')
       return false;
 
-   return apply_patch_content(buf, size, "BPS", global->bps_name,
-         bps_apply_patch);
+   return apply_patch_content(buf, size, mapped, crc, "BPS",
+         global->bps_name, bps_apply_patch);
 }
 
-static bool try_ups_patch(uint8_t **buf, ssize_t *size)
+static bool try_ups_patch(uint8_t **buf, ssize_t *size,
+      bool *mapped, uint32_t *crc)
 {
    global_t *global = global_get_ptr();
    bool allow_ups   = !global->bps_pref && !global->ips_pref;
@@ -533,11 +672,12 @@ static bool try_ups_patch(uint8_t **buf, ssize_t *size)
    if (global->ups_name[0] == '\0')
       return false;
 
-   return apply_patch_content(buf, size, "UPS", global->ups_name,
-         ups_apply_patch);
+   return apply_patch_content(buf, size, mapped, crc, "UPS",
+         global->ups_name, ups_apply_patch);
 }
 
-static bool try_ips_patch(uint8_t **buf, ssize_t *size)
+static bool try_ips_patch(uint8_t **buf, ssize_t *size,
+      bool *mapped, uint32_t *crc)
 {
    global_t *global = global_get_ptr();
    bool allow_ips   = !global->ups_pref && !global->bps_pref;
@@ -547,19 +687,27 @@ static bool try_ips_patch(uint8_t **buf, ssize_t *size)
    if (global->ips_name[0] == '\0')
       return false;
 
-   return apply_patch_content(buf, size, "IPS", global->ips_name,
-         ips_apply_patch);
+   return apply_patch_content(buf, size, mapped, crc, "IPS",
+         global->ips_name, ips_apply_patch);
 }
 
 /**
  * patch_content:
  * @buf          : buffer of the content file.
  * @size         : size   of the content file.
+ * @mapped       : set to whether a patched @buf is a mapping from map_file.
+ * @crc          : if not NULL, the CRC32 of the content file, which is
+ *                 replaced by the CRC32 of the patched content.
  *
  * Apply patch to the content file in-memory.
+ * On success, @buf points to a new buffer and
+ * the original buffer is left to the caller to free.
+ * Patched content is kept in the archive cache, so relaunching
+ * with the same content and patch reads it back instead.
  *
  **/
-void patch_content(uint8_t **buf, ssize_t *size)
+void patch_content(uint8_t **buf, ssize_t *size, bool *mapped,
+      uint32_t *crc)
 {
    global_t *global = global_get_ptr();
 
@@ -569,7 +717,9 @@ void patch_content(uint8_t **buf, ssize_t *size)
       return;
    }
 
-   if (!try_ips_patch(buf, size) && !try_bps_patch(buf, size) && !try_ups_patch(buf, size))
+   if (!try_ips_patch(buf, size, mapped, crc)
+         && !try_bps_patch(buf, size, mapped, crc)
+         && !try_ups_patch(buf, size, mapped, crc))
    {
       RARCH_LOG("Did not find a valid content patch.\n");
    }
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <boolean.h>
 
 /* BPS/UPS/IPS implementation from bSNES (nall::).
  * Modified for RetroArch. */
@@ -62,10 +63,18 @@ patch_error_t ips_apply_patch(
  * patch_content:
  * @buf          : buffer of the content file.
  * @size         : size   of the content file.
+ * @mapped       : set to whether a patched @buf is a read-only mapping.
+ * @crc          : if not NULL, the CRC32 of the content file, which is
+ *                 replaced by the CRC32 of the patched content.
  *
  * Apply patch to the content file in-memory.
+ * On success, @buf points to a new buffer and
+ * the original buffer is left to the caller to free.
+ * Patched content is kept in the archive cache, so relaunching
+ * with the same content and patch reads it back instead.
  *
  **/
-void patch_content(uint8_t **buf, ssize_t *size);
+void patch_content(uint8_t **buf, ssize_t *size, bool *mapped,
+      uint32_t *crc);
 
 #endif
@@ -19,12 +19,49 @@
  * Internally replays recent frames with updated input to hide latency.
  */
 
+#include <string.h>
+
 #include "dynamic.h"
 #include "runloop.h"
+#include "performance.h"
 #include "preempt.h"
+#include "rewind.h"
+#include "secondary_core.h"
+#include "gfx/video_driver.h"
 
 #define PREEMPT_NEXT_PTR(x) ((x + 1) % preempt->frames)
 
+/* Rolling average over roughly the last 16 samples. */
+#define PREEMPT_AVERAGE(avg, sample) \
+   ((avg) = (avg) ? ((avg) * 15 + (sample)) / 16 : (sample))
+
+/* Auto mode picks a new frame count this often (in frames)... */
+#define PREEMPT_AUTO_TUNE_INTERVAL 60
+/* ...and allows one more frame again after this many seconds 
+ * without a missed vsync. */
+#define PREEMPT_AUTO_RECOVER_SECONDS 10
+
+/* Number of recent button presses/releases kept for predictions */
+#define PREEMPT_EDGES 8
+
+/* A speculative branch replays the buffer from its oldest state with 
+ * a guess at the next input, on a secondary core instance, while the 
+ * primary runs the current frame. */
+struct preempt_branch
+{
+   secondary_core_t *core;
+   struct secondary_core_input input;
+
+   /* Copy of the oldest state, and the states made from it */
+   void *start;
+   void *states[MAX_PREEMPT_FRAMES];
+
+   /* preempt serial and frame count it was started with */
+   uint64_t serial;
+   uint8_t frames;
+   bool started;
+};
+
 struct preempt_data
 {
    struct retro_callbacks cbs;
@@ -33,6 +70,20 @@ struct preempt_data
    void* buffer[MAX_PREEMPT_FRAMES];
    size_t state_size;
 
+   /* Delta mode: instead of 'buffer', the oldest state is kept in 
+    * full along with patches leading up to the newest one, which 
+    * is also kept in full so the next patch can be made against it. 
+    * Every serialize goes to 'scratch', which stays in cache. */
+   bool delta;
+   uint8_t *base;
+   uint8_t *last;
+   uint8_t *scratch;
+   uint8_t *patch;
+   uint8_t *deltas[MAX_PREEMPT_FRAMES];
+   size_t deltas_size[MAX_PREEMPT_FRAMES];
+   uint8_t delta_start;
+   uint8_t num_deltas;
+
    /* States saved since buffer init/reset */
    uint64_t states_saved;
 
@@ -56,6 +107,36 @@ struct preempt_data
 
    /* Buffer start index for replays */
    uint8_t start_ptr;
+
+   /* Rolling averages of each stage, in microseconds */
+   retro_time_t serialize_time;
+   retro_time_t unserialize_time;
+   retro_time_t run_time;
+
+   /* Auto mode: 'frames' is picked from the timings above, 
+    * up to frames_cap, which drops when replays miss vsync. */
+   bool auto_frames;
+   bool replayed;
+   uint8_t frames_cap;
+   unsigned tune_count;
+   unsigned frames_since_miss;
+   retro_time_t frame_start;
+
+   /* Speculative branches. 'serial' changes every frame and whenever 
+    * the buffer is reset, so only branches started from the current 
+    * oldest state can stand in for a replay. */
+   struct preempt_branch branches[MAX_PREEMPT_BRANCHES];
+   uint8_t num_branches;
+   uint64_t serial;
+   unsigned branch_hits;
+   unsigned replays;
+
+   /* Most recent joypad button changes, newest first */
+   uint8_t edge_port[PREEMPT_EDGES];
+   uint8_t edge_id[PREEMPT_EDGES];
+   uint8_t num_edges;
+   /* Analog or pointer input changed; branches only guess joypads */
+   bool other_dirty;
 };
 
 static bool preempt_allocating_mem;
@@ -156,6 +237,35 @@ static INLINE bool preempt_analog_input_dirty(preempt_t *preempt,
    return true;
 }
 
+static void preempt_track_edges(preempt_t *preempt,
+      unsigned port, uint16_t changed)
+{
+   unsigned id, i, j;
+
+   for (id = 0; id < 16; id++)
+   {
+      if (!(changed & (1 << id)))
+         continue;
+
+      /* Move to the front, dropping the oldest if full. */
+      for (i = 0; i < preempt->num_edges; i++)
+         if (preempt->edge_port[i] == port && preempt->edge_id[i] == id)
+            break;
+      if (i == preempt->num_edges && i < PREEMPT_EDGES)
+         preempt->num_edges++;
+      if (i == PREEMPT_EDGES)
+         i--;
+
+      for (j = i; j > 0; j--)
+      {
+         preempt->edge_port[j] = preempt->edge_port[j - 1];
+         preempt->edge_id[j]   = preempt->edge_id[j - 1];
+      }
+      preempt->edge_port[0] = port;
+      preempt->edge_id[0]   = id;
+   }
+}
+
 static INLINE void preempt_input_poll(preempt_t *preempt)
 {
    retro_input_state_t state_cb = preempt->cbs.state_cb;
@@ -163,6 +273,7 @@ static INLINE void preempt_input_poll(preempt_t *preempt)
    unsigned p;
 
    preempt->cbs.poll_cb();
+   preempt->other_dirty = false;
 
    /* Check for input state changes */
    for (p = 0; p < max_users; p++)
@@ -172,6 +283,8 @@ static INLINE void preempt_input_poll(preempt_t *preempt)
             0, RETRO_DEVICE_ID_JOYPAD_MASK);
       if (joypad_state != preempt->joypad_state[p])
       {
+         preempt_track_edges(preempt, p,
+               joypad_state ^ (uint16_t)preempt->joypad_state[p]);
          preempt->joypad_state[p] = joypad_state;
          preempt->in_replay = true;
       }
@@ -180,7 +293,8 @@ static INLINE void preempt_input_poll(preempt_t *preempt)
       if (preempt->analog_mask[p] &&
             preempt_analog_input_dirty(preempt, state_cb, p))
       {
-         preempt->in_replay = true;
+         preempt->in_replay   = true;
+         preempt->other_dirty = true;
          preempt->analog_mask[p] = 0;
       }
 
@@ -189,7 +303,10 @@ static INLINE void preempt_input_poll(preempt_t *preempt)
       {
          if (preempt_ptr_input_dirty(
                preempt, state_cb, preempt->ptr_dev_needed[p], p))
-            preempt->in_replay = true;
+         {
+            preempt->in_replay   = true;
+            preempt->other_dirty = true;
+         }
 
          preempt->ptr_dev_polled[p] = preempt->ptr_dev_needed[p];
          preempt->ptr_dev_needed[p] = RETRO_DEVICE_NONE;
@@ -246,21 +363,120 @@ static bool preempt_alloc_buffer(preempt_t *preempt)
 
    preempt->state_size = pretro_serialize_size();
 
-   for (i = 0; i < preempt->frames; i++)
+   if (preempt->delta)
    {
-      preempt->buffer[i] = malloc(preempt->state_size);
-      if (!preempt->buffer[i])
+      size_t size      = state_delta_buffer_size(preempt->state_size);
+
+      preempt->base    = (uint8_t*)calloc(size, 1);
+      preempt->last    = (uint8_t*)calloc(size, 1);
+      preempt->scratch = (uint8_t*)calloc(size, 1);
+      preempt->patch   = (uint8_t*)
+         malloc(state_delta_max_size(preempt->state_size));
+
+      if (preempt->base && preempt->last && preempt->scratch && preempt->patch)
+         return true;
+   }
+   else
+   {
+      /* Auto mode may go up to the maximum later on. */
+      unsigned count = preempt->auto_frames ?
+            MAX_PREEMPT_FRAMES : preempt->frames;
+
+      for (i = 0; i < count; i++)
       {
-         RARCH_WARN("Failed to allocate memory for Preemptive Frames.\n");
-         rarch_main_msg_queue_push("Failed to allocate memory for "
-                                   "Preemptive Frames.", 1, 180, false);
-         return false;
+         preempt->buffer[i] = malloc(preempt->state_size);
+         if (!preempt->buffer[i])
+            break;
       }
+
+      if (i == count)
+         return true;
    }
 
-   return true;
+   RARCH_WARN("Failed to allocate memory for Preemptive Frames.\n");
+   rarch_main_msg_queue_push("Failed to allocate memory for "
+                             "Preemptive Frames.", 1, 180, false);
+   return false;
 }
 
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+static void preempt_branches_free(preempt_t *preempt)
+{
+   unsigned i, j;
+
+   if (preempt->num_branches)
+      RARCH_LOG("Preemptive Frames: %u of %u replays were "
+            "speculative branches.\n",
+            preempt->branch_hits, preempt->replays);
+
+   for (i = 0; i < MAX_PREEMPT_BRANCHES; i++)
+   {
+      struct preempt_branch *branch = &preempt->branches[i];
+
+      secondary_core_free(branch->core);
+      free(branch->start);
+      for (j = 0; j < MAX_PREEMPT_FRAMES; j++)
+         free(branch->states[j]);
+   }
+}
+
+/**
+ * preempt_branches_init:
+ * @preempt    : pointer to preempt_t object
+ *
+ * Loads a secondary core instance for each speculative branch.
+ * Preempt carries on with fewer, or none, if that fails.
+ **/
+static void preempt_branches_init(preempt_t *preempt)
+{
+   unsigned i, j, count;
+   settings_t *settings = config_get_ptr();
+   unsigned branches    = settings->preempt_speculate;
+
+   if (!branches)
+      return;
+
+   if (preempt->delta)
+   {
+      RARCH_WARN("Preemptive Frames: speculative branches "
+            "need the full state buffer.\n");
+      return;
+   }
+
+   if (video_driver_callback()->context_type != RETRO_HW_CONTEXT_NONE)
+   {
+      RARCH_WARN("Preemptive Frames: speculative branches "
+            "are not available with hardware rendering.\n");
+      return;
+   }
+
+   if (branches > MAX_PREEMPT_BRANCHES)
+      branches = MAX_PREEMPT_BRANCHES;
+   count = preempt->auto_frames ? MAX_PREEMPT_FRAMES : preempt->frames;
+
+   for (i = 0; i < branches; i++)
+   {
+      struct preempt_branch *branch = &preempt->branches[i];
+
+      branch->core  = secondary_core_new();
+      branch->start = malloc(preempt->state_size);
+      for (j = 0; j < count; j++)
+      {
+         branch->states[j] = malloc(preempt->state_size);
+         if (!branch->states[j])
+            break;
+      }
+
+      if (!branch->core || !branch->start || j < count)
+         break;
+   }
+
+   preempt->num_branches = i;
+   RARCH_LOG("Preemptive Frames: %u of %u speculative branches.\n",
+         i, branches);
+}
+#endif
+
 /**
  * preempt_free:
  * @preempt    : pointer to preempt_t object
@@ -271,9 +487,20 @@ static void preempt_free(preempt_t *preempt)
 {
    unsigned i;
 
-   for (i = 0; i < preempt->frames; i++)
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+   preempt_branches_free(preempt);
+#endif
+
+   for (i = 0; i < MAX_PREEMPT_FRAMES; i++)
+   {
       free(preempt->buffer[i]);
+      free(preempt->deltas[i]);
+   }
 
+   free(preempt->base);
+   free(preempt->last);
+   free(preempt->scratch);
+   free(preempt->patch);
    free(preempt);
 }
 
@@ -290,6 +517,15 @@ static preempt_t *preempt_new(void)
       return NULL;
    
    preempt->frames = settings->preempt_frames;
+   preempt->delta  = settings->preempt_delta_states;
+
+   if (preempt->frames == PREEMPT_FRAMES_AUTO)
+   {
+      /* Start low, there are no timings to go by yet. */
+      preempt->auto_frames = true;
+      preempt->frames      = 1;
+      preempt->frames_cap  = MAX_PREEMPT_FRAMES;
+   }
 
    if (!preempt_alloc_buffer(preempt))
    {
@@ -300,6 +536,211 @@ static preempt_t *preempt_new(void)
    return preempt;
 }
 
+static INLINE bool preempt_serialize(preempt_t *preempt, void *data)
+{
+   retro_time_t start = rarch_get_time_usec();
+   bool ret           = pretro_serialize(data, preempt->state_size);
+
+   PREEMPT_AVERAGE(preempt->serialize_time, rarch_get_time_usec() - start);
+   return ret;
+}
+
+static INLINE bool preempt_unserialize(preempt_t *preempt, const void *data)
+{
+   retro_time_t start = rarch_get_time_usec();
+   bool ret           = pretro_unserialize(data, preempt->state_size);
+
+   PREEMPT_AVERAGE(preempt->unserialize_time, rarch_get_time_usec() - start);
+   return ret;
+}
+
+static INLINE void preempt_run(preempt_t *preempt)
+{
+   retro_time_t start = rarch_get_time_usec();
+
+   pretro_run();
+   PREEMPT_AVERAGE(preempt->run_time, rarch_get_time_usec() - start);
+}
+
+/**
+ * preempt_auto_tune:
+ * @preempt         : pointer to preempt_t object
+ *
+ * Auto mode: picks the largest frame count whose replay fits in 
+ * preempt_auto_budget percent of a frame, going by the measured 
+ * timings. A replay that made the frame miss vsync caps the count 
+ * one lower for a while.
+ **/
+static void preempt_auto_tune(preempt_t *preempt)
+{
+   unsigned frames, budget;
+   retro_time_t now, interval, frame_time;
+   settings_t *settings = config_get_ptr();
+   double fps           = video_viewport_get_system_av_info()->timing.fps;
+
+   if (!preempt->auto_frames || fps <= 0.0)
+      return;
+
+   now                 = rarch_get_time_usec();
+   interval            = now - preempt->frame_start;
+   frame_time          = (retro_time_t)(1000000.0 / fps);
+   preempt->frame_start = now;
+
+   /* Anything much longer is a pause, menu or loading screen. */
+   if (preempt->replayed && interval > frame_time * 3 / 2
+         && interval < frame_time * 4 && preempt->frames_cap > 1)
+   {
+      preempt->frames_cap        = preempt->frames > 1 ?
+            preempt->frames - 1 : 1;
+      preempt->frames_since_miss = 0;
+      preempt->tune_count        = PREEMPT_AUTO_TUNE_INTERVAL;
+   }
+   else if (++preempt->frames_since_miss >= fps * PREEMPT_AUTO_RECOVER_SECONDS)
+   {
+      if (preempt->frames_cap < MAX_PREEMPT_FRAMES)
+         preempt->frames_cap++;
+      preempt->frames_since_miss = 0;
+   }
+   preempt->replayed = false;
+
+   if (++preempt->tune_count < PREEMPT_AUTO_TUNE_INTERVAL
+         || !preempt->run_time)
+      return;
+   preempt->tune_count = 0;
+
+   budget = frame_time * settings->preempt_auto_budget / 100;
+
+   for (frames = preempt->frames_cap; frames > 1; frames--)
+   {
+      /* One load, then a run and a save per frame. */
+      if (preempt->unserialize_time + frames *
+            (preempt->run_time + preempt->serialize_time) <= budget)
+         break;
+   }
+
+   if (frames != preempt->frames)
+   {
+      RARCH_LOG("Preemptive Frames: auto picked %u frames "
+            "(run %u us, save %u us, load %u us).\n", frames,
+            (unsigned)preempt->run_time, (unsigned)preempt->serialize_time,
+            (unsigned)preempt->unserialize_time);
+
+      /* The buffer is laid out for the old count, refill it. */
+      preempt->frames       = frames;
+      preempt->start_ptr    = 0;
+      preempt->states_saved = 0;
+   }
+}
+
+/**
+ * preempt_delta_store:
+ * @preempt         : pointer to preempt_t object
+ * @prev            : state the patch starts from
+ * @slot            : delta ring slot to store into
+ *
+ * Turns the state just serialized into 'scratch' into a patch 
+ * against @prev, then makes it the new 'last'.
+ *
+ * Returns: true on success, false on failure
+ **/
+static bool preempt_delta_store(preempt_t *preempt,
+      const uint8_t *prev, unsigned slot)
+{
+   uint8_t *swap;
+   size_t size = state_delta_encode(prev, preempt->scratch,
+         preempt->state_size, preempt->patch);
+
+   if (size > preempt->deltas_size[slot])
+   {
+      uint8_t *delta = (uint8_t*)realloc(preempt->deltas[slot], size);
+      if (!delta)
+         return false;
+      preempt->deltas[slot]      = delta;
+      preempt->deltas_size[slot] = size;
+   }
+   memcpy(preempt->deltas[slot], preempt->patch, size);
+
+   swap             = preempt->last;
+   preempt->last    = preempt->scratch;
+   preempt->scratch = swap;
+   return true;
+}
+
+/**
+ * preempt_delta_save
+ * @preempt         : pointer to preempt_t object
+ *
+ * Delta mode counterpart of saving into buffer[start_ptr]: appends 
+ * the current state, then rolls the oldest patch into 'base' 
+ * once there are more than 'frames' states.
+ *
+ * Returns: true on success, false on failure
+ **/
+static bool preempt_delta_save(preempt_t *preempt)
+{
+   if (!preempt->states_saved)
+   {
+      preempt->num_deltas = 0;
+      if (!preempt_serialize(preempt, preempt->base))
+         return false;
+      memcpy(preempt->last, preempt->base, preempt->state_size);
+      return true;
+   }
+
+   if (!preempt_serialize(preempt, preempt->scratch) ||
+         !preempt_delta_store(preempt, preempt->last,
+            (preempt->delta_start + preempt->num_deltas) % MAX_PREEMPT_FRAMES))
+      return false;
+
+   preempt->num_deltas++;
+
+   if (preempt->num_deltas >= preempt->frames)
+   {
+      state_delta_apply(preempt->deltas[preempt->delta_start], preempt->base);
+      preempt->delta_start = (preempt->delta_start + 1) % MAX_PREEMPT_FRAMES;
+      preempt->num_deltas--;
+   }
+
+   return true;
+}
+
+/**
+ * preempt_delta_replay
+ * @preempt         : pointer to preempt_t object
+ *
+ * Delta mode counterpart of the replay loop. 'base' was just loaded 
+ * and run; re-records every patch up to the current frame.
+ *
+ * Returns: true on success, false on failure
+ **/
+static bool preempt_delta_replay(preempt_t *preempt)
+{
+   unsigned i;
+
+   for (i = 0; i < preempt->num_deltas; i++)
+   {
+      /* Once the state size changed, just catch up and start over. */
+      if (preempt->states_saved)
+      {
+         if (!preempt_serialize(preempt, preempt->scratch))
+         {
+            if (preempt->state_size < pretro_serialize_size())
+               preempt->states_saved = 0;
+            else
+               return false;
+         }
+         else if (!preempt_delta_store(preempt,
+                  i ? preempt->last : preempt->base,
+                  (preempt->delta_start + i) % MAX_PREEMPT_FRAMES))
+            return false;
+      }
+
+      preempt_run(preempt);
+   }
+
+   return true;
+}
+
 /**
  * preempt_serialize_or_realloc
  *
@@ -307,8 +748,8 @@ static preempt_t *preempt_new(void)
  */
 static INLINE bool preempt_serialize_or_realloc(preempt_t *preempt)
 {
-   if (pretro_serialize(
-         preempt->buffer[preempt->start_ptr], preempt->state_size))
+   if (preempt->delta ? preempt_delta_save(preempt) : preempt_serialize(
+         preempt, preempt->buffer[preempt->start_ptr]))
    {
       preempt->states_saved++;
       return true;
@@ -320,6 +761,202 @@ static INLINE bool preempt_serialize_or_realloc(preempt_t *preempt)
    return false;
 }
 
+/**
+ * preempt_replay:
+ * @preempt         : pointer to preempt_t object
+ * @failed_str      : set to an error message on failure
+ *
+ * Replays the buffered frames with the current input.
+ *
+ * Returns: true on success, false on failure
+ **/
+static bool preempt_replay(preempt_t *preempt, const char **failed_str)
+{
+   uint8_t replay_ptr;
+
+   if (!preempt_unserialize(preempt, preempt->delta ? preempt->base :
+         preempt->buffer[preempt->start_ptr]))
+   {
+      *failed_str = "Failed to Load State for Preemptive Frames.";
+      return false;
+   }
+
+   preempt_run(preempt);
+
+   if (preempt->delta)
+   {
+      if (!preempt_delta_replay(preempt))
+      {
+         *failed_str = "Failed to Save State for Preemptive Frames.";
+         return false;
+      }
+      return true;
+   }
+
+   replay_ptr = PREEMPT_NEXT_PTR(preempt->start_ptr);
+
+   while (replay_ptr != preempt->start_ptr)
+   {
+      if (!preempt_serialize(preempt, preempt->buffer[replay_ptr]))
+      {
+         if (preempt->state_size < pretro_serialize_size())
+            preempt->states_saved = 0;
+         else
+         {
+            *failed_str = "Failed to Save State for Preemptive Frames.";
+            return false;
+         }
+      }
+
+      preempt_run(preempt);
+      replay_ptr = PREEMPT_NEXT_PTR(replay_ptr);
+   }
+
+   return true;
+}
+
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+/**
+ * preempt_branch_take:
+ * @preempt         : pointer to preempt_t object
+ *
+ * Looks for a finished branch that guessed the new input, and if 
+ * there is one, swaps its states into the buffer and loads its 
+ * newest state instead of replaying.
+ *
+ * Returns: true if a branch was taken
+ **/
+static bool preempt_branch_take(preempt_t *preempt)
+{
+   unsigned i, n;
+   uint8_t slot;
+
+   if (preempt->other_dirty)
+      return false;
+
+   for (i = 0; i < preempt->num_branches; i++)
+   {
+      struct preempt_branch *branch = &preempt->branches[i];
+
+      if (!branch->started
+            || branch->serial != preempt->serial
+            || branch->frames != preempt->frames
+            || memcmp(branch->input.joypad, preempt->joypad_state,
+                  sizeof(preempt->joypad_state)) != 0
+            || secondary_core_busy(branch->core))
+         continue;
+
+      branch->started = false;
+      if (!secondary_core_wait(branch->core))
+         return false;
+
+      slot = PREEMPT_NEXT_PTR(preempt->start_ptr);
+      for (n = 0; slot != preempt->start_ptr; n++)
+      {
+         void *state           = preempt->buffer[slot];
+         preempt->buffer[slot] = branch->states[n];
+         branch->states[n]     = state;
+         slot                  = PREEMPT_NEXT_PTR(slot);
+      }
+
+      return preempt_unserialize(preempt, branch->states[n]);
+   }
+
+   return false;
+}
+
+/**
+ * preempt_branch_inputs:
+ * @preempt         : pointer to preempt_t object
+ * @inputs          : receives up to num_branches guesses
+ *
+ * Guesses the next input: all held buttons released, then each 
+ * recently pressed or released button flipped, newest first.
+ *
+ * Returns: number of guesses
+ **/
+static unsigned preempt_branch_inputs(preempt_t *preempt,
+      struct secondary_core_input *inputs)
+{
+   struct secondary_core_input base;
+   unsigned count = 0, i, j;
+   unsigned port  = preempt->num_edges ? preempt->edge_port[0] : 0;
+
+   secondary_core_input_snapshot(&base, preempt->cbs.state_cb);
+   memcpy(base.joypad, preempt->joypad_state, sizeof(base.joypad));
+
+   for (i = 0; i <= preempt->num_edges
+         && count < preempt->num_branches; i++)
+   {
+      memcpy(&inputs[count], &base, sizeof(base));
+
+      if (i == 0)
+      {
+         if (!base.joypad[port])
+            continue;
+         inputs[count].joypad[port] = 0;
+      }
+      else
+         inputs[count].joypad[preempt->edge_port[i - 1]] ^=
+               1 << preempt->edge_id[i - 1];
+
+      for (j = 0; j < count; j++)
+         if (memcmp(inputs[j].joypad, inputs[count].joypad,
+                  sizeof(base.joypad)) == 0)
+            break;
+
+      if (j == count)
+         count++;
+   }
+
+   return count;
+}
+
+/**
+ * preempt_branch_start:
+ * @preempt         : pointer to preempt_t object
+ *
+ * Starts idle branches replaying from the current oldest state, 
+ * to be ready should the input change next frame.
+ **/
+static void preempt_branch_start(preempt_t *preempt)
+{
+   struct secondary_core_input inputs[MAX_PREEMPT_BRANCHES];
+   unsigned max_users = config_get_ptr()->input.max_users;
+   unsigned count, i;
+
+   if (!preempt->num_branches
+         || preempt->states_saved < preempt->frames)
+      return;
+
+   /* Branches can't see pointing devices. */
+   for (i = 0; i < max_users && i < MAX_USERS; i++)
+      if (preempt->ptr_dev_polled[i])
+         return;
+
+   count = preempt_branch_inputs(preempt, inputs);
+
+   for (i = 0; i < count; i++)
+   {
+      struct preempt_branch *branch = &preempt->branches[i];
+
+      /* Still busy with an older frame, which is of no use now. */
+      if (secondary_core_busy(branch->core))
+         continue;
+
+      memcpy(branch->start, preempt->buffer[preempt->start_ptr],
+            preempt->state_size);
+      memcpy(&branch->input, &inputs[i], sizeof(inputs[i]));
+      branch->serial  = preempt->serial;
+      branch->frames  = preempt->frames;
+      branch->started = true;
+
+      secondary_core_run(branch->core, &branch->input, branch->start,
+            preempt->state_size, preempt->frames, branch->states, false);
+   }
+}
+#endif
+
 /**
  * preempt_pre_frame:
  * @preempt         : pointer to preempt_t object
@@ -333,42 +970,26 @@ void preempt_pre_frame(preempt_t *preempt)
    preempt->in_preframe = true;
    preempt_input_poll(preempt);
    const char *failed_str;
-   uint8_t replay_ptr;
+
+   preempt_auto_tune(preempt);
    
    if (preempt->in_replay
          && preempt->states_saved >= preempt->frames)
    {
+      preempt->replayed = true;
+
       /* Suspend A/V and run preemptive frames */
       driver->audio_suspended = true;
       driver->video_active    = false;
 
-      if (!pretro_unserialize(
-            preempt->buffer[preempt->start_ptr], preempt->state_size))
-      {
-         failed_str = "Failed to Load State for Preemptive Frames.";
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+      preempt->replays++;
+      if (preempt_branch_take(preempt))
+         preempt->branch_hits++;
+      else
+#endif
+      if (!preempt_replay(preempt, &failed_str))
          goto error;
-      }
-
-      pretro_run();
-      replay_ptr = PREEMPT_NEXT_PTR(preempt->start_ptr);
-
-      while (replay_ptr != preempt->start_ptr)
-      {
-         if (!pretro_serialize(
-               preempt->buffer[replay_ptr], preempt->state_size))
-         {
-            if (preempt->state_size < pretro_serialize_size())
-               preempt->states_saved = 0;
-            else
-            {
-               failed_str = "Failed to Save State for Preemptive Frames.";
-               goto error;
-            }
-         }
-
-         pretro_run();
-         replay_ptr = PREEMPT_NEXT_PTR(replay_ptr);
-      }
 
       preempt->in_replay      = false;
       driver->audio_suspended = false;
@@ -384,6 +1005,11 @@ void preempt_pre_frame(preempt_t *preempt)
 
    preempt->start_ptr   = PREEMPT_NEXT_PTR(preempt->start_ptr);
    preempt->in_preframe = false;
+
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+   preempt->serial++;
+   preempt_branch_start(preempt);
+#endif
    return;
 
 error:
@@ -460,6 +1086,10 @@ bool preempt_init(void)
    retro_set_default_callbacks(&preempt->cbs);
    retro_init_libretro_cbs(&driver->retro_ctx); /* usually redundant */
 
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+   preempt_branches_init(preempt);
+#endif
+
    return true;
 }
 
@@ -471,5 +1101,37 @@ bool preempt_init(void)
 void preempt_reset_buffer(preempt_t *preempt)
 {
    if (preempt)
+   {
       preempt->states_saved = 0;
+      preempt->serial++;
+   }
+}
+
+void preempt_set_controller_port_device(preempt_t *preempt,
+      unsigned port, unsigned device)
+{
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+   unsigned i;
+
+   if (!preempt)
+      return;
+
+   for (i = 0; i < preempt->num_branches; i++)
+      secondary_core_set_controller_port_device(
+            preempt->branches[i].core, port, device);
+   preempt->serial++;
+#endif
+}
+
+bool preempt_get_timings(preempt_t *preempt, unsigned *frames,
+      float *run, float *serialize, float *unserialize)
+{
+   if (!preempt)
+      return false;
+
+   *frames      = preempt->frames;
+   *run         = preempt->run_time / 1000.0f;
+   *serialize   = preempt->serialize_time / 1000.0f;
+   *unserialize = preempt->unserialize_time / 1000.0f;
+   return true;
 }
@@ -18,6 +18,12 @@
 
 #define MAX_PREEMPT_FRAMES 10
 
+/* preempt_frames value which lets preempt pick the count itself. */
+#define PREEMPT_FRAMES_AUTO (MAX_PREEMPT_FRAMES + 1)
+
+/* Speculative branches, each on its own secondary core instance. */
+#define MAX_PREEMPT_BRANCHES 4
+
 #include "libretro_version_1.h"
 
 typedef struct preempt_data preempt_t;
@@ -62,5 +68,26 @@ bool preempt_init(void);
  */
 void preempt_reset_buffer(preempt_t *preempt);
 
+/**
+ * preempt_set_controller_port_device
+ *
+ * Mirrors a controller change to the speculative branches.
+ */
+void preempt_set_controller_port_device(preempt_t *preempt,
+      unsigned port, unsigned device);
+
+/**
+ * preempt_get_timings
+ * @preempt         : pointer to preempt object
+ * @frames          : set to the number of frames in use
+ * @run             : set to the average pretro_run time, in ms
+ * @serialize       : set to the average pretro_serialize time, in ms
+ * @unserialize     : set to the average pretro_unserialize time, in ms
+ *
+ * Returns: true if preempt is active, otherwise false.
+ */
+bool preempt_get_timings(preempt_t *preempt, unsigned *frames,
+      float *run, float *serialize, float *unserialize);
+
 #endif /* PREEMPT_H */
 
@@ -22,10 +22,25 @@
 #include <stdint.h>
 #include <string.h>
 #include <retro_inline.h>
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include <file/file_path.h>
 #include "intl/intl.h"
 #include "dynamic.h"
 #include "general.h"
 
+/* After general.h, which pulls in config.h. */
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #ifndef UINT16_MAX
 #define UINT16_MAX 0xffff
 #endif
@@ -83,6 +98,21 @@ size thisstart;
  * This means that on average, ~2 * maxcompsize is 
  * unused at any given moment. */
 
+/* With STATE_MANAGER_DEFLATE or keyframes, each compressed frame 
+ * is packed instead (pseudocode): */
+#if 0
+uint32 size; /* of data, in bytes */
+uint32 flags; /* ENTRY_* */
+uint8[size] data; /* padded to a multiple of uint16 */
+#endif
+
+/* data is a full copy of the state rather than the format above. */
+#define ENTRY_KEYFRAME (1 << 0)
+/* data went through zlib. */
+#define ENTRY_DEFLATED (1 << 1)
+
+#define ENTRY_HEADER_SIZE (sizeof(uint32_t) * 2)
+
 
 /* These are called very few constant times per frame, 
  * keep it as simple as possible. */
@@ -99,162 +129,1298 @@ static INLINE size_t read_size_t(const void *ptr)
    return ret;
 }
 
-struct state_manager
+/* Delta scanners.
+ *
+ * find_change returns the index of the first uint16 which differs.
+ *
+ * find_same returns the number of uint16s until two consecutive ones
+ * (counted in uint32 steps from the start) match, minus one if the
+ * uint16 in front of them matches too.
+ *
+ * Both rely on the sentinels set up by state_manager_new to stop.
+ *
+ * All variants must return exactly what the C versions return, or the
+ * compressed stream would differ between CPUs;
+ * tests/test_rewind.c verifies this. */
+
+static size_t find_change_c(const uint16_t *a, const uint16_t *b)
 {
-   uint8_t *data;
-   size_t capacity;
-   /* Reading and writing is done here here. */
-   uint8_t *head;
-   /* If head comes close to this, discard a frame. */
-   uint8_t *tail;
+   const uint16_t *a_org = a;
+#ifdef NO_UNALIGNED_MEM
+   while (((uintptr_t)a & (sizeof(size_t) - 1)) && *a == *b)
+   {
+      a++;
+      b++;
+   }
+   if (*a == *b)
+#endif
+   {
+      const size_t *a_big = (const size_t*)a;
+      const size_t *b_big = (const size_t*)b;
 
-   uint8_t *thisblock;
-   uint8_t *nextblock;
+      while (*a_big == *b_big)
+      {
+         a_big++;
+         b_big++;
+      }
+      a = (const uint16_t*)a_big;
+      b = (const uint16_t*)b_big;
 
-   /* This one is rounded up from reset::blocksize. */
-   size_t blocksize;
+      while (*a == *b)
+      {
+         a++;
+         b++;
+      }
+   }
+   return a - a_org;
+}
 
-   /* size_t + (blocksize + 131071) / 131072 * 
-    * (blocksize + u16 + u16) + u16 + u32 + size_t
-    * (yes, the math is a bit ugly). */
-   size_t maxcompsize;
+static size_t find_same_c(const uint16_t *a, const uint16_t *b)
+{
+   const uint16_t *a_org = a;
+#ifdef NO_UNALIGNED_MEM
+   if (((uintptr_t)a & (sizeof(uint32_t) - 1)) && *a != *b)
+   {
+      a++;
+      b++;
+   }
+   if (*a != *b)
+#endif
+   {
+      /* With this, it's random whether two consecutive identical
+       * words are caught.
+       *
+       * Luckily, compression rate is the same for both cases, and 
+       * three is always caught.
+       *
+       * (We prefer to miss two-word blocks, anyways; fewer iterations 
+       * of the outer loop, as well as in the decompressor.) */
+      const uint32_t *a_big = (const uint32_t*)a;
+      const uint32_t *b_big = (const uint32_t*)b;
 
-   unsigned entries;
-   bool thisblock_valid;
-};
+      while (*a_big != *b_big)
+      {
+         a_big++;
+         b_big++;
+      }
+      a = (const uint16_t*)a_big;
+      b = (const uint16_t*)b_big;
+
+      if (a != a_org && a[-1] == b[-1])
+      {
+         a--;
+         b--;
+      }
+   }
+   return a - a_org;
+}
 
-state_manager_t *state_manager_new(size_t state_size, size_t buffer_size)
+#if __SSE2__
+#if defined(__GNUC__)
+static INLINE int compat_ctz(unsigned x)
 {
-   size_t newblocksize;
-   int maxcblks;
-   const int maxcblkcover = UINT16_MAX * sizeof(uint16_t);
-   state_manager_t *state = (state_manager_t*)calloc(1, sizeof(*state));
+   return __builtin_ctz(x);
+}
+#else
+static INLINE int compat_ctz(unsigned x)
+{
+   int ret = 0;
 
-   if (!state)
-      return NULL;
+   while (!(x & 1))
+   {
+      x >>= 1;
+      ret++;
+   }
+   return ret;
+}
+#endif
 
-   newblocksize = ((state_size - 1) | (sizeof(uint16_t) - 1)) + 1;
-   state->blocksize = newblocksize;
+#include <emmintrin.h>
+/* There's no equivalent in libc, you'd think so ...
+ * std::mismatch exists, but it's not optimized at all. */
 
-   maxcblks = (state->blocksize + maxcblkcover - 1) / maxcblkcover;
-   state->maxcompsize = state->blocksize + maxcblks * sizeof(uint16_t) * 2 +
-      sizeof(uint16_t) + sizeof(uint32_t) + sizeof(size_t) * 2;
+static size_t find_change_sse2(const uint16_t *a, const uint16_t *b)
+{
+   const __m128i *a128 = (const __m128i*)a;
+   const __m128i *b128 = (const __m128i*)b;
 
-   state->data = (uint8_t*)malloc(buffer_size);
+   for (;;)
+   {
+      __m128i v0    = _mm_loadu_si128(a128);
+      __m128i v1    = _mm_loadu_si128(b128);
+      __m128i c     = _mm_cmpeq_epi32(v0, v1);
+      uint32_t mask = _mm_movemask_epi8(c);
 
-   state->thisblock = (uint8_t*)
-      calloc(state->blocksize + sizeof(uint16_t) * 4 + 16, 1);
-   state->nextblock = (uint8_t*)
-      calloc(state->blocksize + sizeof(uint16_t) * 4 + 16, 1);
-   if (!state->data || !state->thisblock || !state->nextblock)
-      goto error;
+      if (mask != 0xffff) /* Something has changed, figure out where. */
+      {
+         size_t ret = (((uint8_t*)a128 - (uint8_t*)a) |
+               (compat_ctz(~mask))) >> 1;
+         return ret | (a[ret] == b[ret]);
+      }
 
-   /* Force in a different byte at the end, so we don't need to check 
-    * bounds in the innermost loop (it's expensive).
-    *
-    * There is also a large amount of data that's the same, to stop 
-    * the other scan.
-    *
-    * There is also some padding at the end. This is so we don't 
-    * read outside the buffer end if we're reading in large blocks;
-    *
-    * It doesn't make any difference to us, but sacrificing 16 bytes to get 
-    * Valgrind happy is worth it. */
-   *(uint16_t*)(state->thisblock + state->blocksize + sizeof(uint16_t) * 3) =
-      0xFFFF;
-   *(uint16_t*)(state->nextblock + state->blocksize + sizeof(uint16_t) * 3) =
-      0x0000;
+      a128++;
+      b128++;
+   }
+}
 
-   state->capacity = buffer_size;
+static size_t find_same_sse2(const uint16_t *a, const uint16_t *b)
+{
+   const __m128i *a128 = (const __m128i*)a;
+   const __m128i *b128 = (const __m128i*)b;
 
-   state->head = state->data + sizeof(size_t);
-   state->tail = state->data + sizeof(size_t);
+   for (;;)
+   {
+      __m128i v0    = _mm_loadu_si128(a128);
+      __m128i v1    = _mm_loadu_si128(b128);
+      __m128i c     = _mm_cmpeq_epi32(v0, v1);
+      unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(c));
 
-   return state;
+      if (mask) /* One uint32 lane per bit. */
+      {
+         size_t ret = ((const uint16_t*)a128 - a) + compat_ctz(mask) * 2;
 
-error:
-   state_manager_free(state);
-   return NULL;
+         if (ret && a[ret - 1] == b[ret - 1])
+            ret--;
+         return ret;
+      }
+
+      a128++;
+      b128++;
+   }
 }
+#endif
 
-void state_manager_free(state_manager_t *state)
+#if defined(CPU_X86) && (defined(__clang__) || (defined(__GNUC__) && \
+      (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define HAVE_REWIND_AVX2
+#include <immintrin.h>
+
+/* Compiled for AVX2 regardless of -march, only called if 
+ * the CPU reports it. */
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+static AVX2_TARGET size_t find_change_avx2(const uint16_t *a,
+      const uint16_t *b)
 {
-   if (!state)
-      return;
+   const __m256i *a256 = (const __m256i*)a;
+   const __m256i *b256 = (const __m256i*)b;
+
+   for (;;)
+   {
+      __m256i v0    = _mm256_loadu_si256(a256);
+      __m256i v1    = _mm256_loadu_si256(b256);
+      __m256i c     = _mm256_cmpeq_epi16(v0, v1);
+      uint32_t mask = _mm256_movemask_epi8(c);
+
+      if (mask != 0xffffffff)
+         return ((const uint16_t*)a256 - a) + (__builtin_ctz(~mask) >> 1);
+
+      a256++;
+      b256++;
+   }
+}
+
+static AVX2_TARGET size_t find_same_avx2(const uint16_t *a,
+      const uint16_t *b)
+{
+   const __m256i *a256 = (const __m256i*)a;
+   const __m256i *b256 = (const __m256i*)b;
+
+   for (;;)
+   {
+      __m256i v0    = _mm256_loadu_si256(a256);
+      __m256i v1    = _mm256_loadu_si256(b256);
+      __m256i c     = _mm256_cmpeq_epi32(v0, v1);
+      unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(c));
+
+      if (mask)
+      {
+         size_t ret = ((const uint16_t*)a256 - a) + __builtin_ctz(mask) * 2;
+
+         if (ret && a[ret - 1] == b[ret - 1])
+            ret--;
+         return ret;
+      }
+
+      a256++;
+      b256++;
+   }
+}
+#endif
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+static size_t find_change_neon(const uint16_t *a, const uint16_t *b)
+{
+   const uint16_t *a_org = a;
+
+   for (;;)
+   {
+      uint16x8_t c   = vceqq_u16(vld1q_u16(a), vld1q_u16(b));
+      uint64x2_t c64 = vreinterpretq_u64_u16(c);
+
+      if ((vgetq_lane_u64(c64, 0) & vgetq_lane_u64(c64, 1)) != ~(uint64_t)0)
+         break;
+
+      a += 8;
+      b += 8;
+   }
+
+   while (*a == *b)
+   {
+      a++;
+      b++;
+   }
+   return a - a_org;
+}
+
+static size_t find_same_neon(const uint16_t *a, const uint16_t *b)
+{
+   const uint16_t *a_org = a;
+
+   /* Same alignment rules as find_same_c, NO_UNALIGNED_MEM 
+    * is always set here. */
+   if (((uintptr_t)a & (sizeof(uint32_t) - 1)) && *a != *b)
+   {
+      a++;
+      b++;
+   }
+   if (*a != *b)
+   {
+      for (;;)
+      {
+         uint32x4_t c   = vceqq_u32(
+               vreinterpretq_u32_u16(vld1q_u16(a)),
+               vreinterpretq_u32_u16(vld1q_u16(b)));
+         uint64x2_t c64 = vreinterpretq_u64_u32(c);
+
+         if (vgetq_lane_u64(c64, 0) | vgetq_lane_u64(c64, 1))
+            break;
+
+         a += 8;
+         b += 8;
+      }
+
+      while (a[0] != b[0] || a[1] != b[1])
+      {
+         a += 2;
+         b += 2;
+      }
+
+      if (a != a_org && a[-1] == b[-1])
+      {
+         a--;
+         b--;
+      }
+   }
+   return a - a_org;
+}
+#endif
+
+struct state_manager_delta_impl
+{
+   const char *ident;
+   /* RETRO_SIMD_* bits the CPU needs to run this. */
+   uint64_t simd;
+   size_t (*find_change)(const uint16_t *a, const uint16_t *b);
+   size_t (*find_same)(const uint16_t *a, const uint16_t *b);
+};
+
+/* Most preferred first. The C version goes last and runs anywhere. */
+static const struct state_manager_delta_impl delta_impls[] = {
+#ifdef HAVE_REWIND_AVX2
+   { "avx2", RETRO_SIMD_AVX | RETRO_SIMD_AVX2,
+      find_change_avx2, find_same_avx2 },
+#endif
+#if __SSE2__
+   { "sse2", RETRO_SIMD_SSE2, find_change_sse2, find_same_sse2 },
+#endif
+#if defined(__ARM_NEON__)
+   { "neon", RETRO_SIMD_NEON, find_change_neon, find_same_neon },
+#endif
+   { "c",    0,               find_change_c,    find_same_c },
+};
+
+#define NUM_DELTA_IMPLS (sizeof(delta_impls) / sizeof(delta_impls[0]))
+
+static const struct state_manager_delta_impl *delta_impl_find(uint64_t cpu)
+{
+   unsigned i;
+
+   for (i = 0; i < NUM_DELTA_IMPLS; i++)
+      if ((cpu & delta_impls[i].simd) == delta_impls[i].simd)
+         return &delta_impls[i];
+
+   return &delta_impls[NUM_DELTA_IMPLS - 1];
+}
+
+/* Padding after the sentinels, large enough for the widest 
+ * scanner to read a full vector past them. */
+#define STATE_MANAGER_BLOCK_PAD (sizeof(uint16_t) * 4 + 32)
+
+/**
+ * state_manager_raw_compress:
+ * @impl                : Delta scanners to use.
+ * @src                 : Previous state.
+ * @dst                 : Current state.
+ * @len                 : Size of both states, a multiple of uint16_t.
+ * @patch               : Output buffer.
+ *
+ * Writes a patch which turns @dst back into @src. Both buffers need 
+ * STATE_MANAGER_BLOCK_PAD bytes of padding with differing sentinels.
+ *
+ * Returns: size of the patch in bytes.
+ **/
+static size_t state_manager_raw_compress(
+      const struct state_manager_delta_impl *impl,
+      const void *src, const void *dst, size_t len, void *patch)
+{
+   const uint16_t *old16  = (const uint16_t*)src;
+   const uint16_t *new16  = (const uint16_t*)dst;
+   uint16_t *compressed16 = (uint16_t*)patch;
+   size_t num16s          = len / sizeof(uint16_t);
+
+   while (num16s)
+   {
+      size_t i, changed;
+      size_t skip = impl->find_change(old16, new16);
+
+      if (skip >= num16s)
+         break;
+
+      old16  += skip;
+      new16  += skip;
+      num16s -= skip;
+
+      if (skip > UINT16_MAX)
+      {
+         if (skip > UINT32_MAX)
+         {
+            /* This will make it scan the entire thing again, 
+             * but it only hits on 8GB unchanged data anyways,
+             * and if you're doing that, you've got bigger problems. */
+            skip = UINT32_MAX;
+         }
+         *compressed16++ = 0;
+         *compressed16++ = skip;
+         *compressed16++ = skip >> 16;
+         continue;
+      }
+
+      changed = impl->find_same(old16, new16);
+      if (changed > UINT16_MAX)
+         changed = UINT16_MAX;
+
+      *compressed16++ = changed;
+      *compressed16++ = skip;
+
+      for (i = 0; i < changed; i++)
+         compressed16[i] = old16[i];
+
+      old16        += changed;
+      new16        += changed;
+      num16s       -= changed;
+      compressed16 += changed;
+   }
+
+   compressed16[0] = 0;
+   compressed16[1] = 0;
+   compressed16[2] = 0;
+
+   return (uint8_t*)(compressed16 + 3) - (uint8_t*)patch;
+}
+
+/**
+ * state_manager_raw_decompress:
+ * @patch               : Patch made by state_manager_raw_compress.
+ * @data                : State to apply it to.
+ *
+ * Applies @patch to @data in place.
+ **/
+static void state_manager_raw_decompress(const void *patch, void *data)
+{
+   const uint16_t *compressed16 = (const uint16_t*)patch;
+   uint16_t *out16              = (uint16_t*)data;
+
+   for (;;)
+   {
+      uint16_t i;
+      uint16_t numchanged = *(compressed16++);
+
+      if (numchanged)
+      {
+         out16 += *compressed16++;
+
+         /* We could do memcpy, but it seems that memcpy has a 
+          * constant-per-call overhead that actually shows up.
+          *
+          * Our average size in here seems to be 8 or something.
+          * Therefore, we do something with lower overhead. */
+         for (i = 0; i < numchanged; i++)
+            out16[i] = compressed16[i];
+
+         compressed16 += numchanged;
+         out16 += numchanged;
+      }
+      else
+      {
+         uint32_t numunchanged = compressed16[0] | (compressed16[1] << 16);
+
+         if (!numunchanged)
+            break;
+         compressed16 += 2;
+         out16 += numunchanged;
+      }
+   }
+}
+
+#ifdef HAVE_MMAP
+/* Disk tier: a second ring buffer in a memory-mapped file, 
+ * fed with entries as they drop out of the tail of the RAM ring.
+ * It holds the patches older than anything in RAM, so it is used
+ * as a stack: pushed by eviction, popped once the RAM ring is empty.
+ *
+ * Entry format (offsets are relative to the start of the map):
+ * size_t size; uint8[size] payload; size_t start_of_entry;
+ *
+ * A size of SPILL_WRAP means the next entry is at offset 0. */
+
+#define SPILL_WRAP ((size_t)-1)
+
+/* Hand written pages back to the kernel this often, 
+ * so RSS stays bounded no matter how much history piles up. */
+#define SPILL_RELEASE_BYTES (16 << 20)
+
+struct state_spill
+{
+   char path[PATH_MAX_LENGTH];
+   int fd;
+   uint8_t *map;
+   size_t capacity;
+
+   size_t head;
+   size_t tail;
+   /* Where the last SPILL_WRAP went, so pop can step over it. */
+   size_t wrap;
+   size_t unreleased;
+   unsigned entries;
+};
+
+static void state_spill_free(struct state_spill *spill)
+{
+   if (!spill)
+      return;
+
+   if (spill->map)
+      munmap(spill->map, spill->capacity);
+   if (spill->fd >= 0)
+   {
+      close(spill->fd);
+      unlink(spill->path);
+   }
+   free(spill);
+}
+
+static struct state_spill *state_spill_new(const char *path, size_t size)
+{
+   struct state_spill *spill = (struct state_spill*)
+      calloc(1, sizeof(*spill));
+
+   if (!spill)
+      return NULL;
+
+   strlcpy(spill->path, path, sizeof(spill->path));
+   spill->capacity = size & ~(sizeof(size_t) - 1);
+   spill->fd       = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (spill->fd < 0)
+      goto error;
+
+   /* Sparse, so this only reserves the space. */
+   if (ftruncate(spill->fd, spill->capacity) != 0)
+      goto error;
+
+   spill->map = (uint8_t*)mmap(NULL, spill->capacity,
+         PROT_READ | PROT_WRITE, MAP_SHARED, spill->fd, 0);
+   if (spill->map == MAP_FAILED)
+   {
+      spill->map = NULL;
+      goto error;
+   }
+
+   return spill;
+
+error:
+   state_spill_free(spill);
+   return NULL;
+}
+
+static void state_spill_discard_tail(struct state_spill *spill)
+{
+   size_t size = read_size_t(spill->map + spill->tail);
+
+   if (size == SPILL_WRAP)
+   {
+      spill->tail = 0;
+      size        = read_size_t(spill->map);
+   }
+
+   spill->tail += sizeof(size_t) * 2 + size;
+   spill->entries--;
+}
+
+static void state_spill_push(struct state_spill *spill,
+      const uint8_t *payload, size_t size)
+{
+   size_t needed = sizeof(size_t) * 2 + size;
+   size_t start;
+
+   /* Room for the entry and a wrap marker after it. */
+   if (needed + sizeof(size_t) > spill->capacity)
+      return;
+
+   for (;;)
+   {
+      if (!spill->entries)
+         spill->head = spill->tail = 0;
+
+      if (spill->head >= spill->tail)
+      {
+         if (spill->capacity - spill->head >= needed + sizeof(size_t))
+            break;
+
+         if (spill->entries && spill->tail > needed)
+         {
+            write_size_t(spill->map + spill->head, SPILL_WRAP);
+            spill->wrap = spill->head;
+            spill->head = 0;
+            continue;
+         }
+      }
+      else if (spill->tail - spill->head > needed)
+         break;
+
+      state_spill_discard_tail(spill);
+   }
+
+   start = spill->head;
+   write_size_t(spill->map + start, size);
+   memcpy(spill->map + start + sizeof(size_t), payload, size);
+   write_size_t(spill->map + start + sizeof(size_t) + size, start);
+   spill->head = start + needed;
+   spill->entries++;
+
+   spill->unreleased += needed;
+   if (spill->unreleased >= SPILL_RELEASE_BYTES)
+   {
+      /* Pages only need to come back if we rewind that far. */
+#ifdef MADV_DONTNEED
+      msync(spill->map, spill->capacity, MS_ASYNC);
+      madvise(spill->map, spill->capacity, MADV_DONTNEED);
+#endif
+      spill->unreleased = 0;
+   }
+}
+
+/* Returns the most recently pushed payload, 
+ * paging it back in from disk if needed. */
+static const uint8_t *state_spill_pop(struct state_spill *spill)
+{
+   size_t start;
+
+   if (!spill->entries)
+      return NULL;
+
+   if (spill->head == 0)
+      spill->head = spill->wrap;
+
+   start       = read_size_t(spill->map + spill->head - sizeof(size_t));
+   spill->head = start;
+   spill->entries--;
+
+   return spill->map + start + sizeof(size_t);
+}
+#endif
+
+/* Where a keyframe sits in the RAM ring. */
+struct state_keyframe
+{
+   size_t pos;
+   unsigned serial;
+};
+
+struct state_manager
+{
+   uint8_t *data;
+   size_t capacity;
+   /* Reading and writing is done here here. */
+   uint8_t *head;
+   /* If head comes close to this, discard a frame. */
+   uint8_t *tail;
+
+   uint8_t *thisblock;
+   uint8_t *nextblock;
+
+   /* This one is rounded up from reset::blocksize. */
+   size_t blocksize;
+
+   /* size_t + (blocksize + 131071) / 131072 * 
+    * (blocksize + u16 + u16) + u16 + u32 + size_t
+    * (yes, the math is a bit ugly). */
+   size_t maxcompsize;
+
+   const struct state_manager_delta_impl *impl;
+
+   unsigned entries;
+   bool thisblock_valid;
+
+   /* Packed entries, see ENTRY_*. 'scratch' holds a delta 
+    * on its way into or out of zlib. */
+   bool packed;
+   uint8_t *scratch;
+   unsigned keyframe_interval;
+   unsigned since_keyframe;
+
+   /* Every RAM entry gets a serial when pushed; head_serial is 
+    * the one the next push gets. Keyframes are indexed oldest 
+    * first so state_manager_seek can jump straight to them. */
+   unsigned head_serial;
+   struct state_keyframe *keyframes;
+   size_t num_keyframes;
+   size_t keyframes_size;
+#ifdef HAVE_ZLIB
+   z_stream *deflate_stream;
+   z_stream *inflate_stream;
+#endif
+
+#ifdef HAVE_MMAP
+   /* Entries pushed out of the tail end up here. */
+   struct state_spill *spill;
+#endif
+
+#ifdef HAVE_THREADS
+   /* Threaded mode: the main thread serializes into 'pending', 
+    * push_do swaps it with nextblock and the worker compresses. 
+    * Everything above is owned by the worker while 'busy' is set. */
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   uint8_t *pending;
+   bool busy;
+   bool quit;
+   /* Main thread only. Set once a block was handed to the worker, 
+    * which leaves thisblock valid; cleared by pop. */
+   bool handed_off;
+#endif
+};
+
+static void state_manager_push_do_internal(state_manager_t *state);
+
+#ifdef HAVE_THREADS
+static void state_manager_thread(void *data)
+{
+   state_manager_t *state = (state_manager_t*)data;
+
+   slock_lock(state->lock);
+
+   for (;;)
+   {
+      while (!state->busy && !state->quit)
+         scond_wait(state->cond, state->lock);
+
+      if (state->quit)
+         break;
+
+      slock_unlock(state->lock);
+      state_manager_push_do_internal(state);
+      slock_lock(state->lock);
+
+      state->busy = false;
+      scond_signal(state->cond);
+   }
+
+   slock_unlock(state->lock);
+}
+#endif
+
+/**
+ * state_manager_sync:
+ * @state               : State manager.
+ *
+ * Waits for the worker thread (if any) to finish compressing,
+ * after which the main thread owns the ring buffer again.
+ **/
+static void state_manager_sync(state_manager_t *state)
+{
+#ifdef HAVE_THREADS
+   if (!state->thread)
+      return;
+
+   slock_lock(state->lock);
+   while (state->busy)
+      scond_wait(state->cond, state->lock);
+   slock_unlock(state->lock);
+#else
+   (void)state;
+#endif
+}
+
+state_manager_t *state_manager_new(size_t state_size, size_t buffer_size,
+      unsigned flags, unsigned keyframe_interval)
+{
+   size_t newblocksize;
+   int maxcblks;
+   const int maxcblkcover = UINT16_MAX * sizeof(uint16_t);
+   state_manager_t *state = (state_manager_t*)calloc(1, sizeof(*state));
+
+   if (!state)
+      return NULL;
+
+   newblocksize = ((state_size - 1) | (sizeof(uint16_t) - 1)) + 1;
+   state->blocksize = newblocksize;
+
+   maxcblks = (state->blocksize + maxcblkcover - 1) / maxcblkcover;
+   state->maxcompsize = state->blocksize + maxcblks * sizeof(uint16_t) * 2 +
+      sizeof(uint16_t) + sizeof(uint32_t) + sizeof(size_t) * 2;
+
+   state->keyframe_interval = keyframe_interval;
+   state->packed            = keyframe_interval != 0;
+
+#ifdef HAVE_ZLIB
+   if (flags & STATE_MANAGER_DEFLATE)
+   {
+      state->deflate_stream = (z_stream*)calloc(1, sizeof(z_stream));
+      state->inflate_stream = (z_stream*)calloc(1, sizeof(z_stream));
+      if (!state->deflate_stream || !state->inflate_stream)
+         goto error;
+
+      if (deflateInit(state->deflate_stream, Z_BEST_SPEED) != Z_OK)
+      {
+         free(state->deflate_stream);
+         state->deflate_stream = NULL;
+         goto error;
+      }
+      if (inflateInit(state->inflate_stream) != Z_OK)
+      {
+         free(state->inflate_stream);
+         state->inflate_stream = NULL;
+         goto error;
+      }
+      state->packed = true;
+   }
+#endif
+
+   if (state->packed)
+   {
+      /* Stored entries never exceed the raw delta, 
+       * which is never smaller than a keyframe. */
+      state->maxcompsize += ENTRY_HEADER_SIZE;
+      state->scratch      = (uint8_t*)malloc(state->maxcompsize);
+      if (!state->scratch)
+         goto error;
+   }
+
+   state->impl = delta_impl_find(rarch_get_cpu_features());
+
+   state->data = (uint8_t*)malloc(buffer_size);
+
+   state->thisblock = (uint8_t*)
+      calloc(state->blocksize + STATE_MANAGER_BLOCK_PAD, 1);
+   state->nextblock = (uint8_t*)
+      calloc(state->blocksize + STATE_MANAGER_BLOCK_PAD, 1);
+   if (!state->data || !state->thisblock || !state->nextblock)
+      goto error;
+
+   /* Force in a different byte at the end, so we don't need to check 
+    * bounds in the innermost loop (it's expensive).
+    *
+    * There is also a large amount of data that's the same, to stop 
+    * the other scan.
+    *
+    * There is also some padding at the end. This is so we don't 
+    * read outside the buffer end if we're reading in large blocks;
+    *
+    * It doesn't make any difference to us, but sacrificing 32 bytes to get 
+    * Valgrind happy is worth it. */
+   *(uint16_t*)(state->thisblock + state->blocksize + sizeof(uint16_t) * 3) =
+      0xFFFF;
+   *(uint16_t*)(state->nextblock + state->blocksize + sizeof(uint16_t) * 3) =
+      0x0000;
+
+   state->capacity = buffer_size;
+
+   state->head = state->data + sizeof(size_t);
+   state->tail = state->data + sizeof(size_t);
+
+#ifdef HAVE_THREADS
+   if (flags & STATE_MANAGER_THREADED)
+   {
+      state->pending = (uint8_t*)
+         calloc(state->blocksize + STATE_MANAGER_BLOCK_PAD, 1);
+      state->lock    = slock_new();
+      state->cond    = scond_new();
+      if (!state->pending || !state->lock || !state->cond)
+         goto error;
+
+      state->thread  = sthread_create(state_manager_thread, state);
+      if (!state->thread)
+         goto error;
+   }
+#endif
+
+   return state;
+
+error:
+   state_manager_free(state);
+   return NULL;
+}
+
+void state_manager_free(state_manager_t *state)
+{
+   if (!state)
+      return;
+
+#ifdef HAVE_THREADS
+   if (state->thread)
+   {
+      slock_lock(state->lock);
+      state->quit = true;
+      scond_signal(state->cond);
+      slock_unlock(state->lock);
+      sthread_join(state->thread);
+   }
+
+   if (state->lock)
+      slock_free(state->lock);
+   if (state->cond)
+      scond_free(state->cond);
+   free(state->pending);
+#endif
+
+#ifdef HAVE_ZLIB
+   if (state->deflate_stream)
+   {
+      deflateEnd(state->deflate_stream);
+      free(state->deflate_stream);
+   }
+   if (state->inflate_stream)
+   {
+      inflateEnd(state->inflate_stream);
+      free(state->inflate_stream);
+   }
+#endif
+
+#ifdef HAVE_MMAP
+   state_spill_free(state->spill);
+#endif
+
+   free(state->keyframes);
+   free(state->scratch);
+   free(state->data);
+   free(state->thisblock);
+   free(state->nextblock);
+   free(state);
+}
+
+#ifdef HAVE_ZLIB
+static size_t state_manager_deflate(state_manager_t *state,
+      const void *in, size_t in_size, void *out, size_t out_size)
+{
+   z_stream *stream = state->deflate_stream;
+
+   deflateReset(stream);
+   stream->next_in   = (Bytef*)in;
+   stream->avail_in  = in_size;
+   stream->next_out  = (Bytef*)out;
+   stream->avail_out = out_size;
+
+   /* Running out of room just means it didn't pay off. */
+   if (deflate(stream, Z_FINISH) != Z_STREAM_END)
+      return 0;
+   return stream->total_out;
+}
+
+static bool state_manager_inflate(state_manager_t *state,
+      const void *in, size_t in_size, void *out, size_t out_size)
+{
+   z_stream *stream = state->inflate_stream;
+
+   inflateReset(stream);
+   stream->next_in   = (Bytef*)in;
+   stream->avail_in  = in_size;
+   stream->next_out  = (Bytef*)out;
+   stream->avail_out = out_size;
+
+   return inflate(stream, Z_FINISH) == Z_STREAM_END;
+}
+#endif
+
+/**
+ * state_manager_pack:
+ * @state               : State manager.
+ * @out                 : Where the entry goes in the ring buffer.
+ *
+ * Packs the patch from nextblock to thisblock (or all of thisblock 
+ * if a keyframe is due), deflating it if that makes it smaller.
+ *
+ * Returns: bytes written to @out.
+ **/
+static size_t state_manager_pack(state_manager_t *state, uint8_t *out)
+{
+   uint32_t header[2];
+   const uint8_t *src;
+   size_t len;
+   uint8_t *payload = out + ENTRY_HEADER_SIZE;
+   uint32_t flags   = 0;
+
+   if (state->keyframe_interval &&
+         ++state->since_keyframe >= state->keyframe_interval)
+   {
+      state->since_keyframe = 0;
+      src    = state->thisblock;
+      len    = state->blocksize;
+      flags |= ENTRY_KEYFRAME;
+   }
+   else
+   {
+      len = state_manager_raw_compress(state->impl,
+            state->thisblock, state->nextblock,
+            state->blocksize, state->scratch);
+      src = state->scratch;
+   }
+
+#ifdef HAVE_ZLIB
+   if (state->deflate_stream)
+   {
+      size_t deflated = state_manager_deflate(state, src, len,
+            payload, len - 1);
+
+      if (deflated)
+      {
+         len    = deflated;
+         flags |= ENTRY_DEFLATED;
+      }
+   }
+#endif
+
+   if (!(flags & ENTRY_DEFLATED))
+      memcpy(payload, src, len);
+
+   header[0] = len;
+   header[1] = flags;
+   memcpy(out, header, sizeof(header));
+
+   return ENTRY_HEADER_SIZE + ((len + 1) & ~(size_t)1);
+}
+
+/**
+ * state_manager_unpack:
+ * @state               : State manager.
+ * @in                  : Entry made by state_manager_pack.
+ *
+ * Turns thisblock into the state stored in @in.
+ *
+ * Returns: true if successful, otherwise false.
+ **/
+static bool state_manager_unpack(state_manager_t *state, const uint8_t *in)
+{
+   uint32_t header[2];
+   const uint8_t *payload = in + ENTRY_HEADER_SIZE;
+
+   memcpy(header, in, sizeof(header));
+
+   if (header[1] & ENTRY_DEFLATED)
+   {
+#ifdef HAVE_ZLIB
+      uint8_t *out    = (header[1] & ENTRY_KEYFRAME) ?
+         state->thisblock : state->scratch;
+      size_t out_size = (header[1] & ENTRY_KEYFRAME) ?
+         state->blocksize : state->maxcompsize;
+
+      if (!state->inflate_stream || !state_manager_inflate(state,
+               payload, header[0], out, out_size))
+         return false;
+      payload = out;
+#else
+      return false;
+#endif
+   }
+
+   if (!(header[1] & ENTRY_KEYFRAME))
+      state_manager_raw_decompress(payload, state->thisblock);
+   else if (payload != state->thisblock)
+      memcpy(state->thisblock, payload, state->blocksize);
+
+   return true;
+}
+
+/* Called when an entry fails to decode; everything older 
+ * than it depends on it, so none of it can be used. */
+static void state_manager_discard_all(state_manager_t *state)
+{
+   RARCH_ERR("Rewind buffer is corrupt, discarding it.\n");
+   state->head          = state->tail;
+   state->entries       = 0;
+   state->num_keyframes = 0;
+#ifdef HAVE_MMAP
+   /* Disk entries continue from the RAM ones, 
+    * they're no use on their own. */
+   if (state->spill)
+      state->spill->entries = 0;
+#endif
+}
+
+static void state_manager_keyframe_add(state_manager_t *state,
+      size_t pos, unsigned serial)
+{
+   if (state->num_keyframes == state->keyframes_size)
+   {
+      size_t size = state->keyframes_size ? state->keyframes_size * 2 : 16;
+      struct state_keyframe *keyframes = (struct state_keyframe*)
+         realloc(state->keyframes, size * sizeof(*keyframes));
+
+      /* Seeking just gets slower without it. */
+      if (!keyframes)
+         return;
+
+      state->keyframes      = keyframes;
+      state->keyframes_size = size;
+   }
+
+   state->keyframes[state->num_keyframes].pos    = pos;
+   state->keyframes[state->num_keyframes].serial = serial;
+   state->num_keyframes++;
+}
+
+bool state_manager_pop(state_manager_t *state, const void **data)
+{
+   size_t start;
+
+   *data = NULL;
+
+   state_manager_sync(state);
+#ifdef HAVE_THREADS
+   state->handed_off = false;
+#endif
+
+   if (state->thisblock_valid)
+   {
+      state->thisblock_valid = false;
+      state->entries--;
+      *data = state->thisblock;
+      return true;
+   }
+
+   if (state->head == state->tail)
+   {
+#ifdef HAVE_MMAP
+      const uint8_t *payload;
+
+      if (!state->spill || !(payload = state_spill_pop(state->spill)))
+         return false;
+
+      if (!state->packed)
+         state_manager_raw_decompress(payload, state->thisblock);
+      else if (!state_manager_unpack(state, payload))
+      {
+         RARCH_ERR("Rewind history on disk is corrupt, discarding it.\n");
+         state->spill->entries = 0;
+         return false;
+      }
+
+      *data = state->thisblock;
+      return true;
+#else
+      return false;
+#endif
+   }
+
+   start = read_size_t(state->head - sizeof(size_t));
+   state->head = state->data + start;
+
+   /* thisblock is the last pushed (or returned) state. */
+   if (!state->packed)
+      state_manager_raw_decompress(state->data + start + sizeof(size_t),
+            state->thisblock);
+   else if (!state_manager_unpack(state,
+            state->data + start + sizeof(size_t)))
+   {
+      state_manager_discard_all(state);
+      return false;
+   }
 
-   free(state->data);
-   free(state->thisblock);
-   free(state->nextblock);
-   free(state);
+   state->head_serial--;
+   while (state->num_keyframes && state->keyframes[
+         state->num_keyframes - 1].serial >= state->head_serial)
+      state->num_keyframes--;
+
+   state->entries--;
+   *data = state->thisblock;
+   return true;
 }
 
-bool state_manager_pop(state_manager_t *state, const void **data)
+/**
+ * state_manager_seek:
+ * @state               : State manager.
+ * @entries             : How many entries to go back.
+ * @data                : Set to the state that ends up on top.
+ *
+ * Same as calling state_manager_pop @entries times, except that 
+ * the newest keyframe at or past the target is decoded directly, 
+ * so only the entries between it and the target get replayed. 
+ * Without keyframes this degrades to plain pops.
+ *
+ * Returns: how many entries were actually dropped, 
+ * 0 if there was nothing to go back to.
+ **/
+unsigned state_manager_seek(state_manager_t *state, unsigned entries,
+      const void **data)
 {
-   size_t start;
-   uint8_t *out                 = NULL;
-   uint16_t *out16              = NULL;
-   const uint8_t *compressed    = NULL;
-   const uint16_t *compressed16 = NULL;
+   unsigned done = 0;
+   const void *ignored;
 
    *data = NULL;
 
+   if (!entries)
+      return 0;
+
+   state_manager_sync(state);
+#ifdef HAVE_THREADS
+   state->handed_off = false;
+#endif
+
    if (state->thisblock_valid)
    {
       state->thisblock_valid = false;
       state->entries--;
-      *data = state->thisblock;
-      return true;
+      done++;
    }
 
-   if (state->head == state->tail)
-      return false;
+   if (done < entries && state->num_keyframes && state->head != state->tail)
+   {
+      /* Pops from here on return serials head_serial - 1, head_serial - 2 
+       * and so on; find the oldest keyframe not older than the target. */
+      unsigned left   = entries - done;
+      unsigned target = left < state->head_serial ?
+         state->head_serial - left : 0;
+      size_t i        = state->num_keyframes;
 
-   start = read_size_t(state->head - sizeof(size_t));
-   state->head = state->data + start;
+      while (i && state->keyframes[i - 1].serial >= target)
+         i--;
+
+      if (i < state->num_keyframes)
+      {
+         const struct state_keyframe *kf = &state->keyframes[i];
+         unsigned skipped = state->head_serial - kf->serial;
+
+         if (!state_manager_unpack(state,
+                  state->data + kf->pos + sizeof(size_t)))
+         {
+            state_manager_discard_all(state);
+            if (done)
+               *data = state->thisblock;
+            return done;
+         }
+
+         state->head           = state->data + kf->pos;
+         state->head_serial    = kf->serial;
+         state->entries       -= skipped;
+         state->num_keyframes  = i;
+         done                 += skipped;
+      }
+   }
+
+   while (done < entries && state_manager_pop(state, &ignored))
+      done++;
 
-   compressed = state->data + start + sizeof(size_t);
-   out = state->thisblock;
+   if (done)
+      *data = state->thisblock;
+   return done;
+}
+
+#ifdef HAVE_MMAP
+/* Size of the entry starting at @payload, as written by 
+ * state_manager_pack or state_manager_raw_compress. */
+static size_t state_manager_payload_size(state_manager_t *state,
+      const uint8_t *payload)
+{
+   const uint16_t *compressed16 = (const uint16_t*)payload;
 
-   /* Begin decompression code
-    * out is the last pushed (or returned) state */
-   compressed16 = (const uint16_t*)compressed;
-   out16 = (uint16_t*)out;
+   if (state->packed)
+   {
+      uint32_t header[2];
+
+      memcpy(header, payload, sizeof(header));
+      return ENTRY_HEADER_SIZE + ((header[0] + 1) & ~(size_t)1);
+   }
 
    for (;;)
    {
-      uint16_t i;
       uint16_t numchanged = *(compressed16++);
 
       if (numchanged)
-      {
-         out16 += *compressed16++;
-
-         /* We could do memcpy, but it seems that memcpy has a 
-          * constant-per-call overhead that actually shows up.
-          *
-          * Our average size in here seems to be 8 or something.
-          * Therefore, we do something with lower overhead. */
-         for (i = 0; i < numchanged; i++)
-            out16[i] = compressed16[i];
-
-         compressed16 += numchanged;
-         out16 += numchanged;
-      }
+         compressed16 += 1 + numchanged;
       else
       {
          uint32_t numunchanged = compressed16[0] | (compressed16[1] << 16);
 
+         compressed16 += 2;
          if (!numunchanged)
             break;
-         compressed16 += 2;
-         out16 += numunchanged;
       }
    }
-   /* End decompression code */
 
+   return (const uint8_t*)compressed16 - payload;
+}
+#endif
+
+/* Drops the oldest entry from the RAM ring, 
+ * moving it to the disk tier if there is one. */
+static void state_manager_discard_tail(state_manager_t *state)
+{
+#ifdef HAVE_MMAP
+   if (state->spill)
+   {
+      const uint8_t *payload = state->tail + sizeof(size_t);
+      state_spill_push(state->spill, payload,
+            state_manager_payload_size(state, payload));
+   }
+#endif
+
+   if (state->num_keyframes &&
+         state->keyframes[0].pos == (size_t)(state->tail - state->data))
+      memmove(state->keyframes, state->keyframes + 1,
+            --state->num_keyframes * sizeof(*state->keyframes));
+
+   state->tail = state->data + read_size_t(state->tail);
    state->entries--;
-   *data = state->thisblock;
-   return true;
+}
+
+/**
+ * state_manager_spill_init:
+ * @state               : State manager.
+ * @path                : File to keep the disk tier in.
+ * @size                : Maximum size of the file.
+ *
+ * Keeps entries that no longer fit in RAM in a memory-mapped file 
+ * instead of discarding them. The file is deleted again by 
+ * state_manager_free. Call before the first push.
+ *
+ * Returns: true if successful, otherwise false.
+ **/
+bool state_manager_spill_init(state_manager_t *state,
+      const char *path, size_t size)
+{
+#ifdef HAVE_MMAP
+   state_spill_free(state->spill);
+   state->spill = state_spill_new(path, size);
+   return state->spill != NULL;
+#else
+   (void)state;
+   (void)path;
+   (void)size;
+   return false;
+#endif
 }
 
 void state_manager_push_where(state_manager_t *state, void **data)
@@ -263,7 +1429,11 @@ void state_manager_push_where(state_manager_t *state, void **data)
     * pushed state, or we could end up applying a 'patch' to wrong 
     * savestate, and that'd blow up rather quickly. */
 
+#ifdef HAVE_THREADS
+   if (!state->handed_off && !state->thisblock_valid)
+#else
    if (!state->thisblock_valid) 
+#endif
    {
       const void *ignored;
       if (state_manager_pop(state, &ignored))
@@ -272,140 +1442,59 @@ void state_manager_push_where(state_manager_t *state, void **data)
          state->entries++;
       }
    }
-   
-   *data = state->nextblock;
-}
-
-#if __SSE2__
-#if defined(__GNUC__)
-static INLINE int compat_ctz(unsigned x)
-{
-   return __builtin_ctz(x);
-}
-#else
-
-/* Only checks at nibble granularity, 
- * because that's what we need. */
-
-static INLINE int compat_ctz(unsigned x)
-{
-   if (x & 0x000f)
-      return 0;
-   if (x & 0x00f0)
-      return 4;
-   if (x & 0x0f00)
-      return 8;
-   if (x & 0xf000)
-      return 12;
-   return 16;
-}
-#endif
-
-#include <emmintrin.h>
-/* There's no equivalent in libc, you'd think so ...
- * std::mismatch exists, but it's not optimized at all. */
-
-static INLINE size_t find_change(const uint16_t *a, const uint16_t *b)
-{
-   const __m128i *a128 = (const __m128i*)a;
-   const __m128i *b128 = (const __m128i*)b;
-
-   for (;;)
-   {
-      __m128i v0    = _mm_loadu_si128(a128);
-      __m128i v1    = _mm_loadu_si128(b128);
-      __m128i c     = _mm_cmpeq_epi32(v0, v1);
-      uint32_t mask = _mm_movemask_epi8(c);
-
-      if (mask != 0xffff) /* Something has changed, figure out where. */
-      {
-         size_t ret = (((uint8_t*)a128 - (uint8_t*)a) |
-               (compat_ctz(~mask))) >> 1;
-         return ret | (a[ret] == b[ret]);
-      }
 
-      a128++;
-      b128++;
-   }
-}
-#else
-static INLINE size_t find_change(const uint16_t *a, const uint16_t *b)
-{
-   const uint16_t *a_org = a;
-#ifdef NO_UNALIGNED_MEM
-   while (((uintptr_t)a & (sizeof(size_t) - 1)) && *a == *b)
+#ifdef HAVE_THREADS
+   /* The worker may still be reading nextblock, 
+    * but never touches this one. */
+   if (state->thread)
    {
-      a++;
-      b++;
+      *data = state->pending;
+      return;
    }
-   if (*a == *b)
 #endif
-   {
-      const size_t *a_big = (const size_t*)a;
-      const size_t *b_big = (const size_t*)b;
-
-      while (*a_big == *b_big)
-      {
-         a_big++;
-         b_big++;
-      }
-      a = (const uint16_t*)a_big;
-      b = (const uint16_t*)b_big;
-
-      while (*a == *b)
-      {
-         a++;
-         b++;
-      }
-   }
-   return a - a_org;
+   
+   *data = state->nextblock;
 }
-#endif
 
-static INLINE size_t find_same(const uint16_t *a, const uint16_t *b)
+void state_manager_push_do(state_manager_t *state)
 {
-   const uint16_t *a_org = a;
-#ifdef NO_UNALIGNED_MEM
-   if (((uintptr_t)a & (sizeof(uint32_t) - 1)) && *a != *b)
+#ifdef HAVE_THREADS
+   if (state->thread)
    {
-      a++;
-      b++;
+      uint8_t *swap;
+
+      /* Only stalls if compressing takes longer than 
+       * the rewind granularity. */
+      state_manager_sync(state);
+
+      /* Three blocks rotate now, so the sentinel has to be 
+       * picked against whatever thisblock currently holds. */
+      *(uint16_t*)(state->pending + state->blocksize + sizeof(uint16_t) * 3) =
+         ~*(uint16_t*)(state->thisblock + state->blocksize 
+               + sizeof(uint16_t) * 3);
+
+      swap              = state->nextblock;
+      state->nextblock  = state->pending;
+      state->pending    = swap;
+      state->handed_off = true;
+
+      slock_lock(state->lock);
+      state->busy = true;
+      scond_signal(state->cond);
+      slock_unlock(state->lock);
+      return;
    }
-   if (*a != *b)
 #endif
-   {
-      /* With this, it's random whether two consecutive identical
-       * words are caught.
-       *
-       * Luckily, compression rate is the same for both cases, and 
-       * three is always caught.
-       *
-       * (We prefer to miss two-word blocks, anyways; fewer iterations 
-       * of the outer loop, as well as in the decompressor.) */
-      const uint32_t *a_big = (const uint32_t*)a;
-      const uint32_t *b_big = (const uint32_t*)b;
-
-      while (*a_big != *b_big)
-      {
-         a_big++;
-         b_big++;
-      }
-      a = (const uint16_t*)a_big;
-      b = (const uint16_t*)b_big;
 
-      if (a != a_org && a[-1] == b[-1])
-      {
-         a--;
-         b--;
-      }
-   }
-   return a - a_org;
+   state_manager_push_do_internal(state);
 }
 
-void state_manager_push_do(state_manager_t *state)
+static void state_manager_push_do_internal(state_manager_t *state)
 {
    if (state->thisblock_valid)
    {
+      uint8_t *compressed;
+
       if (state->capacity < sizeof(size_t) + state->maxcompsize)
          return;
 
@@ -418,82 +1507,36 @@ recheckcapacity:;
 
       if (remaining <= state->maxcompsize)
       {
-         state->tail = state->data + read_size_t(state->tail);
-         state->entries--;
+         state_manager_discard_tail(state);
          goto recheckcapacity;
       }
 
-      const uint8_t *oldb = state->thisblock;
-      const uint8_t *newb = state->nextblock;
-      uint8_t *compressed = state->head + sizeof(size_t);
-
-      /* Begin compression code; 'compressed' will point to 
-       * the end of the compressed data (excluding the prev pointer). */
-      const uint16_t *old16 = (const uint16_t*)oldb;
-      const uint16_t *new16 = (const uint16_t*)newb;
-      uint16_t *compressed16 = (uint16_t*)compressed;
-      size_t num16s = state->blocksize / sizeof(uint16_t);
-
-      while (num16s)
+      /* 'compressed' will point to the end of the compressed data 
+       * (excluding the prev pointer). */
+      compressed  = state->head + sizeof(size_t);
+      if (state->packed)
       {
-         size_t i;
-         size_t skip = find_change(old16, new16);
-
-         if (skip >= num16s)
-            break;
-
-         old16 += skip;
-         new16 += skip;
-         num16s -= skip;
-
-         if (skip > UINT16_MAX)
-         {
-            if (skip > UINT32_MAX)
-            {
-               /* This will make it scan the entire thing again, 
-                * but it only hits on 8GB unchanged data anyways,
-                * and if you're doing that, you've got bigger problems. */
-               skip = UINT32_MAX;
-            }
-            *compressed16++ = 0;
-            *compressed16++ = skip;
-            *compressed16++ = skip >> 16;
-            skip = 0;
-            continue;
-         }
-
-         size_t changed = find_same(old16, new16);
-         if (changed > UINT16_MAX)
-            changed = UINT16_MAX;
-
-         *compressed16++ = changed;
-         *compressed16++ = skip;
-
-         for (i = 0; i < changed; i++)
-            compressed16[i] = old16[i];
-
-         old16 += changed;
-         new16 += changed;
-         num16s -= changed;
-         compressed16 += changed;
+         compressed += state_manager_pack(state, compressed);
+         if (state->keyframe_interval && !state->since_keyframe)
+            state_manager_keyframe_add(state,
+                  state->head - state->data, state->head_serial);
       }
-
-      compressed16[0] = 0;
-      compressed16[1] = 0;
-      compressed16[2] = 0;
-      compressed = (uint8_t*)(compressed16 + 3);
-      /* End compression code. */
+      else
+         compressed += state_manager_raw_compress(state->impl,
+               state->thisblock, state->nextblock,
+               state->blocksize, compressed);
 
       if (compressed - state->data + state->maxcompsize > state->capacity)
       {
          compressed = state->data;
          if (state->tail == state->data + sizeof(size_t))
-            state->tail = state->data + read_size_t(state->tail);
+            state_manager_discard_tail(state);
       }
       write_size_t(compressed, state->head-state->data);
       compressed += sizeof(size_t);
       write_size_t(state->head, compressed-state->data);
       state->head = compressed;
+      state->head_serial++;
 
    }
    else
@@ -507,24 +1550,115 @@ recheckcapacity:;
 }
 
 void state_manager_capacity(state_manager_t *state,
-      unsigned *entries, size_t *bytes, bool *full)
+      unsigned *entries, size_t *bytes, bool *full, float *ratio)
 {
-   size_t headpos   = state->head - state->data;
-   size_t tailpos   = state->tail - state->data;
-   size_t remaining = (tailpos + state->capacity -
+   size_t headpos, tailpos, remaining;
+
+   state_manager_sync(state);
+
+   headpos   = state->head - state->data;
+   tailpos   = state->tail - state->data;
+   remaining = (tailpos + state->capacity -
          sizeof(size_t) - headpos - 1) % state->capacity + 1;
 
    if (entries)
+   {
       *entries = state->entries;
+#ifdef HAVE_MMAP
+      if (state->spill)
+         *entries += state->spill->entries;
+#endif
+   }
    if (bytes)
       *bytes = state->capacity-remaining;
    if (full)
       *full = remaining <= state->maxcompsize * 2;
+   if (ratio)
+   {
+      /* Full states represented per byte of ring buffer used; 
+       * thisblock lives outside of it. */
+      unsigned stored = state->entries - (state->thisblock_valid ? 1 : 0);
+      size_t used     = state->capacity - remaining;
+
+      *ratio = used ? (float)stored * state->blocksize / used : 0.0f;
+   }
+}
+
+static const struct state_manager_delta_impl *state_delta_impl;
+
+/**
+ * state_delta_buffer_size:
+ * @state_size          : Size of the states.
+ *
+ * Returns: how much to allocate (zeroed) for each state 
+ * passed to state_delta_encode.
+ **/
+size_t state_delta_buffer_size(size_t state_size)
+{
+   return (((state_size - 1) | (sizeof(uint16_t) - 1)) + 1)
+      + STATE_MANAGER_BLOCK_PAD;
+}
+
+/**
+ * state_delta_max_size:
+ * @state_size          : Size of the states.
+ *
+ * Returns: the largest patch state_delta_encode can write.
+ **/
+size_t state_delta_max_size(size_t state_size)
+{
+   const size_t cover = UINT16_MAX * sizeof(uint16_t);
+   size_t blocksize   = ((state_size - 1) | (sizeof(uint16_t) - 1)) + 1;
+
+   return blocksize + (blocksize + cover - 1) / cover * sizeof(uint16_t) * 2
+      + sizeof(uint16_t) * 3 + sizeof(uint32_t);
+}
+
+/**
+ * state_delta_encode:
+ * @from                : Older state.
+ * @to                  : Newer state.
+ * @state_size          : Size of both states.
+ * @patch               : Output buffer, state_delta_max_size bytes.
+ *
+ * Writes a patch which turns @from into @to, using the same 
+ * scanners as the rewind buffer. Both states have to be allocated 
+ * with state_delta_buffer_size; the padding of @to is overwritten.
+ *
+ * Returns: size of the patch in bytes.
+ **/
+size_t state_delta_encode(const void *from, void *to,
+      size_t state_size, void *patch)
+{
+   size_t blocksize = ((state_size - 1) | (sizeof(uint16_t) - 1)) + 1;
+
+   if (!state_delta_impl)
+      state_delta_impl = delta_impl_find(rarch_get_cpu_features());
+
+   *(uint16_t*)((uint8_t*)to + blocksize + sizeof(uint16_t) * 3) =
+      ~*(const uint16_t*)((const uint8_t*)from + blocksize
+            + sizeof(uint16_t) * 3);
+
+   return state_manager_raw_compress(state_delta_impl,
+         to, from, blocksize, patch);
+}
+
+/**
+ * state_delta_apply:
+ * @patch               : Patch made by state_delta_encode.
+ * @data                : State to apply it to.
+ *
+ * Applies @patch to @data in place.
+ **/
+void state_delta_apply(const void *patch, void *data)
+{
+   state_manager_raw_decompress(patch, data);
 }
 
 void init_rewind(void)
 {
    void *state          = NULL;
+   unsigned flags       = 0;
    driver_t *driver     = driver_get_ptr();
    settings_t *settings = config_get_ptr();
    global_t *global     = global_get_ptr();
@@ -555,13 +1689,71 @@ void init_rewind(void)
 
    RARCH_LOG(RETRO_MSG_REWIND_INIT "%u MB\n", settings->rewind_buffer_size);
 
+   if (settings->rewind_threaded)
+      flags |= STATE_MANAGER_THREADED;
+   if (settings->rewind_deflate)
+      flags |= STATE_MANAGER_DEFLATE;
+
    global->rewind.state = state_manager_new(global->rewind.size,
-         settings->rewind_buffer_size << 20);
+         settings->rewind_buffer_size << 20, flags,
+         settings->rewind_keyframe_interval);
 
    if (!global->rewind.state)
       RARCH_WARN(RETRO_LOG_REWIND_INIT_FAILED);
+   else if (settings->rewind_disk_size && *global->savestate_name)
+   {
+      char path[PATH_MAX_LENGTH] = {0};
+
+      fill_pathname(path, global->savestate_name, ".rewind", sizeof(path));
+
+      if (state_manager_spill_init(global->rewind.state, path,
+               (size_t)settings->rewind_disk_size << 20))
+         RARCH_LOG("Keeping older rewind history in \"%s\", up to %u MB.\n",
+               path, settings->rewind_disk_size);
+      else
+         RARCH_WARN("Could not set up rewind history on disk at \"%s\".\n",
+               path);
+   }
+
+   if (*settings->rewind_dump_path && !global->rewind.dump)
+   {
+      uint32_t header[2];
+
+      header[0] = REWIND_DUMP_MAGIC;
+      header[1] = global->rewind.size;
+
+      global->rewind.dump = fopen(settings->rewind_dump_path, "wb");
+      if (global->rewind.dump &&
+            fwrite(header, sizeof(header), 1, global->rewind.dump) == 1)
+         RARCH_LOG("Dumping rewind states to \"%s\".\n",
+               settings->rewind_dump_path);
+      else
+      {
+         RARCH_WARN("Could not open rewind dump \"%s\".\n",
+               settings->rewind_dump_path);
+         if (global->rewind.dump)
+            fclose(global->rewind.dump);
+         global->rewind.dump = NULL;
+      }
+   }
 
    state_manager_push_where(global->rewind.state, &state);
    pretro_serialize(state, global->rewind.size);
+   rewind_dump_state(state);
    state_manager_push_do(global->rewind.state);
 }
+
+void rewind_dump_state(const void *data)
+{
+   global_t *global = global_get_ptr();
+
+   if (!global->rewind.dump)
+      return;
+
+   if (fwrite(data, global->rewind.size, 1, global->rewind.dump) != 1)
+   {
+      RARCH_WARN("Writing the rewind dump failed, stopping it.\n");
+      fclose(global->rewind.dump);
+      global->rewind.dump = NULL;
+   }
+}
@@ -27,18 +27,50 @@ extern "C" {
 
 typedef struct state_manager state_manager_t;
 
-state_manager_t *state_manager_new(size_t state_size, size_t buffer_size);
+/* Compress on a worker thread (needs HAVE_THREADS). */
+#define STATE_MANAGER_THREADED (1 << 0)
+/* Run each entry through zlib as well (needs HAVE_ZLIB). */
+#define STATE_MANAGER_DEFLATE  (1 << 1)
+
+/* keyframe_interval: store every Nth entry as a full state, 0 for never. */
+state_manager_t *state_manager_new(size_t state_size, size_t buffer_size,
+      unsigned flags, unsigned keyframe_interval);
 
 void state_manager_free(state_manager_t *state);
 
+bool state_manager_spill_init(state_manager_t *state,
+      const char *path, size_t size);
+
 bool state_manager_pop(state_manager_t *state, const void **data);
 
+unsigned state_manager_seek(state_manager_t *state, unsigned entries,
+      const void **data);
+
 void state_manager_push_where(state_manager_t *state, void **data);
 
 void state_manager_push_do(state_manager_t *state);
 
 void state_manager_capacity(state_manager_t *state,
-      unsigned int *entries, size_t *bytes, bool *full);
+      unsigned int *entries, size_t *bytes, bool *full, float *ratio);
+
+/* The rewind delta codec on its own. States passed to 
+ * state_delta_encode need state_delta_buffer_size zeroed bytes. */
+size_t state_delta_buffer_size(size_t state_size);
+
+size_t state_delta_max_size(size_t state_size);
+
+size_t state_delta_encode(const void *from, void *to,
+      size_t state_size, void *patch);
+
+void state_delta_apply(const void *patch, void *data);
+
+/* Layout of a rewind_dump_path file: a uint32_t REWIND_DUMP_MAGIC, 
+ * a uint32_t state size, then the states back to back. 
+ * Native byte order, it's only meant for tests/bench_rewind. */
+#define REWIND_DUMP_MAGIC 0x31445752 /* "RWD1" */
+
+/* Appends a state to the dump file, if one is open. */
+void rewind_dump_state(const void *data);
 
 void init_rewind(void);
 
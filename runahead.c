@@ -0,0 +1,309 @@
+/*  RetroArch - A frontend for libretro.
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Run-Ahead with a second instance of the core on a worker thread.
+ *
+ * The primary instance runs on the main thread with confirmed input,
+ * and only its audio is used. A private copy of the core library is
+ * loaded as the secondary instance, which runs 'frames' frames ahead
+ * on the worker using the latest input as a prediction and supplies
+ * the video. The secondary only reloads the primary's state when the
+ * input changes; otherwise it advances one frame alongside it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dynamic.h"
+#include "runloop.h"
+#include "preempt.h"
+#include "runahead.h"
+#include "secondary_core.h"
+#include "gfx/video_driver.h"
+
+struct runahead_data
+{
+   struct retro_callbacks cbs;
+   secondary_core_t *core;
+
+   /* Number of latency frames to remove */
+   uint8_t frames;
+
+   /* Primary's state, handed to the secondary on a resync */
+   void *state;
+   size_t state_size;
+   bool in_serialize;
+   /* False until the next frame resyncs */
+   bool synced;
+
+   /* Input the secondary last predicted with */
+   struct secondary_core_input input;
+};
+
+bool runahead_in_serialize(runahead_t *runahead)
+{
+   return runahead && runahead->in_serialize;
+}
+
+void input_poll_runahead(void)
+{
+   /* no-op. Polling is done in runahead_pre_frame */
+}
+
+/**
+ * runahead_free:
+ * @runahead    : pointer to runahead_t object
+ *
+ * Unloads the secondary instance and frees runahead handle.
+ **/
+static void runahead_free(runahead_t *runahead)
+{
+   secondary_core_free(runahead->core);
+   free(runahead->state);
+   free(runahead);
+}
+
+/**
+ * runahead_new:
+ *
+ * Returns: new runahead handle.
+ **/
+static runahead_t *runahead_new(void)
+{
+   settings_t *settings = config_get_ptr();
+   runahead_t *runahead = (runahead_t*)calloc(1, sizeof(*runahead));
+   if (!runahead)
+      return NULL;
+
+   runahead->frames     = settings->runahead_frames > MAX_PREEMPT_FRAMES
+         ? MAX_PREEMPT_FRAMES : settings->runahead_frames;
+   runahead->state_size = pretro_serialize_size();
+   runahead->state      = malloc(runahead->state_size);
+   runahead->core       = secondary_core_new();
+
+   if (!runahead->state || !runahead->core)
+   {
+      runahead_free(runahead);
+      return NULL;
+   }
+
+   return runahead;
+}
+
+static bool runahead_serialize(runahead_t *runahead)
+{
+   bool ret;
+
+   runahead->in_serialize = true;
+   ret = pretro_serialize(runahead->state, runahead->state_size);
+
+   /* Attempt to handle variable savestate size */
+   if (!ret && runahead->state_size < pretro_serialize_size())
+   {
+      size_t size = pretro_serialize_size();
+      void *state = realloc(runahead->state, size);
+
+      if (state)
+      {
+         runahead->state      = state;
+         runahead->state_size = size;
+         ret = pretro_serialize(runahead->state, runahead->state_size);
+      }
+   }
+
+   runahead->in_serialize = false;
+   return ret;
+}
+
+/**
+ * runahead_pre_frame:
+ * @runahead        : pointer to runahead_t object
+ *
+ * Pre-frame for run-ahead.
+ * Called before retro_run().
+ **/
+void runahead_pre_frame(runahead_t *runahead)
+{
+   driver_t *driver = driver_get_ptr();
+   global_t *global = global_get_ptr();
+   struct secondary_core_input input;
+
+   runahead->cbs.poll_cb();
+   secondary_core_input_snapshot(&input, runahead->cbs.state_cb);
+
+   if (global->rewind.frame_is_reverse)
+      runahead->synced = false;
+
+   /* The secondary kept predicting with the previous input;
+    * restart it from the primary if that turned out wrong. */
+   if (!runahead->synced
+         || memcmp(&input, &runahead->input, sizeof(input)) != 0)
+   {
+      if (!runahead_serialize(runahead))
+      {
+         rarch_main_msg_queue_push("Failed to Save State for Run-Ahead.",
+               1, 180, false);
+         runahead_deinit();
+         return;
+      }
+
+      memcpy(&runahead->input, &input, sizeof(input));
+      runahead->synced = true;
+
+      /* Catch up from the primary's state before this frame. */
+      secondary_core_run(runahead->core, &input, runahead->state,
+            runahead->state_size, runahead->frames + 1, NULL, true);
+   }
+   else
+      secondary_core_run(runahead->core, &input, NULL, 0, 1, NULL, true);
+
+   /* The primary's frame is never shown. */
+   driver->video_active = false;
+}
+
+/**
+ * runahead_post_frame:
+ * @runahead        : pointer to runahead_t object
+ *
+ * Post-frame for run-ahead.
+ * Called after retro_run().
+ **/
+void runahead_post_frame(runahead_t *runahead)
+{
+   driver_t *driver = driver_get_ptr();
+   const void *data;
+   unsigned width, height;
+   size_t pitch;
+
+   driver->video_active = true;
+
+   if (!secondary_core_wait(runahead->core))
+   {
+      rarch_main_msg_queue_push("Failed to Load State for Run-Ahead.",
+            1, 180, false);
+      runahead_deinit();
+      return;
+   }
+
+   /* No new frame is a dupe. */
+   data = secondary_core_frame(runahead->core, &width, &height, &pitch);
+   driver->retro_ctx.frame_cb(data, width, height, pitch);
+}
+
+void runahead_deinit(void)
+{
+   driver_t   *driver   = driver_get_ptr();
+   runahead_t *runahead = (runahead_t*)driver->runahead_data;
+
+   if (runahead)
+   {
+      runahead_free(runahead);
+      driver->runahead_data = NULL;
+      driver->video_active  = true;
+      retro_init_libretro_cbs(&driver->retro_ctx);
+   }
+}
+
+/**
+ * runahead_init:
+ *
+ * Loads the secondary instance and starts the worker.
+ * Skips if runahead_frames == 0.
+ *
+ * Returns: true on success, false on failure
+ **/
+bool runahead_init(void)
+{
+   driver_t   *driver   = driver_get_ptr();
+   settings_t *settings = config_get_ptr();
+   global_t   *global   = global_get_ptr();
+   runahead_t *runahead = NULL;
+
+   if (settings->runahead_frames == 0
+         || !global->content_is_init || global->libretro_dummy)
+      return false;
+
+   if (driver->preempt_data)
+   {
+      RARCH_WARN("Run-Ahead is not used along with Preemptive Frames.\n");
+      return false;
+   }
+
+   if (driver->netplay_data)
+   {
+      RARCH_WARN("Cannot use Run-Ahead during Netplay.\n");
+      return false;
+   }
+
+   if (video_driver_callback()->context_type != RETRO_HW_CONTEXT_NONE)
+   {
+      RARCH_WARN("Run-Ahead init failed. "
+            "Core uses hardware rendering.\n");
+      rarch_main_msg_queue_push("Run-Ahead init failed.\n"
+            "Core uses hardware rendering.", 1, 180, false);
+      return false;
+   }
+
+   /* Run at least one frame before attempting
+    * pretro_serialize_size or pretro_serialize */
+   if (video_state_get_frame_count() == 0)
+      pretro_run();
+
+   if (pretro_serialize_size() == 0)
+   {
+      RARCH_WARN("Run-Ahead init failed. "
+            "Core does not support savestates.\n");
+      rarch_main_msg_queue_push("Run-Ahead init failed.\n"
+            "Core does not support savestates.", 1, 180, false);
+      return false;
+   }
+
+   RARCH_LOG("Initializing Run-Ahead.\n");
+
+   runahead = runahead_new();
+   if (!runahead)
+   {
+      RARCH_WARN("Failed to initialize Run-Ahead.\n");
+      rarch_main_msg_queue_push("Failed to initialize Run-Ahead.",
+            1, 180, false);
+      return false;
+   }
+
+   driver->runahead_data = runahead;
+   retro_set_default_callbacks(&runahead->cbs);
+   retro_init_libretro_cbs(&driver->retro_ctx);
+
+   return true;
+}
+
+/**
+ * runahead_reset_buffer
+ *
+ * Forces the secondary instance to resync with the primary one.
+ */
+void runahead_reset_buffer(runahead_t *runahead)
+{
+   if (runahead)
+      runahead->synced = false;
+}
+
+void runahead_set_controller_port_device(runahead_t *runahead,
+      unsigned port, unsigned device)
+{
+   if (!runahead)
+      return;
+
+   secondary_core_set_controller_port_device(runahead->core, port, device);
+   runahead->synced = false;
+}
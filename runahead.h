@@ -0,0 +1,77 @@
+/*  RetroArch - A frontend for libretro.
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include "libretro_version_1.h"
+
+typedef struct runahead_data runahead_t;
+
+/**
+ * runahead_in_serialize:
+ * @runahead      : pointer to runahead object
+ *
+ * Returns: true while the primary instance is saving a state
+ * for the secondary, which can use same-binary savestates.
+ **/
+bool runahead_in_serialize(runahead_t *runahead);
+
+void input_poll_runahead(void);
+
+/**
+ * runahead_pre_frame:
+ * @runahead        : pointer to runahead object
+ *
+ * Hands the frame to the secondary instance.
+ * Call this before running retro_run().
+ **/
+void runahead_pre_frame(runahead_t *runahead);
+
+/**
+ * runahead_post_frame:
+ * @runahead        : pointer to runahead object
+ *
+ * Waits for the secondary instance and shows its frame.
+ * Call this after running retro_run().
+ **/
+void runahead_post_frame(runahead_t *runahead);
+
+void runahead_deinit(void);
+
+/**
+ * runahead_init:
+ *
+ * Loads the secondary instance. Skips init if runahead_frames == 0.
+ *
+ * Returns: true on success, false on failure
+ **/
+bool runahead_init(void);
+
+/**
+ * runahead_reset_buffer
+ *
+ * Forces the secondary instance to resync with the primary one.
+ */
+void runahead_reset_buffer(runahead_t *runahead);
+
+/**
+ * runahead_set_controller_port_device
+ *
+ * Mirrors a controller change to the secondary instance.
+ */
+void runahead_set_controller_port_device(runahead_t *runahead,
+      unsigned port, unsigned device);
+
+#endif /* RUNAHEAD_H */
@@ -31,6 +31,7 @@
 #include "runloop.h"
 #include "runloop_data.h"
 #include "preempt.h"
+#include "runahead.h"
 
 #include "input/keyboard_line.h"
 #include "input/input_common.h"
@@ -229,6 +230,7 @@ static void check_rewind(bool pressed)
          void *state = NULL;
          state_manager_push_where(global->rewind.state, &state);
          pretro_serialize(state, global->rewind.size);
+         rewind_dump_state(state);
          state_manager_push_do(global->rewind.state);
       }
    }
@@ -236,6 +238,48 @@ static void check_rewind(bool pressed)
    retro_set_rewind_callbacks();
 }
 
+/**
+ * check_rewind_seek:
+ *
+ * Jumps back rewind_seek_seconds in one go, rather than 
+ * one rewind granularity step per frame.
+ **/
+static void check_rewind_seek(void)
+{
+   char msg[PATH_MAX_LENGTH] = {0};
+   const void *buf           = NULL;
+   unsigned entries, done;
+   double fps;
+   global_t *global          = global_get_ptr();
+   settings_t *settings      = config_get_ptr();
+   unsigned granularity      = settings->rewind_granularity ?
+      settings->rewind_granularity : 1;
+
+   if (!global->rewind.state)
+      return;
+
+   fps     = video_viewport_get_system_av_info()->timing.fps;
+   entries = (unsigned)(settings->rewind_seek_seconds * 
+         (fps > 0.0 ? fps : 60.0) / granularity + 0.5);
+   if (!entries)
+      entries = 1;
+
+   done = state_manager_seek(global->rewind.state, entries, &buf);
+   if (!done)
+   {
+      rarch_main_msg_queue_push(RETRO_MSG_REWIND_REACHED_END, 0, 30, true);
+      return;
+   }
+
+   pretro_unserialize(buf, global->rewind.size);
+   event_command(EVENT_CMD_PREEMPT_RESET_BUFFER);
+
+   snprintf(msg, sizeof(msg), "Rewound %.1f seconds.",
+         done * granularity / (fps > 0.0 ? fps : 60.0));
+   RARCH_LOG("%s\n", msg);
+   rarch_main_msg_queue_push(msg, 1, 180, true);
+}
+
 /**
  * check_slowmotion:
  * @slowmotion_pressed   : was slow motion key pressed or held?
@@ -492,6 +536,9 @@ static int do_state_checks(event_cmd_state_t *cmd, retro_input_t trigger_input)
       if (cmd->reset_pressed)
          event_command(EVENT_CMD_RESET);
 
+      if (cmd->rewind_seek_pressed)
+         check_rewind_seek();
+
       if (global->cheat)
       {
          if (cmd->cheat_index_plus_pressed)
@@ -975,6 +1022,7 @@ static void rarch_main_cmd_get_state(event_cmd_state_t *cmd,
       cmd->cheat_index_minus_pressed = BIT64_GET(trigger_input, RARCH_CHEAT_INDEX_MINUS);
       cmd->cheat_toggle_pressed      = BIT64_GET(trigger_input, RARCH_CHEAT_TOGGLE);
       cmd->kbd_focus_toggle_pressed  = BIT64_GET(trigger_input, RARCH_TOGGLE_KEYBOARD_FOCUS);
+      cmd->rewind_seek_pressed       = BIT64_GET(trigger_input, RARCH_REWIND_SEEK);
    }
 
    if (input)
@@ -1063,6 +1111,10 @@ int rarch_main_iterate(void)
 
    if (driver->preempt_data)
       preempt_pre_frame((preempt_t*)driver->preempt_data);
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+   else if (driver->runahead_data)
+      runahead_pre_frame((runahead_t*)driver->runahead_data);
+#endif
 #ifdef HAVE_NETPLAY
    else if (driver->netplay_data)
       netplay_pre_frame((netplay_t*)driver->netplay_data);
@@ -1071,6 +1123,11 @@ int rarch_main_iterate(void)
    /* Run libretro for one frame. */
    pretro_run();
 
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+   if (driver->runahead_data)
+      runahead_post_frame((runahead_t*)driver->runahead_data);
+#endif
+
 #ifdef HAVE_NETPLAY
    if (driver->netplay_data)
       netplay_post_frame((netplay_t*)driver->netplay_data);
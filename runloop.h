@@ -16,6 +16,7 @@
 #ifndef __RETROARCH_RUNLOOP_H
 #define __RETROARCH_RUNLOOP_H
 
+#include <stdio.h>
 #include <queues/message_queue.h>
 #include <setjmp.h>
 #include <libretro.h>
@@ -205,6 +206,8 @@ typedef struct global
       state_manager_t *state;
       size_t size;
       bool frame_is_reverse;
+      /* Every pushed state goes here too if rewind_dump_path is set. */
+      FILE *dump;
    } rewind;
 
    /* Core history paths and count */
@@ -224,6 +227,7 @@ typedef struct global
    char netplay_server[46];
    bool netplay_enable;
    bool netplay_is_client;
+   bool netplay_is_spectate;
    unsigned netplay_port;
 #endif
 
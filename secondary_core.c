@@ -0,0 +1,791 @@
+/*  RetroArch - A frontend for libretro.
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Secondary instances of the current core, each on a worker thread.
+ *
+ * Every instance is a private copy of the core library, so it gets its
+ * own globals, loaded with the same content as the primary instance.
+ * Instances only ever run frames from states the primary hands them,
+ * without audio, and with input given to them up front.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <dynamic/dylib.h>
+#include <file/file_path.h>
+#include <rthreads/rthreads.h>
+
+#include "content.h"
+#include "core_options.h"
+#include "dynamic.h"
+#include "runloop.h"
+#include "file_ops.h"
+#include "performance.h"
+#include "secondary_core.h"
+
+#define SECONDARY_CORE_SYM(x) do { \
+   function_t func = dylib_proc(core->lib, #x); \
+   memcpy(&core->x, &func, sizeof(func)); \
+   if (!core->x) { \
+      RARCH_ERR("Failed to load symbol: \"%s\"\n", #x); \
+      return false; \
+   } \
+} while (0)
+
+/* Environment queries answered for secondary instances. A worker
+ * mustn't call rarch_environment_cb, so the answers are taken on the
+ * main thread when the instance is created. */
+static const struct
+{
+   unsigned cmd;
+   size_t size;   /* answer size, 0 for none */
+   bool string;   /* answer is a string, kept as a copy */
+} secondary_core_env_queries[] = {
+   { RETRO_ENVIRONMENT_GET_OVERSCAN, sizeof(bool), false },
+   { RETRO_ENVIRONMENT_GET_CAN_DUPE, sizeof(bool), false },
+   { RETRO_ENVIRONMENT_GET_LANGUAGE, sizeof(unsigned), false },
+   { RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION, sizeof(unsigned), false },
+   { RETRO_ENVIRONMENT_GET_INPUT_DEVICE_CAPABILITIES,
+      sizeof(uint64_t), false },
+   { RETRO_ENVIRONMENT_GET_INPUT_BITMASKS, 0, false },
+   { RETRO_ENVIRONMENT_GET_LOG_INTERFACE,
+      sizeof(struct retro_log_callback), false },
+   { RETRO_ENVIRONMENT_GET_PERF_INTERFACE,
+      sizeof(struct retro_perf_callback), false },
+   { RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY, sizeof(char*), true },
+   { RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY, sizeof(char*), true },
+   { RETRO_ENVIRONMENT_GET_CORE_ASSETS_DIRECTORY, sizeof(char*), true },
+   { RETRO_ENVIRONMENT_GET_LIBRETRO_PATH, sizeof(char*), true },
+   { RETRO_ENVIRONMENT_GET_USERNAME, sizeof(char*), true },
+};
+
+#define SECONDARY_CORE_ENV_QUERIES (sizeof(secondary_core_env_queries) \
+      / sizeof(secondary_core_env_queries[0]))
+
+struct secondary_core_env
+{
+   bool ret;
+   union
+   {
+      bool b;
+      unsigned u;
+      uint64_t u64;
+      struct retro_log_callback log;
+      struct retro_perf_callback perf;
+      const char *str;
+   } data;
+   char *str;
+};
+
+struct secondary_core
+{
+   unsigned index;
+
+   dylib_t lib;
+   char lib_path[PATH_MAX_LENGTH];
+   bool core_init;
+   bool game_loaded;
+
+   void (*retro_init)(void);
+   void (*retro_deinit)(void);
+   void (*retro_set_environment)(retro_environment_t);
+   void (*retro_set_video_refresh)(retro_video_refresh_t);
+   void (*retro_set_audio_sample)(retro_audio_sample_t);
+   void (*retro_set_audio_sample_batch)(retro_audio_sample_batch_t);
+   void (*retro_set_input_poll)(retro_input_poll_t);
+   void (*retro_set_input_state)(retro_input_state_t);
+   void (*retro_set_controller_port_device)(unsigned, unsigned);
+   void (*retro_run)(void);
+   bool (*retro_serialize)(void*, size_t);
+   bool (*retro_unserialize)(const void*, size_t);
+   bool (*retro_load_game)(const struct retro_game_info*);
+   void (*retro_unload_game)(void);
+
+   /* Environment as seen by the worker, see secondary_core_env_queries.
+    * Core option values are copied again before a run when they
+    * changed, and the change is reported as it is to the primary. */
+   struct secondary_core_env env[SECONDARY_CORE_ENV_QUERIES];
+   struct retro_variable *vars;
+   size_t num_vars;
+   unsigned vars_generation;
+   bool vars_init;
+   bool vars_updated;
+
+   /* Current job */
+   struct secondary_core_input input;
+   const void *state;
+   size_t state_size;
+   void **states;
+   unsigned runs;
+   bool video;
+   bool last_run;
+   bool failed;
+
+   /* Video of the last run. Double buffered, since the video
+    * driver may keep pointing at the frame it was last given. */
+   uint8_t *frame[2];
+   size_t frame_size[2];
+   unsigned frame_write;
+   unsigned width;
+   unsigned height;
+   size_t pitch;
+   bool frame_ready;
+
+   /* Everything above is owned by the worker while 'busy' is set. */
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+   bool busy;
+   bool quit;
+};
+
+/* The core's callbacks take no user data, so each slot
+ * gets its own set of callbacks, which look it up here. */
+static secondary_core_t *secondary_cores[SECONDARY_CORE_MAX];
+
+void secondary_core_input_snapshot(struct secondary_core_input *input,
+      retro_input_state_t state_cb)
+{
+   unsigned max_users = config_get_ptr()->input.max_users;
+   unsigned p, i;
+
+   memset(input, 0, sizeof(*input));
+   for (p = 0; p < max_users && p < MAX_USERS; p++)
+   {
+      input->joypad[p] = state_cb(p, RETRO_DEVICE_JOYPAD,
+            0, RETRO_DEVICE_ID_JOYPAD_MASK);
+
+      for (i = 0; i < 2; i++)
+      {
+         input->analog[p][i][0] = state_cb(p, RETRO_DEVICE_ANALOG, i, 0);
+         input->analog[p][i][1] = state_cb(p, RETRO_DEVICE_ANALOG, i, 1);
+      }
+   }
+}
+
+static int16_t secondary_core_input_state(secondary_core_t *core,
+      unsigned port, unsigned device, unsigned index, unsigned id)
+{
+   struct secondary_core_input *input = &core->input;
+
+   if (port >= MAX_USERS)
+      return 0;
+
+   switch (device & RETRO_DEVICE_MASK)
+   {
+      case RETRO_DEVICE_JOYPAD:
+         if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
+            return input->joypad[port];
+         if (id < 16)
+            return input->joypad[port] & (1 << id) ? 1 : 0;
+         break;
+      case RETRO_DEVICE_ANALOG:
+         if (index < 2 && id < 2)
+            return input->analog[port][index][id];
+         break;
+      default:
+         break;
+   }
+
+   return 0;
+}
+
+static void secondary_core_video_refresh(secondary_core_t *core,
+      const void *data, unsigned width, unsigned height, size_t pitch)
+{
+   unsigned idx = core->frame_write;
+   size_t size  = height * pitch;
+
+   if (!core->video || !core->last_run || !data)
+      return;
+
+   if (core->frame_size[idx] < size)
+   {
+      uint8_t *frame = (uint8_t*)realloc(core->frame[idx], size);
+      if (!frame)
+         return;
+
+      core->frame[idx]      = frame;
+      core->frame_size[idx] = size;
+   }
+
+   memcpy(core->frame[idx], data, size);
+   core->width       = width;
+   core->height      = height;
+   core->pitch       = pitch;
+   core->frame_ready = true;
+}
+
+static void secondary_core_vars_free(secondary_core_t *core)
+{
+   size_t i;
+
+   for (i = 0; i < core->num_vars; i++)
+   {
+      free((char*)core->vars[i].key);
+      free((char*)core->vars[i].value);
+   }
+   free(core->vars);
+
+   core->vars     = NULL;
+   core->num_vars = 0;
+}
+
+/* Main thread only. */
+static void secondary_core_env_snapshot(secondary_core_t *core)
+{
+   size_t i;
+
+   for (i = 0; i < SECONDARY_CORE_ENV_QUERIES; i++)
+   {
+      struct secondary_core_env *env = &core->env[i];
+
+      env->ret = rarch_environment_cb(secondary_core_env_queries[i].cmd,
+            secondary_core_env_queries[i].size ? &env->data : NULL);
+
+      if (env->ret && secondary_core_env_queries[i].string
+            && env->data.str)
+      {
+         env->str      = strdup(env->data.str);
+         env->data.str = env->str;
+      }
+   }
+}
+
+/* Main thread only, while the worker is idle. */
+static void secondary_core_vars_update(secondary_core_t *core)
+{
+   core_option_manager_t *opts = global_get_ptr()->system.core_options;
+   unsigned generation         = core_option_generation(opts);
+   size_t size                 = core_option_size(opts);
+   size_t i;
+
+   if (core->vars_init && generation == core->vars_generation)
+      return;
+
+   secondary_core_vars_free(core);
+
+   if (size)
+      core->vars = (struct retro_variable*)calloc(size, sizeof(*core->vars));
+
+   for (i = 0; core->vars && i < size; i++)
+   {
+      const char *key = core_option_key(opts, i);
+      const char *val = core_option_val(opts, i);
+
+      if (core_option_is_category(opts, i) || !key || !val)
+         continue;
+
+      core->vars[core->num_vars].key   = strdup(key);
+      core->vars[core->num_vars].value = strdup(val);
+      core->num_vars++;
+   }
+
+   core->vars_updated    = core->vars_init;
+   core->vars_init       = true;
+   core->vars_generation = generation;
+}
+
+static bool secondary_core_environment(secondary_core_t *core,
+      unsigned cmd, void *data)
+{
+   size_t i;
+
+   switch (cmd)
+   {
+      case RETRO_ENVIRONMENT_GET_VARIABLE:
+      {
+         struct retro_variable *var = (struct retro_variable*)data;
+
+         core->vars_updated = false;
+         var->value         = NULL;
+
+         for (i = 0; i < core->num_vars; i++)
+         {
+            if (!strcmp(core->vars[i].key, var->key))
+            {
+               var->value = core->vars[i].value;
+               break;
+            }
+         }
+         return true;
+      }
+
+      case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
+         *(bool*)data = core->vars_updated;
+         return true;
+
+      /* Already set up by the primary instance. */
+      case RETRO_ENVIRONMENT_SET_ROTATION:
+      case RETRO_ENVIRONMENT_SET_MESSAGE:
+      case RETRO_ENVIRONMENT_SET_PERFORMANCE_LEVEL:
+      case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+      case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS:
+      case RETRO_ENVIRONMENT_SET_VARIABLES:
+      case RETRO_ENVIRONMENT_SET_CORE_OPTIONS:
+      case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_INTL:
+      case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2:
+      case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_V2_INTL:
+      case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY:
+      case RETRO_ENVIRONMENT_SET_SUPPORT_NO_GAME:
+      case RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO:
+      case RETRO_ENVIRONMENT_SET_GEOMETRY:
+      case RETRO_ENVIRONMENT_SET_SUBSYSTEM_INFO:
+      case RETRO_ENVIRONMENT_SET_CONTROLLER_INFO:
+      case RETRO_ENVIRONMENT_SET_MEMORY_MAPS:
+      case RETRO_ENVIRONMENT_SET_SERIALIZATION_QUIRKS:
+         return true;
+
+      case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:
+         /* Video only for a frame that is kept, never audio. */
+         if (data)
+            *(int*)data = core->video && core->last_run ? 1 : 0;
+         return true;
+
+      case RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT:
+         if (data)
+            *(int*)data = RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_BINARY;
+         return true;
+
+      default:
+         break;
+   }
+
+   /* Shared with the primary instance. */
+   for (i = 0; i < SECONDARY_CORE_ENV_QUERIES; i++)
+   {
+      if (secondary_core_env_queries[i].cmd != cmd)
+         continue;
+
+      if (core->env[i].ret && data && secondary_core_env_queries[i].size)
+         memcpy(data, &core->env[i].data,
+               secondary_core_env_queries[i].size);
+      return core->env[i].ret;
+   }
+
+   /* Interfaces, callbacks and hardware rendering
+    * stay with the primary. */
+   return false;
+}
+
+#define SECONDARY_CORE_CALLBACKS(n) \
+static bool secondary_core_environment_##n(unsigned cmd, void *data) \
+{ \
+   return secondary_core_environment(secondary_cores[n], cmd, data); \
+} \
+static void secondary_core_video_refresh_##n(const void *data, \
+      unsigned width, unsigned height, size_t pitch) \
+{ \
+   secondary_core_video_refresh(secondary_cores[n], \
+         data, width, height, pitch); \
+} \
+static int16_t secondary_core_input_state_##n(unsigned port, \
+      unsigned device, unsigned index, unsigned id) \
+{ \
+   return secondary_core_input_state(secondary_cores[n], \
+         port, device, index, id); \
+}
+
+SECONDARY_CORE_CALLBACKS(0)
+SECONDARY_CORE_CALLBACKS(1)
+SECONDARY_CORE_CALLBACKS(2)
+SECONDARY_CORE_CALLBACKS(3)
+
+static const struct
+{
+   retro_environment_t environment;
+   retro_video_refresh_t video_refresh;
+   retro_input_state_t input_state;
+} secondary_core_callbacks[SECONDARY_CORE_MAX] = {
+   { secondary_core_environment_0, secondary_core_video_refresh_0,
+      secondary_core_input_state_0 },
+   { secondary_core_environment_1, secondary_core_video_refresh_1,
+      secondary_core_input_state_1 },
+   { secondary_core_environment_2, secondary_core_video_refresh_2,
+      secondary_core_input_state_2 },
+   { secondary_core_environment_3, secondary_core_video_refresh_3,
+      secondary_core_input_state_3 },
+};
+
+static void secondary_core_input_poll(void)
+{
+}
+
+static void secondary_core_audio_sample(int16_t left, int16_t right)
+{
+   (void)left;
+   (void)right;
+}
+
+static size_t secondary_core_audio_sample_batch(const int16_t *data,
+      size_t frames)
+{
+   (void)data;
+   return frames;
+}
+
+static void secondary_core_thread(void *data)
+{
+   secondary_core_t *core = (secondary_core_t*)data;
+   unsigned i;
+
+   slock_lock(core->lock);
+
+   for (;;)
+   {
+      while (!core->busy && !core->quit)
+         scond_wait(core->cond, core->lock);
+
+      if (core->quit)
+         break;
+
+      slock_unlock(core->lock);
+
+      core->frame_ready = false;
+      core->failed      = core->state &&
+            !core->retro_unserialize(core->state, core->state_size);
+
+      for (i = 0; i < core->runs && !core->failed; i++)
+      {
+         if (i && core->states &&
+               !core->retro_serialize(core->states[i - 1], core->state_size))
+            core->failed = true;
+
+         core->last_run = (i == core->runs - 1);
+         core->retro_run();
+      }
+
+      if (core->states && !core->failed && !core->retro_serialize(
+            core->states[core->runs - 1], core->state_size))
+         core->failed = true;
+
+      slock_lock(core->lock);
+      core->busy = false;
+      scond_signal(core->cond);
+   }
+
+   slock_unlock(core->lock);
+}
+
+/**
+ * secondary_core_copy:
+ * @core            : secondary instance
+ *
+ * Copies the core library to a temporary file. Loading the same
+ * path twice would just return the same handle, and with it the
+ * same globals.
+ *
+ * Returns: true on success, false on failure
+ **/
+static bool secondary_core_copy(secondary_core_t *core)
+{
+   char name[PATH_MAX_LENGTH];
+   settings_t *settings = config_get_ptr();
+   const char *dir      = settings->extraction_directory;
+   void *buf            = NULL;
+   ssize_t len          = 0;
+   bool ret;
+
+   if (!*dir || !path_is_directory(dir))
+   {
+#ifdef _WIN32
+      dir = getenv("TEMP");
+#else
+      dir = getenv("TMPDIR");
+      if (!dir || !*dir)
+         dir = "/tmp";
+#endif
+   }
+
+   if (!dir || !read_file(settings->libretro, &buf, &len) || len <= 0)
+   {
+      free(buf);
+      return false;
+   }
+
+   /* Unique, in case another instance still has its copy loaded. */
+   snprintf(name, sizeof(name), "retroarch_secondary_%x_%u_%s",
+         (unsigned)rarch_get_time_usec(), core->index,
+         path_basename(settings->libretro));
+   fill_pathname_join(core->lib_path, dir, name, sizeof(core->lib_path));
+
+   ret = write_file(core->lib_path, buf, len);
+   free(buf);
+
+   if (!ret)
+   {
+      RARCH_ERR("Could not write \"%s\".\n", core->lib_path);
+      *core->lib_path = '\0';
+   }
+
+   return ret;
+}
+
+static bool secondary_core_load_symbols(secondary_core_t *core)
+{
+   core->lib = dylib_load(core->lib_path);
+   if (!core->lib)
+   {
+      RARCH_ERR("Failed to open \"%s\".\n", core->lib_path);
+      return false;
+   }
+
+   SECONDARY_CORE_SYM(retro_init);
+   SECONDARY_CORE_SYM(retro_deinit);
+   SECONDARY_CORE_SYM(retro_set_environment);
+   SECONDARY_CORE_SYM(retro_set_video_refresh);
+   SECONDARY_CORE_SYM(retro_set_audio_sample);
+   SECONDARY_CORE_SYM(retro_set_audio_sample_batch);
+   SECONDARY_CORE_SYM(retro_set_input_poll);
+   SECONDARY_CORE_SYM(retro_set_input_state);
+   SECONDARY_CORE_SYM(retro_set_controller_port_device);
+   SECONDARY_CORE_SYM(retro_run);
+   SECONDARY_CORE_SYM(retro_serialize);
+   SECONDARY_CORE_SYM(retro_unserialize);
+   SECONDARY_CORE_SYM(retro_load_game);
+   SECONDARY_CORE_SYM(retro_unload_game);
+
+   return true;
+}
+
+/**
+ * secondary_core_load_game:
+ * @core            : secondary instance
+ *
+ * Loads the primary's content, soft patched the same way.
+ *
+ * Returns: true on success, false on failure
+ **/
+static bool secondary_core_load_game(secondary_core_t *core)
+{
+   struct retro_game_info info = {0};
+   global_t *global            = global_get_ptr();
+   uint8_t *buf                = NULL;
+   ssize_t len                 = 0;
+   bool mapped                 = false;
+   bool ret;
+
+   if (*global->subsystem)
+   {
+      RARCH_WARN("Secondary instances do not support subsystem content.\n");
+      return false;
+   }
+
+   if (!*global->fullpath)
+      return core->retro_load_game(NULL);
+
+   if (global->system.info.need_fullpath)
+   {
+#ifdef HAVE_COMPRESSION
+      if (path_contains_compressed_file(global->fullpath))
+      {
+         RARCH_WARN("Secondary instances do not support compressed "
+               "content for this core.\n");
+         return false;
+      }
+#endif
+   }
+   else
+   {
+      if (!read_content_data(global->fullpath, (void**)&buf, &len,
+               !global->block_patch, &mapped, NULL))
+         return false;
+
+      info.data = buf;
+      info.size = len;
+   }
+
+   info.path = global->fullpath;
+   ret       = core->retro_load_game(&info);
+   if (buf)
+      free_content_data(buf, len, mapped);
+   return ret;
+}
+
+void secondary_core_free(secondary_core_t *core)
+{
+   size_t i;
+
+   if (!core)
+      return;
+
+   if (core->thread)
+   {
+      slock_lock(core->lock);
+      core->quit = true;
+      scond_signal(core->cond);
+      slock_unlock(core->lock);
+      sthread_join(core->thread);
+   }
+
+   if (core->lock)
+      slock_free(core->lock);
+   if (core->cond)
+      scond_free(core->cond);
+
+   if (core->game_loaded)
+      core->retro_unload_game();
+   if (core->core_init)
+      core->retro_deinit();
+   if (core->lib)
+      dylib_close(core->lib);
+   if (*core->lib_path)
+      remove(core->lib_path);
+
+   if (secondary_cores[core->index] == core)
+      secondary_cores[core->index] = NULL;
+
+   for (i = 0; i < SECONDARY_CORE_ENV_QUERIES; i++)
+      free(core->env[i].str);
+   secondary_core_vars_free(core);
+
+   free(core->frame[0]);
+   free(core->frame[1]);
+   free(core);
+}
+
+secondary_core_t *secondary_core_new(void)
+{
+   unsigned i;
+   settings_t *settings   = config_get_ptr();
+   secondary_core_t *core = NULL;
+
+   for (i = 0; i < SECONDARY_CORE_MAX; i++)
+      if (!secondary_cores[i])
+         break;
+
+   if (i == SECONDARY_CORE_MAX)
+      return NULL;
+
+   core = (secondary_core_t*)calloc(1, sizeof(*core));
+   if (!core)
+      return NULL;
+
+   core->index        = i;
+   secondary_cores[i] = core;
+
+   if (!secondary_core_copy(core) || !secondary_core_load_symbols(core))
+      goto error;
+
+   secondary_core_env_snapshot(core);
+   secondary_core_vars_update(core);
+
+   core->retro_set_environment(secondary_core_callbacks[i].environment);
+   core->retro_init();
+   core->core_init = true;
+
+   core->retro_set_video_refresh(secondary_core_callbacks[i].video_refresh);
+   core->retro_set_audio_sample(secondary_core_audio_sample);
+   core->retro_set_audio_sample_batch(secondary_core_audio_sample_batch);
+   core->retro_set_input_poll(secondary_core_input_poll);
+   core->retro_set_input_state(secondary_core_callbacks[i].input_state);
+
+   if (!secondary_core_load_game(core))
+      goto error;
+   core->game_loaded = true;
+
+   for (i = 0; i < settings->input.max_users && i < MAX_USERS; i++)
+      secondary_core_set_controller_port_device(core,
+            i, settings->input.libretro_device[i]);
+
+   core->lock   = slock_new();
+   core->cond   = scond_new();
+   if (!core->lock || !core->cond)
+      goto error;
+
+   core->thread = sthread_create(secondary_core_thread, core);
+   if (!core->thread)
+      goto error;
+
+   return core;
+
+error:
+   secondary_core_free(core);
+   return NULL;
+}
+
+void secondary_core_run(secondary_core_t *core,
+      const struct secondary_core_input *input,
+      const void *state, size_t state_size,
+      unsigned runs, void **states, bool video)
+{
+   secondary_core_vars_update(core);
+
+   memcpy(&core->input, input, sizeof(*input));
+   core->state      = state;
+   core->state_size = state_size;
+   core->runs       = runs;
+   core->states     = states;
+   core->video      = video;
+
+   slock_lock(core->lock);
+   core->busy = true;
+   scond_signal(core->cond);
+   slock_unlock(core->lock);
+}
+
+bool secondary_core_busy(secondary_core_t *core)
+{
+   bool busy;
+
+   slock_lock(core->lock);
+   busy = core->busy;
+   slock_unlock(core->lock);
+
+   return busy;
+}
+
+bool secondary_core_wait(secondary_core_t *core)
+{
+   if (core->lock)
+   {
+      slock_lock(core->lock);
+      while (core->busy)
+         scond_wait(core->cond, core->lock);
+      slock_unlock(core->lock);
+   }
+
+   return !core->failed;
+}
+
+const void *secondary_core_frame(secondary_core_t *core,
+      unsigned *width, unsigned *height, size_t *pitch)
+{
+   const void *data = NULL;
+
+   if (core->frame_ready)
+   {
+      data              = core->frame[core->frame_write];
+      core->frame_write ^= 1;
+      core->frame_ready = false;
+   }
+
+   *width  = core->width;
+   *height = core->height;
+   *pitch  = core->pitch;
+   return data;
+}
+
+void secondary_core_set_controller_port_device(secondary_core_t *core,
+      unsigned port, unsigned device)
+{
+   if (!core || !core->game_loaded)
+      return;
+
+   secondary_core_wait(core);
+   core->retro_set_controller_port_device(port,
+         device == RETRO_DEVICE_KEYBOARD_DEFAULT
+         ? RETRO_DEVICE_NONE : device);
+}
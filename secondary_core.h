@@ -0,0 +1,110 @@
+/*  RetroArch - A frontend for libretro.
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECONDARY_CORE_H
+#define SECONDARY_CORE_H
+
+#include "libretro_version_1.h"
+#include "configuration.h"
+
+/* How many secondary instances can be loaded at once. */
+#define SECONDARY_CORE_MAX 4
+
+typedef struct secondary_core secondary_core_t;
+
+/* Input as seen by a secondary instance. Taken on the main thread,
+ * since the input drivers can't be queried from a worker. */
+struct secondary_core_input
+{
+   int16_t joypad[MAX_USERS];
+   int16_t analog[MAX_USERS][2][2];
+};
+
+/**
+ * secondary_core_input_snapshot:
+ * @input         : input to fill in
+ * @state_cb      : frontend input state callback
+ *
+ * Reads the joypads and analog sticks of every user.
+ **/
+void secondary_core_input_snapshot(struct secondary_core_input *input,
+      retro_input_state_t state_cb);
+
+/**
+ * secondary_core_new:
+ *
+ * Loads a private copy of the current core with the current content
+ * and starts a worker thread for it.
+ *
+ * Returns: new secondary instance, or NULL on failure.
+ **/
+secondary_core_t *secondary_core_new(void);
+
+void secondary_core_free(secondary_core_t *core);
+
+/**
+ * secondary_core_run:
+ * @core          : secondary instance
+ * @input         : input to run with
+ * @state         : state to load first, or NULL to carry on
+ * @state_size    : size of @state and of each of @states
+ * @runs          : number of frames to run
+ * @states        : if not NULL, receives the state before each run
+ *                  after the first, then the state after the last
+ * @video         : keep the frame of the last run
+ *
+ * Starts running frames on the worker. The instance must be idle.
+ **/
+void secondary_core_run(secondary_core_t *core,
+      const struct secondary_core_input *input,
+      const void *state, size_t state_size,
+      unsigned runs, void **states, bool video);
+
+/**
+ * secondary_core_busy:
+ * @core          : secondary instance
+ *
+ * Returns: true while the worker is still running frames.
+ **/
+bool secondary_core_busy(secondary_core_t *core);
+
+/**
+ * secondary_core_wait:
+ * @core          : secondary instance
+ *
+ * Waits for the worker to finish.
+ *
+ * Returns: false if a state could not be loaded or saved.
+ **/
+bool secondary_core_wait(secondary_core_t *core);
+
+/**
+ * secondary_core_frame:
+ * @core          : secondary instance
+ *
+ * Returns: the frame kept by the last secondary_core_run, or NULL
+ * if there was none. Stays valid until the run after next.
+ **/
+const void *secondary_core_frame(secondary_core_t *core,
+      unsigned *width, unsigned *height, size_t *pitch);
+
+/**
+ * secondary_core_set_controller_port_device:
+ *
+ * Waits for the worker, then mirrors a controller change.
+ **/
+void secondary_core_set_controller_port_device(secondary_core_t *core,
+      unsigned port, unsigned device);
+
+#endif /* SECONDARY_CORE_H */
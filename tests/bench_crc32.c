@@ -0,0 +1,191 @@
+/*  RetroArch - A frontend for libretro.
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Benchmark for crc32_update.
+ * Checksums buffers of several sizes with crc32_update, zlib's
+ * crc32 and a plain bytewise table, and reports the throughput of
+ * each. Every result is checked against zlib first, at every
+ * alignment and in odd sized pieces, so a mismatch fails the run.
+ *
+ * Usage: bench_crc32 [-s max KiB] [-m total MiB]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <boolean.h>
+#include <zlib.h>
+#include <rhash.h>
+
+static uint32_t bytewise_table[256];
+
+static void bytewise_init(void)
+{
+   unsigned i, j;
+
+   for (i = 0; i < 256; i++)
+   {
+      uint32_t c = i;
+      for (j = 0; j < 8; j++)
+         c = (c >> 1) ^ (c & 1 ? 0xedb88320 : 0);
+      bytewise_table[i] = c;
+   }
+}
+
+static uint32_t crc32_bytewise(uint32_t crc, const void *data, size_t size)
+{
+   const uint8_t *p = (const uint8_t*)data;
+
+   crc = ~crc;
+   while (size--)
+      crc = (crc >> 8) ^ bytewise_table[(crc ^ *p++) & 0xff];
+   return ~crc;
+}
+
+static uint32_t crc32_zlib(uint32_t crc, const void *data, size_t size)
+{
+   return crc32(crc, (const Bytef*)data, size);
+}
+
+static double bench_time(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return tv.tv_sec + tv.tv_nsec / 1e9;
+}
+
+static bool bench_verify(const uint8_t *data, size_t max)
+{
+   size_t size, offset, piece;
+
+   for (size = 0; size <= max; size = size < 256 ? size + 1 : size * 2 + 3)
+   {
+      for (offset = 0; offset < 16; offset++)
+      {
+         uint32_t expected = crc32_zlib(0, data + offset, size);
+         uint32_t crc      = 0;
+         size_t done       = 0;
+
+         if (crc32_update(0, data + offset, size) != expected
+               || crc32_bytewise(0, data + offset, size) != expected)
+         {
+            fprintf(stderr, "Mismatch at size %u, offset %u.\n",
+                  (unsigned)size, (unsigned)offset);
+            return false;
+         }
+
+         /* Same thing in pieces, as when checksumming while reading. */
+         for (piece = 1 + offset * 37; done < size; done += piece)
+            crc = crc32_update(crc, data + offset + done,
+                  size - done < piece ? size - done : piece);
+
+         if (crc != expected)
+         {
+            fprintf(stderr, "Mismatch at size %u, offset %u in pieces "
+                  "of %u.\n", (unsigned)size, (unsigned)offset,
+                  (unsigned)(1 + offset * 37));
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+static void bench_run(const char *name,
+      uint32_t (*fn)(uint32_t, const void*, size_t),
+      const uint8_t *data, size_t size, size_t total)
+{
+   size_t i;
+   size_t runs         = total / size ? total / size : 1;
+   volatile uint32_t crc = 0;
+   double start        = bench_time();
+   double elapsed;
+
+   for (i = 0; i < runs; i++)
+      crc = fn(crc, data, size);
+
+   elapsed = bench_time() - start;
+
+   printf("%-10s %10u %10.1f\n", name, (unsigned)size,
+         (double)size * runs / elapsed / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+   int i;
+   size_t size;
+   size_t max   = 16 << 20;
+   size_t total = 256 << 20;
+   uint8_t *data;
+   uint32_t seed = 0x12345678;
+
+   for (i = 1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "-s") && i + 1 < argc)
+         max   = (size_t)strtoul(argv[++i], NULL, 0) << 10;
+      else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+         total = (size_t)strtoul(argv[++i], NULL, 0) << 20;
+      else
+      {
+         fprintf(stderr, "Usage: %s [-s max KiB] [-m total MiB]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   if (max < 64 || !total)
+   {
+      fprintf(stderr, "Usage: %s [-s max KiB] [-m total MiB]\n", argv[0]);
+      return 1;
+   }
+
+   data = (uint8_t*)malloc(max + 16);
+   if (!data)
+   {
+      fprintf(stderr, "Out of memory.\n");
+      return 1;
+   }
+
+   for (size = 0; size < max + 16; size++)
+   {
+      /* xorshift32, so runs are reproducible. */
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      data[size] = (uint8_t)seed;
+   }
+
+   bytewise_init();
+
+   if (!bench_verify(data, max < 65536 ? max : 65536))
+   {
+      free(data);
+      return 1;
+   }
+
+   printf("%-10s %10s %10s\n", "crc32", "size", "MB/s");
+
+   for (size = 64; size <= max; size *= 16)
+   {
+      bench_run("rhash", crc32_update, data, size, total);
+      bench_run("zlib", crc32_zlib, data, size, total);
+      bench_run("bytewise", crc32_bytewise, data, size, total / 8);
+   }
+
+   free(data);
+   return 0;
+}
@@ -0,0 +1,312 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2014-2015 - Alfred Agrell
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Benchmark for the rewind state manager.
+ * Pushes a stream of states through every state manager mode, then
+ * pops them all again, and reports throughput both ways along with
+ * how much room each entry took. Streams are either synthetic or
+ * files written by the rewind_dump_path option.
+ *
+ * Usage: bench_rewind [-s state KiB] [-n states] [-b buffer MiB] [dump...]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../rewind.h"
+#include "../performance.h"
+
+struct bench_source
+{
+   const char *name;
+   size_t state_size;
+   unsigned count;
+   unsigned frame;
+   uint32_t seed;
+   /* Dumps are read from here, synthetic streams are generated. */
+   FILE *file;
+   void (*generate)(struct bench_source *source, uint8_t *data);
+};
+
+struct bench_mode
+{
+   const char *name;
+   unsigned flags;
+   unsigned keyframe_interval;
+};
+
+static const struct bench_mode modes[] = {
+   { "delta",          0,                        0 },
+   { "delta+kf30",     0,                        30 },
+#ifdef HAVE_ZLIB
+   { "deflate",        STATE_MANAGER_DEFLATE,    0 },
+   { "deflate+kf30",   STATE_MANAGER_DEFLATE,    30 },
+#endif
+#ifdef HAVE_THREADS
+   { "threaded",       STATE_MANAGER_THREADED,   0 },
+#ifdef HAVE_ZLIB
+   { "threaded+deflate", STATE_MANAGER_THREADED | STATE_MANAGER_DEFLATE, 0 },
+#endif
+#endif
+};
+
+static uint32_t bench_rand(struct bench_source *source)
+{
+   /* xorshift32, so runs are reproducible. */
+   uint32_t x   = source->seed;
+   x           ^= x << 13;
+   x           ^= x >> 17;
+   x           ^= x << 5;
+   source->seed = x;
+   return x;
+}
+
+/* A few counters tick every frame, the rest stays put. */
+static void generate_counters(struct bench_source *source, uint8_t *data)
+{
+   unsigned i;
+
+   if (!source->frame)
+      memset(data, 0x55, source->state_size);
+   for (i = 0; i < 32; i++)
+      data[(i * 4099) % source->state_size] = (uint8_t)(source->frame * (i + 1));
+}
+
+/* A 4 KiB window of fresh bytes moves through the state,
+ * like a scrolling tile map. */
+static void generate_scroll(struct bench_source *source, uint8_t *data)
+{
+   unsigned i;
+   size_t start = (source->frame * 521) % source->state_size;
+
+   if (!source->frame)
+      memset(data, 0, source->state_size);
+   for (i = 0; i < 4096; i++)
+      data[(start + i) % source->state_size] = (uint8_t)bench_rand(source);
+}
+
+/* About 2% of the bytes change each frame, scattered around. */
+static void generate_noisy(struct bench_source *source, uint8_t *data)
+{
+   size_t i, changes = source->state_size / 50;
+
+   if (!source->frame)
+      memset(data, 0, source->state_size);
+   for (i = 0; i < changes; i++)
+      data[bench_rand(source) % source->state_size] = (uint8_t)bench_rand(source);
+}
+
+/* Nothing survives from one frame to the next; worst case. */
+static void generate_random(struct bench_source *source, uint8_t *data)
+{
+   size_t i;
+
+   for (i = 0; i < source->state_size; i++)
+      data[i] = (uint8_t)bench_rand(source);
+}
+
+static bool bench_source_open_dump(struct bench_source *source,
+      const char *path, unsigned max_count)
+{
+   uint32_t header[2];
+   long size;
+
+   memset(source, 0, sizeof(*source));
+   source->name = path;
+   source->file = fopen(path, "rb");
+   if (!source->file)
+   {
+      fprintf(stderr, "Can't open \"%s\".\n", path);
+      return false;
+   }
+
+   if (fread(header, sizeof(header), 1, source->file) != 1 ||
+         header[0] != REWIND_DUMP_MAGIC || !header[1])
+   {
+      fprintf(stderr, "\"%s\" is not a rewind dump.\n", path);
+      fclose(source->file);
+      return false;
+   }
+
+   fseek(source->file, 0, SEEK_END);
+   size = ftell(source->file);
+
+   source->state_size = header[1];
+   source->count      = (size - sizeof(header)) / source->state_size;
+   if (max_count && source->count > max_count)
+      source->count = max_count;
+   return true;
+}
+
+static void bench_source_rewind(struct bench_source *source)
+{
+   source->frame = 0;
+   source->seed  = 0x12345678;
+   if (source->file)
+      fseek(source->file, sizeof(uint32_t) * 2, SEEK_SET);
+}
+
+static bool bench_source_next(struct bench_source *source, uint8_t *data)
+{
+   if (source->frame >= source->count)
+      return false;
+
+   if (source->file)
+   {
+      if (fread(data, source->state_size, 1, source->file) != 1)
+         return false;
+   }
+   else
+      source->generate(source, data);
+
+   source->frame++;
+   return true;
+}
+
+static double bench_mbps(size_t bytes, retro_time_t usec)
+{
+   return usec ? (double)bytes / usec : 0.0;
+}
+
+static void bench_run(struct bench_source *source,
+      const struct bench_mode *mode, size_t buffer_size)
+{
+   unsigned entries = 0, pushed = 0, popped = 0;
+   size_t bytes     = 0;
+   retro_time_t push_time = 0, pop_time = 0, start;
+   const void *data = NULL;
+   uint8_t *input   = (uint8_t*)malloc(source->state_size);
+   state_manager_t *state = state_manager_new(source->state_size,
+         buffer_size, mode->flags, mode->keyframe_interval);
+
+   if (!input || !state)
+   {
+      fprintf(stderr, "Out of memory.\n");
+      goto end;
+   }
+
+   bench_source_rewind(source);
+
+   /* Only the copy into the state manager and the push itself
+    * count, as if the core had serialized straight into it. */
+   while (bench_source_next(source, input))
+   {
+      void *where = NULL;
+
+      start = rarch_get_time_usec();
+      state_manager_push_where(state, &where);
+      memcpy(where, input, source->state_size);
+      state_manager_push_do(state);
+      push_time += rarch_get_time_usec() - start;
+      pushed++;
+   }
+
+   /* Waits for the worker in threaded mode. */
+   start = rarch_get_time_usec();
+   state_manager_capacity(state, &entries, &bytes, NULL, NULL);
+   push_time += rarch_get_time_usec() - start;
+
+   start = rarch_get_time_usec();
+   while (state_manager_pop(state, &data))
+      popped++;
+   pop_time = rarch_get_time_usec() - start;
+
+   printf("%-20.20s %-18s %9.1f %9.1f %11.0f %5u/%u\n",
+         source->name, mode->name,
+         bench_mbps(pushed * source->state_size, push_time),
+         bench_mbps(popped * source->state_size, pop_time),
+         entries ? (double)bytes / entries : 0.0,
+         entries, pushed);
+
+end:
+   state_manager_free(state);
+   free(input);
+}
+
+static void bench_source(struct bench_source *source, size_t buffer_size)
+{
+   unsigned i;
+
+   for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+      bench_run(source, &modes[i], buffer_size);
+}
+
+int main(int argc, char *argv[])
+{
+   int i;
+   unsigned count     = 600;
+   size_t state_size  = 256 << 10;
+   size_t buffer_size = 64 << 20;
+   bool dumps         = false;
+   static const struct
+   {
+      const char *name;
+      void (*generate)(struct bench_source *source, uint8_t *data);
+   } synthetic[] = {
+      { "counters", generate_counters },
+      { "scroll",   generate_scroll },
+      { "noisy",    generate_noisy },
+      { "random",   generate_random },
+   };
+
+   printf("%-20s %-18s %9s %9s %11s %s\n", "stream", "mode",
+         "push MB/s", "pop MB/s", "bytes/entry", "retained");
+
+   for (i = 1; i < argc; i++)
+   {
+      struct bench_source source;
+
+      if (!strcmp(argv[i], "-s") && i + 1 < argc)
+         state_size  = (size_t)strtoul(argv[++i], NULL, 0) << 10;
+      else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+         count       = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+         buffer_size = (size_t)strtoul(argv[++i], NULL, 0) << 20;
+      else if (bench_source_open_dump(&source, argv[i], count))
+      {
+         bench_source(&source, buffer_size);
+         fclose(source.file);
+         dumps = true;
+      }
+      else
+         return 1;
+   }
+
+   if (dumps)
+      return 0;
+
+   if (!state_size || !count)
+   {
+      fprintf(stderr, "Usage: %s [-s state KiB] [-n states] "
+            "[-b buffer MiB] [dump...]\n", argv[0]);
+      return 1;
+   }
+
+   for (i = 0; i < (int)(sizeof(synthetic) / sizeof(synthetic[0])); i++)
+   {
+      struct bench_source source;
+
+      memset(&source, 0, sizeof(source));
+      source.name       = synthetic[i].name;
+      source.generate   = synthetic[i].generate;
+      source.state_size = state_size;
+      source.count      = count;
+      bench_source(&source, buffer_size);
+   }
+
+   return 0;
+}
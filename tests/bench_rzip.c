@@ -0,0 +1,272 @@
+/*  RetroArch - A frontend for libretro.
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Benchmark for RZIP save state files.
+ * Writes and reads back a state with write_rzip_file and
+ * read_rzip_file, at the default and the fast compression level,
+ * on one thread and on every core (or -t threads), and reports
+ * the time taken both ways along with the compression ratio.
+ *
+ * Usage: bench_rzip [-s state KiB] [-n runs] [-t threads] [-o file]
+ *                   [state...]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../file_ops.h"
+#include "../performance.h"
+
+/* The frontend bits file_ops.c reaches for. */
+static unsigned bench_cores;
+
+unsigned rarch_get_cpu_cores(void)
+{
+   return bench_cores;
+}
+
+retro_time_t rarch_get_time_usec(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return (retro_time_t)tv.tv_sec * 1000000 + tv.tv_nsec / 1000;
+}
+
+void rarch_main_msg_queue_push(const char *msg, unsigned prio,
+      unsigned duration, bool flush)
+{
+}
+
+bool video_driver_is_alive(void)
+{
+   return false;
+}
+
+void video_driver_cached_frame(void)
+{
+}
+
+#ifdef HAVE_ZLIB
+int read_zip_file(const char *archive_path,
+      const char *relative_path, void **buf, const char *optional_outfile)
+{
+   return 0;
+}
+#endif
+
+#ifdef HAVE_7ZIP
+int read_7zip_file(const char *archive_path,
+      const char *relative_path, void **buf, const char *optional_outfile)
+{
+   return 0;
+}
+
+struct string_list *compressed_7zip_file_list_new(const char *path,
+      const char *ext)
+{
+   return NULL;
+}
+#endif
+
+struct bench_state
+{
+   const char *name;
+   uint8_t *data;
+   size_t size;
+};
+
+static uint32_t bench_rand(uint32_t *seed)
+{
+   /* xorshift32, so runs are reproducible. */
+   uint32_t x = *seed;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   *seed = x;
+   return x;
+}
+
+/* Mostly empty RAM, some tables and a bit of noise,
+ * roughly what a console state looks like. */
+static void generate_console(uint8_t *data, size_t size)
+{
+   size_t i;
+   uint32_t seed = 0x12345678;
+
+   memset(data, 0, size);
+   for (i = 0; i < size / 4; i++)
+      data[i] = (uint8_t)(i * 7 ^ (i >> 8));
+   for (i = size / 2; i < size / 2 + size / 8; i++)
+      data[i] = (uint8_t)bench_rand(&seed);
+}
+
+/* Nothing compresses; worst case. */
+static void generate_random(uint8_t *data, size_t size)
+{
+   size_t i;
+   uint32_t seed = 0x12345678;
+
+   for (i = 0; i < size; i++)
+      data[i] = (uint8_t)bench_rand(&seed);
+}
+
+static void bench_run(const struct bench_state *state, const char *path,
+      unsigned runs, bool fast, unsigned cores)
+{
+   unsigned i;
+   long size               = 0;
+   retro_time_t save_time  = 0;
+   retro_time_t load_time  = 0;
+   FILE *file;
+
+   bench_cores = cores;
+
+   for (i = 0; i < runs; i++)
+   {
+      void *buf    = NULL;
+      ssize_t len  = 0;
+      retro_time_t start = rarch_get_time_usec();
+
+      if (!write_rzip_file(path, state->data, state->size, fast, false))
+      {
+         fprintf(stderr, "Failed to write \"%s\".\n", path);
+         return;
+      }
+      save_time += rarch_get_time_usec() - start;
+
+      start = rarch_get_time_usec();
+      if (!read_rzip_file(path, &buf, &len))
+      {
+         fprintf(stderr, "Failed to read \"%s\".\n", path);
+         return;
+      }
+      load_time += rarch_get_time_usec() - start;
+
+      if ((size_t)len != state->size || memcmp(buf, state->data, len))
+      {
+         fprintf(stderr, "\"%s\" did not read back.\n", path);
+         free(buf);
+         return;
+      }
+      free(buf);
+   }
+
+   if ((file = fopen(path, "rb")))
+   {
+      fseek(file, 0, SEEK_END);
+      size = ftell(file);
+      fclose(file);
+   }
+
+   printf("%-20.20s %-8s %7u %9.1f %9.1f %9.1f %9.1f %6.1f%%\n",
+         state->name, fast ? "fast" : "default", cores,
+         save_time / 1000.0 / runs, load_time / 1000.0 / runs,
+         (double)state->size * runs / save_time,
+         (double)state->size * runs / load_time,
+         100.0 * size / state->size);
+}
+
+static void bench_state(const struct bench_state *state, const char *path,
+      unsigned runs, unsigned cores)
+{
+   bench_run(state, path, runs, false, 1);
+   if (cores > 1)
+      bench_run(state, path, runs, false, cores);
+   bench_run(state, path, runs, true, 1);
+   if (cores > 1)
+      bench_run(state, path, runs, true, cores);
+}
+
+int main(int argc, char *argv[])
+{
+   int i;
+   unsigned runs     = 5;
+   size_t state_size = 16 << 20;
+   const char *path  = "bench_rzip.tmp";
+   bool files        = false;
+   long cores        = sysconf(_SC_NPROCESSORS_ONLN);
+   static const struct
+   {
+      const char *name;
+      void (*generate)(uint8_t *data, size_t size);
+   } synthetic[] = {
+      { "console", generate_console },
+      { "random",  generate_random },
+   };
+
+   printf("%-20s %-8s %7s %9s %9s %9s %9s %7s\n", "state", "level",
+         "threads", "save ms", "load ms", "save MB/s", "load MB/s", "ratio");
+
+   for (i = 1; i < argc; i++)
+   {
+      struct bench_state state;
+      ssize_t len = 0;
+
+      if (!strcmp(argv[i], "-s") && i + 1 < argc)
+         state_size = (size_t)strtoul(argv[++i], NULL, 0) << 10;
+      else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+         runs       = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+         cores      = strtol(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+         path       = argv[++i];
+      else if (read_file(argv[i], (void**)&state.data, &len) && len > 0)
+      {
+         state.name = argv[i];
+         state.size = len;
+         bench_state(&state, path, runs, cores);
+         free(state.data);
+         files = true;
+      }
+      else
+      {
+         fprintf(stderr, "Can't read \"%s\".\n", argv[i]);
+         return 1;
+      }
+   }
+
+   if (!files)
+   {
+      if (!state_size || !runs || cores < 1)
+      {
+         fprintf(stderr, "Usage: %s [-s state KiB] [-n runs] "
+               "[-t threads] [-o file] [state...]\n", argv[0]);
+         return 1;
+      }
+
+      for (i = 0; i < (int)(sizeof(synthetic) / sizeof(synthetic[0])); i++)
+      {
+         struct bench_state state;
+
+         state.name = synthetic[i].name;
+         state.size = state_size;
+         state.data = (uint8_t*)malloc(state_size);
+         if (!state.data)
+         {
+            fprintf(stderr, "Out of memory.\n");
+            return 1;
+         }
+         synthetic[i].generate(state.data, state.size);
+         bench_state(&state, path, runs, cores);
+         free(state.data);
+      }
+   }
+
+   remove(path);
+   return 0;
+}
@@ -0,0 +1,748 @@
+/*  RetroArch - A frontend for libretro.
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Netplay over loopback, with a bad network in between.
+ * Forks a host and a client, each running netplay.c with libretro-test
+ * built in and scripted input, paced to real time. The parent relays
+ * their traffic, delaying, reordering and dropping UDP packets on the
+ * way. TCP is relayed as is. Each side reports its rollbacks, replay
+ * rate, worst frame time and state checks when done.
+ *
+ * -c and -S set the state check interval and sampling. -x makes the
+ * client's state drift at the given frame, to exercise mismatch
+ * detection; the client then logs where the states differ.
+ *
+ * -w adds spectators, which watch the host directly rather than
+ * through the bad network. With -W, the last of them stops reading
+ * for a while, which must not hold up the host.
+ *
+ * Usage: netplay_sim [-n frames] [-d delay ms] [-j jitter ms]
+ *                    [-l loss %] [-r reorder %] [-b replay budget %]
+ *                    [-c check frames] [-S check sample]
+ *                    [-x desync frame] [-w spectators] [-W]
+ *                    [-p port] [-s seed]
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../general.h"
+#include "../driver.h"
+#include "../dynamic.h"
+#include "../netplay.h"
+#include "../performance.h"
+#include "../runloop.h"
+
+#define SIM_FPS 60
+#define SIM_MAX_PACKET 2048
+#define SIM_QUEUE_SIZE 1024
+
+/* libretro-test, linked in */
+void retro_init(void);
+void retro_deinit(void);
+unsigned retro_api_version(void);
+void retro_set_environment(retro_environment_t);
+void retro_set_video_refresh(retro_video_refresh_t);
+void retro_set_audio_sample(retro_audio_sample_t);
+void retro_set_audio_sample_batch(retro_audio_sample_batch_t);
+void retro_set_input_poll(retro_input_poll_t);
+void retro_set_input_state(retro_input_state_t);
+bool retro_load_game(const struct retro_game_info *game);
+void retro_run(void);
+size_t retro_serialize_size(void);
+bool retro_serialize(void *data, size_t size);
+bool retro_unserialize(const void *data, size_t size);
+void *retro_get_memory_data(unsigned id);
+size_t retro_get_memory_size(unsigned id);
+
+void (*pretro_run)(void);
+unsigned (*pretro_api_version)(void);
+void *(*pretro_get_memory_data)(unsigned);
+size_t (*pretro_get_memory_size)(unsigned);
+
+struct sim_options
+{
+   unsigned frames;
+   unsigned delay;
+   unsigned jitter;
+   unsigned loss;
+   unsigned reorder;
+   unsigned budget;
+   unsigned check_frames;
+   unsigned check_sample;
+   unsigned desync_frame;
+   unsigned spectators;
+   bool stall_spectator;
+   uint16_t port;
+   uint32_t seed;
+};
+
+struct sim_packet
+{
+   retro_time_t due;
+   /* Which way it goes: 0 to the host, 1 to the client */
+   int dir;
+   size_t size;
+   uint8_t data[SIM_MAX_PACKET];
+};
+
+static runloop_t sim_runloop;
+static struct retro_system_av_info sim_av_info;
+static uint32_t sim_seed;
+static uint16_t sim_input;
+
+static uint32_t sim_rand(void)
+{
+   /* xorshift32, so runs are reproducible. */
+   sim_seed ^= sim_seed << 13;
+   sim_seed ^= sim_seed >> 17;
+   sim_seed ^= sim_seed << 5;
+   return sim_seed;
+}
+
+/* Frontend pieces netplay.c calls into */
+
+runloop_t *rarch_main_get_ptr(void)
+{
+   return &sim_runloop;
+}
+
+struct retro_system_av_info *video_viewport_get_system_av_info(void)
+{
+   return &sim_av_info;
+}
+
+void rarch_main_msg_queue_push(const char *msg, unsigned prio,
+      unsigned duration, bool flush)
+{
+   (void)msg;
+   (void)prio;
+   (void)duration;
+   (void)flush;
+}
+
+void video_driver_cached_frame(void)
+{
+}
+
+bool input_driver_key_pressed(int key)
+{
+   (void)key;
+   return false;
+}
+
+void lock_autosave(void)
+{
+}
+
+void unlock_autosave(void)
+{
+}
+
+void retro_init_libretro_cbs(void *data)
+{
+   (void)data;
+}
+
+void retro_set_default_callbacks(void *data)
+{
+   (void)data;
+}
+
+bool preempt_init(void)
+{
+   return false;
+}
+
+void preempt_deinit(void)
+{
+}
+
+#if defined(HAVE_DYNAMIC) && defined(HAVE_THREADS)
+bool runahead_init(void)
+{
+   return false;
+}
+
+void runahead_deinit(void)
+{
+}
+#endif
+
+/* The frontend side of the core, as netplay sees it */
+
+static void sim_poll(void)
+{
+   /* Buttons change every 8 frames or so, like someone playing. */
+   if ((sim_rand() & 7) == 0)
+      sim_input = sim_rand() & 0xfff;
+}
+
+static int16_t sim_state(unsigned port, unsigned device,
+      unsigned idx, unsigned id)
+{
+   (void)port;
+   (void)idx;
+
+   if (device != RETRO_DEVICE_JOYPAD || id >= 16)
+      return 0;
+   return (sim_input >> id) & 1;
+}
+
+static void sim_frame(const void *data, unsigned width,
+      unsigned height, size_t pitch)
+{
+   (void)data;
+   (void)width;
+   (void)height;
+   (void)pitch;
+}
+
+static void sim_sample(int16_t left, int16_t right)
+{
+   (void)left;
+   (void)right;
+}
+
+static size_t sim_sample_batch(const int16_t *data, size_t frames)
+{
+   (void)data;
+   return frames;
+}
+
+static void sim_log(enum retro_log_level level, const char *fmt, ...)
+{
+   (void)level;
+   (void)fmt;
+}
+
+static bool sim_environment(unsigned cmd, void *data)
+{
+   switch (cmd)
+   {
+      case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+         return true;
+      case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+         ((struct retro_log_callback*)data)->log = sim_log;
+         return true;
+      default:
+         break;
+   }
+   return false;
+}
+
+/**
+ * sim_peer:
+ * @opts          : options
+ * @server        : address to connect to, or NULL to host
+ * @port          : port to host on or connect to
+ * @spectator     : 0 to play, otherwise which spectator this is
+ *
+ * Plays opts->frames connected frames, or until the peer hangs up,
+ * then prints a report.
+ *
+ * Returns: exit code for the process.
+ **/
+static int sim_peer(const struct sim_options *opts,
+      const char *server, uint16_t port, unsigned spectator)
+{
+   struct retro_callbacks cbs = {0};
+   struct netplay_stats stats = {0};
+   driver_t *driver           = driver_get_ptr();
+   global_t *global           = global_get_ptr();
+   settings_t *settings       = config_get_ptr();
+   const char *name           = server ? "client" : "host";
+   char spectator_name[16];
+   retro_time_t frame_period  = 1000000 / SIM_FPS;
+   retro_time_t start, next, worst = 0;
+   double elapsed;
+
+   sim_seed = opts->seed + (server ? 1 : 2);
+
+   if (spectator)
+   {
+      snprintf(spectator_name, sizeof(spectator_name), "spect%u", spectator);
+      name = spectator_name;
+      global->netplay_is_spectate = true;
+   }
+
+   /* Give the relay and the host's spectator port time to come up. */
+   if (server)
+      usleep(spectator ? 500000 : 200000);
+
+   pretro_run               = retro_run;
+   pretro_api_version       = retro_api_version;
+   pretro_serialize_size    = retro_serialize_size;
+   pretro_serialize         = retro_serialize;
+   pretro_unserialize       = retro_unserialize;
+   pretro_get_memory_data   = retro_get_memory_data;
+   pretro_get_memory_size   = retro_get_memory_size;
+
+   global->system.info.library_name    = "TestCore";
+   global->system.info.library_version = "v1";
+   global->netplay_port                = port;
+   if (server)
+      strlcpy(global->netplay_server, server, sizeof(global->netplay_server));
+
+   settings->netplay_max_input_delay = 4;
+   settings->netplay_replay_budget   = opts->budget;
+   settings->netplay_check_frames    = opts->check_frames;
+   settings->netplay_check_sample    = opts->check_sample;
+   settings->netplay_check_bisect    = opts->desync_frame != 0;
+   settings->netplay_periodic_resync = true;
+   settings->netplay_max_spectators  = opts->spectators;
+   settings->slowmotion_ratio        = 1.033333;
+   sim_av_info.timing.fps            = SIM_FPS;
+
+   retro_set_environment(sim_environment);
+   retro_init();
+   retro_set_video_refresh(video_frame_net);
+   retro_set_audio_sample(audio_sample_net);
+   retro_set_audio_sample_batch(audio_sample_batch_net);
+   retro_set_input_poll(input_poll_net);
+   retro_set_input_state(input_state_net);
+   retro_load_game(NULL);
+
+   cbs.frame_cb        = sim_frame;
+   cbs.sample_cb       = sim_sample;
+   cbs.sample_batch_cb = sim_sample_batch;
+   cbs.state_cb        = sim_state;
+   cbs.poll_cb         = sim_poll;
+
+   driver->netplay_data = netplay_new(server, name, &cbs);
+   if (!driver->netplay_data)
+   {
+      fprintf(stderr, "%s: failed to start netplay.\n", name);
+      return 1;
+   }
+
+   start = next = rarch_get_time_usec();
+
+   while (driver->netplay_data && stats.frames < opts->frames)
+   {
+      retro_time_t frame_start = rarch_get_time_usec();
+      retro_time_t now;
+
+      netplay_pre_frame((netplay_t*)driver->netplay_data);
+      if (!driver->netplay_data)
+         break;
+      pretro_run();
+      netplay_post_frame((netplay_t*)driver->netplay_data);
+      if (!driver->netplay_data)
+         break;
+
+      netplay_get_stats((netplay_t*)driver->netplay_data, &stats);
+
+      /* Stop reading the stream for a bit. */
+      if (spectator && spectator == opts->spectators
+            && opts->stall_spectator && stats.frames == SIM_FPS)
+         usleep(opts->frames * 1000000 / SIM_FPS / 2);
+
+      /* Nudge the client's game out of step once. */
+      if (server && !spectator && opts->desync_frame
+            && stats.frames == opts->desync_frame)
+      {
+         uint8_t state[2];
+         retro_serialize(state, sizeof(state));
+         state[0] ^= 1;
+         retro_unserialize(state, sizeof(state));
+      }
+
+      now = rarch_get_time_usec();
+      if (stats.frames > 0 && now - frame_start > worst)
+         worst = now - frame_start;
+      if (stats.frames == 0)
+         start = now;
+
+      /* Run at the speed the frontend would. */
+      next += sim_runloop.is_slowmotion
+         ? (retro_time_t)(frame_period * settings->slowmotion_ratio)
+         : frame_period;
+      if (next > now)
+         usleep(next - now);
+      else
+         next = now;
+   }
+
+   elapsed = (rarch_get_time_usec() - start) / 1000000.0;
+
+   printf("%-6s: %u frames in %.1f s, %u rollbacks (max %u), "
+         "%u replayed frames (%.1f/s), worst frame %.2f ms\n"
+         "        RTT %.0f ms, jitter %.1f ms, loss %.1f%%, "
+         "input delay %u, desyncs %u/%u\n",
+         name, stats.frames, elapsed, stats.rollbacks, stats.max_rollback,
+         stats.replayed_frames,
+         elapsed > 0 ? stats.replayed_frames / elapsed : 0.0,
+         worst / 1000.0, stats.rtt, stats.jitter, stats.loss * 100,
+         stats.input_delay, stats.crc_mismatches, stats.crc_checks);
+   fflush(stdout);
+
+   if (driver->netplay_data)
+      deinit_netplay();
+   retro_deinit();
+
+   return stats.crc_mismatches ? 2 : 0;
+}
+
+/* The bad network */
+
+static int sim_socket(int type, uint16_t port)
+{
+   struct sockaddr_in addr;
+   int yes = 1;
+   int fd  = socket(AF_INET, type, 0);
+
+   if (fd < 0)
+      return -1;
+
+   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family      = AF_INET;
+   addr.sin_port        = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0
+         || (type == SOCK_STREAM && listen(fd, 1) < 0))
+   {
+      close(fd);
+      return -1;
+   }
+
+   return fd;
+}
+
+static int sim_connect(uint16_t port)
+{
+   struct sockaddr_in addr;
+   int tries;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family      = AF_INET;
+   addr.sin_port        = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   /* The host might not be listening yet. */
+   for (tries = 0; tries < 50; tries++)
+   {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+      if (fd < 0)
+         return -1;
+      if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+         return fd;
+
+      close(fd);
+      usleep(100000);
+   }
+
+   return -1;
+}
+
+static bool sim_relay_tcp(int from, int to)
+{
+   char buf[4096];
+   ssize_t size = recv(from, buf, sizeof(buf), 0);
+   ssize_t sent = 0;
+
+   if (size <= 0)
+      return false;
+
+   while (sent < size)
+   {
+      ssize_t ret = send(to, buf + sent, size - sent, 0);
+      if (ret <= 0)
+         return false;
+      sent += ret;
+   }
+
+   return true;
+}
+
+static void sim_queue_packet(struct sim_packet *queue,
+      const struct sim_options *opts, int dir,
+      const uint8_t *data, size_t size)
+{
+   unsigned i;
+   retro_time_t delay = opts->delay * 1000;
+
+   if (sim_rand() % 100 < opts->loss)
+      return;
+
+   if (opts->jitter)
+      delay += (retro_time_t)(sim_rand() % (2 * opts->jitter * 1000 + 1))
+         - opts->jitter * 1000;
+   /* Held back past the next one or two packets */
+   if (sim_rand() % 100 < opts->reorder)
+      delay += 2 * 1000000 / SIM_FPS;
+   if (delay < 0)
+      delay = 0;
+
+   for (i = 0; i < SIM_QUEUE_SIZE; i++)
+   {
+      if (queue[i].size)
+         continue;
+
+      queue[i].due  = rarch_get_time_usec() + delay;
+      queue[i].dir  = dir;
+      queue[i].size = size;
+      memcpy(queue[i].data, data, size);
+      return;
+   }
+}
+
+static int sim_network(const struct sim_options *opts, uint16_t host_port,
+      pid_t host, pid_t client, unsigned peers)
+{
+   struct sockaddr_in host_addr, client_addr;
+   struct sim_packet *queue = (struct sim_packet*)
+      calloc(SIM_QUEUE_SIZE, sizeof(*queue));
+   int listen_fd    = sim_socket(SOCK_STREAM, opts->port);
+   int front_fd     = sim_socket(SOCK_DGRAM, opts->port);
+   int back_fd      = sim_socket(SOCK_DGRAM, 0);
+   int client_tcp   = -1;
+   int host_tcp     = -1;
+   bool has_client  = false;
+   int status, ret  = 0;
+   unsigned running = peers;
+
+   if (!queue || listen_fd < 0 || front_fd < 0 || back_fd < 0)
+   {
+      fprintf(stderr, "Failed to set up the relay on port %u.\n",
+            (unsigned)opts->port);
+      kill(host, SIGTERM);
+      kill(client, SIGTERM);
+      ret = 1;
+   }
+
+   memset(&host_addr, 0, sizeof(host_addr));
+   host_addr.sin_family      = AF_INET;
+   host_addr.sin_port        = htons(host_port);
+   host_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   while (running)
+   {
+      struct timeval tv = {0, 1000};
+      int max_fd        = back_fd;
+      retro_time_t now;
+      unsigned i;
+      fd_set fds;
+      pid_t pid;
+
+      while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+      {
+         running--;
+         if (!WIFEXITED(status) || WEXITSTATUS(status))
+            ret = 1;
+      }
+
+      if (ret && (listen_fd < 0 || front_fd < 0 || back_fd < 0))
+         continue;
+
+      FD_ZERO(&fds);
+      FD_SET(listen_fd, &fds);
+      FD_SET(front_fd, &fds);
+      FD_SET(back_fd, &fds);
+      if (listen_fd > max_fd)
+         max_fd = listen_fd;
+      if (front_fd > max_fd)
+         max_fd = front_fd;
+      if (client_tcp >= 0)
+      {
+         FD_SET(client_tcp, &fds);
+         FD_SET(host_tcp, &fds);
+         if (client_tcp > max_fd)
+            max_fd = client_tcp;
+         if (host_tcp > max_fd)
+            max_fd = host_tcp;
+      }
+
+      if (select(max_fd + 1, &fds, NULL, NULL, &tv) < 0 && errno != EINTR)
+         break;
+
+      if (FD_ISSET(listen_fd, &fds) && client_tcp < 0)
+      {
+         client_tcp = accept(listen_fd, NULL, NULL);
+         host_tcp   = sim_connect(host_port);
+         if (host_tcp < 0 && client_tcp >= 0)
+         {
+            close(client_tcp);
+            client_tcp = -1;
+         }
+      }
+
+      /* Either side hanging up ends the session for both. */
+      if (client_tcp >= 0 && ((FD_ISSET(client_tcp, &fds)
+                  && !sim_relay_tcp(client_tcp, host_tcp))
+               || (FD_ISSET(host_tcp, &fds)
+                  && !sim_relay_tcp(host_tcp, client_tcp))))
+      {
+         shutdown(client_tcp, SHUT_RDWR);
+         shutdown(host_tcp, SHUT_RDWR);
+         close(client_tcp);
+         close(host_tcp);
+         client_tcp = host_tcp = -1;
+      }
+
+      if (FD_ISSET(front_fd, &fds))
+      {
+         uint8_t buf[SIM_MAX_PACKET];
+         socklen_t len = sizeof(client_addr);
+         ssize_t size  = recvfrom(front_fd, buf, sizeof(buf), 0,
+               (struct sockaddr*)&client_addr, &len);
+
+         has_client = true;
+         if (size > 0)
+            sim_queue_packet(queue, opts, 0, buf, size);
+      }
+
+      if (FD_ISSET(back_fd, &fds))
+      {
+         uint8_t buf[SIM_MAX_PACKET];
+         ssize_t size = recv(back_fd, buf, sizeof(buf), 0);
+
+         if (size > 0)
+            sim_queue_packet(queue, opts, 1, buf, size);
+      }
+
+      now = rarch_get_time_usec();
+      for (i = 0; i < SIM_QUEUE_SIZE; i++)
+      {
+         if (!queue[i].size || queue[i].due > now)
+            continue;
+
+         if (queue[i].dir == 0)
+            sendto(back_fd, queue[i].data, queue[i].size, 0,
+                  (struct sockaddr*)&host_addr, sizeof(host_addr));
+         else if (has_client)
+            sendto(front_fd, queue[i].data, queue[i].size, 0,
+                  (struct sockaddr*)&client_addr, sizeof(client_addr));
+         queue[i].size = 0;
+      }
+   }
+
+   if (client_tcp >= 0)
+   {
+      close(client_tcp);
+      close(host_tcp);
+   }
+   if (listen_fd >= 0)
+      close(listen_fd);
+   if (front_fd >= 0)
+      close(front_fd);
+   if (back_fd >= 0)
+      close(back_fd);
+   free(queue);
+
+   return ret;
+}
+
+int main(int argc, char *argv[])
+{
+   struct sim_options opts = {0};
+   uint16_t host_port;
+   pid_t host, client;
+   unsigned spectator;
+   int i;
+
+   opts.frames = 600;
+   opts.budget = 25;
+   opts.check_frames = 60;
+   opts.check_sample = 1;
+   opts.port   = 55500;
+   opts.seed   = 1;
+
+   for (i = 1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "-n") && i + 1 < argc)
+         opts.frames  = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+         opts.delay   = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+         opts.jitter  = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+         opts.loss    = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+         opts.reorder = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+         opts.budget  = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+         opts.check_frames = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-S") && i + 1 < argc)
+         opts.check_sample = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-x") && i + 1 < argc)
+         opts.desync_frame = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+         opts.spectators = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-W"))
+         opts.stall_spectator = true;
+      else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+         opts.port    = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+         opts.seed    = strtoul(argv[++i], NULL, 0);
+      else
+      {
+         fprintf(stderr, "Usage: %s [-n frames] [-d delay ms] "
+               "[-j jitter ms] [-l loss %%] [-r reorder %%] "
+               "[-b replay budget %%] [-c check frames] "
+               "[-S check sample] [-x desync frame] "
+               "[-w spectators] [-W] [-p port] [-s seed]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   /* The host listens one port up, the client talks to the relay. */
+   host_port = opts.port + 1;
+   sim_seed  = opts.seed;
+
+   printf("Netplay over loopback: %u frames, delay %u ms, jitter %u ms, "
+         "loss %u%%, reorder %u%%\n", opts.frames, opts.delay,
+         opts.jitter, opts.loss, opts.reorder);
+   fflush(stdout);
+
+   host = fork();
+   if (host == 0)
+      return sim_peer(&opts, NULL, host_port, 0);
+
+   client = fork();
+   if (client == 0)
+      return sim_peer(&opts, "127.0.0.1", opts.port, 0);
+
+   if (host < 0 || client < 0)
+   {
+      fprintf(stderr, "Failed to start host and client.\n");
+      return 1;
+   }
+
+   /* Spectators talk to the host directly, one port above it. */
+   for (spectator = 1; spectator <= opts.spectators; spectator++)
+   {
+      pid_t pid = fork();
+      if (pid == 0)
+         return sim_peer(&opts, "127.0.0.1", host_port, spectator);
+      if (pid < 0)
+         opts.spectators = spectator - 1;
+   }
+
+   return sim_network(&opts, host_port, host, client, 2 + opts.spectators);
+}
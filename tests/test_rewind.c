@@ -0,0 +1,415 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2014-2015 - Alfred Agrell
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Test module for the rewind state manager.
+ * Checks that every delta scanner the CPU supports produces the same
+ * compressed stream, then round-trips a sequence of states through
+ * the state manager in each of its modes, both one state at a time 
+ * and by seeking.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Included rather than linked, to reach the delta scanners. */
+#include "../rewind.c"
+
+#define STATE_SIZE   (64 * 1024 + 1)
+#define NUM_STATES   64
+
+static void make_state(uint8_t *data, unsigned frame)
+{
+   unsigned i;
+
+   /* A handful of counters change every frame,
+    * and a sliding window of bytes moves through the rest. */
+   memset(data, 0x55, STATE_SIZE);
+   for (i = 0; i < 16; i++)
+      data[i * 97] = (uint8_t)(frame * (i + 1));
+   for (i = 0; i < 512; i++)
+      data[(frame * 1031 + i) % STATE_SIZE] = (uint8_t)(frame + i);
+}
+
+struct test_config
+{
+   unsigned flags;
+   unsigned keyframe_interval;
+   size_t buffer_size;
+   /* Disk tier size, 0 for none. */
+   size_t spill_size;
+   /* How many states have to come back, NUM_STATES unless some 
+    * are expected to fall off the end. */
+   unsigned min_states;
+};
+
+static bool test_roundtrip(const struct test_config *config)
+{
+   unsigned frame, popped = 0;
+   uint8_t *expected      = (uint8_t*)malloc(STATE_SIZE);
+   state_manager_t *state = state_manager_new(STATE_SIZE,
+         config->buffer_size, config->flags, config->keyframe_interval);
+   bool ret               = state && expected;
+
+   if (ret && config->spill_size)
+      ret = state_manager_spill_init(state, "test_rewind.spill",
+            config->spill_size);
+
+   for (frame = 0; ret && frame < NUM_STATES; frame++)
+   {
+      void *data = NULL;
+
+      state_manager_push_where(state, &data);
+      make_state((uint8_t*)data, frame);
+      state_manager_push_do(state);
+   }
+
+   /* Rewind a bit, then push on top of the restored state. */
+   for (; ret && frame > NUM_STATES - 8; frame--)
+   {
+      const void *data = NULL;
+      ret = state_manager_pop(state, &data);
+   }
+
+   for (; ret && frame < NUM_STATES; frame++)
+   {
+      void *data = NULL;
+
+      state_manager_push_where(state, &data);
+      make_state((uint8_t*)data, frame);
+      state_manager_push_do(state);
+   }
+
+   while (ret && frame--)
+   {
+      const void *data = NULL;
+
+      if (!state_manager_pop(state, &data))
+         break;
+
+      make_state(expected, frame);
+      if (memcmp(data, expected, STATE_SIZE) != 0)
+      {
+         fprintf(stderr, "State mismatch at frame %u.\n", frame);
+         ret = false;
+      }
+      popped++;
+   }
+
+   if (ret && popped < config->min_states)
+   {
+      fprintf(stderr, "Only %u of %u states came back.\n",
+            popped, config->min_states);
+      ret = false;
+   }
+
+   state_manager_free(state);
+   free(expected);
+   return ret;
+}
+
+static void push_states(state_manager_t *state,
+      unsigned first, unsigned last)
+{
+   unsigned frame;
+
+   for (frame = first; frame < last; frame++)
+   {
+      void *data = NULL;
+
+      state_manager_push_where(state, &data);
+      make_state((uint8_t*)data, frame);
+      state_manager_push_do(state);
+   }
+}
+
+static bool test_seek(const struct test_config *config)
+{
+   static const unsigned seeks[] = { 5, 1, 20, 3, 13 };
+   unsigned i, frame      = NUM_STATES;
+   uint8_t *expected      = (uint8_t*)malloc(STATE_SIZE);
+   state_manager_t *state = state_manager_new(STATE_SIZE,
+         config->buffer_size, config->flags, config->keyframe_interval);
+   bool ret               = state && expected;
+
+   if (ret && config->spill_size)
+      ret = state_manager_spill_init(state, "test_rewind.spill",
+            config->spill_size);
+
+   if (ret)
+      push_states(state, 0, NUM_STATES);
+
+   for (i = 0; ret && i < sizeof(seeks) / sizeof(seeks[0]); i++)
+   {
+      const void *data = NULL;
+      unsigned done    = state_manager_seek(state, seeks[i], &data);
+
+      if (done != seeks[i])
+      {
+         /* Only allowed when history ran out. */
+         if (frame - done >= NUM_STATES - config->min_states)
+         {
+            fprintf(stderr, "Seek by %u only went back %u.\n",
+                  seeks[i], done);
+            ret = false;
+         }
+         break;
+      }
+
+      frame -= done;
+      make_state(expected, frame);
+      if (memcmp(data, expected, STATE_SIZE) != 0)
+      {
+         fprintf(stderr, "State mismatch after seeking to frame %u.\n",
+               frame);
+         ret = false;
+      }
+
+      /* Every other time, carry on from the restored state. */
+      if (i & 1)
+      {
+         push_states(state, frame, frame + 4);
+         frame += 4;
+      }
+   }
+
+   state_manager_free(state);
+   free(expected);
+   return ret;
+}
+
+/* Fills @a and @b with a mix of changed and unchanged runs.
+ * @pattern picks the run lengths, @seed keeps it reproducible. */
+static void delta_test_fill(uint16_t *a, uint16_t *b, size_t num16s,
+      unsigned pattern, uint32_t seed)
+{
+   size_t i = 0;
+
+   while (i < num16s)
+   {
+      size_t run;
+      bool changed;
+
+      seed = seed * 1103515245u + 12345u;
+
+      switch (pattern)
+      {
+         case 0: /* Identical. */
+            run     = num16s;
+            changed = false;
+            break;
+         case 1: /* Everything differs. */
+            run     = num16s;
+            changed = true;
+            break;
+         case 2: /* Sparse single words. */
+            run     = (seed >> 16) & 1 ? 1 : ((seed >> 8) & 127) + 1;
+            changed = (seed >> 16) & 1;
+            break;
+         case 3: /* Short runs, hits both uint32 phases. */
+            run     = ((seed >> 16) & 7) + 1;
+            changed = (seed >> 24) & 1;
+            break;
+         default: /* Runs longer than a uint16 count. */
+            run     = ((seed >> 12) & 0x1ffff) + 1;
+            changed = (seed >> 30) & 1;
+            break;
+      }
+
+      for (; run && i < num16s; run--, i++)
+      {
+         seed = seed * 1103515245u + 12345u;
+         a[i] = seed >> 16;
+         b[i] = changed ? (uint16_t)(a[i] ^ ((seed & 0xff) | 1)) : a[i];
+      }
+   }
+}
+
+/* Compresses synthetic state pairs with every delta scanner this
+ * CPU supports, checks that each one produces the same stream as
+ * the C version and that the stream restores the previous state. */
+static bool test_delta_impls(void)
+{
+   static const size_t sizes[] = { 2, 6, 34, 1000, 4098, 300002 };
+   const struct state_manager_delta_impl *ref = 
+      &delta_impls[NUM_DELTA_IMPLS - 1];
+   uint64_t cpu   = rarch_get_cpu_features();
+   size_t maxsize = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+   size_t maxcomp = maxsize * 2 + STATE_MANAGER_BLOCK_PAD * 2;
+   uint8_t *a     = (uint8_t*)calloc(maxsize + STATE_MANAGER_BLOCK_PAD, 1);
+   uint8_t *b     = (uint8_t*)calloc(maxsize + STATE_MANAGER_BLOCK_PAD, 1);
+   uint8_t *c     = (uint8_t*)calloc(maxsize + STATE_MANAGER_BLOCK_PAD, 1);
+   uint8_t *refp  = (uint8_t*)malloc(maxcomp);
+   uint8_t *patch = (uint8_t*)malloc(maxcomp);
+   bool ret       = a && b && c && refp && patch;
+   unsigned s, pattern, i;
+
+   for (s = 0; ret && s < sizeof(sizes) / sizeof(sizes[0]); s++)
+   {
+      size_t size = sizes[s];
+
+      for (pattern = 0; ret && pattern < 5; pattern++)
+      {
+         size_t reflen;
+
+         memset(a, 0, size + STATE_MANAGER_BLOCK_PAD);
+         memset(b, 0, size + STATE_MANAGER_BLOCK_PAD);
+         delta_test_fill((uint16_t*)a, (uint16_t*)b, size / 2,
+               pattern, (uint32_t)(size * 5 + pattern));
+
+         /* Same sentinels as state_manager_new. */
+         *(uint16_t*)(a + size + sizeof(uint16_t) * 3) = 0xFFFF;
+         *(uint16_t*)(b + size + sizeof(uint16_t) * 3) = 0x0000;
+
+         reflen = state_manager_raw_compress(ref, a, b, size, refp);
+
+         memcpy(c, b, size);
+         state_manager_raw_decompress(refp, c);
+         if (memcmp(a, c, size) != 0)
+         {
+            fprintf(stderr, "Rewind delta (%s) does not restore state "
+                  "(size %u, pattern %u).\n",
+                  ref->ident, (unsigned)size, pattern);
+            ret = false;
+         }
+
+         for (i = 0; ret && i < NUM_DELTA_IMPLS - 1; i++)
+         {
+            const struct state_manager_delta_impl *impl = &delta_impls[i];
+
+            if ((cpu & impl->simd) != impl->simd)
+               continue;
+
+            if (state_manager_raw_compress(impl, a, b, size, patch) != reflen
+                  || memcmp(patch, refp, reflen) != 0)
+            {
+               fprintf(stderr, "Rewind delta (%s) differs from (%s) "
+                     "(size %u, pattern %u).\n",
+                     impl->ident, ref->ident, (unsigned)size, pattern);
+               ret = false;
+            }
+         }
+      }
+   }
+
+   free(a);
+   free(b);
+   free(c);
+   free(refp);
+   free(patch);
+   return ret;
+}
+
+/* Walks a chain of states forward with the stand-alone codec,
+ * the way preemptive frames use it. */
+static bool test_state_delta(void)
+{
+   unsigned frame;
+   size_t size     = state_delta_buffer_size(STATE_SIZE);
+   uint8_t *base   = (uint8_t*)calloc(size, 1);
+   uint8_t *a      = (uint8_t*)calloc(size, 1);
+   uint8_t *b      = (uint8_t*)calloc(size, 1);
+   uint8_t *patch  = (uint8_t*)malloc(state_delta_max_size(STATE_SIZE));
+   bool ret        = base && a && b && patch;
+
+   if (ret)
+   {
+      make_state(base, 0);
+      make_state(a, 0);
+   }
+
+   for (frame = 1; ret && frame < NUM_STATES; frame++)
+   {
+      uint8_t *swap;
+
+      make_state(b, frame);
+      state_delta_encode(a, b, STATE_SIZE, patch);
+      state_delta_apply(patch, base);
+
+      if (memcmp(base, b, STATE_SIZE) != 0)
+      {
+         fprintf(stderr, "State delta mismatch at frame %u.\n", frame);
+         ret = false;
+      }
+
+      swap = a;
+      a    = b;
+      b    = swap;
+   }
+
+   free(base);
+   free(a);
+   free(b);
+   free(patch);
+   return ret;
+}
+
+static const struct test_config configs[] = {
+   { 0, 0, 4 << 20, 0, NUM_STATES },
+   { 0, 5, 4 << 20, 0, NUM_STATES },
+#ifdef HAVE_ZLIB
+   { STATE_MANAGER_DEFLATE, 0, 4 << 20, 0, NUM_STATES },
+   { STATE_MANAGER_DEFLATE, 7, 4 << 20, 0, NUM_STATES },
+#endif
+#ifdef HAVE_THREADS
+   { STATE_MANAGER_THREADED, 0, 4 << 20, 0, NUM_STATES },
+#ifdef HAVE_ZLIB
+   { STATE_MANAGER_THREADED | STATE_MANAGER_DEFLATE, 3, 4 << 20, 0, NUM_STATES },
+#endif
+#endif
+#ifdef HAVE_MMAP
+   /* Most states only fit on disk. */
+   { 0, 0, 160 << 10, 4 << 20, NUM_STATES },
+   { 0, 4, 160 << 10, 4 << 20, NUM_STATES },
+   /* Disk tier wraps around too. */
+   { 0, 0, 160 << 10, 24 << 10, 30 },
+#endif
+};
+
+int main(int argc, char *argv[])
+{
+   unsigned i;
+   bool ret = true;
+
+   (void)argc;
+   (void)argv;
+
+   if (!test_delta_impls())
+   {
+      fprintf(stderr, "Delta scanners disagree.\n");
+      ret = false;
+   }
+
+   if (!test_state_delta())
+      ret = false;
+
+   for (i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+   {
+      if (!test_roundtrip(&configs[i]))
+      {
+         fprintf(stderr, "Rewind round-trip %u failed.\n", i);
+         ret = false;
+      }
+      if (!test_seek(&configs[i]))
+      {
+         fprintf(stderr, "Rewind seek %u failed.\n", i);
+         ret = false;
+      }
+   }
+
+   printf("test_rewind: %s\n", ret ? "passed" : "FAILED");
+   return ret ? 0 : 1;
+}
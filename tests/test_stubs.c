@@ -0,0 +1,63 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2014-2015 - Alfred Agrell
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Minimal stand-ins for the frontend state, so single modules
+ * can be linked into test programs without the rest of RetroArch.
+ */
+
+#include <stdio.h>
+
+#include "../general.h"
+#include "../driver.h"
+#include "../dynamic.h"
+#include "../audio/audio_driver.h"
+
+static global_t   test_global;
+static settings_t test_settings;
+static driver_t   test_driver;
+
+size_t (*pretro_serialize_size)(void);
+bool (*pretro_serialize)(void*, size_t);
+bool (*pretro_unserialize)(const void*, size_t);
+
+global_t *global_get_ptr(void)
+{
+   return &test_global;
+}
+
+settings_t *config_get_ptr(void)
+{
+   return &test_settings;
+}
+
+driver_t *driver_get_ptr(void)
+{
+   return &test_driver;
+}
+
+bool audio_driver_has_callback(void)
+{
+   return false;
+}
+
+bool rarch_main_verbosity(void)
+{
+   return getenv("TEST_VERBOSE") != NULL;
+}
+
+FILE *rarch_main_log_file(void)
+{
+   return stderr;
+}